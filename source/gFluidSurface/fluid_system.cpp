@@ -28,6 +28,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <atomic>
 #include <cuda.h>	
 #include "cutil_math.h"			// cutil32.lib
 
@@ -35,6 +36,7 @@
 
 #include "main.h"
 #include "fluid_system.h"
+#include "gvdb_parallel.h"
 #include "nv_gui.h"
 
 #include <GL/glew.h>
@@ -202,6 +204,8 @@ void FluidSystem::Exit ()
 	for (int n=0; n < MAX_BUF; n++ ) {
 		if ( m_Fluid.bufC(n) != 0x0 )
 			free ( m_Fluid.bufC(n) );
+		if ( m_FluidTemp.bufC(n) != 0x0 )
+			free ( m_FluidTemp.bufC(n) );
 	}
 
 	//cudaExit ();
@@ -217,6 +221,10 @@ void FluidSystem::AllocateBuffer ( int buf_id, int stride, int cpucnt, int gpucn
 			free(src_buf);
 		}
 		m_Fluid.setBuf(buf_id, dest_buf);
+		if (m_FluidTemp.bufC(buf_id) != 0x0) {		// host temp is reallocated on next sort
+			free(m_FluidTemp.bufC(buf_id));
+			m_FluidTemp.setBuf(buf_id, 0x0);
+		}
 	}
 	if (gpumode == GPU_SINGLE || gpumode == GPU_DUAL )	{
 		if (m_Fluid.gpuptr(buf_id) != 0x0) cuCheck(cuMemFree(m_Fluid.gpu(buf_id)), "cuMemFree");
@@ -480,6 +488,7 @@ void FluidSystem::Run ()
 	m_Param[ PTIME_PRESS ] = 0.0;
 	m_Param[ PTIME_FORCE ] = 0.0;
 	m_Param[ PTIME_ADVANCE ] = 0.0;
+	m_Workers.SetThreads ( (int) m_Param[PTHREADS] );
 
 	// Run	
 	#ifdef TEST_VALIDATESIM
@@ -557,12 +566,12 @@ void FluidSystem::PackParticles ()
 	int j;	
 	char* dat = mPackBuf;
 	int cnt = 0;
-	uint* m_Grid = m_Fluid.bufI(FGRID);
+	uint* m_GridOff = m_Fluid.bufI(FGRIDOFF);
+	uint* m_GridCnt = m_Fluid.bufI(FGRIDCNT);
 
 	for (int c=0; c < m_GridTotal; c++) {
-		j = m_Grid[c];
 		mPackGrid[c] = cnt;
-		while ( j != -1 ) {
+		for ( j = m_GridOff[c]; j < m_GridOff[c] + m_GridCnt[c]; j++ ) {
 			*(Vector3DF*) dat = *(m_Fluid.bufV3(FPOS)+j);		dat += sizeof(Vector3DF);
 			*(Vector3DF*) dat = *(m_Fluid.bufV3(FVEL)+j);		dat += sizeof(Vector3DF);
 			*(Vector3DF*) dat = *(m_Fluid.bufV3(FVEVAL)+j);		dat += sizeof(Vector3DF);
@@ -573,7 +582,6 @@ void FluidSystem::PackParticles ()
 			*(int*) dat =		c;								dat += sizeof(int);					// container cell
 			*(uint*) dat =		*(m_Fluid.bufI(FCLR)+j);		dat += sizeof(uint);
 			dat += sizeof(int);
-			j = *(m_Fluid.bufI(FGNEXT)+j);
 			cnt++;
 		}
 	}
@@ -645,14 +653,9 @@ void FluidSystem::DrawDomain ()
 
 void FluidSystem::Advance ()
 {
-	Vector3DF norm, z;
-	Vector3DF dir, accel;
-	Vector3DF vnext;
 	Vector3DF bmin, bmax;
-	Vector4DF clr;
-	float adj;
 	float AL, AL2, SL, SL2, ss, radius;
-	float stiff, damp, speed, diff; 
+	float stiff, damp; 
 	
 	AL = m_Param[PACCEL_LIMIT];	AL2 = AL*AL;
 	SL = m_Param[PVEL_LIMIT];	SL2 = SL*SL;
@@ -664,190 +667,191 @@ void FluidSystem::Advance ()
 	bmax = m_Vec[PBOUNDMAX];
 	ss = m_Param[PSIMSCALE];
 
-	// Get particle buffers
-	Vector3DF*	ppos =		m_Fluid.bufV3(FPOS);
-	Vector3DF*	pvel =		m_Fluid.bufV3(FVEL);
-	Vector3DF*	pveleval =	m_Fluid.bufV3(FVEVAL);
-	Vector3DF*	pforce =	m_Fluid.bufV3(FFORCE);
-	uint*		pclr =		m_Fluid.bufI(FCLR);
-	float*		ppress =	m_Fluid.bufF(FPRESS);
-	float*		pdensity =	m_Fluid.bufF(FDENSITY);
-
-	// Advance each particle
-	for ( int n=0; n < NumPoints(); n++ ) {
-
-		if ( m_Fluid.bufI(FGCELL)[n] == GRID_UNDEF) continue;
-
-		// Compute Acceleration		
-		accel = *pforce;
-		accel *= m_Param[PMASS];
-	
-		// Boundary Conditions
-		// Y-axis walls
-		diff = radius - ( ppos->y - (bmin.y+ (ppos->x-bmin.x)*m_Param[PGROUND_SLOPE] ) )*ss;
-		if (diff > EPSILON ) {			
-			norm.Set ( -m_Param[PGROUND_SLOPE], 1.0f - m_Param[PGROUND_SLOPE], 0 );
-			adj = stiff * diff - damp * (float) norm.Dot ( *pveleval );
-			accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
-		}		
-		diff = radius - ( bmax.y - ppos->y )*ss;
-		if (diff > EPSILON) {
-			norm.Set ( 0, -1, 0 );
-			adj = stiff * diff - damp * (float) norm.Dot ( *pveleval );
-			accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
-		}		
+	// Advance each particle. Particles are independent, so ranges run in parallel.
+	ParallelFor ( m_Workers, NumPoints(), [&] ( slong start, slong end ) {
+		Vector3DF norm;
+		Vector3DF accel;
+		Vector3DF vnext;
+		Vector4DF clr;
+		float adj;
+		float speed, diff; 
+
+		// Get particle buffers
+		Vector3DF*	ppos =		m_Fluid.bufV3(FPOS) + start;
+		Vector3DF*	pvel =		m_Fluid.bufV3(FVEL) + start;
+		Vector3DF*	pveleval =	m_Fluid.bufV3(FVEVAL) + start;
+		Vector3DF*	pforce =	m_Fluid.bufV3(FFORCE) + start;
+		uint*		pclr =		m_Fluid.bufI(FCLR) + start;
+		uint*		pgcell =	m_Fluid.bufI(FGCELL) + start;
+
+		for ( slong n=start; n < end; n++, ppos++, pvel++, pveleval++, pforce++, pclr++, pgcell++ ) {
+
+			if ( *pgcell == GRID_UNDEF) continue;
+
+			// Compute Acceleration		
+			accel = *pforce;
+			accel *= m_Param[PMASS];
+	
+			// Boundary Conditions
+			// Y-axis walls
+			diff = radius - ( ppos->y - (bmin.y+ (ppos->x-bmin.x)*m_Param[PGROUND_SLOPE] ) )*ss;
+			if (diff > EPSILON ) {			
+				norm.Set ( -m_Param[PGROUND_SLOPE], 1.0f - m_Param[PGROUND_SLOPE], 0 );
+				adj = stiff * diff - damp * (float) norm.Dot ( *pveleval );
+				accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
+			}		
+			diff = radius - ( bmax.y - ppos->y )*ss;
+			if (diff > EPSILON) {
+				norm.Set ( 0, -1, 0 );
+				adj = stiff * diff - damp * (float) norm.Dot ( *pveleval );
+				accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
+			}		
 		
-		// X-axis walls
-		if ( !m_Toggle[PWRAP_X] ) {
-			diff = radius - ( ppos->x - (bmin.x + (sin(m_Time*m_Param[PFORCE_FREQ])+1)*0.5f * m_Param[PFORCE_MIN]) )*ss;	
-			//diff = 2 * radius - ( p->pos.x - min.x + (sin(m_Time*10.0)-1) * m_Param[FORCE_XMIN_SIN] )*ss;	
-			if (diff > EPSILON ) {
-				norm.Set ( 1.0, 0, 0 );
-				adj = (m_Param[ PFORCE_MIN ]+1) * stiff * diff - damp * (float) norm.Dot ( *pveleval ) ;
-				accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;					
+			// X-axis walls
+			if ( !m_Toggle[PWRAP_X] ) {
+				diff = radius - ( ppos->x - (bmin.x + (sin(m_Time*m_Param[PFORCE_FREQ])+1)*0.5f * m_Param[PFORCE_MIN]) )*ss;	
+				//diff = 2 * radius - ( p->pos.x - min.x + (sin(m_Time*10.0)-1) * m_Param[FORCE_XMIN_SIN] )*ss;	
+				if (diff > EPSILON ) {
+					norm.Set ( 1.0, 0, 0 );
+					adj = (m_Param[ PFORCE_MIN ]+1) * stiff * diff - damp * (float) norm.Dot ( *pveleval ) ;
+					accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;					
+				}
+
+				diff = radius - ( (bmax.x - (sin(m_Time*m_Param[PFORCE_FREQ])+1)*0.5f* m_Param[PFORCE_MAX]) - ppos->x )*ss;	
+				if (diff > EPSILON) {
+					norm.Set ( -1, 0, 0 );
+					adj = (m_Param[ PFORCE_MAX ]+1) * stiff * diff - damp * (float) norm.Dot ( *pveleval );
+					accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
+				}
 			}
 
-			diff = radius - ( (bmax.x - (sin(m_Time*m_Param[PFORCE_FREQ])+1)*0.5f* m_Param[PFORCE_MAX]) - ppos->x )*ss;	
+			// Z-axis walls
+			diff = radius - ( ppos->z - bmin.z )*ss;			
 			if (diff > EPSILON) {
-				norm.Set ( -1, 0, 0 );
-				adj = (m_Param[ PFORCE_MAX ]+1) * stiff * diff - damp * (float) norm.Dot ( *pveleval );
+				norm.Set ( 0, 0, 1 );
+				adj = stiff * diff - damp * (float) norm.Dot ( *pveleval );
+				accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
+			}
+			diff = radius - ( bmax.z - ppos->z )*ss;
+			if (diff > EPSILON) {
+				norm.Set ( 0, 0, -1 );
+				adj = stiff * diff - damp * (float) norm.Dot ( *pveleval );
 				accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
 			}
-		}
-
-		// Z-axis walls
-		diff = radius - ( ppos->z - bmin.z )*ss;			
-		if (diff > EPSILON) {
-			norm.Set ( 0, 0, 1 );
-			adj = stiff * diff - damp * (float) norm.Dot ( *pveleval );
-			accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
-		}
-		diff = radius - ( bmax.z - ppos->z )*ss;
-		if (diff > EPSILON) {
-			norm.Set ( 0, 0, -1 );
-			adj = stiff * diff - damp * (float) norm.Dot ( *pveleval );
-			accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
-		}
 		
 
-		// Wall barrier
-		if ( m_Toggle[PWALL_BARRIER] ) {
-			diff = 2 * radius - ( ppos->x - 0 )*ss;					
-			if (diff < 2*radius && diff > EPSILON && fabs(ppos->y) < 3 && ppos->z < 10) {
-				norm.Set ( 1.0, 0, 0 );
-				adj = 2*stiff * diff - damp * (float) norm.Dot ( *pveleval ) ;	
-				accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;					
+			// Wall barrier
+			if ( m_Toggle[PWALL_BARRIER] ) {
+				diff = 2 * radius - ( ppos->x - 0 )*ss;					
+				if (diff < 2*radius && diff > EPSILON && fabs(ppos->y) < 3 && ppos->z < 10) {
+					norm.Set ( 1.0, 0, 0 );
+					adj = 2*stiff * diff - damp * (float) norm.Dot ( *pveleval ) ;	
+					accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;					
+				}
 			}
-		}
 		
-		// Levy barrier
-		if ( m_Toggle[PLEVY_BARRIER] ) {
-			diff = 2 * radius - ( ppos->x - 0 )*ss;					
-			if (diff < 2*radius && diff > EPSILON && fabs(ppos->y) > 5 && ppos->z < 10) {
-				norm.Set ( 1.0, 0, 0 );
-				adj = 2*stiff * diff - damp * (float) norm.Dot ( *pveleval ) ;	
-				accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;					
+			// Levy barrier
+			if ( m_Toggle[PLEVY_BARRIER] ) {
+				diff = 2 * radius - ( ppos->x - 0 )*ss;					
+				if (diff < 2*radius && diff > EPSILON && fabs(ppos->y) > 5 && ppos->z < 10) {
+					norm.Set ( 1.0, 0, 0 );
+					adj = 2*stiff * diff - damp * (float) norm.Dot ( *pveleval ) ;	
+					accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;					
+				}
 			}
-		}
-		// Drain barrier
-		if ( m_Toggle[PDRAIN_BARRIER] ) {
-			diff = 2 * radius - ( ppos->z - bmin.z-15 )*ss;
-			if (diff < 2*radius && diff > EPSILON && (fabs(ppos->x)>3 || fabs(ppos->y)>3) ) {
-				norm.Set ( 0, 0, 1);
-				adj = stiff * diff - damp * (float) norm.Dot ( *pveleval );
-				accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
+			// Drain barrier
+			if ( m_Toggle[PDRAIN_BARRIER] ) {
+				diff = 2 * radius - ( ppos->z - bmin.z-15 )*ss;
+				if (diff < 2*radius && diff > EPSILON && (fabs(ppos->x)>3 || fabs(ppos->y)>3) ) {
+					norm.Set ( 0, 0, 1);
+					adj = stiff * diff - damp * (float) norm.Dot ( *pveleval );
+					accel.x += adj * norm.x; accel.y += adj * norm.y; accel.z += adj * norm.z;
+				}
 			}
-		}
-
-		// Plane gravity
-		accel += m_Vec[PPLANE_GRAV_DIR] * m_Param[PGRAV];
-
-		// Point gravity
-		if ( m_Vec[PPOINT_GRAV_POS].x > 0 && m_Param[PGRAV] > 0 ) {
-			norm.x = ( ppos->x - m_Vec[PPOINT_GRAV_POS].x );
-			norm.y = ( ppos->y - m_Vec[PPOINT_GRAV_POS].y );
-			norm.z = ( ppos->z - m_Vec[PPOINT_GRAV_POS].z );
-			norm.Normalize ();
-			norm *= m_Param[PGRAV];
-			accel -= norm;
-		}
 
-		// Acceleration limiting 
-		speed = accel.x*accel.x + accel.y*accel.y + accel.z*accel.z;
-		if ( speed > AL2 ) {
-			accel *= AL / sqrt(speed);
-		}		
-
-		// Velocity limiting 
-		speed = pvel->x*pvel->x + pvel->y*pvel->y + pvel->z*pvel->z;
-		if ( speed > SL2 ) {
-			speed = SL2;
-			(*pvel) *= SL / sqrt(speed);
-		}		
+			// Plane gravity
+			accel += m_Vec[PPLANE_GRAV_DIR] * m_Param[PGRAV];
+
+			// Point gravity
+			if ( m_Vec[PPOINT_GRAV_POS].x > 0 && m_Param[PGRAV] > 0 ) {
+				norm.x = ( ppos->x - m_Vec[PPOINT_GRAV_POS].x );
+				norm.y = ( ppos->y - m_Vec[PPOINT_GRAV_POS].y );
+				norm.z = ( ppos->z - m_Vec[PPOINT_GRAV_POS].z );
+				norm.Normalize ();
+				norm *= m_Param[PGRAV];
+				accel -= norm;
+			}
 
-		// Leapfrog Integration ----------------------------
-		vnext = accel;							
-		vnext *= m_DT;
-		vnext += *pvel;						// v(t+1/2) = v(t-1/2) + a(t) dt
-
-		*pveleval = *pvel;
-		*pveleval += vnext;
-		*pveleval *= 0.5;					// v(t+1) = [v(t-1/2) + v(t+1/2)] * 0.5		used to compute forces later
-		*pvel = vnext;
-		vnext *= m_DT/ss;
-		*ppos += vnext;						// p(t+1) = p(t) + v(t+1/2) dt
-
-		/*if ( m_Param[PCLR_MODE]==1.0 ) {
-			adj = fabs(vnext.x)+fabs(vnext.y)+fabs(vnext.z) / 7000.0;
-			adj = (adj > 1.0) ? 1.0 : adj;
-			*pclr = COLORA( 0, adj, adj, 1 );
-		}
-		if ( m_Param[PCLR_MODE]==2.0 ) {
-			float v = 0.5 + ( *ppress / 1500.0); 
-			if ( v < 0.1 ) v = 0.1;
-			if ( v > 1.0 ) v = 1.0;
-			*pclr = COLORA ( v, 1-v, 0, 1 );
-		}*/
-		if ( speed > SL2*0.1f) {
-			adj = SL2*0.1f;
-			clr.fromClr ( *pclr );
-			clr += Vector4DF( 2/255.0f, 2/255.0f, 2/255.0f, 2/255.0f);
-			clr.Clamp ( 1, 1, 1, 1);
-			*pclr = clr.toClr();
-		}
-		if ( speed < 0.01 ) {
-			clr.fromClr ( *pclr);
-			clr.x -= float(1/255.0f);		if ( clr.x < 0.2f ) clr.x = 0.2f;
-			clr.y -= float(1/255.0f);		if ( clr.y < 0.2f ) clr.y = 0.2f;
-			*pclr = clr.toClr();
-		}
-		
-		// Euler integration -------------------------------
-		/* accel += m_Gravity;
-		accel *= m_DT;
-		p->vel += accel;				// v(t+1) = v(t) + a(t) dt
-		p->vel_eval += accel;
-		p->vel_eval *= m_DT/d;
-		p->pos += p->vel_eval;
-		p->vel_eval = p->vel;  */	
-
-
-		if ( m_Toggle[PWRAP_X] ) {
-			diff = ppos->x - (m_Vec[PBOUNDMIN].x + 2);			// -- Simulates object in center of flow
-			if ( diff <= 0 ) {
-				ppos->x = (m_Vec[PBOUNDMAX].x - 2) + diff*2;				
-				ppos->z = 10;
+			// Acceleration limiting 
+			speed = accel.x*accel.x + accel.y*accel.y + accel.z*accel.z;
+			if ( speed > AL2 ) {
+				accel *= AL / sqrt(speed);
+			}		
+
+			// Velocity limiting 
+			speed = pvel->x*pvel->x + pvel->y*pvel->y + pvel->z*pvel->z;
+			if ( speed > SL2 ) {
+				speed = SL2;
+				(*pvel) *= SL / sqrt(speed);
+			}		
+
+			// Leapfrog Integration ----------------------------
+			vnext = accel;							
+			vnext *= m_DT;
+			vnext += *pvel;						// v(t+1/2) = v(t-1/2) + a(t) dt
+
+			*pveleval = *pvel;
+			*pveleval += vnext;
+			*pveleval *= 0.5;					// v(t+1) = [v(t-1/2) + v(t+1/2)] * 0.5		used to compute forces later
+			*pvel = vnext;
+			vnext *= m_DT/ss;
+			*ppos += vnext;						// p(t+1) = p(t) + v(t+1/2) dt
+
+			/*if ( m_Param[PCLR_MODE]==1.0 ) {
+				adj = fabs(vnext.x)+fabs(vnext.y)+fabs(vnext.z) / 7000.0;
+				adj = (adj > 1.0) ? 1.0 : adj;
+				*pclr = COLORA( 0, adj, adj, 1 );
 			}
-		}	
+			if ( m_Param[PCLR_MODE]==2.0 ) {
+				float v = 0.5 + ( *ppress / 1500.0); 
+				if ( v < 0.1 ) v = 0.1;
+				if ( v > 1.0 ) v = 1.0;
+				*pclr = COLORA ( v, 1-v, 0, 1 );
+			}*/
+			if ( speed > SL2*0.1f) {
+				adj = SL2*0.1f;
+				clr.fromClr ( *pclr );
+				clr += Vector4DF( 2/255.0f, 2/255.0f, 2/255.0f, 2/255.0f);
+				clr.Clamp ( 1, 1, 1, 1);
+				*pclr = clr.toClr();
+			}
+			if ( speed < 0.01 ) {
+				clr.fromClr ( *pclr);
+				clr.x -= float(1/255.0f);		if ( clr.x < 0.2f ) clr.x = 0.2f;
+				clr.y -= float(1/255.0f);		if ( clr.y < 0.2f ) clr.y = 0.2f;
+				*pclr = clr.toClr();
+			}
+		
+			// Euler integration -------------------------------
+			/* accel += m_Gravity;
+			accel *= m_DT;
+			p->vel += accel;				// v(t+1) = v(t) + a(t) dt
+			p->vel_eval += accel;
+			p->vel_eval *= m_DT/d;
+			p->pos += p->vel_eval;
+			p->vel_eval = p->vel;  */	
+
+
+			if ( m_Toggle[PWRAP_X] ) {
+				diff = ppos->x - (m_Vec[PBOUNDMIN].x + 2);			// -- Simulates object in center of flow
+				if ( diff <= 0 ) {
+					ppos->x = (m_Vec[PBOUNDMAX].x - 2) + diff*2;				
+					ppos->z = 10;
+				}
+			}	
 
-		ppos++;
-		pvel++;
-		pveleval++;
-		pforce++;
-		pclr++;
-		ppress++;
-		pdensity++;
-	}
+		}
+	} );
 
 }
 
@@ -898,7 +902,7 @@ int FluidSystem::AddNeighbor( int i, int j, float d )
 	int k = AddNeighbor();
 	m_NeighborTable[k] = j;
 	m_NeighborDist[k] = d;
-	if (*(m_Fluid.bufI(FNBRCNT)+i) == 0 ) *(m_Fluid.bufI(FNBRCNT)+i) = k;
+	if (*(m_Fluid.bufI(FNBRCNT)+i) == 0 ) *(m_Fluid.bufI(FNBRNDX)+i) = k;
 	(*(m_Fluid.bufI(FNBRCNT)+i))++;
 	return k;
 }
@@ -986,25 +990,17 @@ void FluidSystem::InsertParticles ()
 {
 	int gs;	
 	
-	// Reset all grid pointers and neighbor tables to empty
-	memset ( m_Fluid.bufC(FGNEXT),		GRID_UCHAR, NumPoints()*sizeof(uint) );
+	// Reset all grid cells and neighbor tables to empty
 	memset ( m_Fluid.bufC(FGCELL),		GRID_UCHAR, NumPoints()*sizeof(uint) );
 	memset ( m_Fluid.bufC(FCLUSTER),	GRID_UCHAR, NumPoints()*sizeof(uint) );
-
-	// Reset all grid cells to empty	
-	memset( m_Fluid.bufC(FGRID),		GRID_UCHAR, m_GridTotal*sizeof(uint));
 	memset( m_Fluid.bufI(FGRIDCNT),		0, m_GridTotal*sizeof(uint));
 
 	// Insert each particle into spatial grid
 	Vector3DI gc;
 	Vector3DF* ppos =	m_Fluid.bufV3(FPOS);
 	uint* pgrid =		m_Fluid.bufI(FGCELL);
-	uint* pnext =		m_Fluid.bufI(FGNEXT);	
-	uint* pcell =		m_Fluid.bufI(FCLUSTER);
-
-	float poff = m_Param[PSMOOTHRADIUS] / m_Param[PSIMSCALE];
+	uint* pndx =		m_Fluid.bufI(FGNDX);
 
-	int ns = (int) pow ( (float) m_GridAdjCnt, 1.0f/3.0f );
 	register int xns, yns, zns;
 	xns = m_GridRes.x - m_GridSrch;
 	yns = m_GridRes.y - m_GridSrch;
@@ -1012,53 +1008,89 @@ void FluidSystem::InsertParticles ()
 
 	m_Param[ PSTAT_OCCUPY ] = 0.0;
 	m_Param [ PSTAT_GRIDCNT ] = 0.0;
-	uint* m_Grid = m_Fluid.bufI(FGRID);
 	uint* m_GridCnt = m_Fluid.bufI(FGRIDCNT);
 
 	for ( int n=0; n < NumPoints(); n++ ) {
 		gs = getGridCell ( *ppos, gc );
 		if ( gc.x >= 1 && gc.x <= xns && gc.y >= 1 && gc.y <= yns && gc.z >= 1 && gc.z <= zns ) {
-			// put current particle at head of grid cell, pointing to next in list (previous head of cell)
+			// record cell and position within cell (same as insertParticles kernel)
 			*pgrid = gs;
-			*pnext = m_Grid[gs];				
-			if ( *pnext == GRID_UNDEF ) m_Param[ PSTAT_OCCUPY ] += 1.0;
-			m_Grid[gs] = n;
-			m_GridCnt[gs]++;
+			*pndx = m_GridCnt[gs]++;
+			if ( *pndx == 0 ) m_Param[ PSTAT_OCCUPY ] += 1.0;
 			m_Param [ PSTAT_GRIDCNT ] += 1.0;
-			/* -- 1/2 cell offset search method
-			gx = (int)( (-poff + ppos->x - m_GridMin.x) * m_GridDelta.x);	
-			if ( gx < 0 ) gx = 0;
-			if ( gx > m_GridRes.x-2 ) gx = m_GridRes.x-2;
-			gy = (int)( (-poff + ppos->y - m_GridMin.y) * m_GridDelta.y);
-			if ( gy < 0 ) gy = 0;
-			if ( gy > m_GridRes.y-2 ) gx = m_GridRes.y-2;
-			gz = (int)( (-poff + ppos->z - m_GridMin.z) * m_GridDelta.z);
-			if ( gz < 0 ) gz = 0;
-			if ( gz > m_GridRes.z-2 ) gz = m_GridRes.z-2;
-			*pcell = (int)( (gy*m_GridRes.z + gz)*m_GridRes.x + gx) ;	// Cell in which to start 2x2x2 search*/
-		} else {
-			Vector3DF vel, ve;
-			vel = m_Fluid.bufV3(FVEL) [n];
-			ve = m_Fluid.bufV3(FVEVAL) [n];
-			float pr, dn;
-			pr = m_Fluid.bufF(FPRESS) [n];
-			dn = m_Fluid.bufF(FDENSITY) [n];
-			//printf ( "WARNING: Out of Bounds: %d, P<%f %f %f>, V<%f %f %f>, prs:%f, dns:%f\n", n, ppos->x, ppos->y, ppos->z, vel.x, vel.y, vel.z, pr, dn );
-			//ppos->x = -1; ppos->y = -1; ppos->z = -1;
 		}
 		pgrid++;
+		pndx++;
 		ppos++;
-		pnext++;
-		pcell++;
 	}
 
-	// STATS
-	/*m_Param[ PSTAT_OCCUPY ] = 0;
-	m_Param[ PSTAT_GRIDCNT ] = 0;
+	// Sort particles by grid cell, so neighbor search is contiguous in memory
+	PrefixSumCells ();
+	CountingSortFull ();
+}
+
+void FluidSystem::PrefixSumCells ()
+{
+	uint* mgcnt = m_Fluid.bufI(FGRIDCNT);
+	uint* mgoff = m_Fluid.bufI(FGRIDOFF);
+	uint sum = 0;
 	for (int n=0; n < m_GridTotal; n++) {
-		if ( m_GridCnt[n] > 0 )  m_Param[ PSTAT_OCCUPY ] += 1.0;
-		m_Param [ PSTAT_GRIDCNT ] += m_GridCnt[n];
-	}*/
+		mgoff[n] = sum;
+		sum += mgcnt[n];
+	}
+}
+
+void FluidSystem::TransferToTemp ( int buf_id, int stride )
+{
+	// Host temp buffers are allocated on first use
+	if ( m_FluidTemp.bufC(buf_id) == 0x0 ) {
+		int cnt = ( mMaxPoints > NumPoints() ) ? mMaxPoints : NumPoints();
+		m_FluidTemp.setBuf ( buf_id, (char*) malloc ( cnt*stride ) );
+	}
+	// Swap buffers. Temp holds unsorted data, sort writes into fluid buffer
+	char* buf = m_Fluid.bufC(buf_id);
+	m_Fluid.setBuf ( buf_id, m_FluidTemp.bufC(buf_id) );
+	m_FluidTemp.setBuf ( buf_id, buf );
+}
+
+void FluidSystem::CountingSortFull ()
+{
+	// Move particle data to temp buffers
+	TransferToTemp ( FPOS,		sizeof(Vector3DF) );
+	TransferToTemp ( FVEL,		sizeof(Vector3DF) );
+	TransferToTemp ( FVEVAL,	sizeof(Vector3DF) );
+	TransferToTemp ( FFORCE,	sizeof(Vector3DF) );
+	TransferToTemp ( FPRESS,	sizeof(float) );
+	TransferToTemp ( FDENSITY,	sizeof(float) );
+	TransferToTemp ( FAGE,		sizeof(unsigned short) );
+	TransferToTemp ( FCLR,		sizeof(uint) );
+	TransferToTemp ( FSTATE,	sizeof(uint) );
+	TransferToTemp ( FGCELL,	sizeof(uint) );
+	TransferToTemp ( FGNDX,		sizeof(uint) );
+
+	uint* mgoff = m_Fluid.bufI(FGRIDOFF);
+	uint* mgrid = m_Fluid.bufI(FGRID);
+	uint icell, indx, sort_ndx;
+	uint outside = mgoff[m_GridTotal-1] + m_Fluid.bufI(FGRIDCNT)[m_GridTotal-1];	// particles outside grid go after all cells
+
+	for (int i=0; i < NumPoints(); i++ ) {
+		icell = m_FluidTemp.bufI(FGCELL)[i];
+		indx = m_FluidTemp.bufI(FGNDX)[i];
+		sort_ndx = ( icell != GRID_UNDEF ) ? mgoff[icell] + indx : outside++;
+
+		mgrid [ sort_ndx ] =					sort_ndx;			// full sort, grid indexing becomes identity
+		m_Fluid.bufV3(FPOS)[sort_ndx] =			m_FluidTemp.bufV3(FPOS)[i];
+		m_Fluid.bufV3(FVEL)[sort_ndx] =			m_FluidTemp.bufV3(FVEL)[i];
+		m_Fluid.bufV3(FVEVAL)[sort_ndx] =		m_FluidTemp.bufV3(FVEVAL)[i];
+		m_Fluid.bufV3(FFORCE)[sort_ndx] =		m_FluidTemp.bufV3(FFORCE)[i];
+		m_Fluid.bufF(FPRESS)[sort_ndx] =		m_FluidTemp.bufF(FPRESS)[i];
+		m_Fluid.bufF(FDENSITY)[sort_ndx] =		m_FluidTemp.bufF(FDENSITY)[i];
+		((unsigned short*) m_Fluid.bufC(FAGE))[sort_ndx] = ((unsigned short*) m_FluidTemp.bufC(FAGE))[i];
+		m_Fluid.bufI(FCLR)[sort_ndx] =			m_FluidTemp.bufI(FCLR)[i];
+		m_Fluid.bufI(FSTATE)[sort_ndx] =		m_FluidTemp.bufI(FSTATE)[i];
+		m_Fluid.bufI(FGCELL)[sort_ndx] =		icell;
+		m_Fluid.bufI(FGNDX)[sort_ndx] =			indx;
+	}
 }
 
 void FluidSystem::SaveResults ()
@@ -1131,102 +1163,124 @@ void FluidSystem::FindNbrsSlow ()
 
 void FluidSystem::FindNbrsGrid ()
 {
-	// O(n^2)
-	// Does not require grid
-
-	Vector3DF dst;
-	float dsq;
-	int j;
+	// Two passes over the grid: count neighbors, then fill table.
+	// Each particle gathers its own neighbors, so table order does not depend on thread count.
 	int nadj = (m_GridRes.z + 1)*m_GridRes.x + 1;
 	float d2 = m_Param[PSIMSCALE]*m_Param[PSIMSCALE];
-	uint* m_Grid = m_Fluid.bufI(FGRID);
-	uint* m_GridCnt = m_Fluid.bufI(FGRIDCNT);
+	Vector3DF*	pos = m_Fluid.bufV3(FPOS);
+	uint*		gcell = m_Fluid.bufI(FGCELL);
+	uint*		nbrndx = m_Fluid.bufI(FNBRNDX);
+	uint*		nbrcnt = m_Fluid.bufI(FNBRCNT);
+	uint*		m_GridOff = m_Fluid.bufI(FGRIDOFF);
+	uint*		m_GridCnt = m_Fluid.bufI(FGRIDCNT);
 	
 	ResetNeighbors ();
 
-	Vector3DF *ipos;
-	ipos = m_Fluid.bufV3(FPOS);
-	for (int i=0; i < NumPoints(); i++ ) {
-		ClearNeighbors ( i );
-		
-		if ( m_Fluid.bufI(FGCELL)[i] != GRID_UNDEF ) {
-			for (int cell=0; cell < m_GridAdjCnt; cell++) {
-				j = m_Grid [ m_Fluid.bufI(FGCELL)[i] - nadj + m_GridAdj[cell] ] ;
-				while ( j != GRID_UNDEF ) {
-					if ( i==j ) { j = m_Fluid.bufI(FGNEXT)[j]; continue; }
-					dst = *ipos;
-					dst -= m_Fluid.bufV3(FPOS)[j];
-					dsq = d2*(dst.x*dst.x + dst.y*dst.y + dst.z*dst.z);
-					if ( dsq <= m_R2 ) {
-						AddNeighbor( i, j, sqrt(dsq) );
+	for (int pass=0; pass < 2; pass++ ) {
+		ParallelFor ( m_Workers, NumPoints(), [&] ( slong start, slong end ) {
+			Vector3DF dst;
+			float dsq;
+			int c, j, jlast, k;
+			for (int i = (int) start; i < (int) end; i++ ) {
+				if ( pass==0 ) nbrcnt[i] = 0;
+				if ( gcell[i] == GRID_UNDEF ) continue;
+				k = nbrndx[i];
+				for (int cell=0; cell < m_GridAdjCnt; cell++) {
+					c = gcell[i] - nadj + m_GridAdj[cell];
+					jlast = m_GridOff[c] + m_GridCnt[c];
+					for ( j = m_GridOff[c]; j < jlast; j++ ) {
+						if ( i==j ) continue;
+						dst = pos[i];
+						dst -= pos[j];
+						dsq = d2*(dst.x*dst.x + dst.y*dst.y + dst.z*dst.z);
+						if ( dsq <= m_R2 ) {
+							if ( pass==0 ) {
+								nbrcnt[i]++;
+							} else {
+								m_NeighborTable[k] = j;
+								m_NeighborDist[k] = sqrt(dsq);
+								k++;
+							}
+						}
 					}
-					j = m_Fluid.bufI(FGNEXT)[j];
 				}
 			}
+		} );
+		if ( pass==0 ) {
+			// Neighbor table offsets
+			int total = 0;
+			for (int i=0; i < NumPoints(); i++ ) {
+				nbrndx[i] = total;
+				total += nbrcnt[i];
+			}
+			if ( total > m_NeighborMax ) {
+				ClearNeighborTable ();
+				m_NeighborMax = total;
+				m_NeighborTable = (int*) malloc ( m_NeighborMax * sizeof(int) );
+				m_NeighborDist = (float*) malloc ( m_NeighborMax * sizeof(float) );
+			}
+			m_NeighborNum = total;
 		}
-		ipos++;
 	}
 }
 
 
-// Compute Pressures - Using spatial grid, and also create neighbor table
+// Compute Pressures - Using spatial grid
 void FluidSystem::ComputePressureGrid ()
 {
-	int i, j, cnt = 0;	
-	float sum, dsq, c;
 	float d = m_Param[PSIMSCALE];
 	float d2 = d*d;
-	float radius = m_Param[PSMOOTHRADIUS] / m_Param[PSIMSCALE];
 	
 	// Get particle buffers
-	Vector3DF*	ipos =		m_Fluid.bufV3(FPOS);		
-	float*		ipress =	m_Fluid.bufF(FPRESS);
-	float*		idensity =	m_Fluid.bufF(FDENSITY);
-	uint*		inbr =		m_Fluid.bufI(FNBRNDX);
-	uint*		inbrcnt =	m_Fluid.bufI(FNBRCNT);
+	Vector3DF*	pos =		m_Fluid.bufV3(FPOS);		
+	float*		press =		m_Fluid.bufF(FPRESS);
+	float*		density =	m_Fluid.bufF(FDENSITY);
+	uint*		gcell =		m_Fluid.bufI(FGCELL);
 
-	Vector3DF	dst;
 	int			nadj = (m_GridRes.z + 1)*m_GridRes.x + 1;
-	uint*		m_Grid = m_Fluid.bufI(FGRID);
+	uint*		m_GridOff = m_Fluid.bufI(FGRIDOFF);
 	uint*		m_GridCnt = m_Fluid.bufI(FGRIDCNT);
 	
-	int nbrcnt = 0;
-	int srch = 0;
-
-	for ( i=0; i < NumPoints(); i++ ) {
-
-		sum = 0.0;
-
-		if ( m_Fluid.bufI(FGCELL)[i] != GRID_UNDEF ) {
-			for (int cell=0; cell < m_GridAdjCnt; cell++) {
-				j = m_Grid [   m_Fluid.bufI(FGCELL)[i] - nadj + m_GridAdj[cell] ] ;
-				while ( j != GRID_UNDEF ) {
-					if ( i==j ) { j = m_Fluid.bufI(FGNEXT)[j]; continue; }
-					dst = m_Fluid.bufV3(FPOS)[j];
-					dst -= *ipos;
-					dsq = d2*(dst.x*dst.x + dst.y*dst.y + dst.z*dst.z);
-					if ( dsq <= m_R2 ) {
-						c =  m_R2 - dsq;
-						sum += c * c * c;
-						nbrcnt++;
-						/*nbr = AddNeighbor();			// get memory for new neighbor						
-						*(m_NeighborTable + nbr) = j;
-						*(m_NeighborDist + nbr) = sqrt(dsq);
-						inbr->num++;*/
+	std::atomic<slong> nbrcnt ( 0 );
+	std::atomic<slong> srch ( 0 );
+
+	// Particles are sorted by cell, so each range covers a run of grid cells.
+	// Every particle writes only its own pressure and density.
+	ParallelFor ( m_Workers, NumPoints(), [&] ( slong start, slong end ) {
+		Vector3DF dst;
+		float sum, dsq, c;
+		int gc, j, jlast;
+		slong rnbr = 0, rsrch = 0;
+		for (int i = (int) start; i < (int) end; i++ ) {
+
+			sum = 0.0;
+
+			if ( gcell[i] != GRID_UNDEF ) {
+				for (int cell=0; cell < m_GridAdjCnt; cell++) {
+					gc = gcell[i] - nadj + m_GridAdj[cell];
+					jlast = m_GridOff[gc] + m_GridCnt[gc];
+					for ( j = m_GridOff[gc]; j < jlast; j++ ) {
+						if ( i==j ) continue;
+						dst = pos[j];
+						dst -= pos[i];
+						dsq = d2*(dst.x*dst.x + dst.y*dst.y + dst.z*dst.z);
+						if ( dsq <= m_R2 ) {
+							c =  m_R2 - dsq;
+							sum += c * c * c;
+							rnbr++;
+						}
+						rsrch++;
 					}
-					srch++;
-					j = m_Fluid.bufI(FGNEXT)[j];
 				}
 			}
+			density[i] = sum * m_Param[PMASS] * m_Poly6Kern ;	
+			press[i] = ( density[i] - m_Param[PRESTDENSITY] ) * m_Param[PINTSTIFF];		
+			density[i] = 1.0f / density[i];
 		}
-		*idensity = sum * m_Param[PMASS] * m_Poly6Kern ;	
-		*ipress = ( *idensity - m_Param[PRESTDENSITY] ) * m_Param[PINTSTIFF];		
-		*idensity = 1.0f / *idensity;
+		nbrcnt += rnbr;
+		srch += rsrch;
+	} );
 
-		ipos++;
-		idensity++;
-		ipress++;
-	}
 	// Stats:
 	m_Param [ PSTAT_NBR ] = float(nbrcnt);
 	m_Param [ PSTAT_SRCH ] = float(srch);
@@ -1234,144 +1288,109 @@ void FluidSystem::ComputePressureGrid ()
 	if ( m_Param[PSTAT_SRCH] > m_Param [ PSTAT_SRCHMAX ] ) m_Param [ PSTAT_SRCHMAX ] = m_Param[PSTAT_SRCH];
 }
 
-// Compute Forces - Using spatial grid with saved neighbor table. Fastest.
+// Compute Forces - Using spatial grid
 void FluidSystem::ComputeForceGrid ()
 {
-	Vector3DF force;
-	register float pterm, vterm, dterm;
-	int i, j;
-	float c, d;
-	float dx, dy, dz;
-	float mR, visc;	
-
-	d = m_Param[PSIMSCALE];
-	mR = m_Param[PSMOOTHRADIUS];
-	visc = m_Param[PVISC];
+	float d = m_Param[PSIMSCALE];
+	float d2 = d*d;
+	float mR = m_Param[PSMOOTHRADIUS];
+	float visc = m_Param[PVISC];
 	
 	// Get particle buffers
-	Vector3DF*	ipos =		m_Fluid.bufV3(FPOS);		
-	Vector3DF*	iveleval =	m_Fluid.bufV3(FVEVAL);		
-	Vector3DF*	iforce =	m_Fluid.bufV3(FFORCE);		
-	float*		ipress =	m_Fluid.bufF(FPRESS);
-	float*		idensity =	m_Fluid.bufF(FDENSITY);
-	
-	Vector3DF	jpos;
-	float		jdist;
-	float		jpress;
-	float		jdensity;
-	Vector3DF	jveleval;
-	float		dsq;
-	float		d2 = d*d;
+	Vector3DF*	pos =		m_Fluid.bufV3(FPOS);		
+	Vector3DF*	veleval =	m_Fluid.bufV3(FVEVAL);		
+	Vector3DF*	force =		m_Fluid.bufV3(FFORCE);		
+	float*		press =		m_Fluid.bufF(FPRESS);
+	float*		density =	m_Fluid.bufF(FDENSITY);
+	uint*		gcell =		m_Fluid.bufI(FGCELL);
+	
 	int			nadj = (m_GridRes.z + 1)*m_GridRes.x + 1;
-	uint* m_Grid = m_Fluid.bufI(FGRID);
+	uint* m_GridOff = m_Fluid.bufI(FGRIDOFF);
 	uint* m_GridCnt = m_Fluid.bufI(FGRIDCNT);
 
-	for ( i=0; i < NumPoints(); i++ ) {
-
-		iforce->Set ( 0, 0, 0 );
-
-		if ( m_Fluid.bufI(FGCELL)[i] != GRID_UNDEF ) {
-			for (int cell=0; cell < m_GridAdjCnt; cell++) {
-				j = m_Grid [  m_Fluid.bufI(FGCELL)[i] - nadj + m_GridAdj[cell] ];
-				while ( j != GRID_UNDEF ) {
-					if ( i==j ) { j = m_Fluid.bufI(FGNEXT)[j]; continue; }
-					jpos = m_Fluid.bufV3(FPOS)[j];
-					dx = ( ipos->x - jpos.x);		// dist in cm
-					dy = ( ipos->y - jpos.y);
-					dz = ( ipos->z - jpos.z);
-					dsq = d2*(dx*dx + dy*dy + dz*dz);
-					if ( dsq <= m_R2 ) {
-
-						jdist = sqrt(dsq);
-
-						jpress = m_Fluid.bufF(FPRESS)[j];
-						jdensity = m_Fluid.bufF(FDENSITY)[j];
-						jveleval = m_Fluid.bufV3(FVEVAL)[j];
-						dx = ( ipos->x - jpos.x);		// dist in cm
-						dy = ( ipos->y - jpos.y);
-						dz = ( ipos->z - jpos.z);
-						c = (mR-jdist);
-						pterm = d * -0.5f * c * m_SpikyKern * ( *ipress + jpress ) / jdist;
-						dterm = c * (*idensity) * jdensity;
-						vterm = m_LapKern * visc;
-						iforce->x += ( pterm * dx + vterm * ( jveleval.x - iveleval->x) ) * dterm;
-						iforce->y += ( pterm * dy + vterm * ( jveleval.y - iveleval->y) ) * dterm;
-						iforce->z += ( pterm * dz + vterm * ( jveleval.z - iveleval->z) ) * dterm;
+	// Gather: each particle sums contributions of its neighbors into its own force only (no atomics)
+	ParallelFor ( m_Workers, NumPoints(), [&] ( slong start, slong end ) {
+		Vector3DF	iforce;
+		float		pterm, vterm, dterm;
+		float		c, dx, dy, dz, dsq, jdist;
+		int			gc, j, jlast;
+		for (int i = (int) start; i < (int) end; i++ ) {
+
+			iforce.Set ( 0, 0, 0 );
+
+			if ( gcell[i] != GRID_UNDEF ) {
+				for (int cell=0; cell < m_GridAdjCnt; cell++) {
+					gc = gcell[i] - nadj + m_GridAdj[cell];
+					jlast = m_GridOff[gc] + m_GridCnt[gc];
+					for ( j = m_GridOff[gc]; j < jlast; j++ ) {
+						if ( i==j ) continue;
+						dx = ( pos[i].x - pos[j].x);		// dist in cm
+						dy = ( pos[i].y - pos[j].y);
+						dz = ( pos[i].z - pos[j].z);
+						dsq = d2*(dx*dx + dy*dy + dz*dz);
+						if ( dsq <= m_R2 ) {
+							jdist = sqrt(dsq);
+							c = (mR-jdist);
+							pterm = d * -0.5f * c * m_SpikyKern * ( press[i] + press[j] ) / jdist;
+							dterm = c * density[i] * density[j];
+							vterm = m_LapKern * visc;
+							iforce.x += ( pterm * dx + vterm * ( veleval[j].x - veleval[i].x) ) * dterm;
+							iforce.y += ( pterm * dy + vterm * ( veleval[j].y - veleval[i].y) ) * dterm;
+							iforce.z += ( pterm * dz + vterm * ( veleval[j].z - veleval[i].z) ) * dterm;
+						}
 					}
-					j = m_Fluid.bufI(FGNEXT)[j];
 				}
 			}
+			force[i] = iforce;
 		}
-		ipos++;
-		iveleval++;
-		iforce++;
-		ipress++;
-		idensity++;
-	}
+	} );
 }
 
 
-// Compute Forces - Using spatial grid with saved neighbor table. Fastest.
+// Compute Forces - Using saved neighbor table (see FindNbrsGrid)
 void FluidSystem::ComputeForceGridNC ()
 {
-	Vector3DF force;
-	register float pterm, vterm, dterm;
-	int i, j;
-	float c, d;
-	float dx, dy, dz;
-	float mR, visc;	
-
-	d = m_Param[PSIMSCALE];
-	mR = m_Param[PSMOOTHRADIUS];
-	visc = m_Param[PVISC];
+	float d = m_Param[PSIMSCALE];
+	float mR = m_Param[PSMOOTHRADIUS];
+	float visc = m_Param[PVISC];
 
 	// Get particle buffers
-	Vector3DF*	ipos =		m_Fluid.bufV3(FPOS);		
-	Vector3DF*	iveleval =	m_Fluid.bufV3(FVEVAL);		
-	Vector3DF*	iforce =	m_Fluid.bufV3(FFORCE);		
-	float*		ipress =	m_Fluid.bufF(FPRESS);
-	float*		idensity =	m_Fluid.bufF(FDENSITY);
-	uint*		inbr =		m_Fluid.bufI(FNBRNDX);
-	uint*		inbrcnt =	m_Fluid.bufI(FNBRCNT);
-
-	int			jndx;
-	Vector3DF	jpos;
-	float		jdist;
-	float		jpress;
-	float		jdensity;
-	Vector3DF	jveleval;
-
-	for ( i=0; i < NumPoints(); i++ ) {
-
-		iforce->Set ( 0, 0, 0 );
+	Vector3DF*	pos =		m_Fluid.bufV3(FPOS);		
+	Vector3DF*	veleval =	m_Fluid.bufV3(FVEVAL);		
+	Vector3DF*	force =		m_Fluid.bufV3(FFORCE);		
+	float*		press =		m_Fluid.bufF(FPRESS);
+	float*		density =	m_Fluid.bufF(FDENSITY);
+	uint*		nbrndx =	m_Fluid.bufI(FNBRNDX);
+	uint*		nbrcnt =	m_Fluid.bufI(FNBRCNT);
+
+	ParallelFor ( m_Workers, NumPoints(), [&] ( slong start, slong end ) {
+		Vector3DF	iforce;
+		float		pterm, vterm, dterm;
+		float		c, dx, dy, dz, jdist;
+		int			j, jndx;
+		for (int i = (int) start; i < (int) end; i++ ) {
+
+			iforce.Set ( 0, 0, 0 );
 		
-		jndx = *inbr;
-		for (int nbr=0; nbr < (int) *inbrcnt; nbr++ ) {
-			j = *(m_NeighborTable+jndx);
-			jpos =		m_Fluid.bufV3(FPOS)[j];
-			jpress =	m_Fluid.bufF(FPRESS)[j];
-			jdensity =  m_Fluid.bufF(FDENSITY)[j];
-			jveleval =  m_Fluid.bufV3(FVEVAL)[j];
-			jdist = *(m_NeighborDist + jndx);			
-			dx = ( ipos->x - jpos.x);		// dist in cm
-			dy = ( ipos->y - jpos.y);
-			dz = ( ipos->z - jpos.z);
-			c = ( mR - jdist );
-			pterm = d * -0.5f * c * m_SpikyKern * ( *ipress + jpress ) / jdist;
-			dterm = c * (*idensity) * jdensity;
-			vterm = m_LapKern * visc;
-			iforce->x += ( pterm * dx + vterm * ( jveleval.x - iveleval->x) ) * dterm;
-			iforce->y += ( pterm * dy + vterm * ( jveleval.y - iveleval->y) ) * dterm;
-			iforce->z += ( pterm * dz + vterm * ( jveleval.z - iveleval->z) ) * dterm;
-			jndx++;
-		}				
-		ipos++;
-		iveleval++;
-		iforce++;
-		ipress++;
-		idensity++;
-		inbr++;
-	}
+			jndx = nbrndx[i];
+			for (int nbr=0; nbr < (int) nbrcnt[i]; nbr++ ) {
+				j = m_NeighborTable[jndx];
+				jdist = m_NeighborDist[jndx];
+				dx = ( pos[i].x - pos[j].x);		// dist in cm
+				dy = ( pos[i].y - pos[j].y);
+				dz = ( pos[i].z - pos[j].z);
+				c = ( mR - jdist );
+				pterm = d * -0.5f * c * m_SpikyKern * ( press[i] + press[j] ) / jdist;
+				dterm = c * density[i] * density[j];
+				vterm = m_LapKern * visc;
+				iforce.x += ( pterm * dx + vterm * ( veleval[j].x - veleval[i].x) ) * dterm;
+				iforce.y += ( pterm * dy + vterm * ( veleval[j].y - veleval[i].y) ) * dterm;
+				iforce.z += ( pterm * dz + vterm * ( veleval[j].z - veleval[i].z) ) * dterm;
+				jndx++;
+			}
+			force[i] = iforce;
+		}
+	} );
 }
 
 
@@ -1867,8 +1886,9 @@ float FluidSystem::Sample ( Vector3DF p )
 	float mR = m_Param[PSMOOTHRADIUS];
 	float h2 = 2.0f*mR*mR / smoothing;
 	float mGaussKern = 1.0f/ pow (3.141592f * 2.0f*mR*mR, 3.0f/2.0f);		// Kelager, eq 3.18
-	uint* m_Grid = m_Fluid.bufI(FGRID);
+	uint* m_GridOff = m_Fluid.bufI(FGRIDOFF);
 	uint* m_GridCnt = m_Fluid.bufI(FGRIDCNT);
+	int c, jlast;
 	register int xns, yns, zns;
 	xns = m_GridRes.x - m_GridSrch;
 	yns = m_GridRes.y - m_GridSrch;
@@ -1882,8 +1902,9 @@ float FluidSystem::Sample ( Vector3DF p )
 			
 			int nadj = (m_GridRes.z + 1)*m_GridRes.x + 1;			
 			for (int cell=0; cell < m_GridAdjCnt; cell++) {
-				j = m_Grid [ gs - nadj + m_GridAdj[cell] ];
-				while ( j != GRID_UNDEF ) {			
+				c = gs - nadj + m_GridAdj[cell];
+				jlast = m_GridOff[c] + m_GridCnt[c];
+				for ( j = m_GridOff[c]; j < jlast; j++ ) {
 					jpos = m_Fluid.bufV3(FPOS)[j];
 					del = p - jpos;			// dist in cm				
 					dsq = d2*(del.x*del.x + del.y*del.y + del.z*del.z);
@@ -1895,7 +1916,6 @@ float FluidSystem::Sample ( Vector3DF p )
 						//v += jvel * (W / jdensity);			// evaluate variable (jveleval)											
 						v += W;
 					}
-					j = m_Fluid.bufI(FGNEXT)[j];
 				}
 			}			
 		}
@@ -2342,6 +2362,7 @@ void FluidSystem::SetupDefaultParams ()
 	m_Param [PDRAWMODE] = 1;				// Sprite drawing
 	m_Param [PDRAWGRID] = 0;				// No grid 
 	m_Param [PDRAWTEXT] = 0;				// No text
+	m_Param [PTHREADS] = 0;					// All cores for CPU modes
 
 }
 
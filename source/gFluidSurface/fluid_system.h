@@ -43,6 +43,7 @@
 	#include "fluid.h"
 	#include "gvdb_vec.h"
 	#include "gvdb_camera.h"
+	#include "gvdb_parallel.h"
 	using namespace nvdb;
 
 	#define MAX_PARAM			50
@@ -112,6 +113,7 @@
 	#define PTIME_TOGPU			45
 	#define PTIME_FROMGPU		46
 	#define PFORCE_FREQ			47	
+	#define PTHREADS			48		// host threads for CPU modes (0 = all cores)
 
 	// Vector params
 	#define PVOLMIN				0
@@ -214,6 +216,9 @@
 		// Neighbor Search
 		void Search ();
 		void InsertParticles ();
+		void PrefixSumCells ();
+		void CountingSortFull ();
+		void TransferToTemp ( int buf_id, int stride );
 		void BasicSortParticles ();
 		void BinSortParticles ();
 		void FindNbrsSlow ();
@@ -356,6 +361,7 @@
 		float						m_Param [ MAX_PARAM ];			// see defines above
 		Vector3DF					m_Vec [ MAX_PARAM ];
 		bool						m_Toggle [ MAX_PARAM ];		
+		WorkerPool					m_Workers;						// CPU modes, sized by PTHREADS
 
 		// SPH Kernel functions
 		float						m_R2, m_Poly6Kern, m_LapKern, m_SpikyKern;		
@@ -0,0 +1,562 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+// GVDB Benchmark Suite
+// Host-only benchmarks of the topology, atlas and file paths of GVDB. 
+// All inputs are generated from a fixed seed, so runs are repeatable and
+// results of different tree configurations (-c) can be compared directly.
+//
+//   gvdb_bench [-o results.json] [-c 3,3,3,3,3]... [-r repeats] [-s scale] [-t threads] [-d tmpdir] [-m model.obj]
+//
+// Each benchmark runs once for warm-up, then 'repeats' timed runs. 
+// Setup and teardown (volume creation, test data) are excluded from timing.
+// The model (-m) defaults to lucy.obj in the asset path.
+
+#include "gvdb.h"
+using namespace nvdb;
+
+#include "gvdb_parallel.h"
+#include "loader_OBJReader.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+
+struct BenchResult {
+	std::string		name;
+	std::string		config;
+	std::vector<double> ms;				// timed runs (milliseconds)
+	uint64			items;				// work items per run (points, children, triangles..)
+	uint64			bytes;				// bytes per run (file benchmarks)
+	uint64			nodes;				// leaf nodes after run
+};
+
+std::vector<BenchResult>	g_results;
+int			g_repeats = 5;
+int			g_scale = 1;
+int			g_threads = 0;
+std::string	g_tmpdir = ".";
+uint32		g_seed;
+bool		g_failed = false;				// a validation check failed
+
+// Deterministic random numbers (LCG)
+void  benchSeed ( uint32 s )	{ g_seed = s; }
+uint32 benchRand ()				{ g_seed = g_seed * 1664525u + 1013904223u; return g_seed >> 8; }
+float benchRandF ()				{ return float(benchRand()) / float(1 << 24); }
+
+double benchMSec ()
+{
+	return std::chrono::duration<double, std::milli> ( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+std::string benchFile ( const char* name )
+{
+	return g_tmpdir + "/" + name;
+}
+
+uint64 benchFileSize ( std::string fname )
+{
+	FILE* fp = fopen ( fname.c_str(), "rb" );
+	if ( fp == 0x0 ) return 0;
+	fseek ( fp, 0, SEEK_END );
+	uint64 sz = (uint64) ftell ( fp );
+	fclose ( fp );
+	return sz;
+}
+
+VolumeGVDB* NewVolume ( int* cfg )
+{
+	VolumeGVDB* v = new VolumeGVDB;
+	v->SetVerbose ( false );
+	v->SetCPUDevice ( g_threads );
+	v->Initialize ();
+	v->Configure ( cfg[0], cfg[1], cfg[2], cfg[3], cfg[4] );
+	v->SetVoxelSize ( 1, 1, 1 );
+	return v;
+}
+
+// Run a benchmark
+// - setup and teardown are called around every run, and are not timed.
+// - teardown returns the leaf count reported for the run.
+void RunBench ( std::string name, std::string config, uint64 items, uint64 bytes, 
+				std::function<void()> setup, std::function<void()> body, std::function<uint64()> teardown )
+{
+	BenchResult r;
+	r.name = name;
+	r.config = config;
+	r.items = items;
+	r.bytes = bytes;
+	r.nodes = 0;
+
+	for (int n=-1; n < g_repeats; n++ ) {		// n=-1 is warm-up
+		setup ();
+		double t = benchMSec ();
+		body ();
+		t = benchMSec () - t;
+		r.nodes = teardown ();
+		if ( n >= 0 ) r.ms.push_back ( t );
+	}
+	std::vector<double> s = r.ms;
+	std::sort ( s.begin(), s.end() );
+	printf ( "  %-24s %-12s min %9.3f ms  med %9.3f ms", name.c_str(), config.c_str(), s[0], s[s.size()/2] );
+	if ( bytes > 0 ) printf ( "  %8.1f MB/s", bytes / (s[0] * 1000.0) );
+	else if ( items > 0 ) printf ( "  %8.2f M/s", items / (s[0] * 1000.0) );
+	printf ( "\n" );
+	g_results.push_back ( r );
+}
+
+// Points on a lattice with 8 voxel spacing, each kept with probability 'density'.
+// The domain is given in voxels, so the same points are used for every tree configuration.
+std::vector<Vector3DF> MakePoints ( float density, int cells, uint32 seed )
+{
+	std::vector<Vector3DF> pnts;
+	benchSeed ( seed );
+	for (int z=0; z < cells; z++ )
+		for (int y=0; y < cells; y++ )
+			for (int x=0; x < cells; x++ )
+				if ( benchRandF() < density ) pnts.push_back ( Vector3DF( x*8+4, y*8+4, z*8+4 ) );
+	return pnts;
+}
+
+std::vector<Vector3DI> MakeBricks ( std::vector<Vector3DF>& pnts, int res )
+{
+	std::vector<Vector3DI> bricks;
+	for (size_t n=0; n < pnts.size(); n++ ) {
+		Vector3DI p = Vector3DI( int(pnts[n].x) / res, int(pnts[n].y) / res, int(pnts[n].z) / res );
+		bricks.push_back ( p * res );
+	}
+	return bricks;
+}
+
+//-------------------------------------------------------------- Topology
+
+// Activate points from several threads at once, returns the leaf of each point
+void ActivateConcurrent ( VolumeGVDB* v, std::vector<Vector3DF>& pnts, std::vector<slong>& leafs )
+{
+	leafs.resize ( pnts.size() );
+	v->BeginActivate ( pnts.size() );
+	ParallelFor ( g_threads, pnts.size(), [&] ( slong s, slong e ) {
+		for (slong n=s; n < e; n++ ) leafs[n] = v->ActivateSpaceConcurrent ( pnts[n] );
+	} );
+	v->EndActivate ();
+}
+
+// Check that concurrent activation gives the same tree as serial activation.
+// Node ids depend on thread timing, so node positions of each level are compared.
+bool CheckActivate ( int* cfg, std::vector<Vector3DF>& pnts )
+{
+	VolumeGVDB* a = NewVolume ( cfg );
+	for (size_t n=0; n < pnts.size(); n++ ) a->ActivateSpace ( pnts[n] );
+	VolumeGVDB* b = NewVolume ( cfg );
+	std::vector<slong> leafs;
+	ActivateConcurrent ( b, pnts, leafs );
+
+	bool ok = true;
+	for (int lev=0; lev < 5 && ok; lev++ ) {
+		std::vector<Vector3DI> pa, pb;
+		for (int n=0; n < a->getNumNodes(lev); n++ ) pa.push_back ( a->getNodeAtLevel(n, lev)->mPos );
+		for (int n=0; n < b->getNumNodes(lev); n++ ) pb.push_back ( b->getNodeAtLevel(n, lev)->mPos );
+		auto less = [] ( const Vector3DI& p, const Vector3DI& q ) { return p.z < q.z || (p.z == q.z && (p.y < q.y || (p.y == q.y && p.x < q.x))); };
+		std::sort ( pa.begin(), pa.end(), less );
+		std::sort ( pb.begin(), pb.end(), less );
+		ok = ( pa.size() == pb.size() );
+		for (size_t n=0; n < pa.size() && ok; n++ )
+			ok = ( pa[n].x == pb[n].x && pa[n].y == pb[n].y && pa[n].z == pb[n].z );
+	}
+	int res = b->getRes(0);
+	for (size_t n=0; n < pnts.size() && ok; n++ ) {
+		if ( leafs[n] == ID_UNDEFL ) { ok = false; break; }
+		Vector3DI lp = b->getNode ( leafs[n] )->mPos;
+		Vector3DI p = pnts[n];
+		ok = ( p.x >= lp.x && p.y >= lp.y && p.z >= lp.z && p.x < lp.x+res && p.y < lp.y+res && p.z < lp.z+res );
+	}
+	delete a;
+	delete b;
+	return ok;
+}
+
+void BenchActivate ( int* cfg, std::string cfgstr )
+{
+	float density[4] = { 0.01f, 0.1f, 0.5f, 1.0f };
+	char name[128];
+	VolumeGVDB* v = 0x0;
+
+	for (int d=0; d < 4; d++ ) {
+		std::vector<Vector3DF> pnts = MakePoints ( density[d], 40*g_scale, 1 );
+		
+		// Incremental activation, one point at a time
+		sprintf ( name, "activate_%g", density[d] );
+		RunBench ( name, cfgstr, pnts.size(), 0,
+			[&] () { v = NewVolume ( cfg ); },
+			[&] () { for (size_t n=0; n < pnts.size(); n++ ) v->ActivateSpace ( pnts[n] ); },
+			[&] () { uint64 c = v->getNumNodes(0); delete v; return c; } );
+
+		// Concurrent activation, points split over host threads
+		std::vector<slong> leafs;
+		sprintf ( name, "activate_concurrent_%g", density[d] );
+		RunBench ( name, cfgstr, pnts.size(), 0,
+			[&] () { v = NewVolume ( cfg ); },
+			[&] () { ActivateConcurrent ( v, pnts, leafs ); },
+			[&] () { uint64 c = v->getNumNodes(0); delete v; return c; } );
+		if ( !CheckActivate ( cfg, pnts ) ) {
+			printf ( "ERROR: %s does not match serial activation.\n", name );
+			g_failed = true;
+		}
+
+		// Bulk build from brick positions
+		std::vector<Vector3DI> bricks;
+		sprintf ( name, "build_topology_%g", density[d] );
+		RunBench ( name, cfgstr, pnts.size(), 0,
+			[&] () { v = NewVolume ( cfg ); bricks = MakeBricks ( pnts, v->getRes(0) ); },
+			[&] () { v->BuildTopology ( bricks ); },
+			[&] () { uint64 c = v->getNumNodes(0); delete v; return c; } );
+	}
+}
+
+// Insert children in random order into the widest interior level, 
+// so that most insertions shift a long child list.
+void BenchInsertChild ( int* cfg, std::string cfgstr )
+{
+	VolumeGVDB* v = 0x0;
+	int lev = 1;
+	for (int l=2; l < 5; l++ )
+		if ( cfg[4-l] > cfg[4-lev] ) lev = l;
+	int nchild = 1 << (3*cfg[4-lev]);
+	int nparent = std::max ( 1, 65536 * g_scale / nchild );
+
+	std::vector<slong> parents, childs;
+	std::vector<uint32> order ( nchild );
+	for (int n=0; n < nchild; n++ ) order[n] = n;
+	benchSeed ( 2 );
+	for (int n=nchild-1; n > 0; n-- ) std::swap ( order[n], order[benchRand() % (n+1)] );
+
+	RunBench ( "insert_child", cfgstr, uint64(nparent)*nchild, 0,
+		[&] () {
+			v = NewVolume ( cfg );
+			parents.clear (); childs.clear ();
+			for (int p=0; p < nparent; p++ ) {
+				slong id = v->AllocateNode ( lev );
+				v->SetupNode ( id, lev, Vector3DF(0,0,0) );
+				parents.push_back ( id );
+				for (int c=0; c < nchild; c++ ) {
+					id = v->AllocateNode ( lev-1 );
+					v->SetupNode ( id, lev-1, Vector3DF(0,0,0) );
+					childs.push_back ( id );
+				}
+			}
+		},
+		[&] () {
+			for (int p=0; p < nparent; p++ )
+				for (int c=0; c < nchild; c++ )
+					v->InsertChild ( parents[p], childs[p*nchild + c], order[c] );
+		},
+		[&] () { uint64 c = v->getNumNodes(lev-1); delete v; return c; } );
+}
+
+//-------------------------------------------------------------- Atlas
+
+// Volume with a float channel of smoothed noise
+VolumeGVDB* MakeVolume ( int* cfg )
+{
+	VolumeGVDB* v = NewVolume ( cfg );
+	std::vector<Vector3DF> pnts = MakePoints ( 0.25f, 32*g_scale, 3 );
+	std::vector<Vector3DI> bricks = MakeBricks ( pnts, v->getRes(0) );
+	v->BuildTopology ( bricks );
+	v->AddChannel ( 0, T_FLOAT, 1 );
+	v->FinishTopology ();
+	v->UpdateAtlas ();
+	v->FillChannel ( 0, Vector4DF(1,0,0,0) );
+	v->Compute ( FUNC_NOISE, 0, 1, Vector3DF(0.5f,0,0), false );
+	v->Compute ( FUNC_SMOOTH, 0, 2, Vector3DF(3,0,0), true );
+	return v;
+}
+
+void BenchAtlas ( VolumeGVDB* src, std::string cfgstr )
+{
+	uint64 leafs = src->getNumNodes(0);
+	RunBench ( "compute_bounds", cfgstr, leafs, 0, [] () {}, [&] () { src->ComputeBounds (); }, [&] () { return leafs; } );
+	RunBench ( "measure", cfgstr, leafs, 0, [] () {}, [&] () { src->Measure ( false ); }, [&] () { return leafs; } );
+	RunBench ( "update_atlas", cfgstr, leafs, 0, [] () {}, [&] () { src->UpdateAtlas (); }, [&] () { return leafs; } );
+}
+
+// Leaf and atlas layout. Leaves are activated in random order, so neighbors are scattered 
+// in the pools and atlas. Compute and rendering are timed before and after SortTopology.
+void BenchLayout ( int* cfg, std::string cfgstr )
+{
+	std::vector<Vector3DF> pnts = MakePoints ( 0.5f, 24*g_scale, 5 );
+	benchSeed ( 6 );
+	for (size_t n=pnts.size()-1; n > 0; n-- ) std::swap ( pnts[n], pnts[benchRand() % (n+1)] );
+
+	VolumeGVDB* v = NewVolume ( cfg );
+	for (size_t n=0; n < pnts.size(); n++ ) v->ActivateSpace ( pnts[n] );
+	v->AddChannel ( 0, T_FLOAT, 1 );
+	v->FinishTopology ();
+	v->UpdateAtlas ();
+	v->FillChannel ( 0, Vector4DF(1,0,0,0) );
+	v->Compute ( FUNC_NOISE, 0, 1, Vector3DF(0.5f,0,0), true );
+	uint64 leafs = v->getNumNodes(0);
+
+	// Volume render on the host, sampling the atlas along camera rays
+	Scene* scn = v->getScene ();
+	scn->SetSteps ( 0.5f, 16, 0.5f );
+	scn->SetExtinct ( -1.0f, 1.5f, 0 );
+	scn->SetVolumeRange ( 0.5f, 0.0f, 1.0f );
+	scn->SetCutoff ( 0.005f, 0.01f, 0 );
+	scn->LinearTransferFunc ( 0.0f, 0.5f, Vector4DF(0,0,0,0), Vector4DF(1,1,1,0.01f) );
+	scn->LinearTransferFunc ( 0.5f, 1.0f, Vector4DF(1,1,1,0.01f), Vector4DF(1,0,0,0.02f) );
+	v->CommitTransferFunc ();
+	float ctr = 24*g_scale*4.0f;
+	Camera3D* cam = new Camera3D;
+	cam->setFov ( 50 );
+	cam->setOrbit ( Vector3DF(20,30,0), Vector3DF(ctr,ctr,ctr), ctr*4, 1.0f );
+	scn->SetCamera ( cam );
+	Light* lgt = new Light;
+	lgt->setOrbit ( Vector3DF(299,57.3f,0), Vector3DF(ctr,ctr,ctr), ctr*4, 1.0f );
+	scn->SetLight ( 0, lgt );
+	int w = 256, h = 192;
+	scn->SetRes ( w, h );
+	v->AddRenderBuf ( 0, w, h, 4 );
+	auto render = [&] () { v->Render ( 0, SHADE_VOLUME, 0, 0, 1, 1, 1.0f ); };
+	auto smooth = [&] () { v->Compute ( FUNC_SMOOTH, 0, 1, Vector3DF(1,0,0), true ); };
+
+	RunBench ( "compute_smooth_unsorted", cfgstr, leafs, 0, [] () {}, smooth, [&] () { return leafs; } );
+	RunBench ( "render_unsorted", cfgstr, uint64(w)*h, 0, [] () {}, render, [&] () { return leafs; } );
+	RunBench ( "sort_topology", cfgstr, leafs, 0, [] () {}, [&] () { v->SortTopology (); }, [&] () { return leafs; } );
+	RunBench ( "compute_smooth_sorted", cfgstr, leafs, 0, [] () {}, smooth, [&] () { return leafs; } );
+	RunBench ( "render_sorted", cfgstr, uint64(w)*h, 0, [] () {}, render, [&] () { return leafs; } );
+	delete v;
+	delete cam;
+	delete lgt;
+}
+
+//-------------------------------------------------------------- Files
+
+void BenchVBX ( VolumeGVDB* src, int* cfg, std::string cfgstr )
+{
+	std::string fn = benchFile ( "gvdb_bench.vbx" );
+	std::string fnc = benchFile ( "gvdb_bench_c.vbx" );
+	uint64 leafs = src->getNumNodes(0);
+	VolumeGVDB* v = 0x0;
+
+	src->SaveVBX ( fn, false );
+	src->SaveVBX ( fnc, true );
+	uint64 sz = benchFileSize ( fn );
+	uint64 szc = benchFileSize ( fnc );
+
+	// Save throughput is reported against the bytes written
+	RunBench ( "save_vbx", cfgstr, leafs, sz, [] () {}, [&] () { src->SaveVBX ( fn, false ); }, [&] () { return leafs; } );
+	RunBench ( "save_vbx_compressed", cfgstr, leafs, szc, [] () {}, [&] () { src->SaveVBX ( fnc, true ); }, [&] () { return leafs; } );
+
+	// Load throughput is reported against the uncompressed size, so all loads compare directly
+	auto make = [&] () { v = NewVolume ( cfg ); };
+	auto done = [&] () { uint64 c = v->getNumNodes(0); delete v; return c; };
+	RunBench ( "load_vbx", cfgstr, leafs, sz, make, [&] () { v->LoadVBX ( fn ); }, done );
+	RunBench ( "load_vbx_mapped", cfgstr, leafs, sz, make, [&] () { v->LoadVBX ( fn, true ); }, done );
+	RunBench ( "load_vbx_compressed", cfgstr, leafs, sz, make, [&] () { v->LoadVBX ( fnc ); }, done );
+
+	printf ( "  %-24s %-12s %llu bytes, compressed %llu bytes (%.1f%%)\n", "vbx_size", cfgstr.c_str(), 
+		(unsigned long long) sz, (unsigned long long) szc, 100.0 * szc / std::max(sz, uint64(1)) );
+	remove ( fn.c_str() );
+	remove ( fnc.c_str() );
+}
+
+// BRK files hold 8^3 float bricks, so the leaf level of the tree is always 3 after LoadBRK.
+void WriteBRK ( std::string fname )
+{
+	std::vector<Vector3DF> pnts = MakePoints ( 0.25f, 32*g_scale, 4 );
+	std::vector<Vector3DI> bricks = MakeBricks ( pnts, 8 );
+	Vector3DI bres ( 8, 8, 8 );
+	std::vector<float> data ( 8*8*8 );
+
+	FILE* fp = fopen ( fname.c_str(), "wb" );
+	if ( fp == 0x0 ) { printf ( "ERROR: Unable to write %s\n", fname.c_str() ); exit (-1); }
+	int brkcnt = (int) bricks.size();
+	fwrite ( &brkcnt, sizeof(int), 1, fp );
+	for (int n=0; n < brkcnt; n++ ) {
+		Vector3DI bndx = bricks[n];
+		Vector3DF bmin = bndx;
+		Vector3DF bmax = bmin + Vector3DF(8,8,8);
+		for (int i=0; i < 512; i++ ) data[i] = benchRandF ();
+		fwrite ( &bndx, sizeof(Vector3DI), 1, fp );
+		fwrite ( &bmin, sizeof(Vector3DF), 1, fp );
+		fwrite ( &bmax, sizeof(Vector3DF), 1, fp );
+		fwrite ( &bres, sizeof(Vector3DI), 1, fp );
+		fwrite ( &data[0], sizeof(float), 512, fp );
+	}
+	fclose ( fp );
+}
+
+void BenchBRK ( int* cfg, std::string cfgstr )
+{
+	std::string fn = benchFile ( "gvdb_bench.brk" );
+	WriteBRK ( fn );
+	uint64 sz = benchFileSize ( fn );
+	VolumeGVDB* v = 0x0;
+	RunBench ( "load_brk", cfgstr, 0, sz,
+		[&] () { v = NewVolume ( cfg ); for (int l=0; l < 4; l++ ) v->SetVDBConfig ( l, cfg[l] ); },
+		[&] () { v->LoadBRK ( fn ); },
+		[&] () { uint64 c = v->getNumNodes(0); delete v; return c; } );
+	remove ( fn.c_str() );
+}
+
+// Sphere with 'seg' x 2*'seg' quads, written with normals (f v//n)
+void WriteOBJ ( std::string fname, int seg )
+{
+	FILE* fp = fopen ( fname.c_str(), "wt" );
+	if ( fp == 0x0 ) { printf ( "ERROR: Unable to write %s\n", fname.c_str() ); exit (-1); }
+	float r = 100.0f;
+	for (int i=0; i <= seg; i++ ) {
+		float a = 3.141592f * i / seg;
+		for (int j=0; j < 2*seg; j++ ) {
+			float b = 3.141592f * j / seg;
+			Vector3DF n ( sin(a)*cos(b), cos(a), sin(a)*sin(b) );
+			fprintf ( fp, "v %f %f %f\nvn %f %f %f\n", n.x*r, n.y*r, n.z*r, n.x, n.y, n.z );
+		}
+	}
+	for (int i=0; i < seg; i++ ) {
+		for (int j=0; j < 2*seg; j++ ) {
+			int a = i*2*seg + j + 1, b = i*2*seg + (j+1) % (2*seg) + 1;
+			int c = a + 2*seg, d = b + 2*seg;
+			fprintf ( fp, "f %d//%d %d//%d %d//%d\nf %d//%d %d//%d %d//%d\n", a,a, c,c, b,b, b,b, c,c, d,d );
+		}
+	}
+	fclose ( fp );
+}
+
+void BenchOBJ ( std::string name, std::string fname )
+{
+	uint64 sz = benchFileSize ( fname );
+	if ( sz == 0 ) { printf ( "  %-24s skipped, cannot open %s\n", name.c_str(), fname.c_str() ); return; }
+	char fn[1024];
+	strncpy ( fn, fname.c_str(), sizeof(fn)-1 );
+	fn[sizeof(fn)-1] = '\0';
+	Model* m = 0x0;
+	uint64 tris = 0;
+	RunBench ( name, "-", 0, sz,
+		[&] () { m = new Model; },
+		[&] () { OBJReader obj; obj.LoadFile ( m, fn, 0x0, 0 ); },
+		[&] () { tris = m->getNumElem(); delete m; return uint64(0); } );
+	g_results.back().items = tris;
+}
+
+//-------------------------------------------------------------- Output
+
+bool SaveJSON ( std::string fname )
+{
+	FILE* fp = fopen ( fname.c_str(), "wt" );
+	if ( fp == 0x0 ) return false;
+	fprintf ( fp, "{\n  \"repeats\": %d, \"scale\": %d, \"threads\": %d,\n  \"results\": [\n", g_repeats, g_scale, getHostThreads(g_threads) );
+	for (size_t n=0; n < g_results.size(); n++ ) {
+		BenchResult& r = g_results[n];
+		std::vector<double> s = r.ms;
+		std::sort ( s.begin(), s.end() );
+		double mean = 0;
+		for (size_t i=0; i < s.size(); i++ ) mean += s[i];
+		mean /= s.size();
+		fprintf ( fp, "    { \"name\": \"%s\", \"config\": \"%s\", \"min_ms\": %.4f, \"median_ms\": %.4f, \"mean_ms\": %.4f, \"max_ms\": %.4f,", 
+			r.name.c_str(), r.config.c_str(), s[0], s[s.size()/2], mean, s.back() );
+		fprintf ( fp, " \"items\": %llu, \"bytes\": %llu, \"nodes\": %llu, \"items_per_sec\": %.1f, \"mb_per_sec\": %.2f, \"runs_ms\": [",
+			(unsigned long long) r.items, (unsigned long long) r.bytes, (unsigned long long) r.nodes, 
+			r.items * 1000.0 / s[0], r.bytes / (s[0] * 1000.0) );
+		for (size_t i=0; i < r.ms.size(); i++ ) fprintf ( fp, "%s%.4f", (i==0) ? "" : ", ", r.ms[i] );
+		fprintf ( fp, "] }%s\n", (n+1 < g_results.size()) ? "," : "" );
+	}
+	fprintf ( fp, "  ]\n}\n" );
+	fclose ( fp );
+	return true;
+}
+
+bool ParseConfig ( const char* str, int* cfg )
+{
+	return sscanf ( str, "%d,%d,%d,%d,%d", cfg, cfg+1, cfg+2, cfg+3, cfg+4 ) == 5;
+}
+
+int main ( int argc, char** argv )
+{
+	std::string outfile = "gvdb_bench.json";
+	std::string model;
+	std::vector<std::string> configs;
+
+	for (int n=1; n < argc; n++ ) {
+		std::string arg = argv[n];
+		bool bVal = ( n+1 < argc );
+		if ( arg == "-o" && bVal )			outfile = argv[++n];
+		else if ( arg == "-c" && bVal )		configs.push_back ( argv[++n] );
+		else if ( arg == "-r" && bVal )		g_repeats = std::max ( 1, atoi ( argv[++n] ) );
+		else if ( arg == "-s" && bVal )		g_scale = std::max ( 1, atoi ( argv[++n] ) );
+		else if ( arg == "-t" && bVal )		g_threads = atoi ( argv[++n] );
+		else if ( arg == "-d" && bVal )		g_tmpdir = argv[++n];
+		else if ( arg == "-m" && bVal )		model = argv[++n];
+		else {
+			printf ( "Usage: gvdb_bench [-o results.json] [-c 3,3,3,3,3]... [-r repeats] [-s scale] [-t threads] [-d tmpdir] [-m model.obj]\n" );
+			return 1;
+		}
+	}
+	if ( configs.size() == 0 ) {
+		configs.push_back ( "3,3,3,3,3" );
+		configs.push_back ( "3,3,4,4,3" );
+	}
+	printf ( "GVDB Benchmarks. repeats: %d, scale: %d, threads: %d\n", g_repeats, g_scale, getHostThreads(g_threads) );
+
+	for (size_t c=0; c < configs.size(); c++ ) {
+		int cfg[5];
+		if ( !ParseConfig ( configs[c].c_str(), cfg ) ) {
+			printf ( "ERROR: Config '%s' is not of the form r4,r3,r2,r1,r0\n", configs[c].c_str() );
+			return 1;
+		}
+		printf ( "Config <%s>\n", configs[c].c_str() );
+		BenchActivate ( cfg, configs[c] );
+		BenchInsertChild ( cfg, configs[c] );
+
+		VolumeGVDB* src = MakeVolume ( cfg );
+		BenchAtlas ( src, configs[c] );
+		BenchVBX ( src, cfg, configs[c] );
+		delete src;
+
+		BenchLayout ( cfg, configs[c] );
+
+		BenchBRK ( cfg, configs[c] );
+	}
+
+	printf ( "Model parsing\n" );
+	std::string fn = benchFile ( "gvdb_bench.obj" );
+	WriteOBJ ( fn, 128*g_scale );
+	BenchOBJ ( "obj_parse", fn );
+	remove ( fn.c_str() );
+#ifdef ASSET_PATH
+	if ( model.empty() ) model = std::string ( ASSET_PATH ) + "lucy.obj";
+#endif
+	if ( !model.empty() ) BenchOBJ ( "obj_parse_model", model );
+
+	if ( !SaveJSON ( outfile ) ) {
+		printf ( "ERROR: Unable to write %s\n", outfile.c_str() );
+		return 1;
+	}
+	printf ( "Results written to %s\n", outfile.c_str() );
+	return g_failed ? 1 : 0;
+}
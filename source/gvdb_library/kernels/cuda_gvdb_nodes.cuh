@@ -34,8 +34,8 @@
 struct ALIGN(16) VDBNode {
 	uchar		mLev;			// Level		Max = 255			1 byte
 	uchar		mFlags;
-	uchar		mPriority;
-	uchar		pad;
+	uchar		mLogRes;		// log2 of node res (host mask size)
+	uchar		mMaskLog;		// log2 of mask words (prefix counts)
 	int3		mPos;			// Pos			Max = +/- 4 mil (linear space/range)	12 bytes
 	int3		mValue;			// Value		Max = +8 mil		4 bytes
 	float3		mVRange;
@@ -73,6 +73,11 @@ struct ALIGN(16) VDBInfo {
 	float3		bmax;
 	float3		thresh;
 	float4*		transfer;
+	int3*		brick_list;		// active bricks (brick origin in atlas)
+	int			brick_cnt;
+	uchar*		brick_req;		// paged atlas: per-leaf flags, 1 = requested, 2 = used (0x0 if not paged)
+	float3		range_skip;		// skip nodes with value range outside x..y, when z != 0
+	int			tile_offs;		// offset of the tile mask in level 1 nodes, 0 if no tiles
 };
 
 __device__ float								cdebug[256]; 
@@ -94,17 +99,22 @@ __device__ float								cxform[16];
 #endif
 
 
+#define NODE_PREFIX		0x40		// prefix counts follow the mask (see gvdb_node.h)
+#define NODE_RANGE		0x20		// mVRange is valid (see UpdateRange)
+
 inline __device__ uint64 numBitsOn ( uint64 v)
 {
-	v = v - ((v >> 1) & uint64(0x5555555555555555LLU));
-	v = (v & uint64(0x3333333333333333LLU)) + ((v >> 2) & uint64(0x3333333333333333LLU));
-	return ((v + (v >> 4) & uint64(0xF0F0F0F0F0F0F0FLLU)) * uint64(0x101010101010101LLU)) >> 56;
+	return __popcll ( v );
 }
 inline __device__ int countOn ( VDBNode* node, int n )
 {
 	uint64 sum = 0;
 	uint64* w1 = (uint64*) (&node->mMask);
 	uint64* we = w1 + (n >> 6);
+	if ( node->mFlags & NODE_PREFIX ) {
+		sum = ((uint*) (w1 + (uint64(1) << node->mMaskLog)))[ n >> 6 ];		// cached count of earlier words
+		w1 = we;
+	}
 	for (; w1 != we; ) sum += numBitsOn (*w1++ );
 	uint64 w2 = *w1;
 	w2 = *w1 & (( uint64(1) << (n & 63))-1);
@@ -116,6 +126,29 @@ inline __device__ bool isBitOn ( VDBNode* node, int b )
 	return ( (&node->mMask)[ b >> 6 ] & (uint64(1) << (b & 63))) != 0;
 }
 
+// node value range lies outside the span that can reach the image
+inline __device__ bool isRangeSkip ( VDBNode* node )
+{
+	return gvdb.range_skip.z != 0 && (node->mFlags & NODE_RANGE) && ( node->mVRange.y < gvdb.range_skip.x || node->mVRange.x > gvdb.range_skip.y );
+}
+
+// tile value of slot b of a level 1 node, the child bit must be off (see VolumeGVDB::isTile)
+inline __device__ bool getTile ( VDBNode* node, int b, float& v )
+{
+	if ( gvdb.tile_offs == 0 ) return false;
+	uint64* tmask = (uint64*) ((char*) node + gvdb.tile_offs);
+	if ( (tmask[ b >> 6 ] & (uint64(1) << (b & 63))) == 0 ) return false;
+	int mbytes = gvdb.res[1]*gvdb.res[1]*gvdb.res[1] / 8;
+	v = ((float*) ((char*) tmask + (mbytes < 8 ? 8 : mbytes)))[ b ];
+	return true;
+}
+
+// tile value lies outside the span that can reach the image
+inline __device__ bool isValueSkip ( float v )
+{
+	return gvdb.range_skip.z != 0 && ( v < gvdb.range_skip.x || v > gvdb.range_skip.y );
+}
+
 inline __device__ VDBAtlasNode* getAtlasNode ( float3 brickpos )
 {
 	int3 i = make_int3(brickpos.x/gvdb.brick_res, brickpos.y/gvdb.brick_res, brickpos.z/gvdb.brick_res);		// brick index
@@ -228,3 +261,24 @@ inline __device__ VDBNode* getNodeAtPoint ( float3 pos, float3* offs, float3* vm
 	*offs = make_float3( node->mValue );
 	return node;
 }
+
+// tile value at world point, false in a leaf or empty space (see VolumeGVDB::getTileAtPoint)
+inline __device__ bool getTileAtPoint ( float3 pos, float& v )
+{
+	if ( gvdb.tile_offs == 0 ) return false;
+	float3 vmin, vmax;
+	int3 p;
+	int b;
+	int lev = gvdb.top_lev;
+	VDBNode* node = getNode ( lev, 0, &vmin );
+	while ( lev > 0 ) {
+		vmax = vmin + make_float3(gvdb.noderange[lev]) * gvdb.voxelsize; 
+		if ( pos.x < vmin.x || pos.y < vmin.y || pos.z < vmin.z || pos.x >= vmax.x || pos.y >= vmax.y || pos.z >= vmax.z ) return false;
+		p = make_int3 ( (pos-vmin)/gvdb.vdel[lev] );
+		b = (( (int(p.z) << gvdb.dim[lev]) + int(p.y)) << gvdb.dim[lev]) + int(p.x);
+		if ( !isBitOn ( node, b ) ) return lev == 1 && getTile ( node, b, v );
+		node = getNode ( lev-1, getChild ( node, b ), &vmin );
+		lev--;
+	}
+	return false;
+}
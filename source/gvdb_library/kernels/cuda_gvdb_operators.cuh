@@ -47,7 +47,9 @@ extern "C" __global__ void gvdbUpdateApronF ( int axis, int3 res, uchar chan, in
 	VDBNode* node = getNodeAtPoint ( wpos, &offs, &vmin, &vdel, &nid );		// Evaluate at world position
 	offs += (wpos-vmin)/vdel;
 
-	float v = (node==0x0) ? 0.0 : tex3D<float> ( volIn[chan], offs.x, offs.y, offs.z );		// Sample at world point
+	float v = 0.0;
+	if ( node != 0x0 )	v = tex3D<float> ( volIn[chan], offs.x, offs.y, offs.z );		// Sample at world point
+	else if ( chan == 0 ) getTileAtPoint ( wpos, v );		// tile values belong to channel 0 (see PruneBackground)
 
 	surf3Dwrite ( v, volOut[chan], vox.x*sizeof(float), vox.y, vox.z );	// Write to apron voxel
 }
@@ -187,10 +189,37 @@ extern "C" __global__ void gvdbUpdateApronC4 ( int axis, int3 res, uchar chan, i
 	uint3 vox = blockIdx * make_uint3(blockDim.x, blockDim.y, blockDim.z) + threadIdx + make_uint3(1,1,1);		\
 	if ( vox.x >= res.x|| vox.y >= res.y || vox.z >= res.z ) return;
 
+// Active brick operators
+// Launched with grid ( brick_cnt, sub*sub, sub ), block ( 8, 8, 8 ), where sub covers a brick in 8^3 blocks.
+// blockIdx.x selects the brick from gvdb.brick_list, so unused atlas space is not visited.
+#define GVDB_BRICK_LOC(lo,hi)																	\
+	int bsub = (gvdb.brick_res + 7) >> 3;														\
+	int3 bloc = make_int3( (blockIdx.y % bsub)*8 + threadIdx.x, (blockIdx.y / bsub)*8 + threadIdx.y, blockIdx.z*8 + threadIdx.z ) + make_int3(lo);	\
+	if ( blockIdx.x >= gvdb.brick_cnt || bloc.x >= hi || bloc.y >= hi || bloc.z >= hi ) return;	\
+	uint3 vox = make_uint3( gvdb.brick_list[blockIdx.x] + bloc );
+
+#define GVDB_BRICK_VOX			GVDB_BRICK_LOC( 0, gvdb.res[0] )								// brick interior
+#define GVDB_BRICK_VOX_APRON	GVDB_BRICK_LOC( -gvdb.atlas_apron, gvdb.res[0]+gvdb.atlas_apron )	// interior and apron
+
+// Copy brick with one voxel border into shared memory
+#define GVDB_BRICK_SMEM(T)																		\
+	__shared__ T svox[10][10][10]; 																\
+	GVDB_BRICK_VOX																				\
+	uint3 ndx = threadIdx + make_uint3(1,1,1);													\
+	int bmax = gvdb.res[0]-1;																	\
+	svox[ndx.x][ndx.y][ndx.z] = tex3D<T> ( volIn[chan], vox.x, vox.y, vox.z );					\
+	if ( threadIdx.x==0 )					svox[0][ndx.y][ndx.z] = tex3D<T> ( volIn[chan], vox.x-1, vox.y, vox.z );		\
+	if ( threadIdx.x==7 || bloc.x==bmax )	svox[ndx.x+1][ndx.y][ndx.z] = tex3D<T> ( volIn[chan], vox.x+1, vox.y, vox.z );	\
+	if ( threadIdx.y==0 )					svox[ndx.x][0][ndx.z] = tex3D<T> ( volIn[chan], vox.x, vox.y-1, vox.z );		\
+	if ( threadIdx.y==7 || bloc.y==bmax )	svox[ndx.x][ndx.y+1][ndx.z] = tex3D<T> ( volIn[chan], vox.x, vox.y+1, vox.z );	\
+	if ( threadIdx.z==0 )					svox[ndx.x][ndx.y][0] = tex3D<T> ( volIn[chan], vox.x, vox.y, vox.z-1 );		\
+	if ( threadIdx.z==7 || bloc.z==bmax )	svox[ndx.x][ndx.y][ndx.z+1] = tex3D<T> ( volIn[chan], vox.x, vox.y, vox.z+1 );	\
+	__syncthreads ();
+
 
 extern "C" __global__ void gvdbOpGrow ( int3 res, uchar chan, float p1, float p2, float p3 )
 {
-	GVDB_COPY_SMEM_F
+	GVDB_BRICK_SMEM(float)
 	
 	/*float nl;	
 	float3 n;
@@ -210,7 +239,7 @@ extern "C" __global__ void gvdbOpGrow ( int3 res, uchar chan, float p1, float p2
 
 extern "C" __global__ void gvdbOpCut ( int3 res, uchar chan, float p1, float p2, float p3 )
 {
-	GVDB_COPY_SMEM_F			
+	GVDB_BRICK_SMEM(float)			
 
 	// Determine block and index position	
 	float3 wpos;
@@ -260,19 +289,19 @@ extern "C" __global__ void gvdbResample ( int3 res, uchar chan, int3 srcres, flo
 
 extern "C" __global__ void gvdbOpFillF  ( int3 res, uchar chan, float p1, float p2, float p3 )
 {
-	GVDB_VOX	
+	GVDB_BRICK_VOX_APRON	
 
 	surf3Dwrite ( p1, volOut[chan], vox.x*sizeof(float), vox.y, vox.z );
 }
 extern "C" __global__ void gvdbOpFillC4 ( int3 res, uchar chan, float p1, float p2, float p3 )
 {
-	GVDB_VOX
+	GVDB_BRICK_VOX_APRON
 
 	surf3Dwrite ( make_uchar4(p1*255,p2*255,p3*255,255), volOut[chan], vox.x*sizeof(uchar4), vox.y, vox.z );
 }
 extern "C" __global__ void gvdbOpFillC ( int3 res, uchar chan, float p1, float p2, float p3 )
 {
-	GVDB_VOX	
+	GVDB_BRICK_VOX_APRON	
 
 	uchar c = p1;
 	surf3Dwrite ( c, volOut[chan], vox.x*sizeof(uchar), vox.y, vox.z );
@@ -280,7 +309,7 @@ extern "C" __global__ void gvdbOpFillC ( int3 res, uchar chan, float p1, float p
 
 extern "C" __global__ void gvdbOpSmooth ( int3 res, uchar chan, float p1, float p2, float p3 )
 {
-	GVDB_COPY_SMEM_F
+	GVDB_BRICK_SMEM(float)
 
 	//-- smooth
 	float v = p1 * svox[ndx.x][ndx.y][ndx.z];
@@ -297,7 +326,7 @@ extern "C" __global__ void gvdbOpSmooth ( int3 res, uchar chan, float p1, float
 
 extern "C" __global__ void gvdbOpClrExpand ( int3 res, uchar chan, float p1, float p2, float p3 )
 {
-	GVDB_COPY_SMEM_UC4
+	GVDB_BRICK_SMEM(uchar4)
 
 	int3 c, cs;
 	int cp;
@@ -316,7 +345,7 @@ extern "C" __global__ void gvdbOpClrExpand ( int3 res, uchar chan, float p1, flo
 
 extern "C" __global__ void gvdbOpExpandC ( int3 res, uchar chan, float p1, float p2, float p3 )
 {
-	GVDB_COPY_SMEM_UC
+	GVDB_BRICK_SMEM(uchar)
 
 	uchar c = 0;
 	c = (svox[ndx.x-1][ndx.y][ndx.z] == (uchar) p1 ) ? 1 : c;
@@ -336,7 +365,7 @@ extern "C" __global__ void gvdbOpExpandC ( int3 res, uchar chan, float p1, float
 
 extern "C" __global__ void gvdbOpNoise ( int3 res, uchar chan, float p1, float p2, float p3 )
 {
-	GVDB_COPY_SMEM_F
+	GVDB_BRICK_SMEM(float)
 
 	//-- noise
 	float v = svox[ndx.x][ndx.y][ndx.z];
@@ -346,6 +375,40 @@ extern "C" __global__ void gvdbOpNoise ( int3 res, uchar chan, float p1, float p
 
 }
 
+// Value range of listed bricks (see UpdateRange)
+// Launched with grid ( cnt ), block ( 8, 8, 8 ). Each block reduces one brick in shared memory:
+// min and max over the whole brick including apron, mean over the interior.
+extern "C" __global__ void gvdbComputeRange ( int cnt, int3* bricks, uchar chan, int bres, int apron, bool bFloat, float3* out )
+{
+	__shared__ float smin[512], smax[512], ssum[512];
+	if ( blockIdx.x >= cnt ) return;
+	int3 o = bricks[blockIdx.x];
+	int tid = (threadIdx.z*blockDim.y + threadIdx.y)*blockDim.x + threadIdx.x;
+	int lo = apron, hi = bres - apron;
+	float vmin = 1.0e20, vmax = -1.0e20, sum = 0, v;
+
+	for (int z = threadIdx.z; z < bres; z += blockDim.z )
+		for (int y = threadIdx.y; y < bres; y += blockDim.y )
+			for (int x = threadIdx.x; x < bres; x += blockDim.x ) {
+				v = bFloat ? surf3Dread<float> ( volOut[chan], (o.x+x)*sizeof(float), o.y+y, o.z+z ) : float( surf3Dread<uchar> ( volOut[chan], o.x+x, o.y+y, o.z+z ) );
+				vmin = fminf ( vmin, v );
+				vmax = fmaxf ( vmax, v );
+				if ( x >= lo && x < hi && y >= lo && y < hi && z >= lo && z < hi ) sum += v;
+			}
+	smin[tid] = vmin; smax[tid] = vmax; ssum[tid] = sum;
+	__syncthreads ();
+
+	for (int n = 256; n > 0; n >>= 1 ) {
+		if ( tid < n ) {
+			smin[tid] = fminf ( smin[tid], smin[tid+n] );
+			smax[tid] = fmaxf ( smax[tid], smax[tid+n] );
+			ssum[tid] += ssum[tid+n];
+		}
+		__syncthreads ();
+	}
+	if ( tid == 0 ) out[blockIdx.x] = make_float3 ( smin[0], smax[0], ssum[0] / float((hi-lo)*(hi-lo)*(hi-lo)) );
+}
+
 
 /*__device__ bool implicit_func ( int res, uint3 vox )
 {
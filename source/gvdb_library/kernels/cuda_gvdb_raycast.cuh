@@ -632,6 +632,46 @@ __device__ void rayDeepBrick ( char shade, int nodeid, float3 t, float3 pos, flo
 
 
 
+// Tile - Trace a constant tile of a level 1 node (see VolumeGVDB::PruneBackground)
+// Brick functions sample the atlas, so tiles are traced here with the rules of each brick function
+// for a constant value. 'tmin' is the tile corner in world space, t.x and t.y are entry and exit.
+__device__ void rayTile ( float v, float3 tmin, float3 t, float3 pos, float3 dir, float3& hit, float3& norm, float4& clr, gvdbBrickFunc_t brickFunc )
+{
+	float3 tsize = gvdb.vdel[1];
+	if ( brickFunc == rayDeepBrick ) {
+		float4 val = transfer ( v );
+		if ( val.w < SCN_MINVAL ) return;							// empty for the transfer function
+		if ( hit.z == NOHIT ) hit = make_float3 ( t.x, 0, 0 );		// front hit
+		float dt = SCN_PSTEP * gvdb.voxelsize.x;					// world distance per sample
+		float ext = exp ( SCN_EXTINCT * val.w * SCN_PSTEP );
+		for (int iter=0; t.x < t.y && clr.w > SCN_ALPHACUT && iter < MAX_ITER; iter++ ) {
+			clr.x += val.x * clr.w * (1 - ext) * SCN_ALBEDO;
+			clr.y += val.y * clr.w * (1 - ext) * SCN_ALBEDO;
+			clr.z += val.z * clr.w * (1 - ext) * SCN_ALBEDO;
+			clr.w *= ext;
+			t.x += dt;
+		}
+		hit.y = t.x;
+		clr = make_float4(fmin(clr.x, 1.f), fmin(clr.y, 1.f), fmin(clr.z, 1.f), fmax(clr.w, 0.f));
+		return;
+	}
+	if ( brickFunc == rayEmptySkipBrick ) {
+		hit = pos + t.x*dir;
+		return;
+	}
+	bool bIn;
+	if ( brickFunc == rayLevelSetBrick )			bIn = ( v < 0 );					// inside, surface at the tile face
+	else if ( brickFunc == raySurfaceVoxelBrick )	bIn = ( v > gvdb.thresh.x );
+	else											bIn = ( v >= gvdb.thresh.x );
+	if ( !bIn ) return;
+	t = rayBoxIntersect ( pos, dir, tmin, tmin + tsize );
+	if ( t.z == NOHIT ) return;
+	hit = getRayPoint ( pos, dir, t.x );
+	norm.x = EPSTEST(hit.x, tmin.x + tsize.x, VOXEL_EPS) ? 1 : (EPSTEST(hit.x, tmin.x, VOXEL_EPS) ? -1 : 0);
+	norm.y = EPSTEST(hit.y, tmin.y + tsize.y, VOXEL_EPS) ? 1 : (EPSTEST(hit.y, tmin.y, VOXEL_EPS) ? -1 : 0);
+	norm.z = EPSTEST(hit.z, tmin.z + tsize.z, VOXEL_EPS) ? 1 : (EPSTEST(hit.z, tmin.z, VOXEL_EPS) ? -1 : 0);
+}
+
 //----------------------------- MASTER RAYCAST FUNCTION
 // 1. Performs empty skipping of GVDB hiearchy
 // 2. Checks input depth buffer [if set]
@@ -643,6 +683,7 @@ __device__ void rayCast ( char shade, int lev, int rootid, float3 pos, float3 di
 	int		nodeid[MAXLEV];					// level variables
 	float	tMax[MAXLEV];
 	int		b;
+	float	tval;
 
 	// GVDB - Iterative Hierarchical 3DDA on GPU
 	float3 vmin;	
@@ -675,12 +716,23 @@ __device__ void rayCast ( char shade, int lev, int rootid, float3 pos, float3 di
 		b = (((int(p.z) << gvdb.dim[lev]) + int(p.y)) << gvdb.dim[lev]) + int(p.x);
 		if ( isBitOn ( node, b ) ) {							// check vdb bitmask for voxel occupancy						
 			if ( lev == 1 ) {									// enter brick function..
-				nodeid[0] = getChild ( node, b ); t.x += EPS;
-				// gvdbBrickFunc_t ( char shade, int nodeid, float3 t, float3 pos, float3 dir, float3& pstep, float3& hit, float3& norm, float4& clr );
-				(*brickFunc) ( shade, nodeid[0], t, pos, dir, pStep, hit, norm, clr );				
-				if ( clr.w <= 0) {clr.w = 0; return; }			// deep termination
-				if ( hit.x != NOHIT && shade != SHADE_VOLUME ) return;		// surface termination				
-				STEP_DDA										// leaf node empty, step DDA
+				nodeid[0] = getChild ( node, b );
+				VDBNode* leaf = (VDBNode*) (gvdb.nodelist[0] + nodeid[0]*gvdb.nodewid[0]);
+				bool bRes = !isRangeSkip ( leaf );				// brick value range not visible, skip
+				if ( bRes && gvdb.brick_req != 0x0 ) {			// paged atlas, request missing bricks (see UpdateBrickCache)
+					bRes = leaf->mValue.x != -1;
+					gvdb.brick_req[ nodeid[0] ] = bRes ? 2 : 1;
+				}
+				if ( bRes ) {
+					t.x += EPS;
+					// gvdbBrickFunc_t ( char shade, int nodeid, float3 t, float3 pos, float3 dir, float3& pstep, float3& hit, float3& norm, float4& clr );
+					(*brickFunc) ( shade, nodeid[0], t, pos, dir, pStep, hit, norm, clr );				
+					if ( clr.w <= 0) {clr.w = 0; return; }			// deep termination
+					if ( hit.x != NOHIT && shade != SHADE_VOLUME ) return;		// surface termination				
+				}
+				STEP_DDA										// leaf node empty, skipped or not resident, step DDA
+			} else if ( isRangeSkip ( (VDBNode*) (gvdb.nodelist[lev-1] + getChild ( node, b )*gvdb.nodewid[lev-1]) ) ) {
+				STEP_DDA										// sub-tree value range not visible, step DDA
 			} else {				
 				lev--;											// step down tree
 				nodeid[lev]	= getChild ( node, b );				// get child 
@@ -689,6 +741,13 @@ __device__ void rayCast ( char shade, int lev, int rootid, float3 pos, float3 di
 				tMax[lev] = t.y - EPS;							// t.x = entry point, t.y = exit point							
 				PREPARE_DDA										// start dda at next level down
 			}
+		} else if ( lev == 1 && p.x < gvdb.res[1] && p.y < gvdb.res[1] && p.z < gvdb.res[1] && getTile ( node, b, tval ) ) {
+			if ( !isValueSkip ( tval ) ) {						// tile value not visible, skip
+				rayTile ( tval, vmin + p*gvdb.vdel[1], t, pos, dir, hit, norm, clr, brickFunc );
+				if ( clr.w <= 0) {clr.w = 0; return; }			// deep termination
+				if ( hit.x != NOHIT && shade != SHADE_VOLUME ) return;		// surface termination
+			}
+			STEP_DDA
 		} else {			
 			STEP_DDA											// empty voxel, step DDA
 		}
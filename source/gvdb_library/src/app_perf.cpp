@@ -78,6 +78,10 @@ features for CPU and GPU profiling:
 #include <cstring>
 #include <fcntl.h>	
 #include <cstdlib>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
 
 extern void				gprintf(const char * fmt, ...);
 #define PERF_PRINTF		gprintf
@@ -93,73 +97,313 @@ bool				g_perfOn = false;			// Is perf on? DLL was found. Otherwise no perf.
 	char*				g_nvtxPop = 0x0;
 #endif
 
-int					g_perfLevel = 0;			// Current level of push/pop
-sjtime				g_perfStack[1024];			// Stack of recorded CPU timings
-char				g_perfMsg[1024][256];			// Stack of recorded messages
 FILE*				g_perfCons = 0x0;			// On-screen console to output CPU timing
 int					g_perfPrintLev = 2;			// Maximum level to print. Set with PERF_SET
 bool				g_perfCPU = true;			// Do CPU timing? Set with PERF_SET
 bool				g_perfGPU = true;			// Do GPU timing? Set with PERF_SET
 bool				g_perfConsOut = true;
+bool				g_perfTrace = false;		// Record trace events? Set with PERF_TRACE
+sjtime				g_perfBase = 0;				// Time of PERF_INIT or PERF_CLEAR (trace origin)
 std::string			g_perfFName = "";			// File name for CPU output. Set with PERF_SET
 FILE*				g_perfFile = 0x0;			// File handle for output
 
-/*void PERF_PRINTF ( char* format, ... )
+//---------------- PER-THREAD PROFILER
+// Each thread keeps its own marker stack and statistics, so markers may be used 
+// from any thread. Regions are identified by their path of nested markers,
+// and aggregated over all calls. Reports merge the regions of all threads.
+
+#define PERF_HIST			288					// histogram buckets, 8 per octave from 128 ns
+#define PERF_MAX_EVENTS		(1 << 20)			// trace events per thread
+
+struct PerfRegion {
+	std::string		path;						// nested marker names, separated by '/'
+	std::string		name;
+	int				depth;
+	sjtime			count, total, tmin, tmax;	// times in ns
+	unsigned int	hist[PERF_HIST];
+};
+struct PerfEvent {
+	int				region;
+	sjtime			start, dur;
+};
+struct PerfThread {
+	int							id;
+	bool						bFree;			// thread has exited, record may be reused
+	std::mutex					lock;			// guards regions and events while reporting
+	std::vector<int>			stack;			// open regions
+	std::vector<sjtime>			start;
+	std::vector<PerfRegion>		regions;
+	std::map<std::string, int>	lookup;			// path to region
+	std::vector<PerfEvent>		events;
+	std::vector<sjtime>			timers;			// PERF_START / PERF_STOP
+};
+
+std::mutex					g_perfLock;			// guards thread list
+std::vector<PerfThread*>	g_perfThreads;		// kept after threads exit, for reports
+
+// Records outlive their thread, and are handed to the next new thread.
+// Host loops run on long-lived pool workers (WorkerPool), which keep their
+// record until the pool stops or resizes. Records are reused only when a thread exits.
+struct PerfThreadRef {
+	PerfThread* pt;
+	PerfThreadRef () : pt(0x0) {}
+	~PerfThreadRef ()
+	{
+		if ( pt == 0x0 ) return;
+		std::lock_guard<std::mutex> guard ( g_perfLock );
+		std::lock_guard<std::mutex> tguard ( pt->lock );
+		pt->stack.clear ();
+		pt->start.clear ();
+		pt->timers.clear ();
+		pt->bFree = true;
+	}
+};
+thread_local PerfThreadRef	t_perf;
+
+PerfThread* getPerfThread ()
+{
+	if ( t_perf.pt == 0x0 ) {
+		std::lock_guard<std::mutex> guard ( g_perfLock );
+		for (size_t n=0; n < g_perfThreads.size() && t_perf.pt == 0x0; n++ )
+			if ( g_perfThreads[n]->bFree ) t_perf.pt = g_perfThreads[n];
+		if ( t_perf.pt == 0x0 ) {
+			t_perf.pt = new PerfThread;
+			t_perf.pt->id = (int) g_perfThreads.size();
+			g_perfThreads.push_back ( t_perf.pt );
+		}
+		t_perf.pt->bFree = false;
+	}
+	return t_perf.pt;
+}
+
+int getPerfBucket ( sjtime ns )
+{
+	if ( ns < 128 ) return 0;
+	int e = 7;
+	while ( e < 62 && (ns >> (e+1)) != 0 ) e++;
+	int b = (e-7)*8 + int((ns >> (e-3)) & 7) + 1;
+	return ( b < PERF_HIST ) ? b : PERF_HIST-1;
+}
+sjtime getPerfBucketTime ( int b )
 {
-	if ( g_perfCons == 0x0 ) return;
-	va_list argptr;
-	va_start (argptr, format);				
-	vfprintf ( g_perfCons, format, argptr);			
-	va_end (argptr);			
-	fflush ( g_perfCons );
-}*/
+	if ( b == 0 ) return 64;
+	int e = (b-1)/8 + 7, sub = (b-1) % 8;
+	return ( (sjtime(8 + sub) << 1) + 1 ) << (e-4);		// bucket midpoint
+}
 
 void PERF_START ()
 {
-	g_perfStack [ g_perfLevel ] = TimeX::GetSystemNSec ();
-	g_perfLevel++;
+	getPerfThread()->timers.push_back ( TimeX::GetSystemNSec () );
 }
 
 float PERF_STOP ()
 {
-	g_perfLevel--;
+	PerfThread* pt = getPerfThread();
+	if ( pt->timers.size() == 0 ) return 0;
 	sjtime curr = TimeX::GetSystemNSec ();
-	curr -= g_perfStack [ g_perfLevel ];
+	curr -= pt->timers.back ();
+	pt->timers.pop_back ();
 	return ((float) curr) / MSEC_SCALAR;
 }
 
 
 void PERF_PUSH ( const char* msg )
 {
-	if ( g_perfOn ) {
-		#ifdef USE_NVTX
-			if ( g_perfGPU ) (*g_nvtxPush) (msg);	
-		#endif
-		if ( g_perfCPU && g_perfLevel < g_perfPrintLev ) {
-			strncpy ( (char*) g_perfMsg[ g_perfLevel ], msg, 256 );
-			g_perfStack [ g_perfLevel ] = TimeX::GetSystemNSec ();				
-			if ( g_perfConsOut ) PERF_PRINTF ( "%*s%s\n", g_perfLevel <<1, "", msg );
-			if ( g_perfFile != 0x0 ) fprintf ( g_perfFile, "%*s%s\n", g_perfLevel <<1, "", msg );
-		}
-		g_perfLevel++;
+	if ( !g_perfOn ) return;
+	#ifdef USE_NVTX
+		if ( g_perfGPU ) (*g_nvtxPush) (msg);	
+	#endif
+	if ( !g_perfCPU ) return;
+
+	PerfThread* pt = getPerfThread();
+	int level = (int) pt->stack.size();
+	std::string path = ( level > 0 ) ? pt->regions[ pt->stack.back() ].path + "/" + msg : std::string(msg);
+	
+	std::lock_guard<std::mutex> guard ( pt->lock );
+	std::map<std::string, int>::iterator it = pt->lookup.find ( path );
+	int r;
+	if ( it == pt->lookup.end() ) {
+		r = (int) pt->regions.size();
+		pt->regions.push_back ( PerfRegion() );
+		PerfRegion& reg = pt->regions.back();
+		reg.path = path;
+		reg.name = msg;
+		reg.depth = level;
+		reg.count = 0; reg.total = 0; reg.tmin = 0; reg.tmax = 0;
+		memset ( reg.hist, 0, sizeof(reg.hist) );
+		pt->lookup[ path ] = r;
+	} else {
+		r = it->second;
 	}
+	if ( level < g_perfPrintLev ) {
+		if ( g_perfConsOut ) PERF_PRINTF ( "%*s%s\n", level <<1, "", msg );
+		if ( g_perfFile != 0x0 ) fprintf ( g_perfFile, "%*s%s\n", level <<1, "", msg );
+	}
+	pt->stack.push_back ( r );
+	pt->start.push_back ( TimeX::GetSystemNSec () );
 }
 float PERF_POP ()
 {
-	if ( g_perfOn ) {
-		#ifdef USE_NVTX
-			if ( g_perfGPU ) (*g_nvtxPop) ();
-		#endif
-		g_perfLevel--;
-		if ( g_perfCPU && g_perfLevel < g_perfPrintLev ) {
-			sjtime curr = TimeX::GetSystemNSec ();
-			curr -= g_perfStack [ g_perfLevel ];		
-			if ( g_perfConsOut ) PERF_PRINTF ( "%*s%s: %f ms\n", g_perfLevel <<1, "", g_perfMsg[g_perfLevel], ((float) curr)/MSEC_SCALAR );		
-			if ( g_perfFile != 0x0 ) fprintf ( g_perfFile, "%*s%s: %f ms\n", g_perfLevel <<1, "", g_perfMsg[g_perfLevel], ((float) curr)/MSEC_SCALAR );
-			return ((float) curr) / MSEC_SCALAR;
-		}		
-	}	
-	return 0;
+	if ( !g_perfOn ) return 0;
+	#ifdef USE_NVTX
+		if ( g_perfGPU ) (*g_nvtxPop) ();
+	#endif
+	if ( !g_perfCPU ) return 0;
+
+	PerfThread* pt = getPerfThread();
+	if ( pt->stack.size() == 0 ) return 0;			// unmatched pop (e.g. markers enabled inside a region)
+	sjtime curr = TimeX::GetSystemNSec ();
+	sjtime start = pt->start.back ();
+	int r = pt->stack.back ();
+	pt->stack.pop_back ();
+	pt->start.pop_back ();
+	curr -= start;
+
+	{
+		std::lock_guard<std::mutex> guard ( pt->lock );
+		PerfRegion& reg = pt->regions[r];
+		if ( reg.count == 0 || curr < reg.tmin ) reg.tmin = curr;
+		if ( curr > reg.tmax ) reg.tmax = curr;
+		reg.count++;
+		reg.total += curr;
+		reg.hist[ getPerfBucket ( curr ) ]++;
+		if ( g_perfTrace && pt->events.size() < PERF_MAX_EVENTS ) {
+			PerfEvent e;
+			e.region = r; e.start = start; e.dur = curr;
+			pt->events.push_back ( e );
+		}
+	}
+	int level = (int) pt->stack.size();
+	if ( level < g_perfPrintLev ) {
+		if ( g_perfConsOut ) PERF_PRINTF ( "%*s%s: %f ms\n", level <<1, "", pt->regions[r].name.c_str(), ((float) curr)/MSEC_SCALAR );		
+		if ( g_perfFile != 0x0 ) fprintf ( g_perfFile, "%*s%s: %f ms\n", level <<1, "", pt->regions[r].name.c_str(), ((float) curr)/MSEC_SCALAR );
+	}
+	return ((float) curr) / MSEC_SCALAR;
+}
+
+void PERF_TRACE ( bool on )
+{
+	g_perfTrace = on;
+}
+
+void PERF_CLEAR ()
+{
+	// Reset statistics and trace of all threads. Open markers are kept.
+	std::lock_guard<std::mutex> guard ( g_perfLock );
+	for (size_t n=0; n < g_perfThreads.size(); n++ ) {
+		PerfThread* pt = g_perfThreads[n];
+		std::lock_guard<std::mutex> tguard ( pt->lock );
+		for (size_t r=0; r < pt->regions.size(); r++ ) {
+			PerfRegion& reg = pt->regions[r];
+			reg.count = 0; reg.total = 0; reg.tmin = 0; reg.tmax = 0;
+			memset ( reg.hist, 0, sizeof(reg.hist) );
+		}
+		pt->events.clear ();
+	}
+	g_perfBase = TimeX::GetSystemNSec ();
+}
+
+// Merge regions of all threads
+void getPerfSummary ( std::vector<PerfRegion>& list )
+{
+	std::map<std::string, int> lookup;
+	std::lock_guard<std::mutex> guard ( g_perfLock );
+	for (size_t n=0; n < g_perfThreads.size(); n++ ) {
+		PerfThread* pt = g_perfThreads[n];
+		std::lock_guard<std::mutex> tguard ( pt->lock );
+		for (size_t r=0; r < pt->regions.size(); r++ ) {
+			PerfRegion& reg = pt->regions[r];
+			if ( reg.count == 0 ) continue;
+			std::map<std::string, int>::iterator it = lookup.find ( reg.path );
+			if ( it == lookup.end() ) {
+				lookup[ reg.path ] = (int) list.size();
+				list.push_back ( reg );
+				continue;
+			}
+			PerfRegion& dst = list[ it->second ];
+			dst.tmin = std::min ( dst.tmin, reg.tmin );
+			dst.tmax = std::max ( dst.tmax, reg.tmax );
+			dst.count += reg.count;
+			dst.total += reg.total;
+			for (int b=0; b < PERF_HIST; b++ ) dst.hist[b] += reg.hist[b];
+		}
+	}
+	// Sort by path, with separator first so children follow their parent
+	std::stable_sort ( list.begin(), list.end(), [] ( const PerfRegion& a, const PerfRegion& b ) { 
+		std::string pa = a.path, pb = b.path;
+		std::replace ( pa.begin(), pa.end(), '/', '\1' );
+		std::replace ( pb.begin(), pb.end(), '/', '\1' );
+		return pa < pb; 
+	} );
+}
+
+// 99th percentile from histogram, clamped to the measured range
+sjtime getPerfP99 ( PerfRegion& reg )
+{
+	sjtime limit = reg.count / 100, cnt = 0;
+	for (int b = PERF_HIST-1; b >= 0; b-- ) {
+		cnt += reg.hist[b];
+		if ( cnt > limit ) return std::max ( reg.tmin, std::min ( reg.tmax, getPerfBucketTime(b) ) );
+	}
+	return reg.tmin;
+}
+
+void PERF_SUMMARY ()
+{
+	std::vector<PerfRegion> list;
+	getPerfSummary ( list );
+	PERF_PRINTF ( "%-40s %8s %10s %10s %10s %10s %10s\n", "Region", "Count", "Total ms", "Min ms", "Mean ms", "Max ms", "P99 ms" );
+	for (size_t n=0; n < list.size(); n++ ) {
+		PerfRegion& reg = list[n];
+		PERF_PRINTF ( "%*s%-*s %8lld %10.3f %10.3f %10.3f %10.3f %10.3f\n", reg.depth*2, "", 40-reg.depth*2, reg.name.c_str(), (long long) reg.count, 
+			float(reg.total)/MSEC_SCALAR, float(reg.tmin)/MSEC_SCALAR, float(reg.total)/reg.count/MSEC_SCALAR, float(reg.tmax)/MSEC_SCALAR, float(getPerfP99(reg))/MSEC_SCALAR );
+	}
+}
+
+bool PERF_SAVE_CSV ( const char* fname )
+{
+	FILE* fp = fopen ( fname, "wt" );
+	if ( fp == 0x0 ) return false;
+	std::vector<PerfRegion> list;
+	getPerfSummary ( list );
+	fprintf ( fp, "region,depth,count,total_ms,min_ms,mean_ms,max_ms,p99_ms\n" );
+	for (size_t n=0; n < list.size(); n++ ) {
+		PerfRegion& reg = list[n];
+		std::string path = reg.path;
+		std::replace ( path.begin(), path.end(), ',', ';' );
+		fprintf ( fp, "%s,%d,%lld,%f,%f,%f,%f,%f\n", path.c_str(), reg.depth, (long long) reg.count, 
+			float(reg.total)/MSEC_SCALAR, float(reg.tmin)/MSEC_SCALAR, float(reg.total)/reg.count/MSEC_SCALAR, float(reg.tmax)/MSEC_SCALAR, float(getPerfP99(reg))/MSEC_SCALAR );
+	}
+	fclose ( fp );
+	return true;
+}
+
+// Chrome trace format (chrome://tracing), complete events in microseconds
+bool PERF_SAVE_TRACE ( const char* fname )
+{
+	FILE* fp = fopen ( fname, "wt" );
+	if ( fp == 0x0 ) return false;
+	fprintf ( fp, "{\"traceEvents\":[\n" );
+	bool first = true;
+	std::lock_guard<std::mutex> guard ( g_perfLock );
+	for (size_t n=0; n < g_perfThreads.size(); n++ ) {
+		PerfThread* pt = g_perfThreads[n];
+		std::lock_guard<std::mutex> tguard ( pt->lock );
+		for (size_t e=0; e < pt->events.size(); e++ ) {
+			PerfEvent& ev = pt->events[e];
+			std::string name;
+			for (const char* c = pt->regions[ev.region].name.c_str(); *c; c++ ) {
+				if ( *c == '"' || *c == '\\' ) name += '\\';
+				if ( (unsigned char) *c >= 32 ) name += *c;
+			}
+			fprintf ( fp, "%s{\"name\":\"%s\",\"cat\":\"gvdb\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%d}", first ? "" : ",\n", 
+				name.c_str(), double(ev.start - g_perfBase) / 1000.0, double(ev.dur) / 1000.0, pt->id );
+			first = false;
+		}
+	}
+	fprintf ( fp, "\n],\"displayTimeUnit\":\"ms\"}\n" );
+	fclose ( fp );
+	return true;
 }
 
 
@@ -179,7 +423,6 @@ void PERF_INIT ( int buildbits, bool cpu, bool gpu, bool cons, int lev, char* fn
 	if ( lev == 0 ) lev = 32767;
 	g_perfPrintLev = lev;
 	g_perfInit = true;
-	g_perfLevel = 0;	
 	g_perfFile = 0x0;
 	g_perfFName = fname;	
 	if ( g_perfFName.length() > 0 ) {
@@ -247,6 +490,7 @@ void PERF_INIT ( int buildbits, bool cpu, bool gpu, bool cons, int lev, char* fn
 	#endif
 
 	TimeX start;		// create Time obj to initialize system timer
+	g_perfBase = TimeX::GetSystemNSec ();
 }
 
 
@@ -275,6 +519,7 @@ const int TimeX::m_DaysInMonth[13] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31,
 bool TimeX::m_Started = false;
 sjtime			m_BaseTime;
 sjtime			m_BaseTicks;
+sjtime			m_BaseNSec;
 
 void start_timing ( sjtime base )
 {	
@@ -288,6 +533,9 @@ void start_timing ( sjtime base )
 		struct timeval tv;
 		gettimeofday(&tv, NULL);
 		m_BaseTicks = ((sjtime) tv.tv_sec * 1000000LL) + (sjtime) tv.tv_usec;		
+		struct timespec ts;
+		clock_gettime ( CLOCK_MONOTONIC, &ts );
+		m_BaseNSec = ((sjtime) ts.tv_sec * SEC_SCALAR) + (sjtime) ts.tv_nsec;
 	#endif
 }
 
@@ -310,7 +558,9 @@ sjtime TimeX::GetSystemNSec ()
 		QueryPerformanceCounter ( &currCount );
 		return m_BaseTime + sjtime( (double(currCount.QuadPart-m_BaseCount.QuadPart) / m_BaseFreq.QuadPart) * SEC_SCALAR);
 	#else
-		printf ( "ERROR: GetSystemNSec not implemented. QueryPerformanceCounter not available.\n" );
+		struct timespec ts;
+		clock_gettime ( CLOCK_MONOTONIC, &ts );
+		return m_BaseTime + ((sjtime) ts.tv_sec * SEC_SCALAR + (sjtime) ts.tv_nsec) - m_BaseNSec;
 	#endif	
 }
 
@@ -46,6 +46,9 @@
 // 11. CPU Level specifies maximum printf level for markers. Useful when
 //     your markers are inside an inner loop. You can keep them in code, but hide their output.
 // 12. GPU markers use NVIDIA's Perfmarkers for viewing in NVIDIA NSIGHT
+// 13. Markers are per-thread. Each region (path of nested markers) is aggregated 
+//     over all calls: count, total, min, mean, max and p99. Use PERF_SUMMARY, 
+//     PERF_SAVE_CSV, or PERF_TRACE with PERF_SAVE_TRACE for a Chrome trace.
 // 
 
 #ifndef APP_PERF
@@ -73,6 +76,22 @@
 	extern "C" GVDB_API void PERF_SET ( bool cons, int lev );
 	extern "C" GVDB_API void PERF_PRINTF ( char* format, ... );
 
+	// Statistics and trace (per region, merged over all threads)
+	extern "C" GVDB_API void PERF_CLEAR ();								// reset statistics and trace
+	extern "C" GVDB_API void PERF_TRACE ( bool on );					// record events for PERF_SAVE_TRACE
+	extern "C" GVDB_API void PERF_SUMMARY ();							// print count, total, min, mean, max, p99 per region
+	extern "C" GVDB_API bool PERF_SAVE_CSV ( const char* fname );		// write summary as csv
+	extern "C" GVDB_API bool PERF_SAVE_TRACE ( const char* fname );		// write events as Chrome trace json
+
+	// Scoped marker, e.g. PerfScope ps ( "Load", mbProfile );
+	class PerfScope {
+	public:
+		PerfScope ( const char* msg, bool on = true )	{ mOn = on; if ( mOn ) PERF_PUSH ( msg ); }
+		~PerfScope ()									{ if ( mOn ) PERF_POP (); }
+	private:
+		bool	mOn;
+	};
+
 
 	// Time Class
 	// Copyright Rama Hoetzlein (C) 2007
@@ -29,6 +29,9 @@
 	#include "gvdb_model.h"
 	#include "gvdb_volume_3D.h"
 	#include "gvdb_volume_gvdb.h"
+	#include "gvdb_sequence.h"
+	#include "gvdb_brickcache.h"
+	#include "gvdb_accessor.h"
 	#include "app_perf.h"
 
 #endif
@@ -0,0 +1,189 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+
+#include "gvdb_accessor.h"
+#include "gvdb_brickcache.h"
+#include "gvdb_parallel.h"
+#include <cmath>
+
+using namespace nvdb;
+
+ValueAccessor::ValueAccessor ( VolumeGVDB* gvdb, uchar chan, float background )
+{
+	mGVDB = gvdb;
+	mChan = chan;
+	mBackground = background;
+	mLevs = gvdb->mPool->getNumLevels ();
+	mApron = 0;
+	mFloat = true;
+	mAtlas = 0x0;
+	if ( !gvdb->isCPUDevice () ) {
+		gprintf ( "ERROR: ValueAccessor requires the CPU device (SetCPUDevice), the atlas has no host copy.\n" );
+	} else if ( chan < gvdb->mPool->getNumAtlas() ) {
+		DataPtr atlas = gvdb->mPool->getAtlas ( chan );
+		if ( atlas.type == T_FLOAT || atlas.type == T_UCHAR ) {
+			mAtlas = atlas.cpu;
+			mApron = atlas.apron;
+			mFloat = ( atlas.type == T_FLOAT );
+			mAtlasRes = gvdb->mPool->getAtlasRes ( chan );
+		} else {
+			gprintf ( "ERROR: ValueAccessor requires a float or uchar channel.\n" );
+		}
+	}
+	for (int lev=0; lev < mLevs; lev++ ) {
+		mRange[lev] = gvdb->getRange ( lev );
+		mLogDim[lev] = gvdb->getLD ( lev );
+	}
+	mHits = 0;
+	mQueries = 0;
+	mEmpty = background;
+	Clear ();
+}
+
+void ValueAccessor::Clear ()
+{
+	for (int lev=0; lev < MAXLEV; lev++ ) {
+		mNodeID[lev] = ID_UNDEFL;
+		mNode[lev] = 0x0;
+	}
+}
+
+bool ValueAccessor::isCached ( int lev, Vector3DI p )
+{
+	if ( mNodeID[lev] == ID_UNDEFL ) return false;
+	Vector3DI& vmin = mMin[lev];
+	return p.x >= vmin.x && p.y >= vmin.y && p.z >= vmin.z && 
+		   p.x < vmin.x + mRange[lev].x && p.y < vmin.y + mRange[lev].y && p.z < vmin.z + mRange[lev].z;
+}
+
+// Get leaf containing voxel
+// - Descent starts at the lowest cached node containing p, or at the root.
+// - Nodes passed on the way down replace the cached path below that level.
+// - When there is no leaf, getEmpty returns the tile value of the slot, or the background.
+Node* ValueAccessor::getLeaf ( Vector3DI p )
+{
+	mQueries++;
+	mEmpty = mBackground;
+	int lev = 0;
+	while ( lev < mLevs && !isCached ( lev, p ) ) lev++;
+	if ( lev == 0 ) { mHits++; return mNode[0]; }
+
+	slong id;
+	Node* node;
+	if ( lev == mLevs ) {
+		id = mGVDB->mRoot;
+		if ( id == ID_UNDEFL ) return 0x0;
+		node = mGVDB->getNode ( id );
+		lev = node->mLev;
+		mNodeID[lev] = id;
+		mNode[lev] = node;
+		mMin[lev] = node->mPos;
+		if ( !isCached ( lev, p ) ) return 0x0;			// outside root
+	} else {
+		id = mNodeID[lev];
+		node = mNode[lev];
+	}
+	Vector3DI l;
+	uint32 b;
+	while ( lev > 0 ) {
+		Vector3DI& r = mRange[lev-1];					// child extent
+		l.Set ( (p.x - mMin[lev].x) / r.x, (p.y - mMin[lev].y) / r.y, (p.z - mMin[lev].z) / r.z );
+		b = (((l.z << mLogDim[lev]) + l.y) << mLogDim[lev]) + l.x;
+		if ( !node->isOn ( b ) ) {						// no child, exit
+			if ( mGVDB->isTile ( node, b ) ) mEmpty = mGVDB->getTileValues(node)[b];
+			return 0x0;
+		}
+		id = mGVDB->getChildNode ( id, node->countOn ( b ) );
+		node = mGVDB->getNode ( id );
+		lev--;
+		mNodeID[lev] = id;
+		mNode[lev] = node;
+		mMin[lev] = node->mPos;
+	}
+	return node;
+}
+
+// Voxel of the cached leaf, p may lie in its apron
+inline float ValueAccessor::getVoxel ( Node* leaf, Vector3DI p )
+{
+	uint64 i = (uint64(leaf->mValue.z + p.z - leaf->mPos.z)*mAtlasRes.y + (leaf->mValue.y + p.y - leaf->mPos.y))*mAtlasRes.x + (leaf->mValue.x + p.x - leaf->mPos.x);
+	return mFloat ? ((float*) mAtlas)[i] : float( ((uchar*) mAtlas)[i] );
+}
+
+float ValueAccessor::getValue ( Vector3DI p )
+{
+	Node* leaf = getLeaf ( p );
+	if ( leaf == 0x0 ) return mEmpty;
+	if ( mAtlas == 0x0 ) return mBackground;
+	if ( mGVDB->mCache != 0x0 && !mGVDB->mCache->Touch ( ElemNdx ( mNodeID[0] ) ) ) return mBackground;	// not resident, requested
+	if ( leaf->mValue.x == -1 ) return mBackground;
+	return getVoxel ( leaf, p );
+}
+
+// Trilinear value
+// - When the 2x2x2 voxels lie within the brick and apron of the leaf containing p, they are read
+//   directly from the atlas, as device sampling does, so the apron must be current (UpdateApron).
+// - Otherwise each voxel is looked up on its own, and empty space counts as background (or tile value).
+//   Samples whose voxels all fall in one brick of empty space, or one tile, return its value directly.
+float ValueAccessor::getValueLinear ( Vector3DF p )
+{
+	Vector3DF q ( p.x - 0.5f, p.y - 0.5f, p.z - 0.5f );
+	Vector3DI c ( int(floorf(q.x)), int(floorf(q.y)), int(floorf(q.z)) );
+	Vector3DF f ( q.x - c.x, q.y - c.y, q.z - c.z );
+	float v[8];
+
+	Vector3DI i ( int(floorf(p.x)), int(floorf(p.y)), int(floorf(p.z)) );
+	Node* leaf = getLeaf ( i );
+	if ( leaf == 0x0 ) {							// all voxels in the same empty brick
+		Vector3DI& r = mRange[0];
+		Vector3DI lo ( i.x - ((i.x % r.x) + r.x) % r.x, i.y - ((i.y % r.y) + r.y) % r.y, i.z - ((i.z % r.z) + r.z) % r.z );
+		if ( c.x >= lo.x && c.y >= lo.y && c.z >= lo.z && c.x < lo.x+r.x-1 && c.y < lo.y+r.y-1 && c.z < lo.z+r.z-1 ) return mEmpty;
+	}
+	bool bBrick = ( leaf != 0x0 && mAtlas != 0x0 && mApron > 0 && leaf->mValue.x != -1 );
+	if ( bBrick && mGVDB->mCache != 0x0 && !mGVDB->mCache->Touch ( ElemNdx ( mNodeID[0] ) ) ) return mBackground;
+	if ( bBrick ) {
+		Vector3DI lo = leaf->mPos - mApron;
+		Vector3DI hi = leaf->mPos + mRange[0] + mApron - 1;
+		bBrick = ( c.x >= lo.x && c.y >= lo.y && c.z >= lo.z && c.x < hi.x && c.y < hi.y && c.z < hi.z );
+	}
+	for (int n=0; n < 8; n++ ) {
+		Vector3DI s ( c.x + (n & 1), c.y + ((n >> 1) & 1), c.z + ((n >> 2) & 1) );
+		v[n] = bBrick ? getVoxel ( leaf, s ) : getValue ( s );
+	}
+	float x0 = v[0] + (v[1]-v[0])*f.x,  x1 = v[2] + (v[3]-v[2])*f.x;
+	float x2 = v[4] + (v[5]-v[4])*f.x,  x3 = v[6] + (v[7]-v[6])*f.x;
+	float y0 = x0 + (x1-x0)*f.y,  y1 = x2 + (x3-x2)*f.y;
+	return y0 + (y1-y0)*f.z;
+}
+
+// Trilinear values of many points
+// - Contiguous ranges run on host threads, each with its own copy of this accessor,
+//   so coherent point lists keep hitting the cached leaf.
+void ValueAccessor::sample ( const Vector3DF* pts, float* out, uint64 n )
+{
+	ParallelFor ( mGVDB->mWorkers, (slong) n, [&] ( slong s, slong e ) {
+		ValueAccessor acc ( *this );
+		for (slong i = s; i < e; i++ )
+			out[i] = acc.getValueLinear ( pts[i] );
+	} );
+}
@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+
+#ifndef DEF_GVDB_ACCESSOR
+	#define DEF_GVDB_ACCESSOR
+
+	#include "gvdb_volume_gvdb.h"
+
+	namespace nvdb {
+
+	// Value Accessor
+	// Host point queries which keep the node path (one node per level, with its bounds) 
+	// of the previous query. A query inside a cached node starts its descent there instead
+	// of at the root, so coherent queries usually find the leaf directly.
+	// Positions are in index space (voxel units), voxel i covers [i, i+1).
+	// Channels must be float or uchar. Empty space returns the background value, tiles return their value.
+	// Requires the CPU device (SetCPUDevice), since voxels are read from the host atlas. On other
+	// devices the constructor reports an error and all queries return the background.
+	// The cache holds node pointers: call Clear after topology or atlas changes.
+	// An accessor is not thread-safe, use one per thread (sample does this).
+	class GVDB_API ValueAccessor {
+	public:
+		ValueAccessor ( VolumeGVDB* gvdb, uchar chan = 0, float background = 0 );
+
+		void	Clear ();										// forget cached path
+		Node*	getLeaf ( Vector3DI p );						// leaf containing voxel, or 0x0 (see getEmpty)
+		float	getValue ( Vector3DI p );						// voxel value
+		float	getValueLinear ( Vector3DF p );					// trilinear between voxel centers (i+0.5)
+		void	sample ( const Vector3DF* pts, float* out, uint64 n );	// getValueLinear of many points, in parallel
+
+		bool	isCached ( int lev, Vector3DI p );				// p inside cached node at level
+		float	getEmpty ()				{ return mEmpty; }		// value of the last getLeaf which found no leaf: tile value or background
+		uint64	getHits ()				{ return mHits; }		// queries answered by the cached leaf
+		uint64	getQueries ()			{ return mQueries; }
+
+	private:
+		float	getVoxel ( Node* leaf, Vector3DI p );			// p inside leaf, apron allowed
+
+		VolumeGVDB*		mGVDB;
+		uchar			mChan;
+		float			mBackground;
+		int				mLevs;
+		int				mApron;
+		bool			mFloat;
+		char*			mAtlas;
+		Vector3DI		mAtlasRes;
+		Vector3DI		mRange[MAXLEV];				// node extent at each level (index space)
+		int				mLogDim[MAXLEV];
+
+		// cached path
+		slong			mNodeID[MAXLEV];			// ID_UNDEFL if none
+		Node*			mNode[MAXLEV];
+		Vector3DI		mMin[MAXLEV];				// index-space corner of cached node
+
+		float			mEmpty;						// see getEmpty
+
+		uint64			mHits, mQueries;
+	};
+
+	}
+
+#endif
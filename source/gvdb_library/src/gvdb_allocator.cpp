@@ -24,8 +24,14 @@
 
 #if defined(_WIN32)
 #	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
 #endif
 #include <cstdlib>
+#include <algorithm>
 #include <cuda_runtime.h>
 #include <cuda.h>
 
@@ -49,9 +55,16 @@ CUsurfref	Allocator::cuSurfWrite;
 CUtexref	Allocator::cuSurfReadC;
 CUtexref	Allocator::cuSurfReadF;
 
-Allocator::Allocator ()
+Allocator::Allocator ( bool bGPU )
 {
 	mVFBO[0] = -1;
+	mbGPU = bGPU;
+	mMapData = 0x0;
+	mMapSize = 0;
+	mMapFile = 0x0;
+	mMapHandle = 0x0;
+
+	if ( !mbGPU ) return;		// host-only allocator, CUDA module not needed
 	
 	if ( !bAllocator ) {
 		bAllocator = true;
@@ -105,7 +118,7 @@ void Allocator::PoolCreate ( uchar grp, uchar lev, uint64 width, uint64 initmax,
 	}	
 
 	// gpu allocate
-	if ( bGPU ) {
+	if ( bGPU && mbGPU ) {
 		size_t sz = p.size;
 		cudaCheck ( cuMemAlloc ( &p.gpu, sz ), "cuMemAlloc", "PoolCreate" );
 	}
@@ -130,6 +143,7 @@ void Allocator::PoolClearCPU()
 
 void Allocator::PoolFetch(int grp, int lev )
 {
+	if ( !mbGPU ) return;		// host pools are always current
 	DataPtr* p = &mPool[grp][lev];
 	cudaCheck ( cuMemcpyDtoH ( p->cpu,  p->gpu, p->num * p->stride ), "cuMemcpyDtoH", "PoolFetch" );	// Kui: fetch pool from GPU
 }
@@ -144,12 +158,14 @@ void Allocator::PoolFetchAll()
 
 void Allocator::PoolCommit ( int grp, int lev )
 {
+	if ( !mbGPU ) return;
 	DataPtr* p = &mPool[grp][lev];
 	cudaCheck ( cuMemcpyHtoD ( p->gpu, p->cpu, p->num * p->stride ), "cuMemcpyHtoD", "PoolCommit" );	
 }
 
 void Allocator::PoolCommitAtlasMap ()
 {
+	if ( !mbGPU ) return;
 	DataPtr* p;
 	for (int n=0; n < mAtlasMap.size(); n++ ) {
 		if ( mAtlasMap[n].cpu != 0x0 ) {
@@ -165,7 +181,7 @@ void Allocator::PoolReleaseAll ()
 	for (int grp=0; grp < MAX_POOL; grp++) 
 		for (int lev=0; lev < mPool[grp].size(); lev++ )  {
 			if ( mPool[grp][lev].cpu != 0x0 ) 
-				free ( mPool[grp][lev].cpu );
+				FreeCPU ( mPool[grp][lev].cpu );
 
 			if ( mPool[grp][lev].gpu != 0x0 )
 				cudaCheck ( cuMemFree ( mPool[grp][lev].gpu ), "cuFree", "PoolReleaseAll" );
@@ -173,8 +189,11 @@ void Allocator::PoolReleaseAll ()
 
 
 	// release pool structure	
-	for (int grp=0; grp < MAX_POOL; grp++) 
+	for (int grp=0; grp < MAX_POOL; grp++) {
 		mPool[grp].clear ();
+		mPoolFree[grp].clear ();
+		mPoolRunFree[grp].clear ();
+	}
 }
 
 
@@ -182,6 +201,13 @@ uint64 Allocator::PoolAlloc ( uchar grp, uchar lev, bool bGPU )
 {
 	if ( lev >= mPool[grp].size() ) return ID_UNDEFL;
 	DataPtr* p = &mPool[grp][lev];
+
+	// Reuse a freed element
+	if ( lev < mPoolFree[grp].size() && mPoolFree[grp][lev].size() > 0 ) {
+		uint64 ndx = mPoolFree[grp][lev].back ();
+		mPoolFree[grp][lev].pop_back ();
+		return Elem(grp, lev, ndx );
+	}
 	
 	if ( p->num >= p->max ) {
 		// Expand pool
@@ -190,7 +216,7 @@ uint64 Allocator::PoolAlloc ( uchar grp, uchar lev, bool bGPU )
 		if ( p->cpu != 0x0 ) {
 			char* new_cpu = (char*) malloc ( p->size );
 			memcpy ( new_cpu, p->cpu, p->stride*p->num );
-			free ( p->cpu );
+			FreeCPU ( p->cpu );
 			p->cpu = new_cpu;
 		}
 		if ( p->gpu != 0x0 ) {
@@ -207,12 +233,117 @@ uint64 Allocator::PoolAlloc ( uchar grp, uchar lev, bool bGPU )
 	return Elem(grp,lev, (p->num-1) );
 }
 
+// Allocate a block of contiguous elements on pool (used for bulk topology builds)
+uint64 Allocator::PoolAllocN ( uchar grp, uchar lev, uint64 cnt )
+{
+	if ( lev >= mPool[grp].size() ) return ID_UNDEFL;
+	DataPtr* p = &mPool[grp][lev];
+
+	if ( p->num + cnt > p->max ) {
+		// Expand pool
+		uint64 newmax = (p->max == 0) ? 1 : p->max;
+		while ( newmax < p->num + cnt ) newmax *= 2;
+		p->max = newmax;
+		p->size = p->stride * p->max;
+		if ( p->cpu != 0x0 ) {
+			char* new_cpu = (char*) malloc ( p->size );
+			memcpy ( new_cpu, p->cpu, p->stride*p->num );
+			FreeCPU ( p->cpu );
+			p->cpu = new_cpu;
+		}
+		if ( p->gpu != 0x0 ) {
+			size_t sz = p->size;	
+			CUdeviceptr new_gpu;
+			cudaCheck ( cuMemAlloc ( &new_gpu, sz ), "cuMemAlloc", "PoolAllocN" );		
+			cudaCheck ( cuMemcpy ( new_gpu, p->gpu, p->stride*p->num), "cuMemcpy", "PoolAllocN" );
+			cudaCheck ( cuMemFree ( p->gpu ), "cuMemFree", "PoolAllocN" );
+			p->gpu = new_gpu;
+		}
+	}
+	// Return first new element
+	uint64 first = p->num;
+	p->num += cnt;
+	return Elem(grp,lev, first );
+}
+
+// Allocate a run of cnt contiguous elements, where cnt is a power of two (size class)
+// Runs are reused only by runs of the same size, so a pool of mixed sizes does not fragment further.
+// With bGrow=false the pool memory never moves, and ID_UNDEFL is returned when there is no room.
+uint64 Allocator::PoolAllocRun ( uchar grp, uchar lev, uint64 cnt, bool bGrow )
+{
+	if ( lev >= mPool[grp].size() ) return ID_UNDEFL;
+	size_t k = 0;
+	while ( (uint64(1) << k) < cnt ) k++;
+	if ( lev < mPoolRunFree[grp].size() && k < mPoolRunFree[grp][lev].size() && mPoolRunFree[grp][lev][k].size() > 0 ) {
+		uint64 ndx = mPoolRunFree[grp][lev][k].back ();
+		mPoolRunFree[grp][lev][k].pop_back ();
+		return Elem(grp, lev, ndx );
+	}
+	if ( !bGrow && mPool[grp][lev].num + (uint64(1) << k) > mPool[grp][lev].max ) return ID_UNDEFL;
+	return PoolAllocN ( grp, lev, uint64(1) << k );
+}
+
+// Reserve pool capacity
+// Grows the pool to hold at least cnt elements, keeping its contents and count.
+// With bGPU=false only host memory grows, so it can be called from worker threads;
+// the gpu copy is then smaller than the pool until PoolResizeGPU.
+void Allocator::PoolReserve ( uchar grp, uchar lev, uint64 cnt, bool bGPU )
+{
+	if ( lev >= mPool[grp].size() ) return;
+	DataPtr* p = &mPool[grp][lev];
+	if ( cnt <= p->max ) return;
+
+	uint64 newmax = (p->max == 0) ? 1 : p->max;
+	while ( newmax < cnt ) newmax *= 2;
+	p->max = newmax;
+	p->size = p->stride * p->max;
+	if ( p->cpu != 0x0 ) {
+		char* new_cpu = (char*) malloc ( p->size );
+		memcpy ( new_cpu, p->cpu, p->stride*p->num );
+		FreeCPU ( p->cpu );
+		p->cpu = new_cpu;
+	}
+	if ( bGPU && p->gpu != 0x0 ) {
+		CUdeviceptr new_gpu;
+		cudaCheck ( cuMemAlloc ( &new_gpu, p->size ), "cuMemAlloc", "PoolReserve" );
+		cudaCheck ( cuMemcpy ( new_gpu, p->gpu, p->stride*p->num), "cuMemcpy", "PoolReserve" );
+		cudaCheck ( cuMemFree ( p->gpu ), "cuMemFree", "PoolReserve" );
+		p->gpu = new_gpu;
+	}
+}
+
+// Reallocate the gpu copy of a pool to its host capacity, after PoolReserve on the host only.
+// Contents are not kept, the pool must be committed.
+void Allocator::PoolResizeGPU ( uchar grp, uchar lev )
+{
+	if ( !mbGPU || lev >= mPool[grp].size() ) return;
+	DataPtr* p = &mPool[grp][lev];
+	if ( p->gpu == 0x0 ) return;
+	cudaCheck ( cuMemFree ( p->gpu ), "cuMemFree", "PoolResizeGPU" );
+	cudaCheck ( cuMemAlloc ( &p->gpu, p->size ), "cuMemAlloc", "PoolResizeGPU" );
+}
+
+void Allocator::PoolFreeRun ( uint64 id, uint64 cnt )
+{
+	uchar grp = ElemGrp(id);
+	uchar lev = ElemLev(id);
+	if ( lev >= mPool[grp].size() || ElemNdx(id) >= mPool[grp][lev].num ) return;
+	size_t k = 0;
+	while ( (uint64(1) << k) < cnt ) k++;
+	if ( mPoolRunFree[grp].size() <= lev ) mPoolRunFree[grp].resize ( lev+1 );
+	if ( mPoolRunFree[grp][lev].size() <= k ) mPoolRunFree[grp][lev].resize ( k+1 );
+	mPoolRunFree[grp][lev][k].push_back ( ElemNdx(id) );
+}
+
 void Allocator::PoolEmptyAll ()
 {
 	// clear pool data (do not free)
-	for (int grp=0; grp < MAX_POOL; grp++) 
+	for (int grp=0; grp < MAX_POOL; grp++) {
 		for (int lev=0; lev < mPool[grp].size(); lev++ ) 
 			mPool[grp][lev].num = 0;		
+		mPoolFree[grp].clear ();
+		mPoolRunFree[grp].clear ();
+	}
 }
 
 int	Allocator::getPoolMem ()
@@ -242,8 +373,91 @@ uint64* Allocator::PoolData64 ( uint64 elem )
 	return (uint64*) PoolData ( elem );
 }
 
-void PoolFree ( int elem )
+// Free an element on pool
+// Element is added to the free list of its pool, and reused by the next PoolAlloc.
+// Memory is only reclaimed by PoolCompact.
+void Allocator::PoolFree ( uint64 id )
+{
+	uchar grp = ElemGrp(id);
+	uchar lev = ElemLev(id);
+	if ( lev >= mPool[grp].size() || ElemNdx(id) >= mPool[grp][lev].num ) return;
+	if ( mPoolFree[grp].size() <= lev ) mPoolFree[grp].resize ( lev+1 );
+	mPoolFree[grp][lev].push_back ( ElemNdx(id) );
+}
+
+uint64 Allocator::getPoolFree ( uchar grp, uchar lev )
 {
+	return ( lev < mPoolFree[grp].size() ) ? mPoolFree[grp][lev].size() : 0;
+}
+
+// Number of elements held by free runs (PoolFreeRun), not in the free list
+uint64 Allocator::getPoolRunFree ( uchar grp, uchar lev )
+{
+	uint64 cnt = 0;
+	if ( lev < mPoolRunFree[grp].size() ) {
+		for (size_t k=0; k < mPoolRunFree[grp][lev].size(); k++ )
+			cnt += mPoolRunFree[grp][lev][k].size() << k;
+	}
+	return cnt;
+}
+
+// Compact a pool
+// Moves the last used elements down into free slots, then shrinks pool memory 
+// when it is less than a quarter used. Returns the number of elements moved. 
+// 'remap' returns the new index of each old index (ID_UNDEFL for freed elements).
+// Caller must update any references, and commit the pool to the GPU.
+// Pools of runs (PoolAllocRun) are repacked by their owner instead, see PoolAssign.
+uint64 Allocator::PoolCompact ( uchar grp, uchar lev, std::vector<uint64>& remap )
+{
+	remap.clear ();
+	if ( lev >= mPool[grp].size() ) return 0;
+	DataPtr* p = &mPool[grp][lev];
+	uint64 moved = 0;
+
+	remap.resize ( p->num );
+	for (uint64 n=0; n < p->num; n++ ) remap[n] = n;
+	bool bFree = ( lev < mPoolFree[grp].size() && mPoolFree[grp][lev].size() > 0 );
+	if ( !bFree && p->max <= 4*p->num ) return 0;
+
+	// Move used elements from end into free slots
+	if ( bFree ) {
+		std::vector<uint64>& fl = mPoolFree[grp][lev];
+		std::vector<char> used ( p->num, 1 );
+		for (uint64 n=0; n < fl.size(); n++ ) { used[ fl[n] ] = 0; remap[ fl[n] ] = ID_UNDEFL; }
+		uint64 i = 0, j = p->num;
+		for (;;) {
+			while ( i < j && used[i] ) i++;			// next free slot
+			while ( j > i && !used[j-1] ) j--;		// last used element
+			if ( i >= j ) break;
+			j--;
+			memcpy ( p->cpu + i*p->stride, p->cpu + j*p->stride, p->stride );
+			remap[j] = i;
+			used[i] = 1;	used[j] = 0;
+			moved++;
+		}
+		p->num -= fl.size();
+		fl.clear ();
+	}
+
+	// Shrink pool memory
+	if ( p->stride > 0 && p->max > 4*p->num && p->max > 1 ) {
+		uint64 newmax = 1;
+		while ( newmax < 2*p->num ) newmax *= 2;			// keep room to grow
+		p->max = newmax;
+		p->size = p->stride * p->max;
+		if ( p->cpu != 0x0 ) {
+			char* new_cpu = (char*) malloc ( p->size );
+			memcpy ( new_cpu, p->cpu, p->stride*p->num );
+			FreeCPU ( p->cpu );
+			p->cpu = new_cpu;
+		}
+		if ( p->gpu != 0x0 ) {
+			size_t sz = p->size;
+			cudaCheck ( cuMemFree ( p->gpu ), "cuMemFree", "PoolCompact" );
+			cudaCheck ( cuMemAlloc ( &p->gpu, sz ), "cuMemAlloc", "PoolCompact" );		
+		}
+	}
+	return moved;
 }
 
 
@@ -279,16 +493,19 @@ void Allocator::CreateMemLinear ( DataPtr& p, char* dat, int stride, int cnt, bo
 	p.num = cnt; p.max = cnt; 
 	p.stride = stride;
 	p.size = cnt * stride;
+	p.cap = p.size;
 	p.subdim = Vector3DI(0,0,0);
 
 	if ( dat==0x0 ) {
-		if ( bCPU ) {
+		if ( bCPU || !mbGPU ) {					// host-only always needs cpu memory
 			if ( p.cpu != 0x0 ) free (p.cpu);		// release previous
 			p.cpu = (char*) malloc ( p.size );		// create on cpu 
 		}
 	} else {
 		p.cpu = dat;							// get from user
 	}
+	if ( !mbGPU ) return;
+
 	if ( p.gpu != 0x0 ) cudaCheck ( cuMemFree (p.gpu), "cuMemFree", "CreateMemLinear" );
 	cudaCheck ( cuMemAlloc ( &p.gpu, p.size ), "cuMemAlloc", "CreateMemLinear" );	
 
@@ -301,22 +518,73 @@ void Allocator::FreeMemLinear ( DataPtr& p )
 	if ( p.gpu != 0x0 ) cudaCheck ( cuMemFree (p.gpu), "cuMemFree", "FreeMemLinear" );
 	p.cpu = 0x0;
 	p.gpu = 0x0;
+	p.cap = 0;
+}
+
+bool Allocator::ReserveMemLinear ( DataPtr& p, int stride, int cnt, bool bCPU )
+{
+	uint64 need = uint64(cnt) * stride;
+	bool bHost = bCPU || !mbGPU;			// host-only always needs cpu memory
+	bool bGrow = ( need > p.cap );
+
+	p.alloc = this;
+	if ( bGrow ) {
+		uint64 cap = std::max ( need, p.cap*2 );	// geometric growth, amortizes repeated small increases
+		bHost |= ( p.cpu != 0x0 );				// keep an existing cpu copy the same size as gpu
+		if ( p.cpu != 0x0 ) { free ( p.cpu ); p.cpu = 0x0; }
+		if ( mbGPU ) {
+			if ( p.gpu != 0x0 ) cudaCheck ( cuMemFree (p.gpu), "cuMemFree", "ReserveMemLinear" );
+			cudaCheck ( cuMemAlloc ( &p.gpu, cap ), "cuMemAlloc", "ReserveMemLinear" );
+		}
+		p.cap = cap;
+	}
+	if ( bHost && p.cpu == 0x0 && p.cap > 0 ) p.cpu = (char*) malloc ( p.cap );
+
+	p.num = cnt;
+	p.max = p.cap / stride;
+	p.stride = stride;
+	p.size = need;
+	p.subdim = Vector3DI(0,0,0);
+	return bGrow;
+}
+
+void Allocator::TrimMemLinear ( DataPtr& p, uint64 sz )
+{
+	if ( p.cap <= sz ) return;
+	bool bHost = ( p.cpu != 0x0 );
+	if ( sz == 0 ) {
+		FreeMemLinear ( p );
+		p.num = 0; p.max = 0; p.size = 0;
+		return;
+	}
+	if ( bHost ) { free ( p.cpu ); p.cpu = (char*) malloc ( sz ); }
+	if ( mbGPU ) {
+		if ( p.gpu != 0x0 ) cudaCheck ( cuMemFree (p.gpu), "cuMemFree", "TrimMemLinear" );
+		cudaCheck ( cuMemAlloc ( &p.gpu, sz ), "cuMemAlloc", "TrimMemLinear" );
+	}
+	p.cap = sz;
+	if ( p.size > sz ) p.size = sz;
+	if ( p.stride > 0 ) { p.max = sz / p.stride; if ( p.num > p.max ) p.num = p.max; }
 }
 
 void Allocator::RetrieveMem ( DataPtr& p)
 {
+	if ( !mbGPU ) return;
 	cudaCheck ( cuMemcpyDtoH ( p.cpu, p.gpu, p.size), "cuMemcpyDtoH", "RetrieveMem" );	
 	cudaCheck ( cuCtxSynchronize (), "cuCtxSync", "RetrieveMem" );
 }
 
 void Allocator::CommitMem ( DataPtr& p)
 {
+	if ( !mbGPU ) return;
 	cudaCheck ( cuMemcpyHtoD ( p.gpu, p.cpu, p.size), "cuMemcpyHtoD", "CommitMem" );
 }
 
 
 void Allocator::AllocateTextureGPU ( DataPtr& p, uchar dtype, Vector3DI res, bool bGL, uint64 preserve )
 {	
+	if ( !mbGPU ) return;
+
 	// GPU allocate	
 	if ( bGL ) {
 		// OpenGL 3D texture
@@ -393,7 +661,7 @@ void Allocator::AllocateTextureGPU ( DataPtr& p, uchar dtype, Vector3DI res, boo
 				cp.WidthInBytes = res.x * getSize(dtype);
 				cp.Height = res.y;
 				cp.Depth = preserve / (res.x*res.y*getSize(dtype));	  // amount to copy (preserve)
-				if ( cp.Depth < desc.Depth )
+				if ( cp.Depth <= desc.Depth )
 				   cudaCheck ( cuMemcpy3D ( &cp ), "cuMemcpy3D(preserve)", "AllocateTextureGPU" );
 			}	
 		} else {
@@ -406,13 +674,20 @@ void Allocator::AllocateTextureGPU ( DataPtr& p, uchar dtype, Vector3DI res, boo
 
 void Allocator::AllocateTextureCPU ( DataPtr& p, uint64 sz, bool bCPU, uint64 preserve )
 {
-	if ( bCPU ) {
+	if ( bCPU || !mbGPU ) {						// host-only atlas always lives on cpu
 		char* old_cpu = p.cpu;
 		p.cpu = (char*) malloc ( p.size );		
+		if ( p.cpu == 0x0 ) {
+			gprintf ( "ERROR: Unable to malloc %lld for texture.\n", p.size );
+			gerror ();
+		}
 		if ( preserve > 0 && old_cpu != 0x0 ) {
 			memcpy ( p.cpu, old_cpu, preserve );
+		} else {
+			preserve = 0;
 		}
-		if ( old_cpu != 0x0 ) free ( old_cpu );	
+		memset ( p.cpu + preserve, 0, p.size - preserve );
+		if ( old_cpu != 0x0 ) FreeCPU ( old_cpu );	
 	}
 }
 
@@ -435,9 +710,11 @@ void Allocator::AllocateAtlasMap ( int stride, Vector3DI axiscnt )
 	if ( q.cpu != 0x0 ) free ( q.cpu );
 	q.cpu = (char*) malloc ( q.size );			// cpu allocate		
 			
-	size_t sz = q.size;							// gpu allocate
-	if ( q.gpu != 0x0 ) cudaCheck ( cuMemFree ( q.gpu ), "cuMemFree", "AllocateAtlasMap" );
-	cudaCheck ( cuMemAlloc ( &q.gpu, q.size ), "cuMemAlloc", "AllocateAtlasMap" );	
+	if ( mbGPU ) {
+		size_t sz = q.size;						// gpu allocate
+		if ( q.gpu != 0x0 ) cudaCheck ( cuMemFree ( q.gpu ), "cuMemFree", "AllocateAtlasMap" );
+		cudaCheck ( cuMemAlloc ( &q.gpu, q.size ), "cuMemAlloc", "AllocateAtlasMap" );	
+	}
 
 	mAtlasMap[0] = q;
 }
@@ -464,7 +741,7 @@ bool Allocator::TextureCreate ( uchar chan, uchar dtype, Vector3DI res, bool bCP
 	AllocateTextureCPU ( p, p.size, bCPU, 0 );			// CPU allocate	
 	mAtlas.push_back ( p );
 
-	cudaCheck ( cuCtxSynchronize(), "cuCtxSync", "TextureCreate" );
+	if ( mbGPU ) cudaCheck ( cuCtxSynchronize(), "cuCtxSync", "TextureCreate" );
 
 	return true;
 }
@@ -499,7 +776,7 @@ bool Allocator::AtlasCreate ( uchar chan, uchar dtype, Vector3DI leafdim, Vector
 	AllocateTextureCPU ( p, p.size, bCPU, 0 );				// CPU allocate
 	mAtlas.push_back ( p );
 
-	cudaCheck ( cuCtxSynchronize(), "cuCtxSync", "AtlasCreate" );
+	if ( mbGPU ) cudaCheck ( cuCtxSynchronize(), "cuCtxSync", "AtlasCreate" );
 
 	return true;
 }
@@ -550,6 +827,7 @@ bool Allocator::AtlasResize ( uchar chan, uint64 max_leaf )
 	// Compute axis res
 	axisres = axiscnt * int(leafdim + p.apron * 2);		// new atlas resolution
 	uint64 atlas_sz = uint64(getSize(p.type)) * axisres.x * uint64(axisres.y) * axisres.z;	// new atlas size
+	if ( preserve > atlas_sz ) preserve = atlas_sz;		// shrinking keeps the leading bricks
 	p.max = axiscnt.x * axiscnt.y * axiscnt.z;			// max leaves supported
 	p.size = atlas_sz;				// new total # bytes
 	p.subdim = axiscnt;				// new number of bricks on each axis
@@ -576,11 +854,27 @@ void Allocator::AtlasEmptyAll ()
 {
 	for (int n=0; n < mAtlas.size(); n++ )
 		mAtlas[n].num = 0;
+	mAtlasFree.clear ();
 }
 
 bool Allocator::AtlasAlloc ( uchar chan, Vector3DI& val )
 {
 	int id;	
+	if ( chan < mAtlasFree.size() && mAtlasFree[chan].size() > 0 ) {		// reuse freed brick
+		id = (int) mAtlasFree[chan].back ();
+		mAtlasFree[chan].pop_back ();
+		val = getAtlasPos ( chan, id );
+
+		// clear voxels of the deactivated leaf in all channels, as a new brick would be
+		std::vector<char> zero;
+		for (size_t n=0; n < mAtlas.size(); n++ ) {
+			if ( uint64(id) >= mAtlas[n].max ) continue;
+			uint64 bres = mAtlas[n].stride + (mAtlas[n].apron << 1);
+			zero.resize ( bres*bres*bres*getSize(mAtlas[n].type), 0 );
+			AtlasWriteBrick ( n, getAtlasPos ( n, id ), &zero[0] );
+		}
+		return true;
+	}
 	if ( mAtlas[chan].num >= mAtlas[chan].max ) {
 		int layer = mAtlas[chan].subdim.x * mAtlas[chan].subdim.y;
 		AtlasResize ( chan, mAtlas[chan].num + layer );
@@ -589,6 +883,164 @@ bool Allocator::AtlasAlloc ( uchar chan, Vector3DI& val )
 	val = getAtlasPos ( chan, id );
 	return true;
 }
+void Allocator::AtlasFree ( uchar chan, Vector3DI val )
+{
+	if ( chan >= mAtlas.size() || val.x < 0 ) return;
+	uint64 id = getAtlasId ( chan, val );
+	if ( id >= mAtlas[chan].num ) return;
+	if ( mAtlasFree.size() <= chan ) mAtlasFree.resize ( chan+1 );
+	mAtlasFree[chan].push_back ( id );
+}
+uint64 Allocator::getAtlasFree ( uchar chan )
+{
+	return ( chan < mAtlasFree.size() ) ? mAtlasFree[chan].size() : 0;
+}
+uint64 Allocator::AtlasCompact ( uchar chan, std::vector<uint64>& remap )
+{
+	remap.clear ();
+	if ( chan >= mAtlas.size() ) return 0;
+	uint64 num = mAtlas[chan].num;
+	uint64 moved = 0;
+
+	remap.resize ( num );
+	for (uint64 n=0; n < num; n++ ) remap[n] = n;
+	if ( getAtlasFree(chan) == 0 ) return 0;
+
+	// Plan moves of bricks from end of atlas into free bricks
+	std::vector<uint64>& fl = mAtlasFree[chan];
+	std::vector<char> used ( num, 1 );
+	for (uint64 n=0; n < fl.size(); n++ ) { used[ fl[n] ] = 0; remap[ fl[n] ] = ID_UNDEFL; }
+	uint64 i = 0, j = num;
+	for (;;) {
+		while ( i < j && used[i] ) i++;			// next free brick
+		while ( j > i && !used[j-1] ) j--;		// last used brick
+		if ( i >= j ) break;
+		j--;
+		remap[j] = i;
+		used[i] = 1;	used[j] = 0;
+		moved++;
+	}
+	uint64 newnum = num - fl.size();
+	fl.clear ();
+
+	AtlasRemap ( chan, remap, newnum );
+	return moved;
+}
+void Allocator::AtlasRemap ( uchar chan, const std::vector<uint64>& remap, uint64 num )
+{
+	DataPtr& p = mAtlas[chan];
+	int dsize = getSize ( p.type );
+	int bres = int(p.stride + (p.apron << 1));			// brick res including apron
+	Vector3DI atlasres = getAtlasRes ( chan );
+	Vector3DI src, dst;
+
+	if ( chan < mAtlasFree.size() ) mAtlasFree[chan].clear ();
+
+	for (uint64 n=0; n < remap.size() && n < p.max; n++ ) {		// remap follows channel 0, num of other channels is not kept
+		if ( remap[n] == n || remap[n] == ID_UNDEFL ) continue;
+		src = getAtlasPos ( chan, n ) - int(p.apron);
+		dst = getAtlasPos ( chan, remap[n] ) - int(p.apron);
+
+		// Move brick on cpu
+		if ( p.cpu != 0x0 ) {
+			for (int z=0; z < bres; z++ )
+				for (int y=0; y < bres; y++ ) 
+					memcpy ( p.cpu + ((uint64(dst.z+z)*atlasres.y + (dst.y+y))*atlasres.x + dst.x) * dsize,
+							 p.cpu + ((uint64(src.z+z)*atlasres.y + (src.y+y))*atlasres.x + src.x) * dsize, bres*dsize );
+		}
+		// Move brick on gpu
+		if ( mbGPU && p.garray != 0x0 ) {
+			CUDA_MEMCPY3D cp = {0};
+			cp.srcMemoryType = CU_MEMORYTYPE_ARRAY;
+			cp.srcArray = p.garray;
+			cp.srcXInBytes = src.x * dsize;		cp.srcY = src.y;	cp.srcZ = src.z;
+			cp.dstMemoryType = CU_MEMORYTYPE_ARRAY;
+			cp.dstArray = p.garray;
+			cp.dstXInBytes = dst.x * dsize;		cp.dstY = dst.y;	cp.dstZ = dst.z;
+			cp.WidthInBytes = bres * dsize;
+			cp.Height = bres;
+			cp.Depth = bres;
+			cudaCheck ( cuMemcpy3D ( &cp ), "cuMemcpy3D", "AtlasRemap" );
+		}
+	}
+	p.num = num;
+}
+
+// Move bricks given a permutation of all bricks (remap[old] = new).
+// Unlike AtlasRemap, destinations may hold live bricks. Each cycle of the permutation
+// is followed backwards from its first brick, which is held in host memory meanwhile.
+void Allocator::AtlasPermute ( uchar chan, const std::vector<uint64>& remap )
+{
+	DataPtr& p = mAtlas[chan];
+	int dsize = getSize ( p.type );
+	int bres = int(p.stride + (p.apron << 1));			// brick res including apron
+	Vector3DI atlasres = getAtlasRes ( chan );
+	uint64 num = std::min ( (uint64) remap.size(), p.max );		// remap follows channel 0
+	bool bGPU = ( mbGPU && p.garray != 0x0 );
+
+	std::vector<uint64> inv ( num, ID_UNDEFL );
+	for (uint64 n=0; n < num; n++ )
+		if ( remap[n] < num ) inv[ remap[n] ] = n;
+
+	std::vector<char> cpu_tmp ( p.cpu != 0x0 ? uint64(bres)*bres*bres*dsize : 0 );
+	std::vector<char> gpu_tmp ( bGPU ? uint64(bres)*bres*bres*dsize : 0 );
+
+	// Copy a brick between atlas ids, or to/from host memory when an id is ID_UNDEFL
+	auto copyBrick = [&] ( uint64 src_id, uint64 dst_id ) {
+		Vector3DI src = (src_id == ID_UNDEFL) ? Vector3DI(0,0,0) : getAtlasPos ( chan, src_id ) - int(p.apron);
+		Vector3DI dst = (dst_id == ID_UNDEFL) ? Vector3DI(0,0,0) : getAtlasPos ( chan, dst_id ) - int(p.apron);
+		if ( p.cpu != 0x0 ) {
+			for (int z=0; z < bres; z++ )
+				for (int y=0; y < bres; y++ ) {
+					char* tmp = &cpu_tmp[ (uint64(z)*bres + y)*bres*dsize ];
+					char* s = (src_id == ID_UNDEFL) ? tmp : p.cpu + ((uint64(src.z+z)*atlasres.y + (src.y+y))*atlasres.x + src.x) * dsize;
+					char* d = (dst_id == ID_UNDEFL) ? tmp : p.cpu + ((uint64(dst.z+z)*atlasres.y + (dst.y+y))*atlasres.x + dst.x) * dsize;
+					memcpy ( d, s, bres*dsize );
+				}
+		}
+		if ( bGPU ) {
+			CUDA_MEMCPY3D cp = {0};
+			if ( src_id == ID_UNDEFL ) {
+				cp.srcMemoryType = CU_MEMORYTYPE_HOST;
+				cp.srcHost = &gpu_tmp[0];
+				cp.srcPitch = bres * dsize;
+				cp.srcHeight = bres;
+			} else {
+				cp.srcMemoryType = CU_MEMORYTYPE_ARRAY;
+				cp.srcArray = p.garray;
+				cp.srcXInBytes = src.x * dsize;		cp.srcY = src.y;	cp.srcZ = src.z;
+			}
+			if ( dst_id == ID_UNDEFL ) {
+				cp.dstMemoryType = CU_MEMORYTYPE_HOST;
+				cp.dstHost = &gpu_tmp[0];
+				cp.dstPitch = bres * dsize;
+				cp.dstHeight = bres;
+			} else {
+				cp.dstMemoryType = CU_MEMORYTYPE_ARRAY;
+				cp.dstArray = p.garray;
+				cp.dstXInBytes = dst.x * dsize;		cp.dstY = dst.y;	cp.dstZ = dst.z;
+			}
+			cp.WidthInBytes = bres * dsize;
+			cp.Height = bres;
+			cp.Depth = bres;
+			cudaCheck ( cuMemcpy3D ( &cp ), "cuMemcpy3D", "AtlasPermute" );
+		}
+	};
+
+	std::vector<char> done ( num, 0 );
+	for (uint64 n=0; n < num; n++ ) {
+		if ( done[n] || remap[n] == n || inv[n] == ID_UNDEFL ) continue;
+		copyBrick ( n, ID_UNDEFL );						// hold first brick of cycle
+		uint64 i = n;
+		for (; inv[i] != n && inv[i] != ID_UNDEFL; i = inv[i] ) {	// fill each brick from the one moving into it
+			copyBrick ( inv[i], i );
+			done[i] = 1;
+		}
+		copyBrick ( ID_UNDEFL, i );
+		done[i] = 1;
+	}
+	if ( chan < mAtlasFree.size() ) mAtlasFree[chan].clear ();
+}
 
 Vector3DI Allocator::getAtlasPos ( uchar chan, uint64 id )
 {
@@ -601,6 +1053,12 @@ Vector3DI Allocator::getAtlasPos ( uchar chan, uint64 id )
 	p = p * int(mAtlas[chan].stride + (mAtlas[chan].apron << 1) ) + mAtlas[chan].apron;
 	return p;
 }
+uint64 Allocator::getAtlasId ( uchar chan, Vector3DI val )
+{
+	Vector3DI ac = mAtlas[chan].subdim;		// axis count	
+	Vector3DI p = (val - int(mAtlas[chan].apron)) / int(mAtlas[chan].stride + (mAtlas[chan].apron << 1) );
+	return (uint64(p.z)*ac.y + p.y)*ac.x + p.x;
+}
 
 void Allocator::AtlasAppendLinearCPU ( uchar chan, int n, float* src )
 {
@@ -615,11 +1073,91 @@ void Allocator::AtlasAppendLinearCPU ( uchar chan, int n, float* src )
 
 extern "C" CUresult cudaCopyData ( cudaArray* dest, int dx, int dy, int dz, int dest_res, cudaArray* src, int src_res );
 
+// Host copy of a 3D sub-volume into the cpu atlas (host-only allocator)
+void Allocator::AtlasCopyHost ( uchar chan, Vector3DI val, Vector3DI brickres, const char* src, bool bZYX )
+{
+	Vector3DI atlasres = getAtlasRes(chan);
+	int dsize = getSize ( mAtlas[chan].type );
+	char* dst = mAtlas[chan].cpu;
+	if ( dst == 0x0 || src == 0x0 ) return;
+
+	Vector3DI t;
+	for ( t.z=0; t.z < brickres.z; t.z++ )
+		for ( t.y=0; t.y < brickres.y; t.y++ )
+			for ( t.x=0; t.x < brickres.x; t.x++ ) {
+				uint64 s = bZYX ? (uint64(t.x)*brickres.y + t.y)*brickres.x + t.z : (uint64(t.z)*brickres.y + t.y)*brickres.x + t.x;
+				uint64 d = (uint64(t.z+val.z)*atlasres.y + (t.y+val.y))*atlasres.x + (t.x+val.x);
+				memcpy ( dst + d*dsize, src + s*dsize, dsize );
+			}
+}
+
+// Write one brick, including apron, from host memory (used by paging)
+void Allocator::AtlasWriteBrick ( uchar chan, Vector3DI val, const char* src )
+{
+	DataPtr& p = mAtlas[chan];
+	int dsize = getSize ( p.type );
+	int bres = int(p.stride + (p.apron << 1));
+	Vector3DI atlasres = getAtlasRes ( chan );
+	Vector3DI dst = val - int(p.apron);
+
+	if ( p.cpu != 0x0 ) {
+		for (int z=0; z < bres; z++ )
+			for (int y=0; y < bres; y++ )
+				memcpy ( p.cpu + ((uint64(dst.z+z)*atlasres.y + (dst.y+y))*atlasres.x + dst.x) * dsize, src + (uint64(z)*bres + y)*bres*dsize, bres*dsize );
+	}
+	if ( mbGPU && p.garray != 0x0 ) {
+		CUDA_MEMCPY3D cp = {0};
+		cp.srcMemoryType = CU_MEMORYTYPE_HOST;
+		cp.srcHost = src;
+		cp.srcPitch = bres * dsize;
+		cp.srcHeight = bres;
+		cp.dstMemoryType = CU_MEMORYTYPE_ARRAY;
+		cp.dstArray = p.garray;
+		cp.dstXInBytes = dst.x * dsize;		cp.dstY = dst.y;	cp.dstZ = dst.z;
+		cp.WidthInBytes = bres * dsize;
+		cp.Height = bres;
+		cp.Depth = bres;
+		cudaCheck ( cuMemcpy3D ( &cp ), "cuMemcpy3D", "AtlasWriteBrick" );
+	}
+}
+
+// Read one brick, including apron, into host memory. From the device atlas when present.
+void Allocator::AtlasReadBrick ( uchar chan, Vector3DI val, char* dst )
+{
+	DataPtr& p = mAtlas[chan];
+	int dsize = getSize ( p.type );
+	int bres = int(p.stride + (p.apron << 1));
+	Vector3DI atlasres = getAtlasRes ( chan );
+	Vector3DI src = val - int(p.apron);
+
+	if ( mbGPU && p.garray != 0x0 ) {
+		CUDA_MEMCPY3D cp = {0};
+		cp.srcMemoryType = CU_MEMORYTYPE_ARRAY;
+		cp.srcArray = p.garray;
+		cp.srcXInBytes = src.x * dsize;		cp.srcY = src.y;	cp.srcZ = src.z;
+		cp.dstMemoryType = CU_MEMORYTYPE_HOST;
+		cp.dstHost = dst;
+		cp.dstPitch = bres * dsize;
+		cp.dstHeight = bres;
+		cp.WidthInBytes = bres * dsize;
+		cp.Height = bres;
+		cp.Depth = bres;
+		cudaCheck ( cuMemcpy3D ( &cp ), "cuMemcpy3D", "AtlasReadBrick" );
+		return;
+	}
+	if ( p.cpu == 0x0 ) return;
+	for (int z=0; z < bres; z++ )
+		for (int y=0; y < bres; y++ )
+			memcpy ( dst + (uint64(z)*bres + y)*bres*dsize, p.cpu + ((uint64(src.z+z)*atlasres.y + (src.y+y))*atlasres.x + src.x) * dsize, bres*dsize );
+}
+
 void Allocator::AtlasCopyTex ( uchar chan, Vector3DI val, const DataPtr& src )
 {
 	Vector3DI atlasres = getAtlasRes(chan);
 	Vector3DI brickres = src.subdim;
 
+	if ( !mbGPU ) { AtlasCopyHost ( chan, val, brickres, src.cpu, false ); return; }
+
 	Vector3DI block ( 8, 8, 8 );
 	Vector3DI grid ( int(brickres.x/block.x)+1, int(brickres.y/block.y)+1, int(brickres.z/block.z)+1 );	
 
@@ -640,6 +1178,11 @@ void Allocator::AtlasCopyLinear ( uchar chan, Vector3DI offset, CUdeviceptr gpu_
 	Vector3DI brickres = Vector3DI(br,br,br);
 	Vector3DI block ( 8, 8, 8 );
 	Vector3DI grid ( int(brickres.x/block.x)+1, int(brickres.y/block.y)+1, int(brickres.z/block.z)+1 );	
+
+	if ( !mbGPU ) {
+		gprintf ( "ERROR: AtlasCopyLinear requires a device buffer. Not available on host-only allocator.\n" );
+		return;
+	}
 	
 	cudaCheck ( cuSurfRefSetArray( cuSurfWrite, reinterpret_cast<CUarray>(mAtlas[chan].garray), 0 ), "cuSurfRefSetArray", "AtlasCopyLinear" );	
 
@@ -655,6 +1198,19 @@ void Allocator::AtlasRetrieveTexXYZ ( uchar chan, Vector3DI val, DataPtr& dest )
 {
 	Vector3DI atlasres = getAtlasRes(chan);
 	int brickres = mAtlas[chan].stride;
+
+	if ( !mbGPU ) {
+		// host retrieve, output is stored ZYX (see kernelRetrieveTexXYZ)
+		float* src = (float*) mAtlas[chan].cpu;
+		float* buf = (float*) dest.cpu;
+		if ( src == 0x0 || buf == 0x0 ) return;
+		Vector3DI t;
+		for ( t.z=0; t.z < brickres; t.z++ )
+			for ( t.y=0; t.y < brickres; t.y++ )
+				for ( t.x=0; t.x < brickres; t.x++ )
+					buf[ (t.x*brickres + t.y)*brickres + t.z ] = src[ (uint64(t.z+val.z)*atlasres.y + (t.y+val.y))*atlasres.x + (t.x+val.x) ];
+		return;
+	}
 	
 	Vector3DI block ( 8, 8, 8 );
 	Vector3DI grid ( int(brickres/block.x)+1, int(brickres/block.y)+1, int(brickres/block.z)+1 );	
@@ -675,6 +1231,8 @@ void Allocator::AtlasCopyTexZYX ( uchar chan, Vector3DI val, const DataPtr& src
 	Vector3DI atlasres = getAtlasRes(chan);
 	int brickres = src.stride;
 
+	if ( !mbGPU ) { AtlasCopyHost ( chan, val, Vector3DI(brickres,brickres,brickres), src.cpu, true ); return; }
+
 	Vector3DI block ( 8, 8, 8 );
 	Vector3DI grid ( int(brickres/block.x)+1, int(brickres/block.y)+1, int(brickres/block.z)+1 );	
 
@@ -695,12 +1253,18 @@ void Allocator::AtlasCommitFromCPU ( uchar chan, uchar* src )
 {
 	Vector3DI res = mAtlas[chan].subdim * int(mAtlas[chan].stride + (int(mAtlas[chan].apron) << 1) );		// atlas res
 
+	if ( !mbGPU ) {
+		// host atlas is the cpu copy
+		if ( src != (uchar*) mAtlas[chan].cpu ) memcpy ( mAtlas[chan].cpu, src, mAtlas[chan].size );
+		return;
+	}
+
 	CUDA_MEMCPY3D cp = {0};
 	cp.dstMemoryType = CU_MEMORYTYPE_ARRAY;
 	cp.dstArray = mAtlas[chan].garray;
 	cp.srcMemoryType = CU_MEMORYTYPE_HOST;
 	cp.srcHost = src;
-	cp.WidthInBytes = res.x*sizeof(float);
+	cp.WidthInBytes = res.x*getSize(mAtlas[chan].type);
 	cp.Height = res.y;
 	cp.Depth = res.z;
 	
@@ -712,6 +1276,11 @@ void Allocator::AtlasFill ( uchar chan )
 	Vector3DI atlasres = getAtlasRes(chan);	
 	Vector3DI block ( 8, 8, 8 );
 	Vector3DI grid ( int(atlasres.x/block.x)+1, int(atlasres.y/block.y)+1, int(atlasres.z/block.z)+1 );	
+
+	if ( !mbGPU ) {
+		if ( mAtlas[chan].cpu != 0x0 ) memset ( mAtlas[chan].cpu, 0, mAtlas[chan].size );
+		return;
+	}
 	
 	cudaCheck ( cuSurfRefSetArray( cuSurfWrite, reinterpret_cast<CUarray>(mAtlas[chan].garray), 0 ), "cuSurfRefSetArray", "AtlasFill" );	
 	int dsize = getSize( mAtlas[chan].type );
@@ -727,6 +1296,12 @@ void Allocator::AtlasRetrieveSlice ( uchar chan, int slice, int sz, CUdeviceptr
 	Vector3DI grid ( int(atlasres.x/block.x)+1, int(atlasres.y/block.y)+1, 1 );	
 	void* args[3] = { &slice, &atlasres, &gpu_buf };
 
+	if ( !mbGPU ) {
+		uint64 slicesz = uint64(atlasres.x) * atlasres.y * getSize( mAtlas[chan].type );
+		memcpy ( cpu_dest, mAtlas[chan].cpu + slice * slicesz, slicesz );
+		return;
+	}
+
 	CUDA_MEMCPY3D cp = {0};	
 	cp.srcMemoryType = CU_MEMORYTYPE_ARRAY;
 	cp.srcArray = mAtlas[chan].garray;	
@@ -747,6 +1322,11 @@ void Allocator::AtlasWriteSlice ( uchar chan, int slice, int sz, CUdeviceptr gpu
 	Vector3DI grid ( int(atlasres.x/block.x)+1, int(atlasres.y/block.y)+1, 1 );		
 	void* args[3] = { &slice, &atlasres, &gpu_buf };
 
+	if ( !mbGPU ) {
+		uint64 slicesz = uint64(atlasres.x) * atlasres.y * getSize( mAtlas[chan].type );
+		memcpy ( mAtlas[chan].cpu + slice * slicesz, cpu_src, slicesz );
+		return;
+	}
 
 	CUDA_MEMCPY3D cp = {0};	
 	cp.dstMemoryType = CU_MEMORYTYPE_ARRAY;
@@ -798,7 +1378,7 @@ void Allocator::AtlasReleaseAll ()
 
 		// Free cpu memory
 		if ( mAtlas[n].cpu != 0x0 ) {
-			free ( mAtlas[n].cpu );
+			FreeCPU ( mAtlas[n].cpu );
 			mAtlas[n].cpu = 0x0;
 		}
 
@@ -822,6 +1402,7 @@ void Allocator::AtlasReleaseAll ()
 	}
 
 	mAtlas.clear ();
+	mAtlasFree.clear ();
 
 	for (int n=0; n < mAtlasMap.size(); n++ )  {
 		// Free cpu memory
@@ -860,11 +1441,206 @@ void Allocator::PoolWrite ( FILE* fp, uchar grp, uchar lev )
 }
 void Allocator::PoolRead ( FILE* fp, uchar grp, uchar lev, int cnt, int wid )
 {
-	char* dat = getPoolCPU (grp,lev );
-	fread ( dat, wid, cnt, fp );
+	DataPtr* p = &mPool[grp][lev];
+	if ( uint64(cnt) * wid > p->size ) {
+		// Grow pool to hold the file data (e.g. child list pools sized by count)
+		uint64 gpu_size = p->size;
+		if ( p->cpu != 0x0 ) FreeCPU ( p->cpu );
+		p->max = cnt;
+		p->size = uint64(cnt) * wid;
+		p->cpu = (char*) malloc ( p->size );
+		if ( p->gpu != 0x0 && gpu_size < p->size ) {
+			cudaCheck ( cuMemFree ( p->gpu ), "cuMemFree", "PoolRead" );
+			cudaCheck ( cuMemAlloc ( &p->gpu, p->size ), "cuMemAlloc", "PoolRead" );
+		}
+	}
+	fread ( p->cpu, wid, cnt, fp );
 
-	mPool[grp][lev].num = cnt;
-	mPool[grp][lev].stride = wid;
+	p->num = cnt;
+	p->stride = wid;
+}
+void Allocator::PoolMap ( uchar grp, uchar lev, char* src, int cnt, int wid )
+{
+	// Point pool directly at mapped file data. Pages are copy-on-write, 
+	// and the pool is copied out to owned memory when it grows.
+	if ( lev >= mPool[grp].size() || cnt == 0 || src == 0x0 ) return;
+	DataPtr* p = &mPool[grp][lev];
+	uint64 gpu_size = p->size;
+	if ( p->cpu != 0x0 ) FreeCPU ( p->cpu );
+	p->cpu = src;
+	p->num = cnt;
+	p->max = cnt;
+	p->stride = wid;
+	p->size = uint64(cnt) * wid;
+
+	if ( p->gpu != 0x0 && gpu_size < p->size ) {
+		cudaCheck ( cuMemFree ( p->gpu ), "cuMemFree", "PoolMap" );
+		cudaCheck ( cuMemAlloc ( &p->gpu, p->size ), "cuMemAlloc", "PoolMap" );		
+	}
+}
+void Allocator::PoolSwap ( uchar grp, uchar lev, Allocator* src )
+{
+	// Exchange cpu pool memory with another allocator (e.g. a host-only staging allocator). 
+	// Neither pool may be mapped. The gpu pool is grown if needed, but not committed.
+	if ( lev >= mPool[grp].size() || lev >= src->mPool[grp].size() ) return;
+	DataPtr* p = &mPool[grp][lev];
+	DataPtr* s = &src->mPool[grp][lev];
+	uint64 gpu_size = (p->gpu != 0x0) ? p->size : 0;
+	std::swap ( p->cpu, s->cpu );
+	std::swap ( p->num, s->num );
+	std::swap ( p->max, s->max );
+	std::swap ( p->size, s->size );
+	std::swap ( p->stride, s->stride );
+	if ( mPoolFree[grp].size() <= lev ) mPoolFree[grp].resize ( lev+1 );
+	if ( src->mPoolFree[grp].size() <= lev ) src->mPoolFree[grp].resize ( lev+1 );
+	mPoolFree[grp][lev].swap ( src->mPoolFree[grp][lev] );
+	if ( mPoolRunFree[grp].size() <= lev ) mPoolRunFree[grp].resize ( lev+1 );
+	if ( src->mPoolRunFree[grp].size() <= lev ) src->mPoolRunFree[grp].resize ( lev+1 );
+	mPoolRunFree[grp][lev].swap ( src->mPoolRunFree[grp][lev] );
+
+	if ( mbGPU && gpu_size < p->size ) {
+		if ( p->gpu != 0x0 ) cudaCheck ( cuMemFree ( p->gpu ), "cuMemFree", "PoolSwap" );
+		cudaCheck ( cuMemAlloc ( &p->gpu, p->size ), "cuMemAlloc", "PoolSwap" );
+	}
+}
+void Allocator::PoolAssign ( uchar grp, uchar lev, char* src, uint64 cnt, uint64 wid )
+{
+	// Replace pool contents with a copy of src (e.g. a repacked pool), clearing its free lists.
+	// The gpu pool is grown if needed, but not committed.
+	if ( lev >= mPool[grp].size() ) return;
+	DataPtr* p = &mPool[grp][lev];
+	uint64 gpu_size = p->size;
+	uint64 newmax = 1;
+	while ( newmax < cnt ) newmax *= 2;
+	if ( p->cpu != 0x0 ) FreeCPU ( p->cpu );
+	p->cpu = (char*) malloc ( newmax * wid );
+	if ( cnt > 0 ) memcpy ( p->cpu, src, cnt * wid );
+	p->num = cnt;
+	p->max = newmax;
+	p->stride = wid;
+	p->size = newmax * wid;
+	if ( lev < mPoolFree[grp].size() ) mPoolFree[grp][lev].clear ();
+	if ( lev < mPoolRunFree[grp].size() ) mPoolRunFree[grp][lev].clear ();
+
+	if ( p->gpu != 0x0 && gpu_size < p->size ) {
+		cudaCheck ( cuMemFree ( p->gpu ), "cuMemFree", "PoolAssign" );
+		cudaCheck ( cuMemAlloc ( &p->gpu, p->size ), "cuMemAlloc", "PoolAssign" );
+	}
+}
+void Allocator::AtlasSwap ( uchar chan, Allocator* src )
+{
+	// Exchange cpu atlas memory with another allocator having the same atlas layout, 
+	// then commit to gpu. An atlas without cpu memory is committed directly from src.
+	DataPtr& p = mAtlas[chan];
+	DataPtr& s = src->mAtlas[chan];
+	if ( p.size != s.size || isMapped ( s.cpu ) ) {
+		gprintf ( "ERROR: AtlasSwap requires atlas of the same layout (chan %d).\n", chan );
+		return;
+	}
+	if ( p.cpu != 0x0 ) std::swap ( p.cpu, s.cpu );
+	p.num = s.num;
+	AtlasCommitFromCPU ( chan, (uchar*) ( (p.cpu != 0x0) ? p.cpu : s.cpu ) );
+}
+void Allocator::AtlasMap ( uchar chan, char* src, Vector3DI axiscnt )
+{
+	// Point cpu atlas directly at mapped file data (copy-on-write). 
+	// The gpu atlas is committed in one transfer from the mapped pages.
+	DataPtr& p = mAtlas[chan];
+	Vector3DI axisres = axiscnt * int(p.stride + (p.apron << 1));
+	p.max = axiscnt.x * axiscnt.y * axiscnt.z;
+	p.size = uint64(getSize(p.type)) * axisres.x * uint64(axisres.y) * axisres.z;
+	p.subdim = axiscnt;
+
+	if ( mbGPU ) {
+		AllocateTextureGPU ( p, p.type, axisres, (p.glid!=-1), 0 );
+		AtlasCommitFromCPU ( chan, (uchar*) src );
+	}
+	if ( p.cpu != 0x0 || !mbGPU ) {
+		if ( p.cpu != 0x0 ) FreeCPU ( p.cpu );
+		p.cpu = src;
+	}
+}
+
+// Map file into memory
+// - Mapping is private, writes to mapped pages are copy-on-write and never reach the file.
+// - bLazy=false pre-faults the whole file, bLazy=true pages data in on first access.
+bool Allocator::MapFile ( const char* fname, bool bLazy )
+{
+	UnmapFile ( true );			// copies out pools still using the old mapping, release them first to avoid it
+
+	#if defined(_WIN32)
+		HANDLE file = CreateFileA ( fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+		if ( file == INVALID_HANDLE_VALUE ) return false;
+		LARGE_INTEGER sz;
+		GetFileSizeEx ( file, &sz );
+		HANDLE hmap = CreateFileMappingA ( file, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+		if ( hmap == NULL ) { CloseHandle ( file ); return false; }
+		char* data = (char*) MapViewOfFile ( hmap, FILE_MAP_COPY, 0, 0, 0 );
+		if ( data == 0x0 ) { CloseHandle ( hmap ); CloseHandle ( file ); return false; }
+		mMapFile = file;
+		mMapHandle = hmap;
+		mMapSize = sz.QuadPart;
+	#else
+		int fd = open ( fname, O_RDONLY );
+		if ( fd == -1 ) return false;
+		struct stat st;
+		if ( fstat ( fd, &st ) != 0 || st.st_size == 0 ) { close ( fd ); return false; }
+		void* data = mmap ( 0x0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+		close ( fd );											// mapping keeps file referenced
+		if ( data == MAP_FAILED ) return false;
+		mMapSize = st.st_size;
+	#endif
+
+	// Pre-fault pages by reading them. (MAP_POPULATE would fault a writable 
+	// private mapping for write, giving every page a private copy.)
+	if ( !bLazy ) {
+		volatile char sum = 0;
+		for (uint64 n=0; n < mMapSize; n += 4096 ) sum += ((char*) data)[n];
+	}
+	mMapData = (char*) data;
+	return true;
+}
+
+// Release file mapping
+// - Mapping is kept until the next MapFile or UnmapFile, pool and atlas release do not unmap.
+// - bDetach=true copies any pool or atlas still pointing into the mapping to owned memory
+// - bDetach=false only releases the mapping when nothing refers to it
+void Allocator::UnmapFile ( bool bDetach )
+{
+	if ( mMapData == 0x0 ) return;
+
+	for (int grp=0; grp < MAX_POOL; grp++) 
+		for (size_t lev=0; lev < mPool[grp].size(); lev++ )  
+			if ( isMapped ( mPool[grp][lev].cpu ) ) {
+				if ( !bDetach ) return;
+				char* dat = (char*) malloc ( mPool[grp][lev].size );
+				memcpy ( dat, mPool[grp][lev].cpu, mPool[grp][lev].size );
+				mPool[grp][lev].cpu = dat;
+			}
+	for (size_t n=0; n < mAtlas.size(); n++ )
+		if ( isMapped ( mAtlas[n].cpu ) ) {
+			if ( !bDetach ) return;
+			char* dat = (char*) malloc ( mAtlas[n].size );
+			memcpy ( dat, mAtlas[n].cpu, mAtlas[n].size );
+			mAtlas[n].cpu = dat;
+		}
+
+	#if defined(_WIN32)
+		UnmapViewOfFile ( mMapData );
+		CloseHandle ( (HANDLE) mMapHandle );
+		CloseHandle ( (HANDLE) mMapFile );
+	#else
+		munmap ( mMapData, mMapSize );
+	#endif
+	mMapData = 0x0;
+	mMapSize = 0;
+	mMapFile = 0x0;
+	mMapHandle = 0x0;
+}
+
+void Allocator::FreeCPU ( char* dat )
+{
+	if ( !isMapped ( dat ) ) free ( dat );		// mapped data is released by UnmapFile
 }
 
 void Allocator::AtlasWrite ( FILE* fp, uchar chan )
@@ -44,11 +44,12 @@
 	// Pool Pointer
 	// Smart pointer for all CPU/GPU pointers 
 	struct GVDB_API DataPtr {
-		DataPtr () { type=T_UCHAR; num=0; max=0; size=0; stride=0; cpu=0; glid=0; grsc=0; gpu=0; }		
+		DataPtr () { type=T_UCHAR; num=0; max=0; size=0; cap=0; stride=0; cpu=0; glid=0; grsc=0; gpu=0; }		
 		char		type;				// data type
 		char		apron;				// apron size
 		uint64		num, max;			// element count
 		uint64		size;				// size of data
+		uint64		cap;				// allocated bytes (>= size)
 		uint64		stride;				// stride of data	
 		Vector3DI	subdim;				// subdim		
 		Allocator*	alloc;				// allocator instance
@@ -70,7 +71,8 @@
 	// Primary memory handler for GVDB
 	class Allocator {
 	public:
-		Allocator();
+		Allocator( bool bGPU = true );									// bGPU=false, host-only (no CUDA calls)
+		bool	hasGPU ()		{ return mbGPU; }
 		
 		// Pool functions
 		void	PoolCreate ( uchar grp, uchar lev, uint64 width, uint64 initmax, bool bGPU );		// create a pool		
@@ -84,12 +86,20 @@
 		void	PoolFetch(int grp, int lev );
 
 		uint64	PoolAlloc ( uchar grp, uchar lev, bool bGPU );		// allocate on pool
-		void	PoolFree ( uint64 id );								// free from pool		
+		uint64	PoolAllocN ( uchar grp, uchar lev, uint64 cnt );	// allocate cnt contiguous elements, returns first
+		void	PoolFree ( uint64 id );								// free from pool (reused by PoolAlloc)
+		uint64	PoolAllocRun ( uchar grp, uchar lev, uint64 cnt, bool bGrow = true );	// allocate a run of cnt (power of two) contiguous elements, ID_UNDEFL if full and !bGrow
+		void	PoolFreeRun ( uint64 id, uint64 cnt );				// free a run (reused by PoolAllocRun of the same size)
+		uint64	PoolCompact ( uchar grp, uchar lev, std::vector<uint64>& remap );	// defragment pool, returns remap of old to new index
+		void	PoolReserve ( uchar grp, uchar lev, uint64 cnt, bool bGPU );	// grow capacity to at least cnt elements (bGPU=false, host only)
+		void	PoolResizeGPU ( uchar grp, uchar lev );								// match gpu memory to host capacity, commit after
 		char*	PoolData ( uint64 id );								// get data ptr
 		char*	PoolData ( uchar grp, uchar lev, uint64 ndx );
 		uint64* PoolData64 ( uint64 id );		
 		uint64	getPoolCnt ( uchar grp, uchar lev )	{ return mPool[grp][lev].num; }
 		uint64  getPoolMax ( uchar grp, uchar lev ) { return mPool[grp][lev].max; }
+		uint64  getPoolFree ( uchar grp, uchar lev );					// number of freed elements (PoolFree)
+		uint64  getPoolRunFree ( uchar grp, uchar lev );				// number of elements in freed runs (PoolFreeRun)
 		char*	getPoolCPU ( uchar grp, uchar lev ) { return mPool[grp][lev].cpu; }
 		uint64  getPoolSize ( uchar grp, uchar lev ) { return mPool[grp][lev].size; }
 		CUdeviceptr	getPoolGPU ( uchar grp, uchar lev )	{ return mPool[grp][lev].gpu; }
@@ -97,6 +107,16 @@
 		int		getPoolMem ();		
 		void	PoolWrite ( FILE* fp, uchar grp, uchar lev );
 		void	PoolRead ( FILE* fp, uchar grp, uchar lev, int cnt, int wid );
+		void	PoolMap ( uchar grp, uchar lev, char* src, int cnt, int wid );		// point pool at mapped file data
+		void	PoolSwap ( uchar grp, uchar lev, Allocator* src );					// exchange cpu pool memory with another allocator
+		void	PoolAssign ( uchar grp, uchar lev, char* src, uint64 cnt, uint64 wid );	// replace pool contents with a copy of src
+		
+		// Mapped file functions
+		bool	MapFile ( const char* fname, bool bLazy );						// map file copy-on-write 
+		void	UnmapFile ( bool bDetach );
+		char*	getMapData ()					{ return mMapData; }
+		uint64	getMapSize ()					{ return mMapSize; }
+		bool	isMapped ( char* dat )			{ return dat != 0x0 && dat >= mMapData && dat < mMapData + mMapSize; }
 		
 		// Texture functions
 		bool	TextureCreate ( uchar chan, uchar dtype, Vector3DI res, bool bCPU, bool bGL );
@@ -111,13 +131,20 @@
 		void	AtlasSetNum ( uchar chan, int n );
 		void	AtlasReleaseAll ();
 		void	AtlasEmptyAll ();
-		bool	AtlasAlloc ( uchar chan, Vector3DI& val );
+		bool	AtlasAlloc ( uchar chan, Vector3DI& val );						// allocate brick, reuses freed bricks first
+		void	AtlasFree ( uchar chan, Vector3DI val );						// return brick to channel free list
+		uint64	AtlasCompact ( uchar chan, std::vector<uint64>& remap );		// move bricks into free bricks, returns remap of old to new brick id
+		void	AtlasRemap ( uchar chan, const std::vector<uint64>& remap, uint64 num );	// move bricks given a remap (e.g. from another channel)
+		void	AtlasPermute ( uchar chan, const std::vector<uint64>& remap );		// move bricks given a permutation of all bricks
 		void	AtlasFill ( uchar chan );		
 		void	AtlasCommit ( uchar chan );										// commit CPU atlas data to GPU
 		void	AtlasCommitFromCPU ( uchar chan, uchar* src );					// host-to-device copy from 3D to 3D (entire vol)				
 		void	AtlasAppendLinearCPU ( uchar chan, int n, float* src );			// CPU only, append 3D data linearly to end of atlas (no GPU update)
 		void	AtlasCopyTex ( uchar chan, Vector3DI val, const DataPtr& src );		// device-to-device copy 3D sub-vol into 3D 
 		void	AtlasCopyTexZYX ( uchar chan, Vector3DI val, const DataPtr& src );	// device-to-device copy 3D sub-vol into 3D, ZYX order 		
+		void	AtlasCopyHost ( uchar chan, Vector3DI val, Vector3DI brickres, const char* src, bool bZYX );	// host copy 3D sub-vol into cpu atlas
+		void	AtlasWriteBrick ( uchar chan, Vector3DI val, const char* src );	// host brick (with apron, x fastest) into atlas at brick val
+		void	AtlasReadBrick ( uchar chan, Vector3DI val, char* dst );		// atlas brick at val (with apron) to host
 		void	AtlasCopyLinear ( uchar chan, Vector3DI offset, CUdeviceptr gpu_buf );
 		void	AtlasRetrieveSlice ( uchar chan, int y, int sz, CUdeviceptr tempmem, uchar* dest );
 		void	AtlasWriteSlice ( uchar chan, int slice, int sz, CUdeviceptr gpu_buf, uchar* cpu_src );
@@ -125,11 +152,15 @@
 		int		getAtlasMem ();
 		void	AtlasWrite ( FILE* fp, uchar chan );		
 		void	AtlasRead ( FILE* fp, uchar chan, uint64 asize );
+		void	AtlasMap ( uchar chan, char* src, Vector3DI axiscnt );			// point atlas at mapped file data
+		void	AtlasSwap ( uchar chan, Allocator* src );						// exchange cpu atlas with another allocator, and commit
 
 		//void	CreateImage ( DataPtr& p, nvImg& img );
 		void	CreateMemLinear ( DataPtr& p, char* dat, int sz );
 		void	CreateMemLinear ( DataPtr& p, char* dat, int stride, int cnt, bool bCPU );
 		void    FreeMemLinear ( DataPtr& p );
+		bool	ReserveMemLinear ( DataPtr& p, int stride, int cnt, bool bCPU );	// reuse capacity, grow geometrically. true if reallocated
+		void	TrimMemLinear ( DataPtr& p, uint64 sz );						// release capacity above sz bytes
 		void    RetrieveMem ( DataPtr& p);
 		void    CommitMem ( DataPtr& p);
 
@@ -140,6 +171,7 @@
 		// Query functions
 		char*		getAtlasNode ( uchar chan, Vector3DI val );
 		CUdeviceptr getAtlasMapGPU ( uchar chan )		{ return mAtlasMap[chan].gpu; }
+		char*		getAtlasMapCPU ( uchar chan )		{ return (chan < mAtlasMap.size()) ? mAtlasMap[chan].cpu : 0x0; }
 
 		int		getSize ( uchar dtype );
 		int		getNumAtlas ()					{ return (int) mAtlas.size(); }
@@ -148,18 +180,31 @@
 		int		getAtlasGLID ( uchar chan )		{ return mAtlas[chan].glid; }
 		uint64  getAtlasSize ( uchar chan )		{ return (uint64) mAtlas[chan].size; }
 		Vector3DI getAtlasPos ( uchar chan, uint64 id );
+		uint64	getAtlasId ( uchar chan, Vector3DI val );
+		uint64	getAtlasFree ( uchar chan );			// number of freed bricks
 		Vector3DI getAtlasRes ( uchar chan );
 		int		getAtlasBrickres ( uchar chan);		
 		int		getNumLevels ()		{ return (int) mPool[0].size(); }
 		DataPtr* getPool(uchar grp, uchar lev);
 
 	private:
+		void	FreeCPU ( char* dat );							// free cpu memory, unless mapped
+
 
 		std::vector< DataPtr >		mPool[ MAX_POOL ];
+		std::vector< std::vector<uint64> >	mPoolFree[ MAX_POOL ];		// free list per pool level
+		std::vector< std::vector< std::vector<uint64> > > mPoolRunFree[ MAX_POOL ];	// free runs per pool level and size class (log2)
 		std::vector< DataPtr >		mAtlas;
 		std::vector< DataPtr >		mAtlasMap;
+		std::vector< std::vector<uint64> >	mAtlasFree;			// free bricks per channel
 
 		int							mVFBO[2];
+		bool						mbGPU;
+
+		char*						mMapData;			// mapped file (copy-on-write)
+		uint64						mMapSize;
+		void*						mMapFile;			// platform handles
+		void*						mMapHandle;
 
 		static bool					bAllocator;
 		static CUmodule				cuAllocatorModule;
@@ -0,0 +1,268 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+
+#include "gvdb_brickcache.h"
+#include "gvdb_compress.h"
+#include <cstring>
+#include <algorithm>
+
+using namespace nvdb;
+
+BrickCache::BrickCache ()
+{
+	mStoreFile = 0x0;
+	mSpillFile = 0x0;
+	mBres = 0;
+	mBrickBytes = 0;
+	mReq = 0x0;
+	mSlotUse = 0x0;
+	mResident = 0;
+	mSpillCnt = 0;
+	mTick = 1;
+	memset ( &mStats, 0, sizeof(Stats) );
+}
+
+BrickCache::~BrickCache ()
+{
+	Close ();
+}
+
+bool BrickCache::Open ( const char* fname, const char* spill )
+{
+	Close ();
+	mStoreFile = fopen ( fname, "rb" );
+	if ( mStoreFile == 0x0 ) return false;
+	mSpillFile = ( spill != 0x0 && spill[0] != '\0' ) ? fopen ( spill, "w+b" ) : tmpfile ();
+	if ( mSpillFile == 0x0 ) {
+		gprintf ( "ERROR: BrickCache unable to create spill file.\n" );
+		Close ();
+		return false;
+	}
+	return true;
+}
+
+void BrickCache::Close ()
+{
+	if ( mStoreFile != 0x0 ) fclose ( mStoreFile );
+	if ( mSpillFile != 0x0 ) fclose ( mSpillFile );
+	mStoreFile = 0x0;
+	mSpillFile = 0x0;
+	delete [] mReq;			mReq = 0x0;
+	delete [] mSlotUse;		mSlotUse = 0x0;
+	mChan.clear ();
+	mStore.clear ();	mSlot.clear ();		mSpill.clear ();
+	mSlotLeaf.clear ();	mSlotDirty.clear ();	mFree.clear ();		mVictims.clear ();
+	mQueue.clear ();
+	mResident = 0;
+	mSpillCnt = 0;
+}
+
+// Size residency tables. Channels must be added first.
+void BrickCache::Setup ( uint64 leaves, uint64 slots, int bres, Vector3DI axiscnt, Vector3DI axisres )
+{
+	mBres = bres;
+	mAxisCnt = axiscnt;
+	mAxisRes = axisres;
+	mBrickBytes = 0;
+	for (size_t n=0; n < mChan.size(); n++ )
+		mBrickBytes += uint64(bres)*bres*bres*mChan[n].dsize;
+
+	mStore.assign ( leaves, ID_UNDEFL );
+	mSlot.assign ( leaves, ID_UNDEFL );
+	mSpill.assign ( leaves, ID_UNDEFL );
+	delete [] mReq;
+	mReq = new std::atomic<uchar> [ leaves ];
+	for (uint64 n=0; n < leaves; n++ ) mReq[n] = 0;
+
+	mSlotLeaf.assign ( slots, ID_UNDEFL );
+	mSlotDirty.assign ( slots, 0 );
+	delete [] mSlotUse;
+	mSlotUse = new std::atomic<uint> [ slots ];
+	mFree.resize ( slots );
+	for (uint64 n=0; n < slots; n++ ) {
+		mSlotUse[n] = 0;
+		mFree[n] = slots-1-n;				// lowest slot first
+	}
+	mQueue.clear ();
+	mVictims.clear ();
+	mResident = 0;
+	mSpillCnt = 0;
+	mTick = 1;
+}
+
+bool BrickCache::ReadAt ( FILE* fp, uint64 pos, void* dst, uint64 sz )
+{
+	if ( fseek ( fp, pos, SEEK_SET ) != 0 ) return false;
+	mStats.bytes += sz;
+	return fread ( dst, 1, sz, fp ) == sz;
+}
+
+// Read a brick of every channel, channel after channel, x fastest
+// - File access is serialized, decompression is not
+bool BrickCache::ReadBrick ( uint64 leaf, char* dst )
+{
+	if ( mSpill[leaf] != ID_UNDEFL ) {
+		std::lock_guard<std::mutex> lock ( mFileMutex );
+		return ReadAt ( mSpillFile, mSpill[leaf] * mBrickBytes, dst, mBrickBytes );
+	}
+	uint64 id = mStore[leaf];
+	if ( id == ID_UNDEFL ) return false;
+	uint64 bx = id % mAxisCnt.x, by = (id / mAxisCnt.x) % mAxisCnt.y, bz = id / (uint64(mAxisCnt.x)*mAxisCnt.y);
+	std::vector<char> cbuf;
+
+	for (size_t n=0; n < mChan.size(); n++ ) {
+		Channel& ch = mChan[n];
+		uint64 rowsz = uint64(mBres) * ch.dsize;
+		uint64 bsize = rowsz * mBres * mBres;
+		if ( ch.compress == VBX_COMPRESS_RLE ) {
+			if ( id+1 >= ch.table.size() || ch.table[id+1] < ch.table[id] ) return false;
+			cbuf.resize ( ch.table[id+1] - ch.table[id] );
+			{
+				std::lock_guard<std::mutex> lock ( mFileMutex );
+				if ( !ReadAt ( mStoreFile, ch.offs + ch.table[id], cbuf.data(), cbuf.size() ) ) return false;
+			}
+			if ( !BrickDecompress ( cbuf.data(), cbuf.size(), ch.dsize, dst, bsize ) ) return false;
+		} else {
+			// atlas layout, one row of the brick at a time
+			std::lock_guard<std::mutex> lock ( mFileMutex );
+			for (int z=0; z < mBres; z++ )
+				for (int y=0; y < mBres; y++ ) {
+					uint64 pos = ((bz*mBres + z)*mAxisRes.y + by*mBres + y)*mAxisRes.x + bx*mBres;
+					if ( !ReadAt ( mStoreFile, ch.offs + pos*ch.dsize, dst + (uint64(z)*mBres + y)*rowsz, rowsz ) ) return false;
+				}
+		}
+		dst += bsize;
+	}
+	return true;
+}
+
+// Save a modified brick. Each leaf keeps its spill location once assigned.
+bool BrickCache::WriteSpill ( uint64 leaf, const char* src )
+{
+	std::lock_guard<std::mutex> lock ( mFileMutex );
+	if ( mSpill[leaf] == ID_UNDEFL ) mSpill[leaf] = mSpillCnt++;
+	if ( fseek ( mSpillFile, mSpill[leaf] * mBrickBytes, SEEK_SET ) != 0 ) return false;
+	mStats.spill++;
+	return fwrite ( src, 1, mBrickBytes, mSpillFile ) == mBrickBytes;
+}
+
+bool BrickCache::Touch ( uint64 leaf )
+{
+	if ( leaf >= mSlot.size() ) return false;			// not a leaf of the paged file
+	uint64 slot = mSlot[leaf];
+	if ( slot != ID_UNDEFL ) {
+		mSlotUse[slot].store ( mTick, std::memory_order_relaxed );
+		return true;
+	}
+	Request ( leaf );
+	return false;
+}
+
+void BrickCache::Request ( uint64 leaf )
+{
+	if ( leaf >= mSlot.size() || mSlot[leaf] != ID_UNDEFL ) return;
+	if ( mStore[leaf] == ID_UNDEFL && mSpill[leaf] == ID_UNDEFL ) return;		// no brick data
+	if ( mReq[leaf].exchange ( 1 ) != 0 ) return;									// already queued
+	std::lock_guard<std::mutex> lock ( mQueueMutex );
+	mQueue.push_back ( leaf );
+	mStats.faults++;
+}
+
+void BrickCache::TouchFlags ( const uchar* flags, uint64 cnt )
+{
+	for (uint64 n=0; n < cnt && n < mSlot.size(); n++ )
+		if ( flags[n] != 0 ) Touch ( n );
+}
+
+uint64 BrickCache::getNumRequests ()
+{
+	std::lock_guard<std::mutex> lock ( mQueueMutex );
+	return mQueue.size();
+}
+
+// Take queued requests, as many as fit in free slots plus slots not used in the current tick.
+// Requests are ordered by store position for sequential reads. The rest are dropped, 
+// traversal requests them again while they are still needed.
+uint64 BrickCache::TakeRequests ( std::vector<uint64>& list )
+{
+	std::lock_guard<std::mutex> lock ( mQueueMutex );
+	list.clear ();
+	if ( mQueue.size() == 0 ) return 0;
+
+	// Eviction candidates, least recently used at the back
+	std::vector< std::pair<uint,uint64> > lru;
+	for (uint64 n=0; n < mSlotLeaf.size(); n++ ) {
+		uint use = mSlotUse[n].load ( std::memory_order_relaxed );
+		if ( mSlotLeaf[n] != ID_UNDEFL && use < mTick ) lru.push_back ( std::pair<uint,uint64> ( use, n ) );
+	}
+	uint64 avail = mFree.size() + lru.size();
+	uint64 cnt = std::min ( (uint64) mQueue.size(), avail );
+	if ( cnt > mFree.size() ) {
+		uint64 need = cnt - mFree.size();
+		std::partial_sort ( lru.begin(), lru.begin() + need, lru.end() );
+		mVictims.resize ( need );
+		for (uint64 n=0; n < need; n++ ) mVictims[n] = lru[need-1-n].second;
+	}
+	std::sort ( mQueue.begin(), mQueue.end(), [this] ( uint64 a, uint64 b ) { return mStore[a] < mStore[b]; } );
+	list.assign ( mQueue.begin(), mQueue.begin() + cnt );
+	for (uint64 n=0; n < mQueue.size(); n++ ) mReq[ mQueue[n] ] = 0;
+	mQueue.clear ();
+	return cnt;
+}
+
+// Next free slot, or evict the least recently used candidate from TakeRequests
+uint64 BrickCache::AllocSlot ( uint64& evicted )
+{
+	uint64 slot;
+	evicted = ID_UNDEFL;
+	if ( mFree.size() > 0 ) {
+		slot = mFree.back ();
+		mFree.pop_back ();
+		return slot;
+	}
+	if ( mVictims.size() == 0 ) return ID_UNDEFL;
+	slot = mVictims.back ();
+	mVictims.pop_back ();
+	evicted = mSlotLeaf[slot];
+	mSlot[evicted] = ID_UNDEFL;
+	mSlotLeaf[slot] = ID_UNDEFL;
+	mResident--;
+	mStats.evict++;
+	return slot;
+}
+
+void BrickCache::Assign ( uint64 leaf, uint64 slot )
+{
+	mSlot[leaf] = slot;
+	mSlotLeaf[slot] = leaf;
+	mSlotUse[slot] = mTick;
+	mSlotDirty[slot] = 0;
+	mResident++;
+	mStats.pagein++;
+}
+
+void BrickCache::MarkResidentDirty ()
+{
+	for (uint64 n=0; n < mSlotLeaf.size(); n++ )
+		if ( mSlotLeaf[n] != ID_UNDEFL ) mSlotDirty[n] = 1;
+}
@@ -0,0 +1,133 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+
+#ifndef DEF_GVDB_BRICKCACHE
+	#define DEF_GVDB_BRICKCACHE
+
+	#include "gvdb_types.h"
+	#include "gvdb_vec.h"
+	#include <cstdio>
+	#include <vector>
+	#include <mutex>
+	#include <atomic>
+
+	namespace nvdb {
+
+	// Brick Cache
+	// Out-of-core atlas. Topology stays resident while atlas bricks are paged on demand
+	// from a VBX store into a fixed number of atlas slots, set by a memory budget.
+	// Residency is kept per leaf next to Node::mValue, which holds the slot position while
+	// the brick is resident and -1 otherwise. Traversal calls Touch on each leaf it enters:
+	// resident slots are marked used, missing bricks are queued as requests (faults).
+	// VolumeGVDB::UpdateBrickCache pages requests in, evicting least recently used slots.
+	// Bricks written while resident are saved to a local spill file when evicted, and
+	// read back from there instead of the store.
+	// Touch and Request are thread-safe. All other functions run between frames.
+	class GVDB_API BrickCache {
+	public:
+		struct Channel {
+			uchar		type;
+			int			dsize;				// bytes per voxel
+			char		compress;			// VBX_COMPRESS_NONE or VBX_COMPRESS_RLE
+			uint64		offs;				// file offset of atlas (none) or brick data (rle)
+			std::vector<uint64>	table;		// brick offsets relative to offs (rle)
+		};
+		struct Stats {
+			uint64		faults;				// requests queued
+			uint64		pagein;				// bricks read
+			uint64		evict;				// slots evicted
+			uint64		spill;				// bricks written to spill file
+			uint64		bytes;				// bytes read from store and spill file
+		};
+
+		BrickCache ();
+		~BrickCache ();
+
+		// Store
+		bool	Open ( const char* fname, const char* spill );		// spill = 0x0 or "", temporary file
+		void	Close ();
+		void	AddChannel ( const Channel& ch )		{ mChan.push_back ( ch ); }
+		void	Setup ( uint64 leaves, uint64 slots, int bres, Vector3DI axiscnt, Vector3DI axisres );
+		void	SetStore ( uint64 leaf, uint64 id )	{ mStore[leaf] = id; }	// brick id in store atlas, ID_UNDEFL if none
+		bool	ReadBrick ( uint64 leaf, char* dst );			// all channels, from spill file or store
+		bool	WriteSpill ( uint64 leaf, const char* src );
+
+		// Residency
+		bool	Touch ( uint64 leaf );							// true if resident, otherwise requested
+		void	Request ( uint64 leaf );
+		void	TouchFlags ( const uchar* flags, uint64 cnt );		// Touch leaves with a nonzero flag (device traversal)
+		uint64	TakeRequests ( std::vector<uint64>& list );		// requests that fit in free or evictable slots
+		uint64	AllocSlot ( uint64& evicted );					// free or least recently used slot, evicted leaf or ID_UNDEFL
+		void	Assign ( uint64 leaf, uint64 slot );
+		void	NextTick ()								{ mTick++; }
+		void	MarkDirty ( uint64 slot )				{ mSlotDirty[slot] = 1; }
+		void	MarkResidentDirty ();							// after operators write the atlas
+
+		uint64	getLeafSlot ( uint64 leaf )				{ return mSlot[leaf]; }
+		uint64	getSlotLeaf ( uint64 slot )				{ return mSlotLeaf[slot]; }
+		bool	isDirty ( uint64 slot )					{ return mSlotDirty[slot] != 0; }
+		uint64	getNumSlots ()							{ return mSlotLeaf.size(); }
+		uint64	getNumLeaves ()							{ return mSlot.size(); }
+		uint64	getNumResident ()						{ return mResident; }
+		uint64	getNumRequests ();
+		uint64	getBrickBytes ()						{ return mBrickBytes; }	// one brick, all channels
+		int		getNumChannels ()						{ return (int) mChan.size(); }
+		Channel& getChannel ( int n )					{ return mChan[n]; }
+		Stats&	getStats ()								{ return mStats; }
+
+	private:
+		bool	ReadAt ( FILE* fp, uint64 pos, void* dst, uint64 sz );
+
+		FILE*					mStoreFile;
+		FILE*					mSpillFile;
+		std::mutex				mFileMutex;
+		std::vector<Channel>	mChan;
+		int						mBres;				// brick res, including apron
+		Vector3DI				mAxisCnt;			// store atlas
+		Vector3DI				mAxisRes;
+		uint64					mBrickBytes;
+
+		// per leaf
+		std::vector<uint64>		mStore;				// brick id in store
+		std::vector<uint64>		mSlot;				// resident slot, or ID_UNDEFL
+		std::vector<uint64>		mSpill;				// spill file brick, or ID_UNDEFL
+		std::atomic<uchar>*		mReq;				// requested flags
+		std::vector<uint64>		mQueue;
+		std::mutex				mQueueMutex;
+
+		// per slot
+		std::vector<uint64>		mSlotLeaf;			// leaf, or ID_UNDEFL if free
+		std::atomic<uint>*		mSlotUse;			// tick of last use
+		std::vector<char>		mSlotDirty;
+		std::vector<uint64>		mFree;
+		std::vector<uint64>		mVictims;			// evictable slots, most recently used first (see TakeRequests)
+		uint64					mResident;
+		uint64					mSpillCnt;
+		uint					mTick;
+
+		Stats					mStats;
+	};
+
+	}
+
+#endif
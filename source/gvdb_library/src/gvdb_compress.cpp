@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+#include "gvdb_compress.h"
+#include <vector>
+#include <cstring>
+
+using namespace nvdb;
+
+// Run-length encoding
+// Control byte c < 128: c+1 literal bytes follow. c >= 128: next byte repeats c-125 times (3..130).
+#define RLE_MAXLIT		128
+#define RLE_MINRUN		3
+#define RLE_MAXRUN		130
+
+uint64 nvdb::getCompressBound ( uint64 size )
+{
+	return size + size / RLE_MAXLIT + 1;
+}
+
+uint64 nvdb::BrickCompress ( const char* src, uint64 size, int stride, char* dst )
+{
+	if ( stride < 1 || size % stride != 0 ) stride = 1;
+	uint64 cnt = size / stride;
+
+	// Byte shuffle
+	std::vector<uchar> buf ( size );
+	for (int b=0; b < stride; b++ )
+		for (uint64 i=0; i < cnt; i++ )
+			buf[ b*cnt + i ] = (uchar) src[ i*stride + b ];
+
+	// Run-length encode
+	uchar* out = (uchar*) dst;
+	uint64 o = 0, i = 0, lit = 0;
+	while ( i < size ) {
+		uint64 run = 1;
+		while ( i + run < size && run < RLE_MAXRUN && buf[i+run] == buf[i] ) run++;
+		if ( run >= RLE_MINRUN ) {
+			if ( lit > 0 ) {								// flush literals
+				out[o++] = uchar(lit-1);
+				memcpy ( out + o, &buf[i-lit], lit );	o += lit;
+				lit = 0;
+			}
+			out[o++] = uchar(run + 125);
+			out[o++] = buf[i];
+			i += run;
+		} else {
+			lit++;	i++;
+			if ( lit == RLE_MAXLIT ) {
+				out[o++] = uchar(lit-1);
+				memcpy ( out + o, &buf[i-lit], lit );	o += lit;
+				lit = 0;
+			}
+		}
+		if ( o + lit >= size ) {							// does not compress, store raw
+			memcpy ( dst, src, size );
+			return size;
+		}
+	}
+	if ( lit > 0 ) {
+		out[o++] = uchar(lit-1);
+		memcpy ( out + o, &buf[i-lit], lit );	o += lit;
+	}
+	if ( o >= size ) {
+		memcpy ( dst, src, size );
+		return size;
+	}
+	return o;
+}
+
+bool nvdb::BrickDecompress ( const char* src, uint64 len, int stride, char* dst, uint64 size )
+{
+	if ( len == size ) {									// stored raw
+		memcpy ( dst, src, size );
+		return true;
+	}
+	if ( stride < 1 || size % stride != 0 ) stride = 1;
+	uint64 cnt = size / stride;
+
+	// Run-length decode
+	std::vector<uchar> buf ( size );
+	const uchar* in = (const uchar*) src;
+	uint64 i = 0, o = 0, n;
+	while ( i < len ) {
+		uchar c = in[i++];
+		if ( c < RLE_MAXLIT ) {
+			n = uint64(c) + 1;
+			if ( i + n > len || o + n > size ) return false;
+			memcpy ( &buf[o], in + i, n );
+			i += n;
+		} else {
+			n = uint64(c) - 125;
+			if ( i >= len || o + n > size ) return false;
+			memset ( &buf[o], in[i++], n );
+		}
+		o += n;
+	}
+	if ( o != size ) return false;
+
+	// Byte unshuffle
+	for (int b=0; b < stride; b++ )
+		for (uint64 j=0; j < cnt; j++ )
+			dst[ j*stride + b ] = (char) buf[ b*cnt + j ];
+	return true;
+}
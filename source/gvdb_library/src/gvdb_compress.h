@@ -0,0 +1,45 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+#ifndef DEF_GVDB_COMPRESS
+	#define DEF_GVDB_COMPRESS
+
+	#include "gvdb_types.h"
+
+	// VBX grid compression (grid_compress field)
+	#define VBX_COMPRESS_NONE		0		// atlas layout, uncompressed
+	#define VBX_COMPRESS_BLOSC		1		// reserved, not supported
+	#define VBX_COMPRESS_RLE		2		// brick table + byte-shuffled, run-length encoded bricks
+
+	namespace nvdb {
+
+	// Brick codec
+	// Bytes of each element are shuffled into planes (stride planes of size/stride bytes),
+	// so sign/exponent bytes of float data form long runs, then run-length encoded.
+	// Bricks which do not compress are stored raw, with a stored length equal to size.
+	GVDB_API uint64	getCompressBound ( uint64 size );
+	GVDB_API uint64	BrickCompress ( const char* src, uint64 size, int stride, char* dst );					// returns stored length
+	GVDB_API bool	BrickDecompress ( const char* src, uint64 len, int stride, char* dst, uint64 size );	// false if data is corrupt
+
+	}
+
+#endif
@@ -0,0 +1,410 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------
+// Host isosurface extraction (surface nets)
+// - Cells span 2x2x2 voxels. A cell with corners on both sides of the threshold gets 
+//   one vertex, at the average of its edge crossings. Each crossing voxel edge gives 
+//   a quad joining the four cells around it.
+// - Only active bricks are visited, one work item per brick. Voxels are read from the
+//   brick and a one voxel apron, so no dense volume is built.
+// - A cell is owned by the brick holding its min corner. Bricks also own border cells
+//   and edges on the side of inactive neighbors, so the surface closes there.
+// - Tiles (see PruneBackground) are visited as constant bricks, with borders read 
+//   from their neighbors, so the surface also closes around them.
+// - Vertices are stitched across bricks by global cell coordinate, using sorted keys.
+//   Output order depends only on the topology, not the thread count.
+//----------------------------------------------------------------------------------
+
+#include "gvdb_allocator.h"
+#include "gvdb_volume_gvdb.h"
+#include "gvdb_model.h"
+#include "gvdb_node.h"
+#include "gvdb_parallel.h"
+#include "app_perf.h"
+
+#include <GL/glew.h>
+#include <math.h>
+#include <cstring>
+#include <algorithm>
+
+using namespace nvdb;
+
+#define MESH_BIAS		(1 << 20)		// cell key bias, coordinates in +/- 1 million voxels
+
+inline uint64 meshKey ( int x, int y, int z )
+{
+	return (uint64(z + MESH_BIAS) << 42) | (uint64(y + MESH_BIAS) << 21) | uint64(x + MESH_BIAS);
+}
+
+struct MeshVert {
+	uint64		key;
+	Vector3DF	pos, norm;
+	bool operator < ( const MeshVert& op ) const	{ return key < op.key; }
+};
+
+// Extract isosurface of a channel
+// - Inside is value >= thresh. Normals point outward (down the gradient).
+// - The channel apron must be current (see UpdateApron).
+// - Vertices are in world space, faces index verts.
+bool VolumeGVDB::ExtractSurface ( uchar chan, float thresh, std::vector<Vector3DF>& verts, std::vector<Vector3DF>& norms, std::vector<Vector3DI>& faces )
+{
+	verts.clear ();	norms.clear ();	faces.clear ();
+	if ( chan >= mPool->getNumAtlas() ) {
+		gprintf ( "ERROR: ExtractSurface, channel %d does not exist.\n", (int) chan );
+		return false;
+	}
+	DataPtr atlas = mPool->getAtlas ( chan );
+	if ( atlas.apron < 1 || (atlas.type != T_FLOAT && atlas.type != T_UCHAR) ) {
+		gprintf ( "ERROR: ExtractSurface requires a float or uchar channel with apron.\n" );
+		return false;
+	}
+	if ( mbProfile ) PERF_PUSH ( "ExtractSurface" );
+
+	PrepareVDB ();
+
+	// Host copy of atlas
+	Vector3DI res = mPool->getAtlasRes ( chan );
+	int dsize = mPool->getSize ( atlas.type );
+	std::vector<char> host;
+	char* dat = atlas.cpu;
+	if ( !mbCPU ) {
+		uint64 slicesz = uint64(res.x) * res.y * dsize;
+		host.resize ( slicesz * res.z );
+		for (int z=0; z < res.z; z++ )
+			mPool->AtlasRetrieveSlice ( chan, z, (int) slicesz, 0x0, (uchar*) &host[z*slicesz] );
+		dat = &host[0];
+	}
+	int br = getRes ( 0 );
+	int sr = br + 2;									// local copy res, one voxel border
+	slong leafcnt = mPool->getPoolCnt ( 0, 0 );
+	Vector3DF vs = mVoxsize;
+
+	// Tiles of the channel, visited after the leaves
+	std::vector< std::pair<Vector3DI, float> > tiles;
+	bool bTiles = ( chan == 0 && atlas.type == T_FLOAT && hasTiles(1) );		// tile values belong to channel 0 (see PruneBackground)
+	if ( bTiles ) {
+		uint64 words = getMaskSize(1) / sizeof(uint64);
+		for (uint64 n=0; n < mPool->getPoolCnt(0,1); n++ ) {
+			Node* node = getNode ( 0, 1, n );
+			if ( node->mFlags & NODE_FREE ) continue;
+			uint64* tmask = getTileMask ( node );
+			uint64* mask = node->getMask ();
+			for (uint64 w=0; w < words; w++ )
+				for (uint64 bits = tmask[w] & ~mask[w]; bits != 0; bits &= bits-1 ) {
+					uint32 b = uint32( w*64 + node->firstBitOn ( bits ) );
+					tiles.push_back ( std::pair<Vector3DI, float> ( node->mPos + getPosFromBit ( 1, b ) * br, getTileValues(node)[b] ) );
+				}
+		}
+	}
+	slong itemcnt = leafcnt + (slong) tiles.size();
+	int threads = mWorkers.getNumThreads ();
+	slong step = (itemcnt + threads - 1) / threads;	// one output list per range
+	std::vector< std::vector<MeshVert> > cells ( threads );
+	std::vector< std::vector<Vector3DI> > quads ( threads );
+
+	// Value of a voxel at index-space position: leaf voxel, tile, or empty
+	auto voxelAt = [&] ( Vector3DI p ) -> float {
+		Vector3DF vmin, wp = (Vector3DF(p) + Vector3DF(0.5f,0.5f,0.5f)) * vs;
+		slong nid;
+		float v = 0;
+		Node* nb = getNodeAtPoint ( wp, vmin, nid );
+		if ( nb != 0x0 ) {
+			if ( nb->mValue.x == -1 ) return 0;
+			Vector3DI o = nb->mValue + (p - nb->mPos);
+			uint64 i = (uint64(o.z)*res.y + o.y)*res.x + o.x;
+			return (atlas.type == T_FLOAT) ? ((float*) dat)[i] : ((uchar*) dat)[i] / 255.0f;
+		}
+		if ( bTiles ) getTileAtPoint ( wp, v );
+		return v;
+	};
+	// Item setup: position, local copy of brick or tile and border, and which neighbors at -1 are inactive.
+	// Leaves read their apron, tiles read the border from their neighbors. False if the item is not live.
+	auto setupItem = [&] ( slong n, Vector3DI& pos, float* in, bool* open ) -> bool {
+		if ( n < leafcnt ) {
+			Node* node = getNode ( 0, 0, n );
+			if ( (node->mFlags & NODE_FREE) || node->mValue.x == -1 ) return false;
+			pos = node->mPos;
+			Vector3DI o = node->mValue;
+			for (int z=0; z < sr; z++ )
+				for (int y=0; y < sr; y++ )
+					for (int x=0; x < sr; x++ ) {
+						uint64 i = (uint64(o.z+z-1)*res.y + (o.y+y-1))*res.x + (o.x+x-1);
+						in[(z*sr + y)*sr + x] = (atlas.type == T_FLOAT) ? ((float*) dat)[i] : ((uchar*) dat)[i] / 255.0f;
+					}
+		} else {
+			pos = tiles[n - leafcnt].first;
+			float tv = tiles[n - leafcnt].second;
+			for (int z=0; z < sr; z++ )
+				for (int y=0; y < sr; y++ )
+					for (int x=0; x < sr; x++ ) {
+						bool bBorder = ( x == 0 || y == 0 || z == 0 || x == sr-1 || y == sr-1 || z == sr-1 );
+						in[(z*sr + y)*sr + x] = bBorder ? voxelAt ( pos + Vector3DI(x-1, y-1, z-1) ) : tv;
+					}
+		}
+		Vector3DF vmin;
+		slong nid;
+		float tv;
+		for (int j=1; j < 8; j++ ) {
+			Vector3DI p = pos;
+			if ( j & 1 ) p.x -= br;
+			if ( j & 2 ) p.y -= br;
+			if ( j & 4 ) p.z -= br;
+			Vector3DF wp = (Vector3DF(p) + Vector3DF(0.5f,0.5f,0.5f)) * vs;
+			Node* nb = getNodeAtPoint ( wp, vmin, nid );
+			open[j] = ( nb == 0x0 || nb->mLev != 0 || nb->mValue.x == -1 ) && !( bTiles && getTileAtPoint ( wp, tv ) );
+		}
+		open[0] = true;
+		return true;
+	};
+	// Neighbor of a local cell or voxel with coordinates in [-1, br): bit set per axis at -1
+	auto region = [] ( int x, int y, int z ) -> int	{ return (x < 0 ? 1 : 0) | (y < 0 ? 2 : 0) | (z < 0 ? 4 : 0); };
+
+	// Cell vertices
+	ParallelFor ( mWorkers, threads, [&] ( slong ts, slong te ) {
+		std::vector<float> local ( sr*sr*sr );
+		float* in = &local[0];
+		float c[8];
+		bool open[8];
+		Vector3DI pos;
+		for (slong t = ts; t < te; t++ ) {
+			for (slong n = t*step; n < (t+1)*step && n < itemcnt; n++ ) {
+				if ( !setupItem ( n, pos, in, open ) ) continue;
+				for (int z=-1; z < br; z++ )
+					for (int y=-1; y < br; y++ )
+						for (int x=-1; x < br; x++ ) {
+							if ( !open[ region(x,y,z) ] ) continue;		// owned by active neighbor
+							int k = ((z+1)*sr + (y+1))*sr + (x+1);
+							int mask = 0;
+							for (int j=0; j < 8; j++ ) {
+								c[j] = in[ k + (j & 1) + ((j & 2) ? sr : 0) + ((j & 4) ? sr*sr : 0) ];
+								if ( c[j] >= thresh ) mask |= (1 << j);
+							}
+							if ( mask == 0 || mask == 255 ) continue;
+
+							// average of edge crossings, corner j at (j&1, j&2, j&4)
+							Vector3DF p ( 0, 0, 0 );
+							int cnt = 0;
+							for (int j=0; j < 8; j++ ) {
+								for (int a=1; a < 8; a <<= 1 ) {
+									if ( (j & a) || ((mask >> j) & 1) == ((mask >> (j|a)) & 1) ) continue;
+									float f = (thresh - c[j]) / (c[j|a] - c[j]);
+									Vector3DF q ( (j & 1) ? 1.0f : 0.0f, (j & 2) ? 1.0f : 0.0f, (j & 4) ? 1.0f : 0.0f );
+									if ( a == 1 ) q.x += f; else if ( a == 2 ) q.y += f; else q.z += f;
+									p += q;	cnt++;
+								}
+							}
+							p /= float(cnt);
+							Vector3DF g;								// gradient from cell corners
+							g.x = (c[1]-c[0]) + (c[3]-c[2]) + (c[5]-c[4]) + (c[7]-c[6]);
+							g.y = (c[2]-c[0]) + (c[3]-c[1]) + (c[6]-c[4]) + (c[7]-c[5]);
+							g.z = (c[4]-c[0]) + (c[5]-c[1]) + (c[6]-c[2]) + (c[7]-c[3]);
+							g /= vs;
+							float len = sqrt ( g.x*g.x + g.y*g.y + g.z*g.z );
+							if ( len > 0 ) g *= -1.0f / len;
+
+							MeshVert v;
+							Vector3DI gc = pos + Vector3DI(x, y, z);
+							v.key = meshKey ( gc.x, gc.y, gc.z );
+							v.pos = (Vector3DF(gc) + Vector3DF(0.5f,0.5f,0.5f) + p) * vs;		// voxel centers at +0.5
+							v.norm = g;
+							cells[t].push_back ( v );
+						}
+			}
+		}
+	} );
+
+	// Stitch: unique cells in key order, duplicates from border cells share a position
+	std::vector<MeshVert> vlist;
+	for (int t=0; t < threads; t++ ) {
+		vlist.insert ( vlist.end(), cells[t].begin(), cells[t].end() );
+		std::vector<MeshVert>().swap ( cells[t] );
+	}
+	ParallelSort ( mWorkers, vlist );
+	vlist.erase ( std::unique ( vlist.begin(), vlist.end(), [] ( const MeshVert& a, const MeshVert& b ) { return a.key == b.key; } ), vlist.end() );
+	std::vector<uint64> keys ( vlist.size() );
+	for (size_t n=0; n < vlist.size(); n++ ) keys[n] = vlist[n].key;
+
+	// Faces: quad of the four cells around each crossing edge
+	ParallelFor ( mWorkers, threads, [&] ( slong ts, slong te ) {
+		std::vector<float> local ( sr*sr*sr );
+		float* in = &local[0];
+		bool open[8];
+		Vector3DI pos;
+		int q[4];
+		for (slong t = ts; t < te; t++ ) {
+			for (slong n = t*step; n < (t+1)*step && n < itemcnt; n++ ) {
+				if ( !setupItem ( n, pos, in, open ) ) continue;
+				for (int a=0; a < 3; a++ ) {
+					int u = (a+1) % 3, w = (a+2) % 3;			// quad axes, u x w = a
+					for (int z=-1; z < br; z++ )
+						for (int y=-1; y < br; y++ )
+							for (int x=-1; x < br; x++ ) {
+								int v[3] = { x, y, z };
+								// edge from v along a: own if v in brick, or v at -1 along a in an inactive neighbor
+								if ( v[u] < 0 || v[w] < 0 ) continue;
+								if ( v[a] < 0 && !open[ region(x,y,z) ] ) continue;
+								int k = ((z+1)*sr + (y+1))*sr + (x+1);
+								int ka = (a == 0) ? 1 : ((a == 1) ? sr : sr*sr);
+								bool b0 = ( in[k] >= thresh ), b1 = ( in[k+ka] >= thresh );
+								if ( b0 == b1 ) continue;
+
+								bool bOk = true;
+								for (int j=0; j < 4 && bOk; j++ ) {
+									int cv[3] = { v[0], v[1], v[2] };
+									cv[u] -= ( j == 0 || j == 3 ) ? 1 : 0;
+									cv[w] -= ( j < 2 ) ? 1 : 0;
+									uint64 key = meshKey ( pos.x + cv[0], pos.y + cv[1], pos.z + cv[2] );
+									std::vector<uint64>::iterator it = std::lower_bound ( keys.begin(), keys.end(), key );
+									bOk = ( it != keys.end() && *it == key );
+									if ( bOk ) q[j] = int( it - keys.begin() );
+								}
+								if ( !bOk ) continue;
+								if ( b0 ) {								// inside at v, facing +a
+									quads[t].push_back ( Vector3DI(q[0], q[1], q[2]) );
+									quads[t].push_back ( Vector3DI(q[0], q[2], q[3]) );
+								} else {
+									quads[t].push_back ( Vector3DI(q[0], q[2], q[1]) );
+									quads[t].push_back ( Vector3DI(q[0], q[3], q[2]) );
+								}
+							}
+				}
+			}
+		}
+	} );
+
+	verts.resize ( vlist.size() );
+	norms.resize ( vlist.size() );
+	for (size_t n=0; n < vlist.size(); n++ ) { verts[n] = vlist[n].pos; norms[n] = vlist[n].norm; }
+	for (int t=0; t < threads; t++ )
+		faces.insert ( faces.end(), quads[t].begin(), quads[t].end() );
+
+	if ( mbProfile ) PERF_POP ();
+	return true;
+}
+
+// Extract isosurface into a polygonal model (interleaved position and normal)
+bool VolumeGVDB::ExtractSurface ( Model* model, uchar chan, float thresh )
+{
+	std::vector<Vector3DF> verts, norms;
+	std::vector<Vector3DI> faces;
+	if ( !ExtractSurface ( chan, thresh, verts, norms, faces ) ) return false;
+
+	if ( model->vertBuffer != 0x0 ) free ( model->vertBuffer );
+	if ( model->elemBuffer != 0x0 ) free ( model->elemBuffer );
+	model->vertBuffer = (float*) malloc ( (verts.size()+1) * 2*sizeof(Vector3DF) );
+	model->elemBuffer = (unsigned int*) malloc ( (faces.size()+1) * sizeof(Vector3DI) );
+	Vector3DF* vb = (Vector3DF*) model->vertBuffer;
+	for (size_t n=0; n < verts.size(); n++ ) {
+		vb[n*2] = verts[n];
+		vb[n*2+1] = norms[n];
+	}
+	if ( faces.size() > 0 ) memcpy ( model->elemBuffer, &faces[0], faces.size() * sizeof(Vector3DI) );
+
+	model->modelType		= 0;
+	model->elemDataType		= GL_TRIANGLES;
+	model->elemCount		= (int) faces.size();
+	model->elemArrayOffset	= 0;
+	model->elemStride		= 3 * sizeof(unsigned int);
+	model->vertCount		= (int) verts.size();
+	model->vertDataType		= GL_FLOAT;
+	model->vertComponents	= 3;
+	model->vertOffset		= 0;
+	model->vertStride		= 2*sizeof(Vector3DF);
+	model->normDataType		= GL_FLOAT;
+	model->normComponents	= 3;
+	model->normOffset		= sizeof(Vector3DF);
+	Matrix4F ident;
+	ident.Identity ();
+	model->ComputeBounds ( ident, 0 );
+	return true;
+}
+
+// Write isosurface as indexed .OBJ
+bool VolumeGVDB::WriteObj ( char* fname, uchar chan, float thresh )
+{
+	std::vector<Vector3DF> verts, norms;
+	std::vector<Vector3DI> faces;
+	if ( !ExtractSurface ( chan, thresh, verts, norms, faces ) ) return false;
+
+	FILE* fp = fopen ( fname, "w" );
+	if ( fp == 0x0 ) {
+		gprintf ( "ERROR: Unable to write %s\n", fname );
+		return false;
+	}
+	if ( mbProfile ) PERF_PUSH ( "WriteObj" );
+	fprintf ( fp, "# Wavefront OBJ format\n" );
+	fprintf ( fp, "# %d vertices, %d faces\n\n", (int) verts.size(), (int) faces.size() );
+	for (size_t n=0; n < verts.size(); n++ )
+		fprintf ( fp, "v %f %f %f\n", verts[n].x, verts[n].y, verts[n].z );
+	for (size_t n=0; n < norms.size(); n++ )
+		fprintf ( fp, "vn %f %f %f\n", norms[n].x, norms[n].y, norms[n].z );
+	for (size_t n=0; n < faces.size(); n++ )		// .obj indices are base 1
+		fprintf ( fp, "f %d//%d %d//%d %d//%d\n", faces[n].x+1, faces[n].x+1, faces[n].y+1, faces[n].y+1, faces[n].z+1, faces[n].z+1 );
+	fclose ( fp );
+	if ( mbProfile ) PERF_POP ();
+
+	gprintf ( "Write OBJ complete: %s (%d vertices, %d faces)\n", fname, (int) verts.size(), (int) faces.size() );
+	return true;
+}
+
+// Write isosurface as binary .PLY
+bool VolumeGVDB::WritePly ( char* fname, uchar chan, float thresh )
+{
+	std::vector<Vector3DF> verts, norms;
+	std::vector<Vector3DI> faces;
+	if ( !ExtractSurface ( chan, thresh, verts, norms, faces ) ) return false;
+
+	FILE* fp = fopen ( fname, "wb" );
+	if ( fp == 0x0 ) {
+		gprintf ( "ERROR: Unable to write %s\n", fname );
+		return false;
+	}
+	if ( mbProfile ) PERF_PUSH ( "WritePly" );
+	fprintf ( fp, "ply\nformat binary_little_endian 1.0\n" );
+	fprintf ( fp, "element vertex %d\n", (int) verts.size() );
+	fprintf ( fp, "property float x\nproperty float y\nproperty float z\n" );
+	fprintf ( fp, "property float nx\nproperty float ny\nproperty float nz\n" );
+	fprintf ( fp, "element face %d\n", (int) faces.size() );
+	fprintf ( fp, "property list uchar int vertex_indices\nend_header\n" );
+
+	std::vector<char> buf ( verts.size() * 2*sizeof(Vector3DF) );
+	for (size_t n=0; n < verts.size(); n++ ) {
+		memcpy ( &buf[n*2*sizeof(Vector3DF)], &verts[n], sizeof(Vector3DF) );
+		memcpy ( &buf[n*2*sizeof(Vector3DF) + sizeof(Vector3DF)], &norms[n], sizeof(Vector3DF) );
+	}
+	if ( buf.size() > 0 ) fwrite ( &buf[0], 1, buf.size(), fp );
+
+	const int fsz = 1 + sizeof(Vector3DI);				// count, then three indices
+	buf.resize ( faces.size() * fsz );
+	for (size_t n=0; n < faces.size(); n++ ) {
+		buf[n*fsz] = 3;
+		memcpy ( &buf[n*fsz+1], &faces[n], sizeof(Vector3DI) );
+	}
+	if ( buf.size() > 0 ) fwrite ( &buf[0], 1, buf.size(), fp );
+	fclose ( fp );
+	if ( mbProfile ) PERF_POP ();
+
+	gprintf ( "Write PLY complete: %s (%d vertices, %d faces)\n", fname, (int) verts.size(), (int) faces.size() );
+	return true;
+}
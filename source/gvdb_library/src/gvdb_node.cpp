@@ -22,8 +22,9 @@
 #include "gvdb_volume_gvdb.h"
 using namespace nvdb;
 
-int		Node::getMaskBits()		{ int r = gVDB->getRes(mLev); return (uint64) r*r*r; }
-int		Node::getMaskBytes()	{ int r = gVDB->getRes(mLev); return imax( ((uint64) r*r*r) >> 3, 1); }		// divide by bits per byte (2^3=8)
-uint64	Node::getMaskWords()	{ int r = gVDB->getRes(mLev); return imax( ((uint64) r*r*r) >> 6, 1); }		// divide by bits per 64-bit word (2^6=64)
+// Mask size comes from the node itself, so nodes of any volume can be used from any thread
+int		Node::getMaskBits()		{ return int( uint64(1) << (3*mLogRes) ); }
+int		Node::getMaskBytes()	{ return imax( int( uint64(1) << (3*mLogRes) >> 3 ), 1); }		// divide by bits per byte (2^3=8)
+uint64	Node::getMaskWords()	{ uint64 w = uint64(1) << (3*mLogRes) >> 6; return (w > 1) ? w : 1; }	// divide by bits per 64-bit word (2^6=64)
 uint64*  Node::getMask()			{ return (uint64*) &mMask; }
 int		Node::getNumChild()		{ return (mLev==0) ? 0 : countOn(); }
@@ -28,9 +28,31 @@
 	#include "gvdb_types.h"
 	#include "gvdb_vec.h"
 	#include <assert.h>
+	#include <string.h>
+	#if defined(_MSC_VER) && defined(_M_X64)
+		#include <intrin.h>
+	#endif
 
 	#define imax(a,b)		((a) > (b) ? (a) : (b) )
 
+	// Node flags
+	#define NODE_FREE		0x80		// node has been deactivated and is on the pool free list
+	#define NODE_PREFIX		0x40		// prefix counts follow the mask, see getPrefix
+	#define NODE_RANGE		0x20		// mVRange holds the value range of the sub-tree, see UpdateRange
+
+	// Hardware bit counting (define GVDB_NO_POPCNT for the portable versions)
+	// - MSVC __popcnt64 always emits POPCNT, so it is only used with GVDB_HW_POPCNT (BUILD_POPCNT)
+	#if !defined(GVDB_NO_POPCNT) && (defined(__GNUC__) || defined(__clang__))
+		#define GVDB_POPCNT64(v)	__builtin_popcountll(v)
+		#define GVDB_CTZ64(v)		__builtin_ctzll(v)
+	#elif !defined(GVDB_NO_POPCNT) && defined(_MSC_VER) && defined(_M_X64)
+		#ifdef GVDB_HW_POPCNT
+			#define GVDB_POPCNT64(v)	__popcnt64(v)
+		#endif
+		inline unsigned long gvdbCtz64 ( unsigned __int64 v )	{ unsigned long i; _BitScanForward64 ( &i, v ); return i; }
+		#define GVDB_CTZ64(v)		gvdbCtz64(v)
+	#endif
+
 	namespace nvdb {	
 
 	class VolumeGVDB;
@@ -43,8 +65,8 @@
 	public:							//						Size:	Range:
 		uchar		mLev;			// Tree Level			1 byte	Max = 0 to 255
 		uchar		mFlags;			// Flags				1 byte	
-		uchar		mPriority;		// Priority				1 byte
-		uchar		pad;
+		uchar		mLogRes;		// log2 of node res		1 byte	Sizes the mask, set by SetupNode
+		uchar		mMaskLog;		// log2 of mask words	1 byte	Locates prefix counts
 		Vector3DI	mPos;			// Pos in Index-space	12 byte
 		Vector3DI	mValue;			// Value in Atlas		12 byte
 		Vector3DF	mVRange;		// Value min, max, ave	12 byte
@@ -52,6 +74,7 @@
 		uint64		mChildList;		// Child List			8 byte	Pool1 reference					
 		uint64		mMask;			// Start of BITMASK.	1 byte  +BYTES: (2^4)^3 = 4096 bits / 8 = +512 bytes
 									// HEADER TOTAL			56 bytes
+									// PREFIX (optional)	uint32 per mask word, after the mask
 
 	public:
 
@@ -89,9 +112,13 @@
 
 		inline uint64 numBitsOn ( uint64 v)
 		{
-			v = v - ((v >> 1) & UINT64_C(0x5555555555555555));
-			v = (v & UINT64_C(0x3333333333333333)) + ((v >> 2) & UINT64_C(0x3333333333333333));
-			return ((v + (v >> 4) & UINT64_C(0xF0F0F0F0F0F0F0F)) * UINT64_C(0x101010101010101)) >> 56;
+			#ifdef GVDB_POPCNT64
+				return GVDB_POPCNT64 ( v );
+			#else
+				v = v - ((v >> 1) & UINT64_C(0x5555555555555555));
+				v = (v & UINT64_C(0x3333333333333333)) + ((v >> 2) & UINT64_C(0x3333333333333333));
+				return ((v + (v >> 4) & UINT64_C(0xF0F0F0F0F0F0F0F)) * UINT64_C(0x101010101010101)) >> 56;
+			#endif
 		}
 
 		inline uint64 numBitsOff ( uint64 v) { return numBitsOn( (uint64) ~v); }
@@ -116,13 +143,17 @@
 		inline uint64 firstBitOn ( uint64 v)
 		{
 			assert(v);    
-			static const byte DeBruijn[64] = {
-				0,   1,  2, 53,  3,  7, 54, 27, 4,  38, 41,  8, 34, 55, 48, 28,
-				62,  5, 39, 46, 44, 42, 22,  9, 24, 35, 59, 56, 49, 18, 29, 11,
-				63, 52,  6, 26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
-				51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12,
-			};
-			return DeBruijn[ uint64((sint64(v) & -sint64(v)) * UINT64_C(0x022FDD63CC95386D)) >> 58];
+			#ifdef GVDB_CTZ64
+				return GVDB_CTZ64 ( v );
+			#else
+				static const byte DeBruijn[64] = {
+					0,   1,  2, 53,  3,  7, 54, 27, 4,  38, 41,  8, 34, 55, 48, 28,
+					62,  5, 39, 46, 44, 42, 22,  9, 24, 35, 59, 56, 49, 18, 29, 11,
+					63, 52,  6, 26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+					51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12,
+				};
+				return DeBruijn[ uint64((sint64(v) & -sint64(v)) * UINT64_C(0x022FDD63CC95386D)) >> 58];
+			#endif
 		}
 
 		inline uint64 lastBitOn ( uint32 v)
@@ -143,6 +174,31 @@
 		{						
 			mMask = 0;
 			memset ( &mMask, 0, getMaskBytes() );		
+			if ( mFlags & NODE_PREFIX ) memset ( getPrefix(), 0, getPrefixWords()*sizeof(uint32) );
+		}
+
+		// Prefix counts
+		// When NODE_PREFIX is set, one uint32 per mask word follows the mask, holding
+		// the number of bits on in all earlier words, so countOn(b) is O(1).
+		// Only the owner of the pool can enable it, as the pool width must have room.
+		uint64	getPrefixWords()	{ return uint64(1) << mMaskLog; }
+		uint32*	getPrefix()			{ return (uint32*) ((uint64*) &mMask + getPrefixWords()); }
+		void enablePrefix ( bool on )
+		{
+			if ( !on ) { mFlags &= ~NODE_PREFIX; return; }
+			uint64 w = getMaskWords();
+			for ( mMaskLog = 0; (uint64(1) << mMaskLog) < w; ) mMaskLog++;
+			mFlags |= NODE_PREFIX;
+			updatePrefix ();
+		}
+		void updatePrefix ()
+		{
+			if ( !(mFlags & NODE_PREFIX) ) return;
+			uint64* w1 = (uint64*) &mMask;
+			uint32* pre = getPrefix();
+			uint64 words = getPrefixWords();
+			uint32 sum = 0;
+			for (uint64 i=0; i < words; i++ ) { pre[i] = sum; sum += (uint32) numBitsOn ( w1[i] ); }
 		}
 
 		// set operator
@@ -152,6 +208,7 @@
 			uint64* w2 = op2.getMask();
 			for ( ; w1 != we; ) 
 				*w1++ = *w2++;
+			updatePrefix ();
 		}
 		// compare operator
 		bool operator == (Node &op2 ) 
@@ -172,6 +229,10 @@
 		// count on
 		uint32 countOn()
 		{
+			if ( mFlags & NODE_PREFIX ) {
+				uint64 last = getPrefixWords() - 1;
+				return getPrefix()[last] + (uint32) numBitsOn ( (&mMask)[last] );
+			}
 			uint32 sum = 0;
 			uint64* w1 = (uint64*) &mMask;
 			uint64* we = (uint64*) &mMask + getMaskWords();
@@ -183,6 +244,10 @@
 			uint64 sum = 0;
 			uint64* w1 = (uint64*) &mMask;
 			uint64* we = (uint64*) &mMask + (b >> 6);
+			if ( mFlags & NODE_PREFIX ) {
+				sum = getPrefix()[ b >> 6 ];
+				w1 = we;
+			}
 			for (; w1 != we; ) sum += (int) numBitsOn (*w1++ );
 			uint64 w2 = *w1;
 			w2 = w2 & (( uint64(1) << (b & 63))-1);
@@ -193,9 +258,11 @@
 		uint64 countOff() { return getMaskBits() - countOn(); }
 
 		void setOn ( uint32 n) {        
+			if ( (mFlags & NODE_PREFIX) && isOff(n) ) adjustPrefix ( n, 1 );
 			(&mMask)[n >> 6] |= uint64(1) << (n & 63);
 		}    
 		void setOff (uint32 n ) {        
+			if ( (mFlags & NODE_PREFIX) && isOn(n) ) adjustPrefix ( n, -1 );
 			(&mMask)[n >> 6] &=  ~(uint64(1) << (n & 63));
 		}    
 		void setAll (bool on)
@@ -204,7 +271,14 @@
 			uint64* w1 = (uint64*) &mMask;
 			uint64* we = (uint64*) &mMask + getMaskWords();
 			for ( ; w1 != we; ) *w1++ = val;
+			updatePrefix ();
 		}    
+		void adjustPrefix ( uint32 n, int delta )		// bit n changed, update later words
+		{
+			uint32* pre = getPrefix();
+			uint64 words = getPrefixWords();
+			for (uint64 i = (n >> 6) + 1; i < words; i++ ) pre[i] += delta;
+		}
 
 		bool isOn ( uint64 n )
 		{
@@ -0,0 +1,207 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+#ifndef DEF_GVDB_PARALLEL
+	#define DEF_GVDB_PARALLEL
+
+	#include "gvdb_types.h"
+	#include <thread>
+	#include <mutex>
+	#include <condition_variable>
+	#include <atomic>
+	#include <functional>
+	#include <vector>
+	#include <algorithm>
+
+	namespace nvdb {
+
+	// Number of host worker threads. 0 = use all hardware threads
+	inline int getHostThreads ( int req )
+	{
+		if ( req > 0 ) return req;
+		int n = (int) std::thread::hardware_concurrency ();
+		return ( n < 1 ) ? 1 : n;
+	}
+
+	// Host parallel loop
+	// Calls func ( start, end ) on contiguous ranges covering [0, cnt).
+	// Ranges depend only on cnt and thread count, so results are repeatable.
+	template <class F> inline void ParallelFor ( int threads, slong cnt, F func )
+	{
+		if ( cnt <= 0 ) return;
+		threads = getHostThreads ( threads );
+		if ( threads > cnt ) threads = (int) cnt;
+		if ( threads <= 1 ) { func ( slong(0), cnt ); return; }
+
+		std::vector< std::thread > workers;
+		slong step = (cnt + threads - 1) / threads;
+		for (slong start = step; start < cnt; start += step ) {
+			slong end = (start + step < cnt) ? start + step : cnt;
+			workers.push_back ( std::thread ( func, start, end ) );
+		}
+		func ( slong(0), step );				// first range runs on calling thread
+		for (size_t n=0; n < workers.size(); n++ )
+			workers[n].join ();
+	}
+
+	// Persistent host worker pool
+	// Workers are started on first use and wait between jobs, so frequent parallel loops 
+	// (render, mesh, sort passes) do not create threads. Jobs from several threads are 
+	// run one at a time. A job started from inside a pool job runs on the calling thread.
+	class WorkerPool {
+	public:
+		WorkerPool () : mThreads(0), mStop(false), mJob(0x0), mJobCnt(0), mGen(0), mBusy(0) { mNext = 0; }
+		~WorkerPool ()							{ Stop (); }
+
+		void SetThreads ( int threads )			// 0 = all cores. Restarts workers when the count changes
+		{
+			threads = getHostThreads ( threads );
+			if ( threads == mThreads ) return;
+			std::lock_guard<std::mutex> run ( mRunMutex );
+			Stop ();
+			mThreads = threads;
+		}
+		int getNumThreads ()					{ if ( mThreads == 0 ) mThreads = getHostThreads ( 0 ); return mThreads; }
+		static bool& isWorker ()				{ static thread_local bool worker = false; return worker; }
+
+		// Calls job ( i ) for i in [0, cnt) on the workers and the calling thread
+		void Run ( slong cnt, const std::function<void(slong)>& job )
+		{
+			std::lock_guard<std::mutex> run ( mRunMutex );
+			if ( mWorkers.size() == 0 ) Start ();
+			{
+				std::lock_guard<std::mutex> lock ( mMutex );
+				mJob = &job;
+				mJobCnt = cnt;
+				mNext = 0;
+				mBusy = (int) mWorkers.size();
+				mGen++;
+			}
+			mWake.notify_all ();
+			isWorker() = true;
+			Work ();
+			isWorker() = false;
+			std::unique_lock<std::mutex> lock ( mMutex );
+			mDone.wait ( lock, [&] { return mBusy == 0; } );
+			mJob = 0x0;
+		}
+
+	private:
+		WorkerPool ( const WorkerPool& );
+		WorkerPool& operator= ( const WorkerPool& );
+
+		void Start ()
+		{
+			mStop = false;
+			for (int n=1; n < getNumThreads(); n++ )				// calling thread is the last worker
+				mWorkers.push_back ( std::thread ( &WorkerPool::Worker, this, mGen ) );
+		}
+		void Stop ()
+		{
+			{
+				std::lock_guard<std::mutex> lock ( mMutex );
+				mStop = true;
+			}
+			mWake.notify_all ();
+			for (size_t n=0; n < mWorkers.size(); n++ )
+				mWorkers[n].join ();
+			mWorkers.clear ();
+		}
+		void Work ()
+		{
+			for (slong i = mNext++; i < mJobCnt; i = mNext++ )
+				(*mJob) ( i );
+		}
+		void Worker ( uint64 gen )							// gen = last job before the worker started
+		{
+			isWorker() = true;
+			std::unique_lock<std::mutex> lock ( mMutex );
+			for (;;) {
+				mWake.wait ( lock, [&] { return mStop || mGen != gen; } );
+				if ( mStop ) return;
+				gen = mGen;
+				lock.unlock ();
+				Work ();
+				lock.lock ();
+				if ( --mBusy == 0 ) mDone.notify_one ();
+			}
+		}
+
+		int								mThreads;
+		std::vector< std::thread >		mWorkers;
+		std::mutex						mRunMutex;			// one job at a time
+		std::mutex						mMutex;
+		std::condition_variable			mWake, mDone;
+		bool							mStop;
+		const std::function<void(slong)>* mJob;
+		slong							mJobCnt;
+		std::atomic<slong>				mNext;				// next job index
+		uint64							mGen;				// job generation, wakes workers
+		int								mBusy;				// workers still in the job
+	};
+
+	// Host parallel loop on a worker pool
+	// Same ranges as ParallelFor with the pool thread count, so results match.
+	template <class F> inline void ParallelFor ( WorkerPool& pool, slong cnt, F func )
+	{
+		if ( cnt <= 0 ) return;
+		int threads = pool.getNumThreads ();
+		if ( threads > cnt ) threads = (int) cnt;
+		if ( threads <= 1 || WorkerPool::isWorker() ) { func ( slong(0), cnt ); return; }
+
+		slong step = (cnt + threads - 1) / threads;
+		slong ranges = (cnt + step - 1) / step;
+		pool.Run ( ranges, [&] ( slong r ) {
+			slong end = (r+1)*step;
+			func ( r*step, (end < cnt) ? end : cnt );
+		} );
+	}
+
+	// Host parallel sort
+	// Sorts contiguous ranges in parallel, then merges pairs of ranges until one remains.
+	template <class T> inline void ParallelSort ( WorkerPool& pool, std::vector<T>& list )
+	{
+		slong cnt = (slong) list.size();
+		int threads = pool.getNumThreads ();
+		if ( cnt < 4096 || threads <= 1 ) { std::sort ( list.begin(), list.end() ); return; }
+
+		slong step = (cnt + threads - 1) / threads;
+		ParallelFor ( pool, threads, [&] ( slong s, slong e ) {
+			for (slong n = s; n < e; n++ ) {
+				slong i = n*step, j = (n+1)*step;
+				if ( i < cnt ) std::sort ( list.begin() + i, list.begin() + (j < cnt ? j : cnt) );
+			}
+		} );
+		for (; step < cnt; step *= 2 ) {
+			slong pairs = (cnt + 2*step - 1) / (2*step);
+			ParallelFor ( pool, pairs, [&] ( slong s, slong e ) {
+				for (slong n = s; n < e; n++ ) {
+					slong i = n*2*step, m = i + step, j = i + 2*step;
+					if ( m >= cnt ) continue;
+					std::inplace_merge ( list.begin() + i, list.begin() + m, list.begin() + (j < cnt ? j : cnt) );
+				}
+			} );
+		}
+	}
+
+	}
+
+#endif
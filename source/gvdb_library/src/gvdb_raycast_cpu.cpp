@@ -0,0 +1,835 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------
+// Host (CPU) raycasting
+// C++ version of cuda_gvdb_raycast.cuh, used by Render and Raytrace on the CPU device.
+// - hostRayCast			- hierarchical 3DDA over pool 0 masks (rayCast)
+// - hostRayTile			- constant tiles of level 1 nodes, in place of a brick function
+// - brick functions		- rayDeepBrick, raySurfaceVoxelBrick, raySurfaceTrilinearBrick,
+//							  raySurfaceTricubicBrick, rayLevelSetBrick, rayEmptySkipBrick, rayShadowBrick
+// - RenderCPU				- gvdbRayDeep, gvdbRaySurface*, gvdbRayLevelSet, gvdbRayEmptySkip (cuda_gvdb_module.cu)
+// - RaytraceCPU			- gvdbRaytrace
+//
+// Images are split into 8x8 tiles (the CUDA block size) which are rendered in parallel.
+// Each tile row is a packet of 8 rays: view rays and bounding box entry are computed
+// for the whole packet, and packets that miss the volume are filled with background.
+// Packets only share this setup, they are not SIMD: the remaining rays are traversed 
+// one at a time, as DDA paths diverge once rays enter different nodes.
+// Atlas reads use trilinear filtering with clamp addressing, as with volTexIn on the GPU.
+//-----------------------------------------------
+
+#include "gvdb_allocator.h"
+#include "gvdb_volume_gvdb.h"
+#include "gvdb_brickcache.h"
+#include "gvdb_scene.h"
+#include "gvdb_node.h"
+#include "gvdb_parallel.h"
+#include "app_perf.h"
+
+#include <math.h>
+#include <cstring>
+
+using namespace nvdb;
+
+#define HOST_MAX_ITER		512
+#define HOST_EPS			0.02f
+#define HOST_NOHIT			1.0e10f
+#define HOST_TILE			8			// tile width and height (pixels)
+#define HOST_PACKET			8			// rays per packet (one tile row)
+
+// Host float3/float4, inline so traversal does not call into gvdb_vec.cpp
+struct hvec3 { float x, y, z; };
+struct hvec4 { float x, y, z, w; };
+
+inline hvec3 make_hvec3 ( float x, float y, float z )			{ hvec3 v = { x, y, z }; return v; }
+inline hvec3 make_hvec3 ( Vector3DF a )							{ return make_hvec3 ( a.x, a.y, a.z ); }
+inline hvec3 make_hvec3 ( Vector3DI a )							{ return make_hvec3 ( float(a.x), float(a.y), float(a.z) ); }
+inline hvec4 make_hvec4 ( float x, float y, float z, float w )	{ hvec4 v = { x, y, z, w }; return v; }
+inline hvec4 make_hvec4 ( Vector4DF a )							{ return make_hvec4 ( a.x, a.y, a.z, a.w ); }
+inline hvec3 operator+ ( hvec3 a, hvec3 b )		{ return make_hvec3 ( a.x+b.x, a.y+b.y, a.z+b.z ); }
+inline hvec3 operator- ( hvec3 a, hvec3 b )		{ return make_hvec3 ( a.x-b.x, a.y-b.y, a.z-b.z ); }
+inline hvec3 operator* ( hvec3 a, hvec3 b )		{ return make_hvec3 ( a.x*b.x, a.y*b.y, a.z*b.z ); }
+inline hvec3 operator/ ( hvec3 a, hvec3 b )		{ return make_hvec3 ( a.x/b.x, a.y/b.y, a.z/b.z ); }
+inline hvec3 operator+ ( hvec3 a, float b )		{ return make_hvec3 ( a.x+b, a.y+b, a.z+b ); }
+inline hvec3 operator- ( hvec3 a, float b )		{ return make_hvec3 ( a.x-b, a.y-b, a.z-b ); }
+inline hvec3 operator* ( hvec3 a, float b )		{ return make_hvec3 ( a.x*b, a.y*b, a.z*b ); }
+inline hvec3 operator* ( float b, hvec3 a )		{ return make_hvec3 ( a.x*b, a.y*b, a.z*b ); }
+inline hvec3 operator/ ( hvec3 a, float b )		{ return make_hvec3 ( a.x/b, a.y/b, a.z/b ); }
+inline void  operator+= ( hvec3& a, hvec3 b )	{ a.x += b.x; a.y += b.y; a.z += b.z; }
+inline void  operator-= ( hvec3& a, hvec3 b )	{ a.x -= b.x; a.y -= b.y; a.z -= b.z; }
+inline hvec4 operator* ( hvec4 a, float b )		{ return make_hvec4 ( a.x*b, a.y*b, a.z*b, a.w*b ); }
+inline float hdot ( hvec3 a, hvec3 b )			{ return a.x*b.x + a.y*b.y + a.z*b.z; }
+inline float hlength ( hvec3 a )				{ return sqrtf ( hdot(a,a) ); }
+inline hvec3 hnormalize ( hvec3 a )				{ float l = hlength(a); return (l > 0) ? a / l : a; }
+inline hvec3 hfloor ( hvec3 a )					{ return make_hvec3 ( floorf(a.x), floorf(a.y), floorf(a.z) ); }
+inline hvec3 hfrac ( hvec3 a )					{ return a - hfloor(a); }
+inline hvec3 hfabs ( hvec3 a )					{ return make_hvec3 ( fabsf(a.x), fabsf(a.y), fabsf(a.z) ); }
+inline hvec4 hlerp4 ( hvec4 a, hvec4 b, float t )	{ return make_hvec4 ( a.x+t*(b.x-a.x), a.y+t*(b.y-a.y), a.z+t*(b.z-a.z), a.w+t*(b.w-a.w) ); }
+inline uchar hclamp255 ( float v )				{ return uchar ( (v < 0) ? 0 : ((v > 255.0f) ? 255.0f : v) ); }
+
+// Render state shared by all rays, host equivalent of the gvdb and scn constants
+struct HostRayInfo {
+	VDBInfo*	gvdb;
+	ScnInfo*	scn;
+	char*		nodes[MAXLEV];			// pool 0, nodes
+	char*		childs[MAXLEV];			// pool 1, child lists
+	uint64		nodewid[MAXLEV];
+	uint64		childwid[MAXLEV];
+	hvec3		vdel[MAXLEV];
+	hvec3		voxelsize;
+	float*		atlas;					// channel 0 (float)
+	Vector3DI	ares;
+	uchar*		clr;					// color channel (uchar4), 0x0 if none
+	Vector3DI	cres;
+	Vector4DF*	transfer;				// transfer function (16384 entries)
+	BrickCache*	cache;					// paged atlas, 0x0 if not paged
+};
+
+// Brick function, same signature as gvdbBrickFunc_t
+typedef void (*hostBrickFunc_t) ( HostRayInfo&, char, int, hvec3, hvec3, hvec3, hvec3&, hvec3&, hvec3&, hvec4& );
+
+//----------- Atlas sampling
+
+// Trilinear sample of channel 0 with clamp addressing (tex3D on volTexIn)
+inline float hostTex ( HostRayInfo& c, float x, float y, float z )
+{
+	x -= 0.5f; y -= 0.5f; z -= 0.5f;				// texel centers
+	float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+	float ax = x - fx, ay = y - fy, az = z - fz;
+	int x0 = int(fx), y0 = int(fy), z0 = int(fz);
+	int x1 = x0+1, y1 = y0+1, z1 = z0+1;
+	const Vector3DI& r = c.ares;
+	x0 = (x0 < 0) ? 0 : ((x0 >= r.x) ? r.x-1 : x0);	x1 = (x1 < 0) ? 0 : ((x1 >= r.x) ? r.x-1 : x1);
+	y0 = (y0 < 0) ? 0 : ((y0 >= r.y) ? r.y-1 : y0);	y1 = (y1 < 0) ? 0 : ((y1 >= r.y) ? r.y-1 : y1);
+	z0 = (z0 < 0) ? 0 : ((z0 >= r.z) ? r.z-1 : z0);	z1 = (z1 < 0) ? 0 : ((z1 >= r.z) ? r.z-1 : z1);
+	const float* s0 = c.atlas + uint64(z0)*r.y*r.x;
+	const float* s1 = c.atlas + uint64(z1)*r.y*r.x;
+	float v00 = s0[y0*r.x + x0] + ax * (s0[y0*r.x + x1] - s0[y0*r.x + x0]);
+	float v10 = s0[y1*r.x + x0] + ax * (s0[y1*r.x + x1] - s0[y1*r.x + x0]);
+	float v01 = s1[y0*r.x + x0] + ax * (s1[y0*r.x + x1] - s1[y0*r.x + x0]);
+	float v11 = s1[y1*r.x + x0] + ax * (s1[y1*r.x + x1] - s1[y1*r.x + x0]);
+	v00 += ay * (v10 - v00);
+	v01 += ay * (v11 - v01);
+	return v00 + az * (v01 - v00);
+}
+inline float hostTex ( HostRayInfo& c, hvec3 p )	{ return hostTex ( c, p.x, p.y, p.z ); }
+
+// Color channel at atlas voxel (point sampled, as getColorF)
+inline hvec4 hostColorF ( HostRayInfo& c, hvec3 p )
+{
+	if ( c.clr == 0x0 ) return make_hvec4 ( 1, 1, 1, 1 );
+	int x = int(p.x), y = int(p.y), z = int(p.z);
+	x = (x < 0) ? 0 : ((x >= c.cres.x) ? c.cres.x-1 : x);
+	y = (y < 0) ? 0 : ((y >= c.cres.y) ? c.cres.y-1 : y);
+	z = (z < 0) ? 0 : ((z >= c.cres.z) ? c.cres.z-1 : z);
+	uchar* v = c.clr + ((uint64(z)*c.cres.y + y)*c.cres.x + x) * 4;
+	return make_hvec4 ( v[0]/255.0f, v[1]/255.0f, v[2]/255.0f, v[3]/255.0f );
+}
+
+// Transfer function (cuda_gvdb_dda.cuh)
+inline hvec4 hostTransfer ( HostRayInfo& c, float v )
+{
+	Vector3DF& th = c.gvdb->thresh;
+	float f = (v - th.y) / (th.z - th.y);
+	f = (f < 0) ? 0 : ((f > 1) ? 1 : f);
+	return make_hvec4 ( c.transfer[ int(f * 16300.0f) ] );
+}
+
+inline hvec3 hostGradient ( HostRayInfo& c, hvec3 p )
+{
+	hvec3 g;
+	// note: must use +/- 0.5 since apron may only be 1 voxel wide (cannot go beyond brick)
+	g.x = hostTex ( c, p.x-.5f, p.y, p.z ) - hostTex ( c, p.x+.5f, p.y, p.z );
+	g.y = hostTex ( c, p.x, p.y-.5f, p.z ) - hostTex ( c, p.x, p.y+.5f, p.z );
+	g.z = hostTex ( c, p.x, p.y, p.z-.5f ) - hostTex ( c, p.x, p.y, p.z+.5f );
+	return hnormalize ( g );
+}
+
+inline hvec3 hostGradientLevelSet ( HostRayInfo& c, hvec3 offs, hvec3 pos, hvec3 vmin, hvec3 vdel )
+{
+	hvec3 vs = c.voxelsize * 0.5f / vdel;
+	hvec3 g, p = offs + (pos-vmin)/vdel;
+	g.x = 0.5f * (hostTex ( c, p.x+vs.x, p.y, p.z ) - hostTex ( c, p.x-vs.x, p.y, p.z ));
+	g.y = 0.5f * (hostTex ( c, p.x, p.y+vs.y, p.z ) - hostTex ( c, p.x, p.y-vs.y, p.z ));
+	g.z = 0.5f * (hostTex ( c, p.x, p.y, p.z+vs.z ) - hostTex ( c, p.x, p.y, p.z-vs.z ));
+	return hnormalize ( g );
+}
+
+// Tricubic sample, same as getTricubic
+inline float hostTricubic ( HostRayInfo& c, hvec3 p, hvec3 offs )
+{
+	hvec3 q = hfloor ( p + offs ) - 1.0f;			// bottom-left corner of local 3x3x3 group
+	hvec3 tb = hfrac ( p ) * 0.5f + 0.25f;
+	hvec3 ta = make_hvec3 ( 1, 1, 1 ) - tb;
+	hvec3 ta2 = ta*ta, tb2 = tb*tb, tab = ta*tb*2.0f;
+	float r[3];
+	for (int k=0; k < 3; k++ ) {
+		float row[3];
+		for (int j=0; j < 3; j++ ) {
+			float v0 = hostTex ( c, q.x,	q.y+j, q.z+k );
+			float v1 = hostTex ( c, q.x+1, q.y+j, q.z+k );
+			float v2 = hostTex ( c, q.x+2, q.y+j, q.z+k );
+			row[j] = v0*ta2.x + v1*tab.x + v2*tb2.x;
+		}
+		r[k] = row[0]*ta2.y + row[1]*tab.y + row[2]*tb2.y;
+	}
+	return r[0]*ta2.z + r[1]*tab.z + r[2]*tb2.z;
+}
+
+inline hvec3 hostGradientTricubic ( HostRayInfo& c, hvec3 p, hvec3 offs )
+{
+	const float vs = 0.5f;
+	hvec3 g;
+	g.x = (hostTricubic ( c, p+make_hvec3(-vs,0,0), offs ) - hostTricubic ( c, p+make_hvec3(vs,0,0), offs )) / (2*vs);
+	g.y = (hostTricubic ( c, p+make_hvec3(0,-vs,0), offs ) - hostTricubic ( c, p+make_hvec3(0,vs,0), offs )) / (2*vs);
+	g.z = (hostTricubic ( c, p+make_hvec3(0,0,-vs), offs ) - hostTricubic ( c, p+make_hvec3(0,0,vs), offs )) / (2*vs);
+	return hnormalize ( g );
+}
+
+//----------- Nodes
+
+inline Node* hostGetNode ( HostRayInfo& c, int lev, int n, hvec3& vmin )
+{
+	Node* node = (Node*) (c.nodes[lev] + n*c.nodewid[lev]);
+	vmin = make_hvec3 ( node->mPos ) * c.voxelsize;
+	return node;
+}
+
+inline Node* hostGetNode ( HostRayInfo& c, int lev, int n )
+{
+	return (Node*) (c.nodes[lev] + n*c.nodewid[lev]);
+}
+
+// Node value range lies outside the span that can reach the image (isRangeSkip)
+inline bool hostRangeSkip ( HostRayInfo& c, Node* node )
+{
+	Vector3DF& r = c.gvdb->range_skip;
+	return r.z != 0 && (node->mFlags & NODE_RANGE) && ( node->mVRange.y < r.x || node->mVRange.x > r.y );
+}
+
+inline int hostGetChild ( HostRayInfo& c, Node* node, int b )
+{
+	uint64 n = node->countOn ( b );
+	uint64 listid = node->mChildList;
+	uint64* clist = (uint64*) (c.childs[ ElemLev(listid) ] + ElemNdx(listid) * c.childwid[ ElemLev(listid) ]);
+	return int ( ElemNdx ( clist[n] ) );
+}
+
+// Tile value of slot b of a level 1 node (VolumeGVDB::isTile), the child bit must be off
+inline bool hostGetTile ( HostRayInfo& c, Node* node, int b, float& v )
+{
+	if ( c.gvdb->tile_offs == 0 ) return false;
+	uint64* tmask = (uint64*) ((char*) node + c.gvdb->tile_offs);
+	if ( (tmask[b >> 6] & (uint64(1) << (b & 63))) == 0 ) return false;
+	uint64 res = c.gvdb->res[1];
+	uint64 mbytes = res*res*res / 8;
+	v = ((float*) ((char*) tmask + (mbytes < 8 ? 8 : mbytes)))[b];
+	return true;
+}
+
+// Value lies outside the span that can reach the image (hostRangeSkip of a single value)
+inline bool hostValueSkip ( HostRayInfo& c, float v )
+{
+	Vector3DF& r = c.gvdb->range_skip;
+	return r.z != 0 && ( v < r.x || v > r.y );
+}
+
+inline hvec3 hostRayBox ( hvec3 rpos, hvec3 rdir, hvec3 vmin, hvec3 vmax )
+{
+	float ht[8];
+	ht[0] = (vmin.x - rpos.x)/rdir.x;
+	ht[1] = (vmax.x - rpos.x)/rdir.x;
+	ht[2] = (vmin.y - rpos.y)/rdir.y;
+	ht[3] = (vmax.y - rpos.y)/rdir.y;
+	ht[4] = (vmin.z - rpos.z)/rdir.z;
+	ht[5] = (vmax.z - rpos.z)/rdir.z;
+	ht[6] = fmaxf(fmaxf(fminf(ht[0], ht[1]), fminf(ht[2], ht[3])), fminf(ht[4], ht[5]));
+	ht[7] = fminf(fminf(fmaxf(ht[0], ht[1]), fmaxf(ht[2], ht[3])), fmaxf(ht[4], ht[5]));
+	ht[6] = (ht[6] < 0 ) ? 0.0f : ht[6];
+	return make_hvec3 ( ht[6], ht[7], (ht[7]<ht[6] || ht[7]<0) ? HOST_NOHIT : 0 );
+}
+
+//----------- DDA (cuda_gvdb_dda.cuh)
+
+struct HostDDA {
+	hvec3	p, tDel, tSide, mask, pStep;
+
+	inline void Prepare ( hvec3& t, hvec3 pos, hvec3 dir, hvec3 vmin, hvec3 vdel, bool bLeaf )
+	{
+		p = (pos + t.x*dir - vmin) / vdel;
+		tDel = hfabs ( vdel / dir );
+		tSide = ((hfloor(p) - p + 0.5f)*pStep + 0.5f) * tDel;
+		if ( !bLeaf ) tSide = tSide + t.x;
+		if ( isinf(tDel.x) ) tSide.x = tDel.x;					// axis-aligned rays never cross this axis
+		if ( isinf(tDel.y) ) tSide.y = tDel.y;
+		if ( isinf(tDel.z) ) tSide.z = tDel.z;
+		p = hfloor ( p );
+	}
+	inline void Next ( hvec3& t )
+	{
+		mask.x = float ( (tSide.x < tSide.y) & (tSide.x <= tSide.z) );
+		mask.y = float ( (tSide.y < tSide.z) & (tSide.y <= tSide.x) );
+		mask.z = float ( (tSide.z < tSide.x) & (tSide.z <= tSide.y) );
+		t.y = mask.x ? tSide.x : (mask.y ? tSide.y : tSide.z);
+	}
+	inline void Step ( hvec3& t )
+	{
+		t.x = t.y;												// select axis instead of mask*tDel, which is NaN
+		if ( mask.x ) { tSide.x += tDel.x; p.x += pStep.x; }	// when tDel is inf (axis-aligned rays)
+		if ( mask.y ) { tSide.y += tDel.y; p.y += pStep.y; }
+		if ( mask.z ) { tSide.z += tDel.z; p.z += pStep.z; }
+	}
+	inline bool InBrick ( int res )
+	{
+		return p.x >= 0 && p.y >= 0 && p.z >= 0 && p.x < res && p.y < res && p.z < res;
+	}
+};
+
+//----------- Brick functions
+
+#define EPSTEST(a,b,c)	(a>b-c && a<b+c)
+#define VOXEL_EPS		0.0001f
+
+hvec3 hostRayLevelSet ( HostRayInfo& c, float t, hvec3 offs, hvec3 rpos, hvec3 rdir, hvec3 vmin, hvec3 vdel )
+{
+	float dt = c.scn->steps.z * c.voxelsize.x;
+	t -= c.voxelsize.x;
+	hvec3 wpt = dt*rdir;
+	hvec3 wp = rpos + t*rdir;
+	for ( int i=0; i < 64; i++ ) {
+		hvec3 p = offs + (wp-vmin)/vdel;
+		if ( hostTex ( c, p ) < 0 ) return wp;
+		wp += wpt;
+	}
+	return make_hvec3 ( HOST_NOHIT, HOST_NOHIT, HOST_NOHIT );
+}
+
+// Box hit and face normal, used by SurfaceVoxelBrick (one voxel) and hostRayTile (one tile)
+inline bool hostBoxHit ( hvec3 bmin, hvec3 bsize, hvec3 pos, hvec3 dir, hvec3& hit, hvec3& norm, float eps )
+{
+	hvec3 t = hostRayBox ( pos, dir, bmin, bmin + bsize );
+	if ( t.z == HOST_NOHIT ) { hit.x = HOST_NOHIT; return false; }
+	hit = pos + t.x*dir;
+	norm.x = EPSTEST(hit.x, bmin.x + bsize.x, eps) ? 1 : (EPSTEST(hit.x, bmin.x, eps) ? -1 : 0);
+	norm.y = EPSTEST(hit.y, bmin.y + bsize.y, eps) ? 1 : (EPSTEST(hit.y, bmin.y, eps) ? -1 : 0);
+	norm.z = EPSTEST(hit.z, bmin.z + bsize.z, eps) ? 1 : (EPSTEST(hit.z, bmin.z, eps) ? -1 : 0);
+	return true;
+}
+inline bool hostVoxelHit ( HostRayInfo& c, hvec3 voxmin, hvec3 pos, hvec3 dir, hvec3& hit, hvec3& norm, float eps )
+{
+	return hostBoxHit ( voxmin, c.voxelsize, pos, dir, hit, norm, eps );
+}
+
+// SurfaceVoxelBrick - Trace brick to render voxels as cubes
+void hostRaySurfaceVoxelBrick ( HostRayInfo& c, char /*shade*/, int nodeid, hvec3 t, hvec3 pos, hvec3 dir, hvec3& pStep, hvec3& hit, hvec3& norm, hvec4& hclr )
+{
+	hvec3 vmin;
+	Node* node = hostGetNode ( c, 0, nodeid, vmin );
+	hvec3 o = make_hvec3 ( node->mValue );
+	VDBInfo& gvdb = *c.gvdb;
+	HostDDA d;
+	d.pStep = pStep;
+	d.Prepare ( t, pos, dir, vmin, c.vdel[0], true );
+
+	for (int iter=0; iter < HOST_MAX_ITER && d.InBrick ( gvdb.res[0] ); iter++ ) {
+		if ( hostTex ( c, d.p.x+o.x+.5f, d.p.y+o.y+.5f, d.p.z+o.z+.5f ) > gvdb.thresh.x ) {
+			if ( !hostVoxelHit ( c, d.p * c.vdel[0] + vmin, pos, dir, hit, norm, VOXEL_EPS ) ) continue;
+			if ( gvdb.clr_chan != CHAN_UNDEF ) hclr = hostColorF ( c, d.p+o );
+			return;
+		}
+		d.Next ( t );
+		d.Step ( t );
+	}
+}
+
+// SurfaceTrilinearBrick - Trace brick to render surface with trilinear smoothing
+void hostRaySurfaceTrilinearBrick ( HostRayInfo& c, char /*shade*/, int nodeid, hvec3 t, hvec3 pos, hvec3 dir, hvec3& /*pStep*/, hvec3& hit, hvec3& norm, hvec4& hclr )
+{
+	hvec3 vmin;
+	Node* node = hostGetNode ( c, 0, nodeid, vmin );
+	hvec3 o = make_hvec3 ( node->mValue );
+	hvec3 p = (pos + t.x*dir - vmin) / c.vdel[0];			// sample point in index coords
+	VDBInfo& gvdb = *c.gvdb;
+	float pstep = c.scn->steps.x;
+	int res = gvdb.res[0];
+
+	for (int iter=0; iter < HOST_MAX_ITER && p.x >=0 && p.y >=0 && p.z >=0 && p.x < res && p.y < res && p.z < res; iter++) {
+		if ( hostTex ( c, p.x+o.x, p.y+o.y, p.z+o.z ) >= gvdb.thresh.x ) {
+			hit = p*c.vdel[0] + vmin;
+			norm = hostGradient ( c, p+o );
+			if ( gvdb.clr_chan != CHAN_UNDEF ) hclr = hostColorF ( c, p+o );
+			return;
+		}
+		p += pstep*dir;
+	}
+}
+
+// SurfaceTricubicBrick - Trace brick to render surface with tricubic smoothing
+void hostRaySurfaceTricubicBrick ( HostRayInfo& c, char /*shade*/, int nodeid, hvec3 t, hvec3 pos, hvec3 dir, hvec3& /*pStep*/, hvec3& hit, hvec3& norm, hvec4& hclr )
+{
+	hvec3 vmin;
+	Node* node = hostGetNode ( c, 0, nodeid, vmin );
+	hvec3 o = make_hvec3 ( node->mValue );
+	hvec3 p = (pos + t.x*dir - vmin) / c.vdel[0];			// sample point in index coords
+	VDBInfo& gvdb = *c.gvdb;
+	float pstep = c.scn->steps.x, fstep = c.scn->steps.z;
+	int res = gvdb.res[0];
+	hvec3 v;
+
+	for (int iter=0; iter < HOST_MAX_ITER && p.x >=0 && p.y >=0 && p.z >=0 && p.x < res && p.y < res && p.z < res; iter++) {
+		v.z = hostTricubic ( c, p, o );
+		if ( v.z >= gvdb.thresh.x ) {
+			v.x = hostTricubic ( c, p - fstep*dir, o );
+			v.y = (v.z - gvdb.thresh.x)/(v.z - v.x);
+			p += -v.y*fstep*dir;
+			hit = p*c.vdel[0] + vmin;
+			norm = hostGradientTricubic ( c, p, o );
+			if ( gvdb.clr_chan != CHAN_UNDEF ) hclr = hostColorF ( c, p+o );
+			return;
+		}
+		p += pstep*dir;
+	}
+}
+
+// LevelSet brick - Trace into brick to find level set surface
+void hostRayLevelSetBrick ( HostRayInfo& c, char /*shade*/, int nodeid, hvec3 t, hvec3 pos, hvec3 dir, hvec3& pStep, hvec3& hit, hvec3& norm, hvec4& /*clr*/ )
+{
+	hvec3 vmin;
+	Node* node = hostGetNode ( c, 0, nodeid, vmin );
+	hvec3 o = make_hvec3 ( node->mValue );
+	VDBInfo& gvdb = *c.gvdb;
+	hvec3 vdel = make_hvec3 ( gvdb.noderange[0] ) * c.voxelsize / float(gvdb.res[0]-1);
+	HostDDA d;
+	d.pStep = pStep;
+	d.Prepare ( t, pos, dir, vmin, c.vdel[0], true );
+
+	for (int iter=0; iter < HOST_MAX_ITER && d.InBrick ( gvdb.res[0] ); iter++ ) {
+		if ( hostTex ( c, d.p.x+o.x+.5f, d.p.y+o.y+.5f, d.p.z+o.z+.5f ) < 0 ) {		// test atlas for zero crossing
+			t.x = hlength ( (d.p*c.vdel[0] + vmin) + c.voxelsize*0.5f - pos );		// t value at center of voxel
+			hit = hostRayLevelSet ( c, t.x, o, pos, dir, vmin, c.vdel[0] );
+			if ( hit.x != HOST_NOHIT ) {
+				norm = hostGradientLevelSet ( c, o, hit, vmin, vdel );
+				return;
+			}
+		}
+		d.Next ( t );
+		d.Step ( t );
+	}
+}
+
+// EmptySkip brick - Return brick itself (do not trace values)
+void hostRayEmptySkipBrick ( HostRayInfo& c, char /*shade*/, int nodeid, hvec3 t, hvec3 pos, hvec3 dir, hvec3& /*pStep*/, hvec3& hit, hvec3& /*norm*/, hvec4& /*clr*/ )
+{
+	hvec3 vmin;
+	hostGetNode ( c, 0, nodeid, vmin );
+	hit = pos + t.x*dir;								// Return brick hit
+}
+
+// Shadow brick - Return deep shadow accumulation
+void hostRayShadowBrick ( HostRayInfo& c, char /*shade*/, int nodeid, hvec3 t, hvec3 pos, hvec3 dir, hvec3& /*pStep*/, hvec3& /*hit*/, hvec3& /*norm*/, hvec4& clr )
+{
+	hvec3 vmin;
+	Node* node = hostGetNode ( c, 0, nodeid, vmin );
+	t.x += HOST_EPS;									// make sure we start inside
+	t.y -= HOST_EPS;
+	hvec3 o = make_hvec3 ( node->mValue );
+	hvec3 p = (pos + t.x*dir - vmin) / c.vdel[0];
+	hvec3 pt = c.scn->steps.x * dir;
+	float sstep = c.scn->steps.y, extinct = c.scn->extinct.x;
+	int res = c.gvdb->res[0];
+	float val;
+
+	for (; clr.w < 1 && p.x >=0 && p.y >=0 && p.z >=0 && p.x < res && p.y < res && p.z < res;) {
+		val = expf ( extinct * hostTransfer ( c, hostTex ( c, p+o ) ).w * sstep / (1.0f + t.x * 0.4f) );		// 0.4 = shadow gain
+		clr.w = 1.0f - (1.0f-clr.w) * val;
+		p += pt;
+		t.x += sstep;
+	}
+}
+
+// DeepBrick - Sample into brick for deep volume raytracing
+void hostRayDeepBrick ( HostRayInfo& c, char /*shade*/, int nodeid, hvec3 t, hvec3 pos, hvec3 dir, hvec3& /*pStep*/, hvec3& hit, hvec3& /*norm*/, hvec4& clr )
+{
+	hvec3 vmin;
+	Node* node = hostGetNode ( c, 0, nodeid, vmin );
+	hvec3 o = make_hvec3 ( node->mValue );
+	hvec3 wp = pos + t.x*dir;
+	hvec3 p = (wp-vmin) / c.vdel[0];						// sample point in index coords
+	ScnInfo& scn = *c.scn;
+	float pstep = scn.steps.x, minval = scn.cutoff.x, alphacut = scn.cutoff.y;
+	float extinct = scn.extinct.x, albedo = scn.extinct.y;
+	hvec3 wpt = pstep*dir * c.vdel[0];					// world increment
+	hvec3 pt = pstep*dir;
+	hvec4 val = make_hvec4 ( 0, 0, 0, 0 );
+	hvec4 hclr;
+	bool bClr = ( c.gvdb->clr_chan != CHAN_UNDEF );
+	int res = c.gvdb->res[0];
+	int iter = 0;
+
+	// skip empty voxels
+	for (iter=0; val.w < minval && iter < HOST_MAX_ITER && p.x >= 0 && p.y >=0 && p.z >=0 && p.x < res && p.y < res && p.z < res; iter++) {
+		val.w = hostTransfer ( c, hostTex ( c, p+o ) ).w;
+		p += pt;
+		wp += wpt;
+		t.x += pstep;
+	}
+	// record front hit point at first significant voxel
+	if ( hit.z == HOST_NOHIT ) hit = make_hvec3 ( hlength ( wp - pos ), 0, 0 );
+
+	// accumulate remaining voxels
+	for (; clr.w > alphacut && iter < HOST_MAX_ITER && p.x >=0 && p.y >=0 && p.z >=0 && p.x < res && p.y < res && p.z < res; iter++) {
+		val = hostTransfer ( c, hostTex ( c, p+o ) );
+		val.w = expf ( extinct * val.w * pstep );
+		hclr = bClr ? hostColorF ( c, p+o ) : make_hvec4 ( 1, 1, 1, 1 );
+		clr.x += val.x * clr.w * (1 - val.w) * albedo * hclr.x;
+		clr.y += val.y * clr.w * (1 - val.w) * albedo * hclr.y;
+		clr.z += val.z * clr.w * (1 - val.w) * albedo * hclr.z;
+		clr.w *= val.w;
+		p += pt;
+		wp += wpt;
+		t.x += pstep;
+	}
+	hit.y = hlength ( wp - pos );
+	clr = make_hvec4 ( fminf(clr.x, 1.f), fminf(clr.y, 1.f), fminf(clr.z, 1.f), fmaxf(clr.w, 0.f) );
+}
+
+// Tile - Trace a constant tile (see VolumeGVDB::PruneBackground)
+// Brick functions sample the atlas, so tiles are traced here with the rules of each brick function
+// for a constant value. 'tmin' is the tile corner in world space, t.x and t.y are entry and exit.
+void hostRayTile ( HostRayInfo& c, float v, hvec3 tmin, hvec3 t, hvec3 pos, hvec3 dir, hvec3& hit, hvec3& norm, hvec4& clr, hostBrickFunc_t brickFunc )
+{
+	ScnInfo& scn = *c.scn;
+	VDBInfo& gvdb = *c.gvdb;
+	hvec3 hnorm;
+	if ( brickFunc == hostRayDeepBrick ) {
+		hvec4 val = hostTransfer ( c, v );
+		if ( val.w < scn.cutoff.x ) return;								// empty for the transfer function
+		if ( hit.z == HOST_NOHIT ) hit = make_hvec3 ( t.x, 0, 0 );		// front hit
+		float pstep = scn.steps.x, albedo = scn.extinct.y;
+		float dt = pstep * c.voxelsize.x;								// world distance per sample
+		float ext = expf ( scn.extinct.x * val.w * pstep );
+		for (int iter=0; t.x < t.y && clr.w > scn.cutoff.y && iter < HOST_MAX_ITER; iter++ ) {
+			clr.x += val.x * clr.w * (1 - ext) * albedo;
+			clr.y += val.y * clr.w * (1 - ext) * albedo;
+			clr.z += val.z * clr.w * (1 - ext) * albedo;
+			clr.w *= ext;
+			t.x += dt;
+		}
+		hit.y = t.x;
+		clr = make_hvec4 ( fminf(clr.x, 1.f), fminf(clr.y, 1.f), fminf(clr.z, 1.f), fmaxf(clr.w, 0.f) );
+	} else if ( brickFunc == hostRayEmptySkipBrick ) {
+		hit = pos + t.x*dir;
+	} else if ( brickFunc == hostRayLevelSetBrick ) {
+		if ( v < 0 && hostBoxHit ( tmin, c.vdel[1], pos, dir, hit, hnorm, VOXEL_EPS ) ) norm = hnorm;		// inside, surface at the tile face
+	} else {
+		bool bIn = ( brickFunc == hostRaySurfaceVoxelBrick ) ? ( v > gvdb.thresh.x ) : ( v >= gvdb.thresh.x );
+		if ( bIn && hostBoxHit ( tmin, c.vdel[1], pos, dir, hit, hnorm, VOXEL_EPS ) ) norm = hnorm;
+	}
+}
+
+//----------- Master raycast (rayCast)
+// 1. Performs empty skipping of GVDB hiearchy
+// 2. Calls the specified 'brickFunc' when a brick is hit
+// 3. Returns a color and/or surface hit and normal
+// t is the bounding box entry/exit from hostRayBox, computed by the caller so packets can share it.
+void hostRayCast ( HostRayInfo& c, char shade, hvec3 t, hvec3 pos, hvec3 dir, hvec3& hit, hvec3& norm, hvec4& clr, hostBrickFunc_t brickFunc )
+{
+	VDBInfo& gvdb = *c.gvdb;
+	int		lev = gvdb.top_lev;
+	int		nodeid[MAXLEV];
+	float	tMax[MAXLEV];
+	int		b, res;
+	float	tval;
+	hvec3	vmin;
+
+	if ( t.z == HOST_NOHIT ) { hit.x = HOST_NOHIT; return; }
+	nodeid[lev] = 0;
+	Node* node = hostGetNode ( c, lev, 0, vmin );		// root
+
+	t.x += HOST_EPS;
+	tMax[lev] = t.y - HOST_EPS;
+	HostDDA d;
+	d.pStep = make_hvec3 ( (dir.x > 0) ? 1 : -1, (dir.y > 0) ? 1 : -1, (dir.z > 0) ? 1 : -1 );
+	d.Prepare ( t, pos, dir, vmin, c.vdel[lev], false );
+
+	for (int iter=0; iter < HOST_MAX_ITER && lev > 0 && lev <= gvdb.top_lev; iter++ ) {
+		res = gvdb.res[lev];
+		if ( d.p.x < 0 || d.p.y < 0 || d.p.z < 0 || d.p.x > res || d.p.y > res || d.p.z > res ) break;
+
+		d.Next ( t );
+
+		// node active test (p == res is outside the node, step on)
+		b = (((int(d.p.z) << gvdb.dim[lev]) + int(d.p.y)) << gvdb.dim[lev]) + int(d.p.x);
+		if ( d.p.x < res && d.p.y < res && d.p.z < res && node->isOn ( b ) ) {
+			if ( lev == 1 ) {										// enter brick function..
+				nodeid[0] = hostGetChild ( c, node, b ); 
+				if ( !hostRangeSkip ( c, hostGetNode ( c, 0, nodeid[0] ) ) &&		// brick value range not visible, skip
+					 ( c.cache == 0x0 || c.cache->Touch ( nodeid[0] ) ) ) {	// paged atlas, missing bricks are requested
+					t.x += HOST_EPS;
+					(*brickFunc) ( c, shade, nodeid[0], t, pos, dir, d.pStep, hit, norm, clr );
+					if ( clr.w <= 0 ) { clr.w = 0; return; }			// deep termination
+					if ( hit.x != HOST_NOHIT && shade != SHADE_VOLUME ) return;		// surface termination
+				}
+				d.Step ( t );										// leaf node empty, skipped or not resident, step DDA
+			} else if ( hostRangeSkip ( c, hostGetNode ( c, lev-1, hostGetChild ( c, node, b ) ) ) ) {
+				d.Step ( t );										// sub-tree value range not visible, step DDA
+			} else {
+				lev--;												// step down tree
+				nodeid[lev] = hostGetChild ( c, node, b );
+				node = hostGetNode ( c, lev, nodeid[lev], vmin );
+				t.x += HOST_EPS;									// make sure we start inside child
+				tMax[lev] = t.y - HOST_EPS;							// t.x = entry point, t.y = exit point
+				d.Prepare ( t, pos, dir, vmin, c.vdel[lev], false );
+			}
+		} else if ( lev == 1 && d.p.x < res && d.p.y < res && d.p.z < res && hostGetTile ( c, node, b, tval ) ) {
+			if ( !hostValueSkip ( c, tval ) ) {						// tile value not visible, skip
+				hostRayTile ( c, tval, vmin + d.p*c.vdel[1], t, pos, dir, hit, norm, clr, brickFunc );
+				if ( clr.w <= 0 ) { clr.w = 0; return; }			// deep termination
+				if ( hit.x != HOST_NOHIT && shade != SHADE_VOLUME ) return;		// surface termination
+			}
+			d.Step ( t );
+		} else {
+			d.Step ( t );											// empty voxel, step DDA
+		}
+		while ( lev <= gvdb.top_lev && t.x > tMax[lev] ) {
+			lev++;													// step up tree
+			if ( lev <= gvdb.top_lev ) {
+				node = hostGetNode ( c, lev, nodeid[lev], vmin );
+				d.Prepare ( t, pos, dir, vmin, c.vdel[lev], false );	// restore dda at next level up
+			}
+		}
+	}
+	hit.x = HOST_NOHIT;
+}
+
+//----------- Shading (cuda_gvdb_module.cu)
+
+hvec4 hostPhongShading ( HostRayInfo& c, hvec4& hclr, hvec3 hit, hvec3 norm )
+{
+	ScnInfo& scn = *c.scn;
+	float diff = 1.0f;
+	float amb = 0.0f;
+
+	// shadow ray
+	if ( scn.shadow_amt > 0 ) {
+		hvec3 lightdir = hnormalize ( make_hvec3 ( scn.light_pos ) - hit );
+		float ndotl = hdot ( norm, lightdir );
+		diff = fmaxf ( 0.0f, ndotl ) * scn.shadow_amt;
+		amb = 1.0f - scn.shadow_amt;
+
+		hvec3 spos = hit + norm * c.voxelsize * 2.0f;
+		hvec3 shit = make_hvec3 ( HOST_NOHIT, HOST_NOHIT, HOST_NOHIT ), snorm;
+		hostRayCast ( c, scn.shading, hostRayBox ( spos, lightdir, make_hvec3(c.gvdb->bmin), make_hvec3(c.gvdb->bmax) ), spos, lightdir, shit, snorm, hclr, 
+			(scn.shading==SHADE_VOXEL) ? hostRaySurfaceVoxelBrick : hostRaySurfaceTrilinearBrick );
+		diff *= (shit.z == HOST_NOHIT) ? 1 : 0;
+	}
+	return make_hvec4 ( hclr.x * (diff + amb), hclr.y * (diff + amb), hclr.z * (diff + amb), 1.0f );
+}
+
+// Shade one pixel, given its view ray and bounding box entry
+void hostRenderPixel ( HostRayInfo& c, char shade, hvec3 rpos, hvec3 rdir, hvec3 t, uchar* out )
+{
+	ScnInfo& scn = *c.scn;
+	hvec4 back = make_hvec4 ( scn.backclr );
+	hvec3 hit = make_hvec3 ( HOST_NOHIT, HOST_NOHIT, HOST_NOHIT );
+	hvec3 norm = make_hvec3 ( 0, 0, 0 );
+	hvec4 clr = make_hvec4 ( 1, 1, 1, 1 );
+
+	switch ( shade ) {
+	case SHADE_VOLUME:
+		clr = make_hvec4 ( 0, 0, 0, 1 );
+		hostRayCast ( c, SHADE_VOLUME, t, rpos, rdir, hit, norm, clr, hostRayDeepBrick );
+		clr = ( hit.z != HOST_NOHIT ) ? hlerp4 ( back, clr, 1.0f-clr.w ) : back;
+		clr.w = 1.0f;
+		break;
+	case SHADE_VOXEL: case SHADE_TRILINEAR: case SHADE_TRICUBIC: {
+		hostBrickFunc_t func = (shade==SHADE_VOXEL) ? hostRaySurfaceVoxelBrick : ((shade==SHADE_TRILINEAR) ? hostRaySurfaceTrilinearBrick : hostRaySurfaceTricubicBrick);
+		hostRayCast ( c, shade, t, rpos, rdir, hit, norm, clr, func );
+		clr = ( hit.z != HOST_NOHIT ) ? hostPhongShading ( c, clr, hit, norm ) : back;
+		} break;
+	case SHADE_LEVELSET:
+		hit = make_hvec3 ( HOST_NOHIT, 1, 1 );
+		hostRayCast ( c, 0, t, rpos, rdir, hit, norm, clr, hostRayLevelSetBrick );
+		if ( hit.x != HOST_NOHIT ) {
+			hvec3 lightdir = hnormalize ( make_hvec3 ( scn.light_pos ) - hit );
+			hvec3 eyedir = hnormalize ( make_hvec3 ( scn.campos ) - hit );
+			hvec3 H = hnormalize ( eyedir + lightdir );
+			float diffuse = 0.4f * fmaxf ( 0.0f, hdot ( norm, lightdir ) );
+			float spec = 0.3f * powf ( fmaxf ( 0.0f, hdot ( norm, H ) ), 24 );
+
+			// shadow ray
+			hvec3 spos = hit + norm * c.voxelsize * 2.0f;
+			hvec3 h2 = make_hvec3 ( HOST_NOHIT, 1, 1 ), n2;
+			hostRayCast ( c, 0, hostRayBox ( spos, lightdir, make_hvec3(c.gvdb->bmin), make_hvec3(c.gvdb->bmax) ), spos, lightdir, h2, n2, clr, hostRayLevelSetBrick );
+			clr.x = (diffuse+spec) * ((h2.x==HOST_NOHIT) ? 1 : 0);
+			clr.w = 1.0f;
+		} else {
+			clr = back;
+		}
+		break;
+	case SHADE_EMPTYSKIP:
+		hostRayCast ( c, 0, t, rpos, rdir, hit, norm, clr, hostRayEmptySkipBrick );
+		clr = ( hit.z != HOST_NOHIT ) ? make_hvec4 ( hit.x*0.01f, hit.y*0.01f, hit.z*0.01f, 1 ) : back;
+		clr.w = 1.0f;
+		break;
+	}
+	out[0] = hclamp255 ( clr.x*255 );
+	out[1] = hclamp255 ( clr.y*255 );
+	out[2] = hclamp255 ( clr.z*255 );
+	out[3] = hclamp255 ( clr.w*255 );
+}
+
+// Setup host render state
+bool VolumeGVDB::PrepareRenderCPU ( void* info )
+{
+	HostRayInfo& c = *(HostRayInfo*) info;
+	DataPtr atlas = mPool->getAtlas ( 0 );
+	if ( atlas.cpu == 0x0 || atlas.type != T_FLOAT ) {
+		gprintf ( "ERROR: Host raycasting requires a float channel 0 on cpu.\n" );
+		return false;
+	}
+	int levs = mPool->getNumLevels ();
+	if ( mVDBInfo.top_lev >= levs || mPool->getPoolCnt ( 0, mVDBInfo.top_lev ) == 0 ) return false;
+
+	c.gvdb = &mVDBInfo;
+	c.scn = &mScnInfo;
+	for (int n=0; n < levs; n++ ) {
+		c.nodes[n] = mPool->getPoolCPU ( 0, n );
+		c.childs[n] = mPool->getPoolCPU ( 1, n );
+		c.nodewid[n] = mPool->getPoolWidth ( 0, n );
+		c.childwid[n] = mPool->getPoolWidth ( 1, n );
+		c.vdel[n] = make_hvec3 ( mVDBInfo.vdel[n] );
+	}
+	c.voxelsize = make_hvec3 ( mVDBInfo.voxelsize );
+	c.atlas = (float*) atlas.cpu;
+	c.ares = mPool->getAtlasRes ( 0 );
+	c.clr = 0x0;
+	uchar cc = mVDBInfo.clr_chan;
+	if ( cc != CHAN_UNDEF && cc < mPool->getNumAtlas() && mPool->getAtlas(cc).type == T_UCHAR4 && mPool->getAtlas(cc).cpu != 0x0 ) {
+		c.clr = (uchar*) mPool->getAtlas(cc).cpu;
+		c.cres = mPool->getAtlasRes ( cc );
+	}
+	c.transfer = mScene->getTransferFunc ();
+	c.cache = mCache;
+	return true;
+}
+
+// Render (host)
+// Tiles of HOST_TILE x HOST_TILE pixels are distributed over the worker threads.
+void VolumeGVDB::RenderCPU ( uchar rbuf, char shading )
+{
+	int width = mRenderBuf[rbuf].stride;
+	int height = mRenderBuf[rbuf].max / width;
+	uchar* out = (uchar*) mRenderBuf[rbuf].cpu;
+
+	switch ( shading ) {
+	case SHADE_VOXEL: case SHADE_TRILINEAR: case SHADE_TRICUBIC: case SHADE_LEVELSET: case SHADE_EMPTYSKIP: case SHADE_VOLUME:	break;
+	default:
+		gprintf ( "ERROR: Shading %d not available on CPU device.\n", (int) shading );
+		return;
+	}
+	HostRayInfo c;
+	hvec4 back = make_hvec4 ( mScnInfo.backclr );
+	bool bVol = PrepareRenderCPU ( &c );
+
+	int tx = (width + HOST_TILE-1) / HOST_TILE;
+	int ty = (height + HOST_TILE-1) / HOST_TILE;
+	hvec3 campos = make_hvec3 ( mScnInfo.campos );
+	hvec3 cams = make_hvec3 ( mScnInfo.cams ), camu = make_hvec3 ( mScnInfo.camu ), camv = make_hvec3 ( mScnInfo.camv );
+	hvec3 bmin = make_hvec3 ( mVDBInfo.bmin ), bmax = make_hvec3 ( mVDBInfo.bmax );
+
+	ParallelFor ( mWorkers, slong(tx)*ty, [&] ( slong s, slong e ) {
+		float dx[HOST_PACKET], dy[HOST_PACKET], dz[HOST_PACKET];
+		float t0[HOST_PACKET], t1[HOST_PACKET];
+		uchar bg[4] = { hclamp255(back.x*255), hclamp255(back.y*255), hclamp255(back.z*255), hclamp255(back.w*255) };
+		if ( shading == SHADE_VOLUME || shading == SHADE_EMPTYSKIP ) bg[3] = 255;
+
+		for (slong tile = s; tile < e; tile++ ) {
+			int x0 = int(tile % tx) * HOST_TILE;
+			int y0 = int(tile / tx) * HOST_TILE;
+			int cnt = (x0 + HOST_PACKET <= width) ? HOST_PACKET : width - x0;
+
+			for (int y = y0; y < y0 + HOST_TILE && y < height; y++ ) {
+				// packet setup: view rays and box entry for one tile row
+				float v = (y + 0.5f) / height;
+				bool bAny = false;
+				for (int i=0; i < cnt; i++ ) {
+					float u = (x0 + i + 0.5f) / width;
+					float rx = u*camu.x + v*camv.x + cams.x;
+					float ry = u*camu.y + v*camv.y + cams.y;
+					float rz = u*camu.z + v*camv.z + cams.z;
+					float l = 1.0f / sqrtf ( rx*rx + ry*ry + rz*rz );
+					dx[i] = rx*l; dy[i] = ry*l; dz[i] = rz*l;
+					float ax = (bmin.x - campos.x) / dx[i], bx = (bmax.x - campos.x) / dx[i];
+					float ay = (bmin.y - campos.y) / dy[i], by = (bmax.y - campos.y) / dy[i];
+					float az = (bmin.z - campos.z) / dz[i], bz = (bmax.z - campos.z) / dz[i];
+					t0[i] = fmaxf ( fmaxf ( fminf(ax,bx), fminf(ay,by) ), fminf(az,bz) );
+					t1[i] = fminf ( fminf ( fmaxf(ax,bx), fmaxf(ay,by) ), fmaxf(az,bz) );
+					t0[i] = (t0[i] < 0) ? 0 : t0[i];
+					bAny |= ( t1[i] >= t0[i] && t1[i] >= 0 );
+				}
+				uchar* row = out + (uint64(y)*width + x0) * 4;
+
+				// packet misses the volume
+				if ( !bVol || !bAny ) {
+					for (int i=0; i < cnt; i++ ) memcpy ( row + i*4, bg, 4 );
+					continue;
+				}
+				// trace rays of the packet
+				for (int i=0; i < cnt; i++ ) {
+					hvec3 t = make_hvec3 ( t0[i], t1[i], (t1[i] < t0[i] || t1[i] < 0) ? HOST_NOHIT : 0 );
+					hostRenderPixel ( c, shading, campos, make_hvec3 ( dx[i], dy[i], dz[i] ), t, row + i*4 );
+				}
+			}
+		}
+	} );
+}
+
+// Raytrace a bundle of rays (host)
+void VolumeGVDB::RaytraceCPU ( DataPtr rays, float bias )
+{
+	ScnRay* list = (ScnRay*) rays.cpu;
+	if ( list == 0x0 ) {
+		gprintf ( "ERROR: Raytrace on CPU device requires rays on cpu.\n" );
+		return;
+	}
+	HostRayInfo c;
+	bool bVol = PrepareRenderCPU ( &c );
+	hvec3 bmin = make_hvec3 ( mVDBInfo.bmin ), bmax = make_hvec3 ( mVDBInfo.bmax );
+	char shade = mScnInfo.shading;
+
+	ParallelFor ( mWorkers, (slong) rays.num, [&] ( slong s, slong e ) {
+		for (slong n = s; n < e; n++ ) {
+			ScnRay& r = list[n];
+			r.hit.Set ( HOST_NOHIT, HOST_NOHIT, HOST_NOHIT );
+			if ( !bVol ) continue;
+			hvec3 pos = make_hvec3 ( r.orig ), dir = make_hvec3 ( r.dir );
+			hvec3 hit = make_hvec3 ( HOST_NOHIT, HOST_NOHIT, HOST_NOHIT ), norm = make_hvec3 ( r.normal );
+			hvec4 hclr = make_hvec4 ( 1, 1, 1, 1 );
+			hostRayCast ( c, shade, hostRayBox ( pos, dir, bmin, bmax ), pos, dir, hit, norm, hclr, hostRaySurfaceTricubicBrick );
+			if ( hit.z != HOST_NOHIT ) hit -= dir * bias;
+			r.hit.Set ( hit.x, hit.y, hit.z );
+			r.normal.Set ( norm.x, norm.y, norm.z );
+		}
+	} );
+}
@@ -87,6 +87,36 @@ void Scene::LinearTransferFunc ( float t0, float t1, Vector4DF a, Vector4DF b )
 	}
 }
 
+// Value span that can affect the image for a shading mode. Nodes whose value range
+// lies outside it are skipped by the raycaster (see UpdateRange).
+// - Volume: transfer function entries with nonzero alpha, widened one entry for rounding
+// - Surfaces: values above the iso threshold. Level sets: values below zero.
+// - Tricubic reads beyond the brick apron, so it is not skipped.
+Vector3DF Scene::getSkipRange ( char shading )
+{
+	Vector3DF th = mVThreshold;
+	switch ( shading ) {
+	case SHADE_VOXEL: case SHADE_TRILINEAR:
+		return Vector3DF ( th.x, 1.0e20f, 1 );
+	case SHADE_LEVELSET:
+		return Vector3DF ( -1.0e20f, 0, 1 );
+	case SHADE_VOLUME: {
+		if ( mTransferFunc == 0x0 || th.z <= th.y ) break;
+		int i0 = -1, i1 = -1;
+		for (int n=0; n <= 16300; n++ ) {			// entries reachable by transfer ()
+			if ( mTransferFunc[n].w <= 0 ) continue;
+			if ( i0 == -1 ) i0 = n;
+			i1 = n;
+		}
+		if ( i0 == -1 ) return Vector3DF ( 1.0e20f, -1.0e20f, 1 );		// fully transparent
+		float lo = ( i0 == 0 ) ? -1.0e20f : th.y + (th.z - th.y) * float(i0-1) / 16300.0f;
+		float hi = ( i1 == 16300 ) ? 1.0e20f : th.y + (th.z - th.y) * float(i1+2) / 16300.0f;
+		return Vector3DF ( lo, hi, 1 );
+		}
+	}
+	return Vector3DF ( -1.0e20f, 1.0e20f, 0 );
+}
+
 Scene::~Scene ()
 {
 	
@@ -94,6 +94,7 @@
 		
 		// Transfer function		
 		void		LinearTransferFunc ( float t0, float t1, Vector4DF a, Vector4DF b );		
+		Vector3DF	getSkipRange ( char shading );		// values that can reach the image: x..y, z = 0 if no skipping
 
 		int			getNumModels ()		{ return (int) mModels.size(); }
 		Model*		getModel ( int n )	{ if (n < mModels.size()) return mModels[n]; else return 0x0; }
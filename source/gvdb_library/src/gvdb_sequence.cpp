@@ -0,0 +1,247 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+#include "gvdb_sequence.h"
+#include "gvdb_volume_gvdb.h"
+#include "gvdb_scene.h"
+#include "app_perf.h"
+#include <chrono>
+
+using namespace nvdb;
+
+#define SEQ_FPS_FRAMES		30		// frames averaged for fps
+
+static slong getSeqNSec ()
+{
+	return (slong) std::chrono::duration_cast<std::chrono::nanoseconds> ( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+VolumeSequence::VolumeSequence ()
+{
+	mbBrick = false;
+	mFirst = 0; mLast = -1;
+	mFrame = -1; mWant = 0; mNext = 0; mWindow = 0;
+	mbStop = true;
+	mFPS = 0; mWaitTime = 0;
+}
+
+VolumeSequence::~VolumeSequence ()
+{
+	Close ();
+}
+
+// Open a frame sequence
+// - 'name'     Frame file name, with '#' for the frame number
+// - 'buffers'  Number of host staging volumes. Each holds one decoded frame. 
+// - 'threads'  Number of loader threads (at most one per buffer)
+bool VolumeSequence::Open ( std::string name, int first, int last, int buffers, int threads )
+{
+	Close ();
+	if ( last < first || buffers < 1 ) return false;
+
+	mName = name;
+	mFirst = first;
+	mLast = last;
+	mFrame = first - 1;
+	mWant = first;
+	mNext = first;
+	mWindow = (buffers < getNumFrames()) ? buffers : getNumFrames();
+	mFrameTimes.clear ();
+	mFPS = 0; mWaitTime = 0;
+
+	std::string ext = (name.length() > 4) ? name.substr ( name.length()-4 ) : "";
+	mbBrick = ( ext.compare ( ".brk" ) == 0 || ext.compare ( ".BRK" ) == 0 );
+	if ( mbBrick ) return true;
+
+	// Host-only staging volumes (keep the application scene and volume current)
+	Scene* scn = Scene::gScene;
+	VolumeGVDB* vdb = gVDB;
+	mSlots.resize ( mWindow );
+	for (int n=0; n < mWindow; n++ ) {
+		mSlots[n].vol = new VolumeGVDB;
+		mSlots[n].vol->SetVerbose ( false );
+		mSlots[n].vol->SetCPUDevice ();
+		mSlots[n].vol->Initialize ();
+		mSlots[n].frame = -1;
+		mSlots[n].state = SLOT_EMPTY;
+		mSlots[n].ok = false;
+	}
+	Scene::gScene = scn;
+	gVDB = vdb;
+
+	// Loader threads
+	mbStop = false;
+	if ( threads <= 0 || threads > mWindow ) threads = mWindow;
+	for (int n=0; n < threads; n++ )
+		mWorkers.push_back ( std::thread ( &VolumeSequence::Worker, this ) );
+
+	return true;
+}
+
+void VolumeSequence::Close ()
+{
+	{
+		std::lock_guard<std::mutex> lock ( mMutex );
+		mbStop = true;
+	}
+	mCond.notify_all ();
+	for (size_t n=0; n < mWorkers.size(); n++ )
+		mWorkers[n].join ();
+	mWorkers.clear ();
+
+	for (size_t n=0; n < mSlots.size(); n++ ) {
+		if ( gVDB == mSlots[n].vol ) gVDB = 0x0;		// no dangling current volume
+		mSlots[n].vol->DestroyChannels ();
+		delete mSlots[n].vol;
+	}
+	mSlots.clear ();
+}
+
+std::string VolumeSequence::getFrameName ( int frame )
+{
+	// Replace '#' digits with the zero-padded frame number
+	std::string fname = mName;
+	size_t lpos = fname.find_first_of ( '#' );
+	if ( lpos != std::string::npos ) {
+		size_t rpos = fname.find_last_of ( '#' );
+		char buf[64];
+		sprintf ( buf, "%0*d", (int) (rpos-lpos+1), frame );
+		fname = fname.substr ( 0, lpos ) + std::string(buf) + fname.substr ( rpos+1 );
+	}
+	return fname;
+}
+
+int VolumeSequence::FindSlot ( int frame )
+{
+	for (size_t n=0; n < mSlots.size(); n++ )
+		if ( mSlots[n].state != SLOT_EMPTY && mSlots[n].frame == frame ) return (int) n;
+	return -1;
+}
+
+int VolumeSequence::Ahead ( int frame )
+{
+	int cnt = getNumFrames();
+	return ( (frame - mWant) % cnt + cnt ) % cnt;
+}
+
+void VolumeSequence::Reclaim ()
+{
+	for (size_t n=0; n < mSlots.size(); n++ )
+		if ( mSlots[n].state == SLOT_READY && Ahead ( mSlots[n].frame ) >= mWindow ) {
+			mSlots[n].state = SLOT_EMPTY;
+			mSlots[n].vol->DestroyChannels ();			// release stale atlas early
+		}
+}
+
+// Loader thread
+// Loads the next frame in the prefetch window into an empty staging volume.
+void VolumeSequence::Worker ()
+{
+	std::unique_lock<std::mutex> lock ( mMutex );
+
+	while ( !mbStop ) {
+		Reclaim ();
+
+		// Skip frames already buffered or loading
+		for (int n=0; n < mWindow && FindSlot ( mNext ) >= 0; n++ )
+			mNext = (mNext >= mLast) ? mFirst : mNext+1;
+
+		int s = -1;
+		for (size_t n=0; n < mSlots.size() && s < 0; n++ )
+			if ( mSlots[n].state == SLOT_EMPTY ) s = (int) n;
+
+		if ( s < 0 || FindSlot ( mNext ) >= 0 || Ahead ( mNext ) >= mWindow ) {
+			mCond.wait ( lock );						// nothing to do until a frame is taken or requested
+			continue;
+		}
+		Slot& slot = mSlots[s];
+		slot.frame = mNext;
+		slot.state = SLOT_LOADING;
+		mNext = (mNext >= mLast) ? mFirst : mNext+1;
+
+		std::string fname = getFrameName ( slot.frame );
+		lock.unlock ();
+		PERF_PUSH ( "Sequence Load" );
+		bool ok = slot.vol->LoadVBX ( fname );		// read, decode and build on host
+		PERF_POP ();
+		lock.lock ();
+
+		slot.ok = ok;
+		slot.state = SLOT_READY;
+		mCond.notify_all ();
+	}
+}
+
+// Load frame into volume
+// Takes the frame from the staging volumes when prefetched, otherwise restarts 
+// prefetching at the frame and waits for it. Prefetch then continues with the following frames.
+bool VolumeSequence::LoadFrame ( VolumeGVDB& vol, int frame )
+{
+	if ( frame < mFirst || frame > mLast ) return false;
+
+	slong t0 = getSeqNSec ();
+	bool ok;
+
+	if ( mbBrick ) {
+		ok = vol.LoadBRK ( getFrameName ( frame ) );
+		mWaitTime = float( getSeqNSec () - t0 ) / 1.0e6f;
+	} else {
+		std::unique_lock<std::mutex> lock ( mMutex );
+		if ( mbStop ) return false;
+		mWant = frame;
+		if ( FindSlot ( frame ) < 0 ) mNext = frame;		// not prefetched, seek
+		mCond.notify_all ();
+
+		int s;
+		mCond.wait ( lock, [&] { s = FindSlot ( frame ); return s >= 0 && mSlots[s].state == SLOT_READY; } );
+		mWaitTime = float( getSeqNSec () - t0 ) / 1.0e6f;
+
+		Slot& slot = mSlots[s];
+		slot.state = SLOT_LOADING;						// hold slot during swap
+		lock.unlock ();
+
+		PERF_PUSH ( "Sequence Swap" );
+		ok = slot.ok && vol.SwapFrame ( *slot.vol );
+		PERF_POP ();
+		if ( !slot.ok ) gprintf ( "ERROR: Unable to load frame %s\n", getFrameName(frame).c_str() );
+		slot.vol->DestroyChannels ();					// atlas was committed to vol
+
+		lock.lock ();
+		slot.state = SLOT_EMPTY;
+		mWant = (frame >= mLast) ? mFirst : frame+1;		// prefetch following frames
+		mCond.notify_all ();
+	}
+	mFrame = frame;
+
+	// Throughput
+	mFrameTimes.push_back ( getSeqNSec () );
+	if ( mFrameTimes.size() > SEQ_FPS_FRAMES ) mFrameTimes.erase ( mFrameTimes.begin() );
+	slong dt = mFrameTimes.back() - mFrameTimes.front();
+	mFPS = ( dt > 0 ) ? float(mFrameTimes.size()-1) * 1.0e9f / dt : 0;
+
+	return ok;
+}
+
+bool VolumeSequence::LoadNext ( VolumeGVDB& vol )
+{
+	return LoadFrame ( vol, (mFrame < mFirst || mFrame >= mLast) ? mFirst : mFrame+1 );
+}
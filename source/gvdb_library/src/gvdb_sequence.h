@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+
+#ifndef DEF_GVDB_SEQUENCE
+	#define DEF_GVDB_SEQUENCE
+
+	#include "gvdb_types.h"
+	#include <string>
+	#include <vector>
+	#include <thread>
+	#include <mutex>
+	#include <condition_variable>
+
+	namespace nvdb {
+
+	class VolumeGVDB;
+
+	// Volume Sequence
+	// Streams a numbered sequence of VBX frames for playback. Frames ahead of the current
+	// frame are loaded and decoded on background threads into host-only staging volumes,
+	// then swapped into the playback volume by LoadFrame. Host memory is bounded by the 
+	// number of staging volumes (2 = double buffered).
+	// Frame names use '#' for the frame number, e.g. "smoke####.vbx" (zero padded to the number of '#').
+	// BRK frames need the gpu to build bricks, so they are loaded synchronously.
+	class GVDB_API VolumeSequence {
+	public:
+		VolumeSequence ();
+		~VolumeSequence ();
+
+		bool	Open ( std::string name, int first, int last, int buffers = 2, int threads = 0 );	// threads = 0, one per buffer
+		void	Close ();
+		bool	LoadFrame ( VolumeGVDB& vol, int frame );		// swap frame into vol, waits until it is loaded
+		bool	LoadNext ( VolumeGVDB& vol );					// next frame, wraps to first
+
+		std::string getFrameName ( int frame );
+		int		getFrame ()				{ return mFrame; }
+		int		getFirst ()				{ return mFirst; }
+		int		getLast ()				{ return mLast; }
+		int		getNumFrames ()			{ return mLast - mFirst + 1; }
+		float	getFPS ()				{ return mFPS; }			// frames delivered per second (recent average)
+		float	getWaitTime ()			{ return mWaitTime; }		// time LoadFrame waited for last frame (ms)
+
+	private:
+		enum SlotState { SLOT_EMPTY=0, SLOT_LOADING, SLOT_READY };
+		struct Slot {
+			VolumeGVDB*	vol;		// host-only staging volume
+			int			frame;
+			int			state;
+			bool		ok;
+		};
+		void	Worker ();
+		int		FindSlot ( int frame );			// slot holding frame, or -1
+		int		Ahead ( int frame );			// frames ahead of requested frame, wrapping from last to first
+		void	Reclaim ();						// empty ready slots outside the prefetch window
+
+		std::string		mName;
+		bool			mbBrick;		// BRK frames (synchronous)
+		int				mFirst, mLast;
+		int				mFrame;			// current frame
+		int				mWant;			// requested (or next expected) frame
+		int				mNext;			// next frame to prefetch
+		int				mWindow;		// frames prefetched from mWant
+		bool			mbStop;
+
+		std::vector<Slot>			mSlots;
+		std::vector<std::thread>	mWorkers;
+		std::mutex					mMutex;
+		std::condition_variable		mCond;
+
+		std::vector<slong>			mFrameTimes;	// delivery times of recent frames (ns)
+		float						mFPS;
+		float						mWaitTime;
+	};
+
+	}
+
+#endif
@@ -0,0 +1,525 @@
+//--------------------------------------------------------------------------------
+// NVIDIA(R) GVDB VOXELS
+// Copyright 2017, NVIDIA Corporation. 
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+//    in the documentation and/or  other materials provided with the distribution.
+// 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+//    from this software without specific prior written permission.
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+// BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Version 1.0: Rama Hoetzlein, 5/1/2017
+//----------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------
+// Host (CPU) reference backend
+// Multithreaded C++ versions of the native GVDB kernels. Used when VolumeGVDB
+// is set to the CPU device (see SetCPUDevice). Each function mirrors the math of the
+// matching CUDA kernel so results can be compared against the GPU.
+// - ComputeCPU			- FILL_F, FILL_C, FILL_C4, SMOOTH, NOISE, GROW (cuda_gvdb_operators.cuh)
+// - UpdateApronCPU		- apron update 
+// - ResampleCPU		- resample aux volume into atlas
+// - InsertPointsCPU	- insert points into bricks (cuda_gvdb_particles.cuh)
+// - ScatterPointDensityCPU - splat points into bricks
+// - ComputeRangeCPU	- value range of bricks (gvdbComputeRange)
+//
+// Host atlases are stored linearly on cpu, x-fastest: (z*res.y + y)*res.x + x
+//-----------------------------------------------
+
+#include "gvdb_allocator.h"
+#include "gvdb_volume_gvdb.h"
+#include "gvdb_node.h"
+#include "gvdb_parallel.h"
+#include "app_perf.h"
+
+#include <vector>
+#include <cstring>
+
+using namespace nvdb;
+
+// Hash and random, same as cuda_gvdb_geom.cuh
+inline uint hostHash ( uint x ) 
+{
+	x += ( x << 10u );    x ^= ( x >>  6u );
+	x += ( x <<  3u );    x ^= ( x >> 11u );
+	x += ( x << 15u );
+	return x;
+}
+inline float hostRandom ( float x, float y, float z )
+{
+	int v[3];
+	memcpy ( &v[0], &x, sizeof(float) );	// __float_as_int
+	memcpy ( &v[1], &y, sizeof(float) );
+	memcpy ( &v[2], &z, sizeof(float) );
+	uint m = hostHash ( v[0] ^ hostHash(v[1]) ^ hostHash(v[2]) );
+	m &= 0x007FFFFFu;						// keep mantissa bits
+	m |= 0x3F800000u;						// add fractional part to 1.0
+	float f;
+	memcpy ( &f, &m, sizeof(float) );		// range [1:2]
+	return f - 1.0;							// range [0:1]
+}
+
+// Point splat falloff, same as distFunc in cuda_gvdb_particles.cuh
+inline float hostDistFunc ( Vector3DF& a, float bx, float by, float bz, float r )
+{
+	bx -= a.x; by -= a.y; bz -= a.z;	
+	float c = (bx*bx+by*by+bz*bz) / (r*r);
+	return 1.0 + c*(-3 + c*(3-c));	
+}
+
+// Atlas voxel index with clamp addressing (matches CU_TR_ADDRESS_MODE_CLAMP)
+inline uint64 hostAtlasNdx ( Vector3DI& res, int x, int y, int z )
+{
+	x = (x < 0) ? 0 : ((x >= res.x) ? res.x-1 : x);
+	y = (y < 0) ? 0 : ((y >= res.y) ? res.y-1 : y);
+	z = (z < 0) ? 0 : ((z >= res.z) ? res.z-1 : z);
+	return (uint64(z)*res.y + y)*res.x + x;
+}
+
+// Get leaf node at a world point (host)
+// - Iterative descent from the top level, same as getNodeAtPoint in cuda_gvdb_nodes.cuh
+// - Uses VDB info, so PrepareVDB must be called first
+Node* VolumeGVDB::getNodeAtPoint ( Vector3DF pos, Vector3DF& vmin, slong& nodeid )
+{
+	int lev = mVDBInfo.top_lev;
+	nodeid = ID_UNDEFL;
+	if ( lev >= mPool->getNumLevels() || mPool->getPoolCnt(0, lev) == 0 ) return 0x0;
+
+	nodeid = Elem ( 0, lev, 0 );
+	Node* node = getNode ( nodeid );
+	vmin = Vector3DF(node->mPos) * mVoxsize;
+	Vector3DF vmax, p;
+	uint32 b;
+
+	while ( lev > 0 ) {
+		// is point inside node? if no, exit
+		vmax = Vector3DF(mVDBInfo.noderange[lev]) * mVoxsize;
+		vmax += vmin;
+		if ( pos.x < vmin.x || pos.y < vmin.y || pos.z < vmin.z || pos.x >= vmax.x || pos.y >= vmax.y || pos.z >= vmax.z ) {
+			nodeid = ID_UNDEFL;
+			return 0x0;
+		}
+		p = pos - vmin;	p /= mVDBInfo.vdel[lev];		// check child bit
+		b = (( (int(p.z) << mVDBInfo.dim[lev]) + int(p.y)) << mVDBInfo.dim[lev]) + int(p.x);
+		lev--;
+		if ( !node->isOn ( b ) ) {
+			nodeid = ID_UNDEFL;
+			return 0x0;									// no child, exit
+		}
+		nodeid = getChildNode ( nodeid, node->countOn ( b ) );	// child exists, go down tree
+		node = getNode ( nodeid );
+		vmin = Vector3DF(node->mPos) * mVoxsize;
+	}
+	return node;
+}
+
+// Get tile value at a world point (host), same as getTileAtPoint in cuda_gvdb_nodes.cuh
+// - False if the point is in a leaf or in empty space
+bool VolumeGVDB::getTileAtPoint ( Vector3DF pos, float& v )
+{
+	int lev = mVDBInfo.top_lev;
+	if ( !hasTiles(1) || lev >= mPool->getNumLevels() || mPool->getPoolCnt(0, lev) == 0 ) return false;
+
+	slong nodeid = Elem ( 0, lev, 0 );
+	Node* node = getNode ( nodeid );
+	Vector3DF vmin = Vector3DF(node->mPos) * mVoxsize;
+	Vector3DF vmax, p;
+	uint32 b;
+
+	while ( lev > 0 ) {
+		vmax = Vector3DF(mVDBInfo.noderange[lev]) * mVoxsize;
+		vmax += vmin;
+		if ( pos.x < vmin.x || pos.y < vmin.y || pos.z < vmin.z || pos.x >= vmax.x || pos.y >= vmax.y || pos.z >= vmax.z ) return false;
+		p = pos - vmin;	p /= mVDBInfo.vdel[lev];
+		b = (( (int(p.z) << mVDBInfo.dim[lev]) + int(p.y)) << mVDBInfo.dim[lev]) + int(p.x);
+		if ( !node->isOn ( b ) ) {
+			if ( lev != 1 || !isTile ( node, b ) ) return false;
+			v = getTileValues(node)[b];
+			return true;
+		}
+		nodeid = getChildNode ( nodeid, node->countOn ( b ) );
+		node = getNode ( nodeid );
+		vmin = Vector3DF(node->mPos) * mVoxsize;
+		lev--;
+	}
+	return false;
+}
+
+// Atlas voxel to world position, same as getAtlasToWorld in cuda_gvdb_nodes.cuh
+// - Returns false for unused bricks
+inline bool hostAtlasToWorld ( Allocator* pool, VDBInfo& info, Vector3DI vox, Vector3DF& wpos )
+{
+	AtlasNode* an = (AtlasNode*) pool->getAtlasNode ( 0, vox );
+	if ( an->mLeafNode == (int) ID_UNDEFL ) return false;
+	Vector3DI poffset ( vox.x % info.brick_res, vox.y % info.brick_res, vox.z % info.brick_res );
+	poffset -= Vector3DI( info.atlas_apron, info.atlas_apron, info.atlas_apron );
+	wpos.x = ( float(an->mPos.x) + float(poffset.x) + 0.5f ) * info.voxelsize.x;
+	wpos.y = ( float(an->mPos.y) + float(poffset.y) + 0.5f ) * info.voxelsize.y;
+	wpos.z = ( float(an->mPos.z) + float(poffset.z) + 0.5f ) * info.voxelsize.z;
+	return true;
+}
+
+// Value range of bricks (gvdbComputeRange)
+// - 'bricks' are brick corners in the atlas, apron included
+// - min and max cover the whole brick, the mean covers the interior
+void VolumeGVDB::ComputeRangeCPU ( uchar chan, int cnt, Vector3DI* bricks, Vector3DF* out )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	Vector3DI res = mPool->getAtlasRes ( chan );
+	int bres = mPool->getAtlasBrickres ( chan );
+	int lo = atlas.apron, hi = bres - atlas.apron;
+	bool bFloat = ( atlas.type == T_FLOAT );
+
+	ParallelFor ( mWorkers, cnt, [&] ( slong s, slong e ) {
+		for (slong b = s; b < e; b++ ) {
+			Vector3DI o = bricks[b];
+			float vmin = 1.0e20f, vmax = -1.0e20f, v;
+			double sum = 0;
+			for (int z=0; z < bres; z++ ) {
+				for (int y=0; y < bres; y++ ) {
+					uint64 i = (uint64(o.z+z)*res.y + (o.y+y))*res.x + o.x;
+					bool bIn = ( z >= lo && z < hi && y >= lo && y < hi );
+					for (int x=0; x < bres; x++, i++ ) {
+						v = bFloat ? ((float*) atlas.cpu)[i] : float( ((uchar*) atlas.cpu)[i] );
+						if ( v < vmin ) vmin = v;
+						if ( v > vmax ) vmax = v;
+						if ( bIn && x >= lo && x < hi ) sum += v;
+					}
+				}
+			}
+			out[b].Set ( vmin, vmax, float( sum / (double(hi-lo)*(hi-lo)*(hi-lo)) ) );
+		}
+	} );
+}
+
+// Native compute operators (host)
+// - One work item per active brick (see UpdateBrickList), unused atlas space is skipped.
+// - Fill operators write the whole brick including apron, others write the interior only.
+// - Stencil operators copy the brick with a one voxel border first, as GVDB_COPY_SMEM
+//   does in shared memory, so neighbors are read from before the pass. The border is 
+//   clamped to the brick apron, so bricks never read each other.
+void VolumeGVDB::ComputeCPU ( int effect, uchar chan, Vector3DF parm )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	Vector3DI res = mPool->getAtlasRes ( chan );
+	float p1 = parm.x, p2 = parm.y, p3 = parm.z;
+	char* dst = atlas.cpu;
+	if ( dst == 0x0 ) {
+		gprintf ( "ERROR: Channel %d has no host atlas.\n", (int) chan );
+		return;
+	}
+	bool bFill = false;
+	switch ( effect ) {
+	case FUNC_FILL_F: case FUNC_FILL_C: case FUNC_FILL_C4:
+		bFill = true;
+		break;
+	case FUNC_SMOOTH: case FUNC_NOISE: case FUNC_GROW:
+		if ( atlas.type != T_FLOAT ) {
+			gprintf ( "ERROR: Compute effect %d requires a float channel.\n", effect );
+			return;
+		}
+		break;
+	default:
+		gprintf ( "ERROR: Compute effect %d not available on CPU device.\n", effect );
+		return;
+	}
+	Vector3DI* bricks = (Vector3DI*) mAux[AUX_BRICKS].cpu;
+	int apron = atlas.apron;
+	int br = mPool->getAtlasBrickres ( chan ) - 2*apron;		// brick interior res
+	int lo = bFill ? -apron : 0;								// range written
+	int hi = bFill ? br + apron : br;
+
+	ParallelFor ( mWorkers, mVDBInfo.brick_cnt, [&] ( slong s, slong e ) {
+		int sr = br + 2;										// local copy res
+		std::vector<float> local ( bFill ? 0 : sr*sr*sr );
+		float* in = bFill ? 0x0 : &local[0];
+		float v;
+		uint64 i;
+		int x, y, z, cx, cy, cz, k;
+		for (slong b = s; b < e; b++ ) {
+			Vector3DI o = bricks[b];
+			if ( !bFill ) {
+				for (z=0; z < sr; z++ ) {
+					cz = (z-1 < -apron) ? -apron : ((z-1 >= br+apron) ? br+apron-1 : z-1);
+					for (y=0; y < sr; y++ ) {
+						cy = (y-1 < -apron) ? -apron : ((y-1 >= br+apron) ? br+apron-1 : y-1);
+						for (x=0; x < sr; x++ ) {
+							cx = (x-1 < -apron) ? -apron : ((x-1 >= br+apron) ? br+apron-1 : x-1);
+							in[(z*sr + y)*sr + x] = ((float*) dst)[ hostAtlasNdx ( res, o.x+cx, o.y+cy, o.z+cz ) ];
+						}
+					}
+				}
+			}
+			for (z = lo; z < hi; z++ )
+				for (y = lo; y < hi; y++ ) 
+					for (x = lo; x < hi; x++ ) {
+						i = (uint64(o.z+z)*res.y + (o.y+y))*res.x + (o.x+x);
+						k = ((z+1)*sr + (y+1))*sr + (x+1);				// local copy index
+						switch ( effect ) {
+						case FUNC_FILL_F:	((float*) dst)[i] = p1;		break;
+						case FUNC_FILL_C:	((uchar*) dst)[i] = uchar(p1);	break;
+						case FUNC_FILL_C4: {
+							uchar* c = (uchar*) dst + i*4;
+							c[0] = uchar(p1*255); c[1] = uchar(p2*255); c[2] = uchar(p3*255); c[3] = 255;
+							} break;
+						case FUNC_SMOOTH:
+							v = p1 * in[k];
+							v += in[k-1];
+							v += in[k+1];
+							v += in[k-sr];
+							v += in[k+sr];
+							v += in[k-sr*sr];
+							v += in[k+sr*sr];
+							v = v / (p1 + 6.0) + p2;
+							((float*) dst)[i] = v;
+							break;
+						case FUNC_NOISE:
+							v = in[k];
+							if ( v > 0.01 ) v += hostRandom ( float(o.x+x), float(o.y+y), float(o.z+z) ) * p1;
+							((float*) dst)[i] = v;
+							break;
+						case FUNC_GROW:
+							v = in[k];
+							if ( v != 0.0) v += p1 * 10.0;
+							if ( v < 0.01) v = 0.0;
+							((float*) dst)[i] = v;
+							break;
+						}
+					}
+		}
+	} );
+}
+
+// Update apron (host)
+// Apron voxels only read from brick interiors, so all three axes are done in one pass.
+void VolumeGVDB::UpdateApronCPU ( uchar chan )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	Vector3DI res = mPool->getAtlasRes ( chan );
+	int brickres = mPool->getAtlasBrickres ( chan );
+	int apron = atlas.apron;
+	int dsize = mPool->getSize ( atlas.type );
+	char* dat = atlas.cpu;
+	if ( dat == 0x0 || apron == 0 ) return;
+	bool bTiles = ( chan == 0 && atlas.type == T_FLOAT && hasTiles(1) );		// tile values belong to channel 0 (see PruneBackground)
+	
+	ParallelFor ( mWorkers, res.z, [&] ( slong zs, slong ze ) {
+		Vector3DI vox, b, q;
+		Vector3DF wpos, vmin, offs;
+		slong nid;
+		Node* node;
+		float tval;
+		for ( vox.z = int(zs); vox.z < int(ze); vox.z++ ) {
+			b.z = vox.z % brickres;
+			for ( vox.y = 0; vox.y < res.y; vox.y++ ) {
+				b.y = vox.y % brickres;
+				for ( vox.x = 0; vox.x < res.x; vox.x++ ) {
+					b.x = vox.x % brickres;
+					if ( b.x >= apron && b.x < brickres-apron && b.y >= apron && b.y < brickres-apron && b.z >= apron && b.z < brickres-apron ) continue;	// interior
+					if ( !hostAtlasToWorld ( mPool, mVDBInfo, vox, wpos ) ) continue;
+
+					char* out = dat + ((uint64(vox.z)*res.y + vox.y)*res.x + vox.x) * dsize;
+					node = getNodeAtPoint ( wpos, vmin, nid );		// evaluate at world position
+					if ( node == 0x0 ) { 
+						if ( bTiles && getTileAtPoint ( wpos, tval ) )	memcpy ( out, &tval, dsize );
+						else											memset ( out, 0, dsize ); 
+						continue;
+					}
+					offs = wpos - vmin;	offs /= mVDBInfo.vdel[ node->mLev ];
+					offs += node->mValue;
+					memcpy ( out, dat + hostAtlasNdx ( res, int(offs.x), int(offs.y), int(offs.z) ) * dsize, dsize );	// sample at world point
+				}
+			}
+		}
+	} );
+}
+
+// Resample (host), same as gvdbResample
+void VolumeGVDB::ResampleCPU ( uchar chan, Matrix4F& xform, Vector3DI in_res, char in_aux, Vector3DF inr, Vector3DF outr )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	Vector3DI res = mPool->getAtlasRes ( chan );
+	float* dst = (float*) atlas.cpu;
+	float* src = (float*) mAux[(uchar) in_aux].cpu;
+	float* xf = xform.GetDataF ();
+	if ( dst == 0x0 || src == 0x0 ) return;
+
+	ParallelFor ( mWorkers, res.z-1, [&] ( slong zs, slong ze ) {
+		Vector3DI vox, ndx;
+		Vector3DF wpos;
+		float v;
+		for ( vox.z = int(zs)+1; vox.z < int(ze)+1; vox.z++ )
+			for ( vox.y = 1; vox.y < res.y; vox.y++ )
+				for ( vox.x = 1; vox.x < res.x; vox.x++ ) {
+					if ( !hostAtlasToWorld ( mPool, mVDBInfo, vox, wpos ) ) continue;
+					
+					// transform to scn index
+					ndx.x = (int) (wpos.x * xf[0] + wpos.y * xf[4] + wpos.z * xf[8] + xf[12]);
+					ndx.y = (int) (wpos.x * xf[1] + wpos.y * xf[5] + wpos.z * xf[9] + xf[13]);
+					ndx.z = (int) (wpos.x * xf[2] + wpos.y * xf[6] + wpos.z * xf[10] + xf[14]);
+
+					// skip if outside src
+					if ( ndx.x < 0 || ndx.y < 0 || ndx.z < 0 || ndx.x >= in_res.x || ndx.y >= in_res.y || ndx.z >= in_res.z )
+						continue;
+
+					v = src[ (uint64(ndx.z)*in_res.y + ndx.y)*in_res.x + ndx.x ];
+					v = outr.x + (v-inr.x)*(outr.y-outr.x)/(inr.y-inr.x);    // remap value
+					dst[ (uint64(vox.z)*res.y + vox.y)*res.x + vox.x ] = v;
+				}
+	} );
+}
+
+// Insert points (host), same as gvdbInsertPoints and gvdbSortPoints
+// - Per-brick point index is assigned in point order, so the result is deterministic.
+void VolumeGVDB::InsertPointsCPU ( int num_pnts, Vector3DF trans, bool bPrefix )
+{
+	int bricks = mPool->getAtlas(0).num;
+	char* ppos = mAux[AUX_PNTPOS].cpu;
+	int pos_off = mAux[AUX_PNTPOS].subdim.x;
+	int pos_stride = (int) mAux[AUX_PNTPOS].stride;
+	int* pnode = (int*) mAux[AUX_PNODE].cpu;
+	int* poff = (int*) mAux[AUX_PNDX].cpu;
+	int* gcnt = (int*) mAux[AUX_GRIDCNT].cpu;
+	if ( ppos == 0x0 ) {
+		gprintf ( "ERROR: InsertPoints. Points not on host.\n" );
+		return;
+	}
+
+	// Find brick for each point
+	if ( mbProfile ) PERF_PUSH ( "Insert points" );
+	ParallelFor ( mWorkers, num_pnts, [&] ( slong s, slong e ) {
+		Vector3DF wpos, vmin;
+		slong nid;
+		for ( slong i = s; i < e; i++ ) {
+			wpos = *(Vector3DF*) (ppos + i*pos_stride + pos_off);		// NOTE: +trans is below. Allows check for wpos.z==NOHIT
+			if ( wpos.z == NOHIT ) { pnode[i] = ID_UNDEFL; continue; }
+			wpos += trans;
+			if ( getNodeAtPoint ( wpos, vmin, nid ) == 0x0 || ElemNdx(nid) >= (uint64) bricks ) { pnode[i] = ID_UNDEFL; continue; }
+			pnode[i] = (int) ElemNdx(nid);
+		}
+	} );
+	for (int i=0; i < num_pnts; i++ ) 
+		if ( pnode[i] != (int) ID_UNDEFL ) poff[i] = gcnt[ pnode[i] ]++;		// index of point in brick
+	if ( mbProfile ) PERF_POP ();
+
+	if ( bPrefix ) {
+		// Prefix sum for brick offsets (exclusive)
+		if ( mbProfile ) PERF_PUSH ( "  Prefix sum");
+		int* goff = (int*) mAux[AUX_GRIDOFF].cpu;
+		int sum = 0;
+		for (int n=0; n < bricks; n++ ) { goff[n] = sum; sum += gcnt[n]; }
+		if ( mbProfile ) PERF_POP();
+
+		if ( mbProfile ) PERF_PUSH ( "  Sort points");
+		Vector3DF* pout = (Vector3DF*) mAux[AUX_PNTSORT].cpu;
+		ParallelFor ( mWorkers, num_pnts, [&] ( slong s, slong e ) {
+			for ( slong i = s; i < e; i++ ) {
+				if ( pnode[i] == (int) ID_UNDEFL ) continue;
+				pout[ goff[pnode[i]] + poff[i] ] = *(Vector3DF*) (ppos + i*pos_stride + pos_off) + trans;
+			}
+		} );
+		if ( mbProfile ) PERF_POP();
+	}
+}
+
+// Scatter point density (host), same as gvdbScatterPointDensity and gvdbScatterPointAvgCol
+// - All writes for a point stay inside its own brick (including apron), so 
+//   points are grouped by brick and bricks are processed in parallel. 
+//   Points within a brick are splatted in point order.
+void VolumeGVDB::ScatterPointDensityCPU ( int num_pnts, float radius, float /*amp*/, Vector3DF trans, bool expand, bool avgColor )
+{
+	int leafcnt = getNumNodes ( 0 );
+	char* ppos = mAux[AUX_PNTPOS].cpu;
+	int pos_off = mAux[AUX_PNTPOS].subdim.x;
+	int pos_stride = (int) mAux[AUX_PNTPOS].stride;
+	char* pclr = mAux[AUX_PNTCLR].cpu;
+	int clr_off = mAux[AUX_PNTCLR].subdim.x;
+	int clr_stride = (int) mAux[AUX_PNTCLR].stride;
+	int* pnode = (int*) mAux[AUX_PNODE].cpu;
+	uint* colorBuf = avgColor ? (uint*) mAux[AUX_COLAVG].cpu : 0x0;	// prepared by ScatterPointDensity
+	if ( ppos == 0x0 || pnode == 0x0 ) {
+		gprintf ( "ERROR: ScatterPointDensity. Points not inserted on host.\n" );
+		return;
+	}
+	float* dens = (float*) mPool->getAtlas(0).cpu;
+	uchar* clr = (pclr != 0x0 && mPool->getNumAtlas() > 1 ) ? (uchar*) mPool->getAtlas(1).cpu : 0x0;	// uchar4 color channel
+	Vector3DI res = mPool->getAtlasRes ( 0 );
+	int brickres = getRes(0);
+	Vector3DF vdel = mVDBInfo.vdel[0];
+
+	// Group points by brick (counting sort)
+	std::vector<int> boff ( leafcnt+1, 0 );
+	std::vector<int> blist;
+	for (int i=0; i < num_pnts; i++ ) 
+		if ( pnode[i] != (int) ID_UNDEFL && pnode[i] < leafcnt ) boff[ pnode[i]+1 ]++;
+	for (int n=0; n < leafcnt; n++ ) boff[n+1] += boff[n];
+	blist.resize ( boff[leafcnt] );
+	std::vector<int> bfill ( boff.begin(), boff.end()-1 );
+	for (int i=0; i < num_pnts; i++ ) 
+		if ( pnode[i] != (int) ID_UNDEFL && pnode[i] < leafcnt ) blist[ bfill[pnode[i]]++ ] = i;
+
+	ParallelFor ( mWorkers, leafcnt, [&] ( slong bs, slong be ) {
+		Vector3DF wpos, p;
+		Vector3DI pi, q;
+		float w;
+		for ( slong nid = bs; nid < be; nid++ ) {
+			Node* node = getNode ( 0, 0, nid );
+			Vector3DF vmin = Vector3DF(node->mPos) * mVoxsize;
+			for (int k = boff[nid]; k < boff[nid+1]; k++ ) {
+				int i = blist[k];
+				wpos = *(Vector3DF*) (ppos + i*pos_stride + pos_off) + trans;
+				p = wpos - vmin; p /= vdel;
+				pi.Set ( int(p.x), int(p.y), int(p.z) );
+				if ( pi.x < 0 || pi.y < 0 || pi.z < 0 || pi.x >= brickres || pi.y >= brickres || pi.z >= brickres ) continue;
+				q.Set ( pi.x + node->mValue.x, pi.y + node->mValue.y, pi.z + node->mValue.z );
+
+				#define SPLAT(dx,dy,dz)	{ uint64 j = hostAtlasNdx ( res, q.x+dx, q.y+dy, q.z+dz ); w = dens[j] + hostDistFunc ( p, float(pi.x+dx), float(pi.y+dy), float(pi.z+dz), radius ); dens[j] = w; }
+				SPLAT(0,0,0);
+				if ( expand ) {
+					SPLAT(-1,0,0);	SPLAT(1,0,0);
+					SPLAT(0,-1,0);	SPLAT(0,1,0);
+					SPLAT(0,0,-1);	SPLAT(0,0,1);
+				}
+				#undef SPLAT
+
+				if ( pclr != 0x0 ) {
+					uchar* wclr = (uchar*) (pclr + i*clr_stride + clr_off );
+					if ( colorBuf != 0x0 ) {
+						uint vid = (brickres * brickres * brickres * uint(nid)) + (brickres * brickres * (uint) pi.z) + (brickres * (uint) pi.y) + (uint) pi.x;
+						colorBuf[vid*4 + 0] += 1;
+						colorBuf[vid*4 + 1] += wclr[0];
+						colorBuf[vid*4 + 2] += wclr[1];
+						colorBuf[vid*4 + 3] += wclr[2];
+					} else if ( clr != 0x0 ) {
+						memcpy ( clr + hostAtlasNdx ( res, q.x, q.y, q.z )*4, wclr, 4 );
+					}
+				}
+			}
+		}
+	} );
+
+	// Average colors
+	if ( pclr != 0x0 && colorBuf != 0x0 && clr != 0x0 ) {
+		ParallelFor ( mWorkers, leafcnt, [&] ( slong bs, slong be ) {
+			int bvox = brickres*brickres*brickres;
+			for ( slong nid = bs; nid < be; nid++ ) {
+				Node* node = getNode ( 0, 0, nid );
+				for (int v = 0; v < bvox; v++ ) {
+					uint* c = colorBuf + (uint64(nid)*bvox + v)*4;
+					if ( c[0] == 0 ) continue;
+					int px = v % brickres, py = (v / brickres) % brickres, pz = v / (brickres*brickres);
+					uchar* pc = clr + hostAtlasNdx ( res, px + node->mValue.x, py + node->mValue.y, pz + node->mValue.z )*4;
+					pc[0] = c[1] / c[0];	pc[1] = c[2] / c[0];	pc[2] = c[3] / c[0]; pc[3] = 255;
+				}
+			}
+		} );
+	}
+}
@@ -24,9 +24,16 @@
 #include "gvdb_volume_gvdb.h"
 #include "gvdb_render.h"
 #include "gvdb_node.h"
+#include "gvdb_parallel.h"
+#include "gvdb_compress.h"
+#include "gvdb_brickcache.h"
 #include "app_perf.h"
 #include "string_helper.h"
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
 #if !defined(_WIN32)
 #	include <GL/glx.h>
 #endif
@@ -35,7 +42,7 @@
 using namespace nvdb;
 
 #define MAJOR_VERSION		1
-#define MINOR_VERSION		0
+#define MINOR_VERSION		1
 
 #ifdef BUILD_OPENVDB
 	// Link GVDB to OpenVDB for loading .vdb files
@@ -94,8 +101,15 @@ VolumeGVDB::VolumeGVDB ()
 	mOVDB = 0x0;
 	mV3D = 0x0;
 	mAtlasResize.Set ( 0, 20, 0 );
+	mbDirtyBricks = true;
+	mbPrefix = false;
+	mbTiles = false;
+	mCache = 0x0;
+	mAct = 0x0;
+	mRangeChan = -1;
 	mVoxsize.Set ( 1, 1, 1 );		// default voxel size
 	mApron = 1;						// default apron
+	for (int n=0; n < MAXLEV; n++ ) mVCFG[n] = 3;	// default config for LoadBRK
 
 	mRoot = ID_UNDEFL;
 	mTime = 0;	
@@ -103,17 +117,43 @@ VolumeGVDB::VolumeGVDB ()
 
 	mVDBInfo.update = true;	
 	mVDBInfo.clr_chan = CHAN_UNDEF;
+	mVDBInfo.brick_list = 0;
+	mVDBInfo.brick_cnt = 0;
+	mVDBInfo.range_skip.Set ( 0, 0, 0 );
+	mVDBInfo.tile_offs = 0;
 
 	mbProfile = false;
 	mbVerbose = false;
+	mbCPU = false;
+	mNumThreads = 0;
 
 	mDummyFrameBuffer = -1;
 
+	for (int n=0; n < MAX_AUX; n++ ) mAuxFramePeak[n] = 0;
+	mAuxPeakTotal = 0;
+	mAuxAllocs = 0;
+	mAuxAllocsTotal = 0;
+
 	for (int n=0; n < 5; n++ ) cuModule[n] = (CUmodule) -1;
 	for (int n=0; n < MAX_FUNC; n++ ) cuFunc[n] = (CUfunction) -1;
 	for (int n=0; n < 10; n++ ) { mTexIn[n] = ID_UNDEFL; mTexOut[n] = ID_UNDEFL; }
 }
 
+VolumeGVDB::~VolumeGVDB ()
+{
+	if ( mAct != 0x0 ) EndActivate ();
+	delete mCache;			// closes brick store and spill files
+}
+
+// Topology edits are not available for a paged atlas.
+// The brick cache is indexed by leaf, and leaves are fixed when the file is opened.
+bool VolumeGVDB::RejectPaged ( const char* func )
+{
+	if ( mCache == 0x0 ) return false;
+	gprintf ( "ERROR: %s is not available for a paged atlas.\n", func );
+	return true;
+}
+
 void VolumeGVDB::SetProfile ( bool pf ) 
 {
 	mbProfile = pf; 	
@@ -184,10 +224,25 @@ void VolumeGVDB::SetCudaDevice ( int devid )
 	LoadFunction ( FUNC_NOISE,				"gvdbOpNoise",					MODL_PRIMARY, "cuda_gvdb_module.ptx" );	
 	LoadFunction ( FUNC_CLR_EXPAND,			"gvdbOpClrExpand",				MODL_PRIMARY, "cuda_gvdb_module.ptx" );	
 	LoadFunction ( FUNC_EXPANDC,			"gvdbOpExpandC",				MODL_PRIMARY, "cuda_gvdb_module.ptx" );	
+	LoadFunction ( FUNC_RANGE,				"gvdbComputeRange",				MODL_PRIMARY, "cuda_gvdb_module.ptx" );	
 
 	SetModule ( cuModule[MODL_PRIMARY] );	
 }
 
+// Use the host reference backend instead of a CUDA device
+// Must be called before Initialize. Kernels run on 'threads' host threads (0 = all cores).
+void VolumeGVDB::SetCPUDevice ( int threads ) 
+{
+	if ( mPool != 0x0 ) {
+		gprintf ( "ERROR: SetCPUDevice must be called before Initialize.\n" );
+		gerror ();
+	}
+	mbCPU = true;
+	mNumThreads = getHostThreads ( threads );
+	mWorkers.SetThreads ( mNumThreads );
+	gprintf ( "GVDB: Using CPU device, %d threads.\n", mNumThreads );
+}
+
 // Reset to default module
 void VolumeGVDB::SetModule ()
 {
@@ -197,6 +252,7 @@ void VolumeGVDB::SetModule ()
 // Set to a user-defined module (application)
 void VolumeGVDB::SetModule ( CUmodule module )
 {
+	if ( mbCPU ) return;
 	cudaCheck ( cuCtxSynchronize (), "cuCtxSync", "SetModule" );
 
 	ClearAtlasAccess ();
@@ -307,130 +363,607 @@ bool VolumeGVDB::ImportVTK ( std::string fname, std::string field, Vector3DI& re
 	return true;
 }
 
+// VBX grid header (see SaveVBX)
+struct VBXGridHeader {
+	char		name[257];
+	char		dtype;				// grid data type
+	char		components;
+	char		compress;			// VBX_COMPRESS_NONE, VBX_COMPRESS_RLE
+	Vector3DF	voxelsize;
+	int			leafcnt;			// total brick count
+	Vector3DI	leafdim;			// brick dimensions
+	int			apron;
+	int			num_chan;
+	uint64		atlas_sz;
+	char		topotype;			// 1=reuse, 2=gvdb
+	int			reuse;				// topology reuse grid
+	char		layout;				// 0=atlas, 1=brick
+	Vector3DI	axiscnt;			// atlas brick count
+	Vector3DI	axisres;			// atlas res
+};
+
+// VBX reader
+// Reads from a file stream, or in place from a mapped file
+struct VBXReader {
+	FILE*	fp;
+	char*	map;
+	uint64	pos, size;
+	uchar	minor;								// file minor version, see readGridTable
+	bool open ( Allocator* pool, const char* fname, bool bMap, bool bLazy ) {
+		fp = 0x0; map = 0x0; pos = 0; size = 0; minor = 0;
+		if ( bMap && pool->MapFile ( fname, bLazy ) ) {
+			map = pool->getMapData ();
+			size = pool->getMapSize ();
+			if ( size >= 2 && uchar(map[1]) >= 1 ) return true;
+			map = 0x0; size = 0;				// files before 1.1 are repaired on load, so they are read (see ReadVBXGrid)
+		}
+		pool->UnmapFile ( true );				// detaches any data still mapped from a previous file (see ReleaseMapped)
+		fp = fopen ( fname, "rb" );
+		return fp != 0x0;
+	}
+	void close () {
+		if ( fp != 0x0 ) fclose ( fp );
+		fp = 0x0;
+	}
+	void seek ( uint64 p ) {
+		if ( map == 0x0 ) fseek ( fp, p, SEEK_SET );
+		pos = p;
+	}
+	bool read ( void* dst, size_t sz, size_t cnt ) {
+		if ( map == 0x0 ) return fread ( dst, sz, cnt, fp ) == cnt;
+		if ( pos + sz*cnt > size ) return false;
+		memcpy ( dst, map + pos, sz*cnt );
+		pos += sz*cnt;
+		return true;
+	}
+	uint64 tell () {
+		return ( map == 0x0 ) ? (uint64) ftell ( fp ) : pos;
+	}
+	void skip ( uint64 sz ) {
+		seek ( tell() + sz );
+	}
+	void readGridHeader ( VBXGridHeader& h ) {
+		memset ( h.name, 0, sizeof(h.name) );
+		read ( h.name, 256, 1 );
+		read ( &h.dtype, sizeof(uchar), 1 );
+		read ( &h.components, sizeof(uchar), 1 );
+		read ( &h.compress, sizeof(uchar), 1 );
+		read ( &h.voxelsize, sizeof(float), 3 );
+		read ( &h.leafcnt, sizeof(int), 1 );
+		read ( &h.leafdim.x, sizeof(int), 3 );
+		read ( &h.apron, sizeof(int), 1 );
+		read ( &h.num_chan, sizeof(int), 1 );
+		read ( &h.atlas_sz, sizeof(uint64), 1 );
+		read ( &h.topotype, sizeof(uchar), 1 );
+		read ( &h.reuse, sizeof(int), 1 );
+		read ( &h.layout, sizeof(uchar), 1 );
+		read ( &h.axiscnt.x, sizeof(int), 3 );
+		read ( &h.axisres.x, sizeof(int), 3 );
+	}
+	char* data ( uint64 sz ) {						// mapped only, returns data in place
+		char* dat = map + pos;
+		pos += sz;
+		return ( pos <= size ) ? dat : 0x0;
+	}
+	bool readGridTable ( std::vector<uint64>& grid_offs ) {
+		uchar major;
+		int num_grids = 0;
+		read ( &major, sizeof(uchar), 1 );			// major version
+		read ( &minor, sizeof(uchar), 1 );			// minor version
+		if ( !read ( &num_grids, sizeof(int), 1 ) || num_grids < 0 ) return false;		// number of grids
+		grid_offs.resize ( num_grids );
+		return num_grids == 0 || read ( &grid_offs[0], sizeof(uint64), num_grids );	// grid offsets
+	}
+};
+
+// Release a grid mapped from a previous file before loading another.
+// The pools are replaced by the load anyway, and releasing them first means
+// UnmapFile has no mapped data left to copy out (see VBXReader::open).
+void VolumeGVDB::ReleaseMapped ()
+{
+	if ( mPool->getMapData() == 0x0 ) return;
+	DestroyChannels ();
+	mPool->PoolReleaseAll ();
+	mRoot = ID_UNDEFL;
+	mPool->UnmapFile ( false );
+}
+
 // Load a VBX file
-bool VolumeGVDB::LoadVBX ( std::string fname )
+// - Loads all grids. Grids which reuse topology are added as further channels.
+bool VolumeGVDB::LoadVBX ( std::string fname, bool bMap, bool bLazy )
 {
 	char buf[2048];
 	strcpy ( buf, fname.c_str() );
-	FILE* fp = fopen ( buf, "rb" );
+
+	// Open file, or map it for in-place access
+	ReleaseMapped ();
+	VBXReader vbx;
+	if ( !vbx.open ( mPool, buf, bMap, bLazy ) ) {
+		gprintf ( "ERROR: Unable to open file %s\n", buf );
+		return false;
+	}
 	
 	if ( mbProfile ) PERF_PUSH ( "Read VBX" );	
 	
-  	gprintf ( "LoadVBX: %s\n", fname.c_str() );
+  	gprintf ( "LoadVBX: %s%s\n", fname.c_str(), (vbx.map != 0x0) ? " (mapped)" : "" );
         gprintf ( "Sizes: char %d, int %d, u64 %d, float %d\n", sizeof(char), sizeof(int), sizeof(uint64), sizeof(float) );
 
-	// Read VDB config
-	uchar major, minor;
-	int num_grids;
-	char grid_name[512];
-	char grid_components;
-	char grid_dtype;
-	char grid_compress;
-	char grid_topotype;
-	int  grid_reuse;
-	char grid_layout;
-	int levels, leafcnt, apron;
-	int num_chan;
-	Vector3DI axisres, axiscnt, leafdim;
+	//--- gvdb header
+	std::vector<uint64> grid_offs;
+	bool ok = vbx.readGridTable ( grid_offs );
+
+	int chan = 0;
+	for (size_t n=0; n < grid_offs.size() && ok; n++ ) {
+		vbx.seek ( grid_offs[n] );
+		ok = ReadVBXGrid ( vbx, chan, true );
+	}	
+	vbx.close ();
+
+	if ( mbProfile ) PERF_POP ();
+
+	return ok;
+}
+
+// Load a single named grid from a VBX file
+// - Seeks directly to the grid using the grid table. When the grid reuses topology, 
+//   only the topology of the reuse grid is read. The grid is loaded as channel 0.
+bool VolumeGVDB::LoadVBXGrid ( std::string fname, std::string name, bool bMap, bool bLazy )
+{
+	char buf[2048];
+	strcpy ( buf, fname.c_str() );
+
+	ReleaseMapped ();
+	VBXReader vbx;
+	if ( !vbx.open ( mPool, buf, bMap, bLazy ) ) {
+		gprintf ( "ERROR: Unable to open file %s\n", buf );
+		return false;
+	}
+	if ( mbProfile ) PERF_PUSH ( "Read VBX Grid" );	
+
+	gprintf ( "LoadVBXGrid: %s, %s\n", fname.c_str(), name.c_str() );
+
+	std::vector<uint64> grid_offs;
+	bool ok = vbx.readGridTable ( grid_offs );
+
+	// Find grid by name, keeping its header for the topology type and reuse grid (see GVDB_FILESPEC)
+	VBXGridHeader h;
+	int grid = -1;
+	for (size_t n=0; n < grid_offs.size() && ok && grid == -1; n++ ) {
+		vbx.seek ( grid_offs[n] );
+		vbx.readGridHeader ( h );
+		if ( name.compare ( h.name ) == 0 ) grid = (int) n;
+	}
+	if ( grid == -1 ) {
+		gprintf ( "ERROR: Grid %s not found in %s\n", name.c_str(), buf );
+		ok = false;
+	}
+
+	int chan = 0;
+	if ( ok ) {
+		if ( h.topotype == 1 ) {
+			ok = ( h.reuse >= 0 && size_t(h.reuse) < grid_offs.size() );
+			if ( ok ) { 
+				vbx.seek ( grid_offs[h.reuse] ); 
+				ok = ReadVBXGrid ( vbx, chan, false );		// topology only
+			}
+		}
+	}
+	if ( ok ) {
+		vbx.seek ( grid_offs[grid] );
+		ok = ReadVBXGrid ( vbx, chan, true );
+	}
+	vbx.close ();
+
+	if ( mbProfile ) PERF_POP ();
+
+	return ok;
+}
+
+// Swap in a frame held by a host-only staging volume (see VolumeSequence)
+// - Topology pools and host atlas are exchanged rather than copied, so the staging volume
+//   is left holding this volume's previous buffers. Atlas channels without host memory
+//   are committed directly from the staging atlas. The staging volume must not be mapped.
+bool VolumeGVDB::SwapFrame ( VolumeGVDB& src )
+{
+	Allocator* sp = src.mPool;
+	int levels = sp->getNumLevels();
+	if ( levels == 0 || sp->getMapData() != 0x0 ) {
+		gprintf ( "ERROR: SwapFrame requires a loaded, unmapped staging volume.\n" );
+		return false;
+	}
+	if ( mbProfile ) PERF_PUSH ( "Swap Frame" );
+
+	int ld[MAXLEV], cnt[MAXLEV];
+	for (int n=0; n < levels; n++ ) {
+		ld[n] = src.mLogDim[n];
+		cnt[n] = 1;										// minimal pools, exchanged below
+	}
+	// Keep atlas channels when the layout matches the staged frame
+	bool bKeep = ( mPool->getNumAtlas() == sp->getNumAtlas() && mPool->getMapData() == 0x0 );
+	for (int chan=0; chan < sp->getNumAtlas() && bKeep; chan++ ) {
+		DataPtr a = mPool->getAtlas ( chan ), b = sp->getAtlas ( chan );
+		bKeep = ( a.type == b.type && a.apron == b.apron && a.size == b.size && a.subdim.x == b.subdim.x && a.subdim.y == b.subdim.y && a.subdim.z == b.subdim.z );
+	}
+	Configure ( levels, ld, cnt );
+	SetVoxelSize ( src.mVoxsize.x, src.mVoxsize.y, src.mVoxsize.z );
+	if ( !bKeep ) DestroyChannels ();
+	mPool->UnmapFile ( true );							// previous frame may have been mapped
+
+	// Topology
+	for (int n=0; n < levels; n++ ) {
+		mPool->PoolSwap ( 0, n, sp );
+		mPool->PoolSwap ( 1, n, sp );
+	}
+	mRoot = src.mRoot;
+	FinishTopology ();
+
+	// Atlas
+	for (int chan=0; chan < sp->getNumAtlas(); chan++ ) {
+		DataPtr atlas = sp->getAtlas ( chan );
+		if ( !bKeep ) AddChannel ( chan, atlas.type, atlas.apron, atlas.subdim );
+		mPool->AtlasSwap ( chan, sp );
+	}
+	UpdateAtlas ();
+
+	if ( mbProfile ) PERF_POP ();
+
+	return true;
+}
+
+// Load a VBX file out-of-core (see BrickCache)
+// - Topology is read and stays resident. Channels are created with as many brick slots as fit
+//   in 'budget' bytes, and bricks are paged in from the file by UpdateBrickCache on request.
+// - Grids which reuse topology are added as further channels, as with LoadVBX.
+// - Modified bricks are saved to 'spill' when evicted (temporary file if empty).
+bool VolumeGVDB::LoadVBXPaged ( std::string fname, uint64 budget, std::string spill )
+{
+	char buf[2048];
+	strcpy ( buf, fname.c_str() );
+
+	ReleaseMapped ();
+	VBXReader vbx;
+	if ( !vbx.open ( mPool, buf, false, false ) ) {
+		gprintf ( "ERROR: Unable to open file %s\n", buf );
+		return false;
+	}
+	if ( mbProfile ) PERF_PUSH ( "Read VBX Paged" );
+
+	gprintf ( "LoadVBXPaged: %s, budget %llu bytes\n", fname.c_str(), budget );
+
+	std::vector<uint64> grid_offs;
+	bool ok = vbx.readGridTable ( grid_offs ) && grid_offs.size() > 0;
+
+	// Topology, and location of each channel in the file
+	VBXGridHeader h, h0;
+	std::vector<BrickCache::Channel> chans;
+	int chan = 0;
+	for (size_t n=0; n < grid_offs.size() && ok; n++ ) {
+		vbx.seek ( grid_offs[n] );
+		vbx.readGridHeader ( h );
+		if ( n == 0 ) {
+			h0 = h;
+			vbx.seek ( grid_offs[n] );
+			ok = ( h.topotype != 1 ) && ReadVBXGrid ( vbx, chan, false );
+			if ( !ok ) break;
+		} else if ( h.topotype != 1 || h.leafcnt != h0.leafcnt || h.apron != h0.apron ||
+				h.axiscnt.x != h0.axiscnt.x || h.axiscnt.y != h0.axiscnt.y || h.axiscnt.z != h0.axiscnt.z ) {
+			gprintf ( "  Grid %s does not share topology of grid 0, skipped.\n", h.name );
+			continue;
+		}
+		if ( h.compress != VBX_COMPRESS_NONE && h.compress != VBX_COMPRESS_RLE ) { ok = false; break; }
+		for (int c=0; c < h.num_chan && ok; c++ ) {
+			BrickCache::Channel ch;
+			int chan_type, chan_stride;
+			vbx.read ( &chan_type, sizeof(int), 1 );
+			ok = vbx.read ( &chan_stride, sizeof(int), 1 );
+			ch.type = chan_type;
+			ch.dsize = chan_stride;
+			ch.compress = h.compress;
+			if ( h.compress == VBX_COMPRESS_RLE ) {
+				int bricks = 0;
+				vbx.read ( &bricks, sizeof(int), 1 );
+				ok = ok && ( bricks == h.axiscnt.x * h.axiscnt.y * h.axiscnt.z );
+				if ( ok ) {
+					ch.table.resize ( bricks+1 );
+					ok = vbx.read ( &ch.table[0], sizeof(uint64), bricks+1 );
+				}
+				ch.offs = vbx.tell ();
+				if ( ok ) vbx.skip ( ch.table[bricks] );
+			} else {
+				ch.offs = vbx.tell ();
+				vbx.skip ( uint64(h.axisres.x) * h.axisres.y * h.axisres.z * chan_stride );
+			}
+			chans.push_back ( ch );
+		}
+	}
+	vbx.close ();
+
+	int bres = getRes(0) + h0.apron*2;
+	uint64 bbytes = 0;
+	for (size_t c=0; c < chans.size(); c++ ) bbytes += uint64(bres)*bres*bres*chans[c].dsize;
+	uint64 leafcnt = ok ? mPool->getPoolCnt(0,0) : 0;
+	uint64 slots = ( bbytes > 0 ) ? std::min ( budget / bbytes, leafcnt ) : 0;
+	if ( !ok || chans.size() == 0 || slots == 0 ) {
+		gprintf ( "ERROR: LoadVBXPaged: %s\n", !ok ? "unable to read file." : "budget smaller than one brick." );
+		if ( mbProfile ) PERF_POP ();
+		return false;
+	}
+
+	// Atlas slots, layers of up to 32x32 bricks
+	Vector3DI axiscnt;
+	axiscnt.x = (int) std::min ( slots, uint64(32) );
+	axiscnt.y = (int) std::min ( slots / axiscnt.x, uint64(32) );
+	axiscnt.z = (int) ( slots / (axiscnt.x * axiscnt.y) );
+	slots = uint64(axiscnt.x) * axiscnt.y * axiscnt.z;
+	DestroyChannels ();
+	for (size_t c=0; c < chans.size(); c++ ) {
+		AddChannel ( c, chans[c].type, h0.apron, axiscnt );
+		mPool->AtlasSetNum ( c, (int) slots );
+	}
+
+	// Residency, each leaf remembers its brick in the file atlas and starts out missing
+	mCache = new BrickCache;
+	if ( !mCache->Open ( buf, spill.c_str() ) ) {
+		delete mCache;
+		mCache = 0x0;
+		if ( mbProfile ) PERF_POP ();
+		return false;
+	}
+	for (size_t c=0; c < chans.size(); c++ ) mCache->AddChannel ( chans[c] );
+	mCache->Setup ( leafcnt, slots, bres, h0.axiscnt, h0.axisres );
+	for (uint64 n=0; n < leafcnt; n++ ) {
+		Node* node = getNode ( 0, 0, n );
+		if ( node->mValue.x != -1 && !(node->mFlags & NODE_FREE) ) {
+			Vector3DI b = (node->mValue - h0.apron) / bres;
+			mCache->SetStore ( n, (uint64(b.z)*h0.axiscnt.y + b.y)*h0.axiscnt.x + b.x );
+		}
+		node->mValue = Vector3DI(-1,-1,-1);
+	}
+	if ( !mbCPU ) PrepareAux ( AUX_BRICKREQ, (int) leafcnt, sizeof(uchar), true, true );
+	UpdateAtlas ();
+
+	gprintf ( "  Paged atlas: %llu slots for %llu bricks, %llu bytes per brick\n", slots, leafcnt, bbytes );
+
+	if ( mbProfile ) PERF_POP ();
+
+	return true;
+}
+
+// Page in requested bricks
+// - Device requests are gathered from the flags written by rayCast.
+// - Bricks are read in parallel, then written to free or least recently used slots.
+//   An evicted brick which was written while resident is saved to the spill file first.
+// - Returns the number of bricks paged in. Call between frames.
+int VolumeGVDB::UpdateBrickCache ()
+{
+	if ( mCache == 0x0 ) return 0;
+	if ( mbProfile ) PERF_PUSH ( "Update Brick Cache" );
+
+	uint64 leafcnt = mCache->getNumLeaves ();
+	if ( !mbCPU ) {
+		RetrieveData ( mAux[AUX_BRICKREQ] );
+		mCache->TouchFlags ( (uchar*) mAux[AUX_BRICKREQ].cpu, leafcnt );
+		cudaCheck ( cuMemsetD8 ( mAux[AUX_BRICKREQ].gpu, 0, leafcnt ), "cuMemsetD8", "UpdateBrickCache" );
+	}
+
+	std::vector<uint64> list;
+	uint64 cnt = mCache->TakeRequests ( list );
+	if ( cnt > 0 ) {
+		int num_chan = mCache->getNumChannels ();
+		int bres = mPool->getAtlasBrickres ( 0 );
+		uint64 bbytes = mCache->getBrickBytes ();
+		std::vector<uint64> slots ( cnt );
+		std::vector<char> stage ( cnt * bbytes );
+
+		// Evict
+		for (uint64 n=0; n < cnt; n++ ) {
+			uint64 leaf;
+			slots[n] = mCache->AllocSlot ( leaf );
+			if ( leaf == ID_UNDEFL ) continue;
+			Node* node = getNode ( 0, 0, leaf );
+			if ( mCache->isDirty ( slots[n] ) ) {
+				char* dst = &stage[0];
+				for (int c=0; c < num_chan; c++ ) {
+					mPool->AtlasReadBrick ( c, node->mValue, dst );
+					dst += uint64(bres)*bres*bres*mCache->getChannel(c).dsize;
+				}
+				if ( !mCache->WriteSpill ( leaf, &stage[0] ) ) gprintf ( "ERROR: Unable to write brick cache spill file.\n" );
+			}
+			node->mValue = Vector3DI(-1,-1,-1);
+		}
+
+		// Read
+		std::atomic<bool> bValid ( true );
+		ParallelFor ( mWorkers, cnt, [&] ( slong s, slong e ) {
+			for (slong n = s; n < e; n++ )
+				if ( !mCache->ReadBrick ( list[n], &stage[n*bbytes] ) ) bValid = false;
+		} );
+		if ( !bValid ) gprintf ( "ERROR: Brick cache unable to read bricks.\n" );
+
+		// Write slots
+		for (uint64 n=0; n < cnt; n++ ) {
+			Vector3DI pos = mPool->getAtlasPos ( 0, slots[n] );
+			char* src = &stage[n*bbytes];
+			for (int c=0; c < num_chan; c++ ) {
+				mPool->AtlasWriteBrick ( c, pos, src );
+				src += uint64(bres)*bres*bres*mCache->getChannel(c).dsize;
+			}
+			getNode ( 0, 0, list[n] )->mValue = pos;
+			mCache->Assign ( list[n], slots[n] );
+		}
+		UpdateAtlas ();				// atlas mapping and leaf values
+	}
+	mCache->NextTick ();
+
+	if ( mbProfile ) PERF_POP ();
+
+	return (int) cnt;
+}
+
+// Request bricks of all leaves overlapping a world-space box
+void VolumeGVDB::RequestBricks ( Vector3DF wmin, Vector3DF wmax )
+{
+	if ( mCache == 0x0 ) return;
+	uint64 leafcnt = mCache->getNumLeaves ();
+	for (uint64 n=0; n < leafcnt; n++ ) {
+		Node* node = getNode ( 0, 0, n );
+		if ( node->mFlags & NODE_FREE ) continue;
+		Vector3DF a = getWorldMin ( node ), b = getWorldMax ( node );
+		if ( a.x <= wmax.x && a.y <= wmax.y && a.z <= wmax.z && b.x >= wmin.x && b.y >= wmin.y && b.z >= wmin.z )
+			mCache->Request ( n );
+	}
+}
+
+// Read one VBX grid at the current file position
+// - 'chan'    Channel for the first atlas of the grid, advanced for each channel read. Reset when topology is read.
+// - 'bAtlas'  Read atlas data, otherwise only topology
+bool VolumeGVDB::ReadVBXGrid ( VBXReader& vbx, int& chan, bool bAtlas )
+{
+	int levels;
 	int ld[MAXLEV], res[MAXLEV];
 	Vector3DI range[MAXLEV];
 	int cnt0[MAXLEV], cnt1[MAXLEV];
 	int width0[MAXLEV], width1[MAXLEV];
-	Vector3DF voxelsize;	
-	uint64 atlas_sz, root;
+	uint64 root;
 
-	std::vector<uint64> grid_offs;
+	//---- grid header
+	VBXGridHeader h;
+	vbx.readGridHeader ( h );
+	int leafcnt = h.leafcnt, apron = h.apron;
+	Vector3DI axiscnt = h.axiscnt, axisres = h.axisres;
 
-	//--- gvdb header
-	fread ( &major, sizeof(uchar), 1, fp );					// major version
-	fread ( &minor, sizeof(uchar), 1, fp );					// minor version
-	fread ( &num_grids, sizeof(int), 1, fp );				// number of grids
-	for (int n=0; n < num_grids; n++ ) {
-		grid_offs.push_back(0);
-		fread ( &grid_offs[n], sizeof(uint64), 1, fp );		// grid offsets
+	if ( h.compress != VBX_COMPRESS_NONE && h.compress != VBX_COMPRESS_RLE ) {
+		gprintf ( "ERROR: VBX file uses unsupported compression (%d).\n", (int) h.compress );
+		return false;
 	}
+	gprintf ( "  Grid: %s, %d channels%s\n", h.name, h.num_chan, (h.topotype==1) ? " (reuses topology)" : "" );
 
-	for (int n=0; n < num_grids; n++ ) {
-		
-		//---- grid header
-		fread ( &grid_name, 256, 1, fp );					// grid name		
-		fread ( &grid_dtype, sizeof(uchar), 1, fp );		// grid data type
-		fread ( &grid_components, sizeof(uchar), 1, fp );	// grid components
-		fread ( &grid_compress, sizeof(uchar), 1, fp );		// grid compression (0=none, 1=blosc, 2=..)
-		fread ( &voxelsize, sizeof(float), 3, fp );			// voxel size
-		fread ( &leafcnt, sizeof(int), 1, fp );				// total brick count
-		fread ( &leafdim.x, sizeof(int), 3, fp );			// brick dimensions
-		fread ( &apron, sizeof(int), 1, fp );				// brick apron
-		fread ( &num_chan, sizeof(int), 1, fp );			// number of channels
-		fread ( &atlas_sz, sizeof(uint64), 1, fp );			// total atlas size (all channels)
-		fread ( &grid_topotype, sizeof(uchar), 1, fp );		// topology type? (0=none, 1=reuse, 2=gvdb, 3=..)
-		fread ( &grid_reuse, sizeof(int), 1, fp);			// topology reuse
-		fread ( &grid_layout, sizeof(uchar), 1, fp);		// brick layout? (0=atlas, 1=brick)
-		fread ( &axiscnt.x, sizeof(int), 3, fp );			// atlas brick count
-		fread ( &axisres.x, sizeof(int), 3, fp );			// atlas res
-		
-	
+	if ( h.topotype == 1 ) {
+		// Topology reused from another grid, which must already be loaded
+		if ( mPool->getNumLevels() == 0 || mPool->getPoolCnt(0,0) != uint64(h.leafcnt) ) {
+			gprintf ( "ERROR: VBX grid %s reuses topology of grid %d, which is not loaded.\n", h.name, h.reuse );
+			return false;
+		}
+	} else {
 		//---- topology section
-		fread ( &levels, sizeof(int), 1, fp );				// num levels
-		fread ( &root, sizeof(uint64), 1, fp );			// root id	
+		vbx.read ( &levels, sizeof(int), 1 );				// num levels
+		vbx.read ( &root, sizeof(uint64), 1 );			// root id	
 		for (int n=0; n < levels; n++ ) {				
-			fread ( &ld[n], sizeof(int), 1, fp );
-			fread ( &res[n], sizeof(int), 1, fp );
-			fread ( &range[n].x, sizeof(int), 1, fp );
-			fread ( &range[n].y, sizeof(int), 1, fp );
-			fread ( &range[n].z, sizeof(int), 1, fp );
-			fread ( &cnt0[n], sizeof(int), 1, fp );			
-			fread ( &width0[n], sizeof(int), 1, fp );
-			fread ( &cnt1[n], sizeof(int), 1, fp );
-			fread ( &width1[n], sizeof(int), 1, fp );			
+			vbx.read ( &ld[n], sizeof(int), 1 );
+			vbx.read ( &res[n], sizeof(int), 1 );
+			vbx.read ( &range[n].x, sizeof(int), 1 );
+			vbx.read ( &range[n].y, sizeof(int), 1 );
+			vbx.read ( &range[n].z, sizeof(int), 1 );
+			vbx.read ( &cnt0[n], sizeof(int), 1 );			
+			vbx.read ( &width0[n], sizeof(int), 1 );
+			vbx.read ( &cnt1[n], sizeof(int), 1 );
+			vbx.read ( &width1[n], sizeof(int), 1 );			
 		}	
 		if ( width0[0] != sizeof(nvdb::Node) ) {
 			gprintf ( "ERROR: VBX file contains nodes incompatible with current gvdb_library.\n" );
 			gprintf ( "       Size in file: %d,  Size in library: %d\n", width0[0], sizeof(nvdb::Node) );
 			gerror ();
 		}
-	
+
+		// Node layout follows the file: level 1 wider than node + mask holds tiles and/or prefix counts
+		if ( levels > 1 ) {
+			uint64 mask1 = (uint64(1) << (3*ld[1])) / 8;
+			if ( mask1 < 8 ) mask1 = 8;
+			uint64 tile1 = mask1 + (uint64(1) << (3*ld[1])) * sizeof(float);
+			uint64 extra = uint64(width0[1]) - sizeof(nvdb::Node) - mask1;
+			mbTiles = ( uint64(width0[1]) >= sizeof(nvdb::Node) + mask1 + tile1 );
+			mbPrefix = ( extra > (mbTiles ? tile1 : 0) );
+		}
+
 		// Initialize GVDB
 		Configure ( levels, ld, cnt0 );
-		SetVoxelSize ( voxelsize.x, voxelsize.y, voxelsize.z );
+		SetVoxelSize ( h.voxelsize.x, h.voxelsize.y, h.voxelsize.z );
 		mRoot = root;		// must be set after initialize
 
 		// Read topology
-		for (int n=0; n < levels; n++ ) 
-			mPool->PoolRead ( fp, 0, n, cnt0[n], width0[n] );
-		for (int n=0; n < levels; n++ )
-			mPool->PoolRead ( fp, 1, n, cnt1[n], width1[n] );
+		if ( vbx.map != 0x0 ) {
+			for (int n=0; n < levels; n++ ) 
+				mPool->PoolMap ( 0, n, vbx.data ( uint64(cnt0[n])*width0[n] ), cnt0[n], width0[n] );
+			for (int n=0; n < levels; n++ )
+				mPool->PoolMap ( 1, n, vbx.data ( uint64(cnt1[n])*width1[n] ), cnt1[n], width1[n] );
+		} else {
+			for (int n=0; n < levels; n++ ) 
+				mPool->PoolRead ( vbx.fp, 0, n, cnt0[n], width0[n] );
+			for (int n=0; n < levels; n++ )
+				mPool->PoolRead ( vbx.fp, 1, n, cnt1[n], width1[n] );
+		}
+		// Files from version 1.1 hold nodes ready to use (see PackTopology), so a mapped
+		// topology is left untouched. Older files may hold stale flags and mask sizes, 
+		// no prefix counts, and exact-count or full-width child lists. They are never 
+		// mapped (see VBXReader::open), so repairing them does not copy mapped pages.
+		if ( vbx.minor < 1 ) {
+			for (int n=0; n < levels; n++ ) {
+				bool bPrefix = hasPrefix ( n );		// file was saved with room for prefix counts
+				for (int i=0; i < cnt0[n]; i++ ) {
+					Node* node = getNode ( 0, n, i );
+					if ( node->mLogRes != mLogDim[n] ) node->mLogRes = (uchar) mLogDim[n];
+					if ( node->mFlags != 0 ) node->mFlags = 0;
+					if ( bPrefix ) node->enablePrefix ( true );
+				}
+			}
+			for (int n=1; n < levels; n++ )
+				RepackChildLists ( n );		// inflate to size classes
+		}
 
 		FinishTopology ();
 
 		// Atlas section
 		DestroyChannels ();
-		
-		// Read atlas into GPU slice-by-slice to conserve CPU and GPU mem		
-		for (int chan = 0 ; chan < num_chan; chan++ ) {			
-		
-			uint64 cpos = ftell ( fp );				
-
-			int chan_type, chan_stride;
-			fread ( &chan_type, sizeof(int), 1, fp );
-			fread ( &chan_stride, sizeof(int), 1, fp );
-			
-			AddChannel ( chan, chan_type, apron, axiscnt );		// provide axiscnt
-					
-			mPool->AtlasSetNum ( chan, cnt0[0] );		// assumes atlas contains all bricks (all are resident)
-
-			DataPtr slice;			
-			mPool->CreateMemLinear ( slice, 0x0, chan_stride, axisres.x*axisres.y, true );
-			for (int z = 0; z < axisres.z; z++ ) {
-				fread ( slice.cpu, slice.size, 1, fp );
-				mPool->AtlasWriteSlice ( chan, z, slice.size, slice.gpu, (uchar*) slice.cpu );		// transfer from GPU, directly into CPU atlas				
+		chan = 0;
+	}
+	if ( !bAtlas ) return true;
+	
+	// Read atlas into GPU slice-by-slice to conserve CPU and GPU mem		
+	for (int n = 0 ; n < h.num_chan; n++, chan++ ) {			
+	
+		int chan_type, chan_stride;
+		vbx.read ( &chan_type, sizeof(int), 1 );
+		vbx.read ( &chan_stride, sizeof(int), 1 );
+		uint64 slicesz = uint64(axisres.x) * axisres.y * chan_stride;
+
+		if ( h.compress == VBX_COMPRESS_RLE ) {
+			// Compressed bricks
+			AddChannel ( chan, chan_type, apron, axiscnt );
+			mPool->AtlasSetNum ( chan, leafcnt );
+			if ( !ReadAtlasBricks ( vbx, chan ) ) {
+				gprintf ( "ERROR: VBX file has corrupt brick data (chan %d).\n", chan );
+				gerror ();
 			}
-			mPool->FreeMemLinear ( slice );	
+			continue;
 		}
-		UpdateAtlas ();
-	}	
-
-	if ( mbProfile ) PERF_POP ();
+		if ( vbx.map != 0x0 ) {
+			// Mapped atlas, used in place when layout matches the library atlas
+			AddChannel ( chan, chan_type, apron, Vector3DI(axiscnt.x, axiscnt.y, 1) );
+			Vector3DI brickres = getRes3DI(0) + apron*2;
+			if ( chan_stride == mPool->getSize(chan_type) && axisres.x == axiscnt.x*brickres.x && axisres.y == axiscnt.y*brickres.y && axisres.z == axiscnt.z*brickres.z ) {
+				mPool->AtlasMap ( chan, vbx.data ( slicesz * axisres.z ), axiscnt );
+			} else {
+				mPool->AtlasResize ( chan, axiscnt.x, axiscnt.y, axiscnt.z );
+				for (int z = 0; z < axisres.z; z++ ) 
+					mPool->AtlasWriteSlice ( chan, z, slicesz, 0x0, (uchar*) vbx.data ( slicesz ) );
+			}
+			mPool->AtlasSetNum ( chan, leafcnt );		// assumes atlas contains all bricks (all are resident)
+			continue;
+		}
+		
+		AddChannel ( chan, chan_type, apron, axiscnt );		// provide axiscnt
+				
+		mPool->AtlasSetNum ( chan, leafcnt );		// assumes atlas contains all bricks (all are resident)
+
+		DataPtr slice;			
+		mPool->CreateMemLinear ( slice, 0x0, chan_stride, axisres.x*axisres.y, true );
+		for (int z = 0; z < axisres.z; z++ ) {
+			vbx.read ( slice.cpu, slice.size, 1 );
+			mPool->AtlasWriteSlice ( chan, z, slice.size, slice.gpu, (uchar*) slice.cpu );		// transfer from GPU, directly into CPU atlas				
+		}
+		mPool->FreeMemLinear ( slice );	
+	}
+	UpdateAtlas ();
 
 	return true;
 }
@@ -444,7 +977,7 @@ void VolumeGVDB::SetColorChannel ( uchar chan )
 // Clear device access to atlases
 void VolumeGVDB::ClearAtlasAccess ()
 {
-	if ( mPool==0x0 ) return;
+	if ( mPool==0x0 || mbCPU ) return;
 
 	int num_chan = mPool->getNumAtlas();
 	for (int chan=0; chan < num_chan; chan++ ) {
@@ -464,7 +997,7 @@ void VolumeGVDB::ClearAtlasAccess ()
 // Setup device access to atlases
 void VolumeGVDB::SetupAtlasAccess ()
 {	
-	if ( mPool == 0x0 ) return;
+	if ( mPool == 0x0 || mbCPU ) return;
 	if ( mPool->getNumAtlas() == 0 ) return;
 
 	//-- Texture Access using TexRefs
@@ -529,19 +1062,130 @@ void VolumeGVDB::ClearAtlas ()
 	if ( mbProfile ) PERF_PUSH ( "Clear Atlas" );
 	for (int n=0; n < mPool->getNumAtlas(); n++ )
 		mPool->AtlasFill ( n );	
+	mRangeChan = -1;
+
+	if ( mbProfile ) PERF_POP ();
+}
+
+// Compact atlas
+// - Moves live bricks into bricks freed by deactivated leaves, 
+//   then patches leaf values and the atlas map. All channels share the brick layout of channel 0.
+void VolumeGVDB::AtlasCompact ()
+{
+	if ( mPool->getNumAtlas() == 0 || mPool->getAtlasFree(0) == 0 ) return;
+
+	if ( mbProfile ) PERF_PUSH ( "Compact Atlas" );
+
+	std::vector<uint64> remap;
+	uint64 moved = mPool->AtlasCompact ( 0, remap );
+	uint64 bricks = mPool->getAtlas(0).num;
+	for (int chan=1; chan < mPool->getNumAtlas(); chan++ )
+		mPool->AtlasRemap ( chan, remap, bricks );
+
+	// Patch leaf values
+	int leafcnt = mPool->getPoolCnt(0,0);
+	ParallelFor ( mWorkers, leafcnt, [&] ( slong s, slong e ) {
+		for (slong n = s; n < e; n++ ) {
+			Node* node = getNode ( 0, 0, n );
+			if ( node->mValue.x == -1 || (node->mFlags & NODE_FREE) ) continue;
+			uint64 id = mPool->getAtlasId ( 0, node->mValue );
+			if ( id < remap.size() && remap[id] != id && remap[id] != ID_UNDEFL )
+				node->mValue = mPool->getAtlasPos ( 0, remap[id] );
+		}
+	} );
+
+	// Rebuild atlas mapping
+	if ( mPool->getAtlasMapCPU ( 0 ) != 0x0 ) {
+		ClearMapping ();
+		for (int n=0; n < leafcnt; n++ ) {
+			Node* node = getNode ( 0, 0, n );
+			if ( node->mValue.x == -1 || (node->mFlags & NODE_FREE) ) continue;
+			AssignMapping ( node->mValue, node->mPos, n );
+		}
+		mPool->PoolCommitAtlasMap ();
+	}
+	mPool->PoolCommit ( 0, 0 );
+
+	if ( mbVerbose ) gprintf ( "AtlasCompact: %llu bricks moved, %llu in use.\n", moved, bricks );
+
+	if ( mbProfile ) PERF_POP ();
+}
+
+// Update active brick list
+// - One entry per live leaf, giving the atlas position of its brick interior.
+// - Built with a prefix sum over leaf ranges, so entries stay in leaf order.
+// - Rebuilt only after the atlas mapping has changed. Native operators
+//   dispatch one work item per entry instead of covering the full atlas.
+void VolumeGVDB::UpdateBrickList ()
+{
+	if ( !mbDirtyBricks ) return;
+	if ( mbProfile ) PERF_PUSH ( "Brick List" );
+
+	slong leafcnt = mPool->getPoolCnt(0,0);
+	int ranges = mWorkers.getNumThreads ();
+	slong step = (leafcnt + ranges - 1) / ranges;
+	std::vector<slong> offs ( ranges+1, 0 );
+
+	// Count live leaves in each range
+	ParallelFor ( mWorkers, ranges, [&] ( slong s, slong e ) {
+		for (slong r = s; r < e; r++ )
+			for (slong n = r*step; n < (r+1)*step && n < leafcnt; n++ ) {
+				Node* node = getNode ( 0, 0, n );
+				if ( node->mValue.x != -1 && !(node->mFlags & NODE_FREE) ) offs[r+1]++;
+			}
+	} );
+	for (int r=0; r < ranges; r++ ) offs[r+1] += offs[r];		// prefix sum
+	int cnt = (int) offs[ranges];
+
+	// Write bricks at range offsets
+	PrepareAux ( AUX_BRICKS, (cnt > 0) ? cnt : 1, sizeof(Vector3DI), false, true );
+	Vector3DI* list = (Vector3DI*) mAux[AUX_BRICKS].cpu;
+	ParallelFor ( mWorkers, ranges, [&] ( slong s, slong e ) {
+		for (slong r = s; r < e; r++ ) {
+			slong i = offs[r];
+			for (slong n = r*step; n < (r+1)*step && n < leafcnt; n++ ) {
+				Node* node = getNode ( 0, 0, n );
+				if ( node->mValue.x != -1 && !(node->mFlags & NODE_FREE) ) list[i++] = node->mValue;
+			}
+		}
+	} );
+	if ( !mbCPU ) CommitData ( mAux[AUX_BRICKS] );
+
+	mVDBInfo.brick_list = mAux[AUX_BRICKS].gpu;
+	mVDBInfo.brick_cnt = cnt;
+	mVDBInfo.update = true;
+	mbDirtyBricks = false;
 
 	if ( mbProfile ) PERF_POP ();
 }
 
 // Save a VBX file
-void VolumeGVDB::SaveVBX ( std::string fname )
+void VolumeGVDB::SaveVBX ( std::string fname, bool bCompress )
+{
+	std::vector<std::string> grids;			// single unnamed grid holding all channels
+	SaveVBX ( fname, grids, bCompress );
+}
+
+// Save VBX with one named grid per channel
+// - 'grids'  Name of the grid for each channel (exactly one per channel). The first grid holds the topology,
+//            the others reuse it (topology type 1). If empty, writes one unnamed grid with all channels.
+void VolumeGVDB::SaveVBX ( std::string fname, std::vector<std::string>& grids, bool bCompress )
 {
 	int cnt[2], width[2];
 	Vector3DI range;
 	char buf[512];
 	strcpy ( buf, fname.c_str() );
-	
+
+	if ( RejectPaged ( "SaveVBX" ) ) return;
+	if ( grids.size() > 0 && (int) grids.size() != mPool->getNumAtlas() ) {
+		gprintf ( "ERROR: SaveVBX given %d grid names for %d channels, one name per channel is required.\n", (int) grids.size(), mPool->getNumAtlas() );
+		return;
+	}
 	FILE* fp = fopen ( buf, "wb" );
+	if ( fp == 0x0 ) {
+		gprintf ( "ERROR: Unable to write VBX file %s\n", buf );
+		return;
+	}
 
 	uchar major = MAJOR_VERSION;
 	uchar minor = MINOR_VERSION;
@@ -551,18 +1195,24 @@ void VolumeGVDB::SaveVBX ( std::string fname )
 	gprintf ( "  Saving VBX (ver %d.%d)\n", major, minor );
 
 	int levels = mPool->getNumLevels();
-
-	int		num_grids = 1;	
+	int		num_chan = mPool->getNumAtlas();
+
+	// Files never hold deactivated nodes or bricks (LoadVBX assumes all are resident).
+	// They are compacted as the file is written, the grid itself keeps its node ids and brick positions.
+	std::vector< std::vector<char> > nodes ( levels ), lists ( levels );
+	std::vector<uint64> brick_src;
+	uint64 root = mRoot;
+	if ( mRoot != ID_UNDEFL ) root = PackTopology ( nodes, lists, brick_src );
+	int		num_grids = grids.size() > 0 ? num_chan : 1;
 	char	grid_name[512]; 
-	sprintf( grid_name, "" );	
 	char	grid_components = 1;						// one component
 	char	grid_dtype = 'f';							// float
-	char	grid_compress = 0;							// no compression
+	char	grid_compress = bCompress ? VBX_COMPRESS_RLE : VBX_COMPRESS_NONE;	// brick compression
 	char	grid_topotype = 2;							// gvdb topology
 	int		grid_reuse = 0;
 	char	grid_layout = 0;							// atlas layout
 
-	int		leafcnt = mPool->getPoolCnt(0,0);			// brick count
+	int		leafcnt = int( nodes[0].size() / mPool->getPoolWidth(0,0) );	// brick count
 	int		res = getRes(0);
 	Vector3DI leafdim = Vector3DI(res,res,res);			// brick resolution
 	int		apron	= mPool->getAtlas(0).apron;			// brick apron
@@ -582,11 +1232,16 @@ void VolumeGVDB::SaveVBX ( std::string fname )
 	for (int n=0; n < num_grids; n++ ) {
 		fwrite ( &grid_offs[n], sizeof(uint64), 1, fp );		// grid offsets (populated later)
 	}
-	int num_chan = mPool->getNumAtlas();
-
 	for (int n=0; n < num_grids; n++ ) {
 		grid_offs[n] = ftell ( fp );						// record grid offset
 
+		memset ( grid_name, 0, 512 );
+		if ( grids.size() > 0 ) strncpy ( grid_name, grids[n].c_str(), 255 );
+		int chan_first = (grids.size() > 0) ? n : 0;		// channels of this grid
+		int chan_cnt = (grids.size() > 0) ? 1 : num_chan;
+		grid_topotype = (n == 0) ? 2 : 1;					// first grid holds topology, others reuse it
+		atlas_sz = (num_chan > 0) ? mPool->getAtlas(chan_first).size : 0;
+
 		//---- grid header
 		fwrite ( &grid_name, 256, 1, fp );					// grid name		
 		fwrite ( &grid_dtype, sizeof(uchar), 1, fp );		// grid data type
@@ -596,7 +1251,7 @@ void VolumeGVDB::SaveVBX ( std::string fname )
 		fwrite ( &leafcnt, sizeof(int), 1, fp );			// total brick count
 		fwrite ( &leafdim.x, sizeof(int), 3, fp );			// brick dimensions
 		fwrite ( &apron, sizeof(int), 1, fp );				// brick apron
-		fwrite ( &num_chan, sizeof(int), 1, fp );			// number of channels
+		fwrite ( &chan_cnt, sizeof(int), 1, fp );			// number of channels
 		fwrite ( &atlas_sz, sizeof(uint64), 1, fp );			// total atlas size (all channels)
 		fwrite ( &grid_topotype, sizeof(uchar), 1, fp );	// topology type? (0=none, 1=reuse, 2=gvdb, 3=..)
 		fwrite ( &grid_reuse, sizeof(int), 1, fp);			// topology reuse
@@ -605,33 +1260,35 @@ void VolumeGVDB::SaveVBX ( std::string fname )
 		fwrite ( &axisres.x, sizeof(int), 3, fp );			// atlas res			
 
 		//---- topology section
-		fwrite ( &levels, sizeof(int), 1, fp );				// num levels
-		fwrite ( &mRoot, sizeof(uint64), 1, fp );			// root id	
-		for (int n=0; n < levels; n++ ) {				
-			res = getRes(n); range = getRange(n);			
-			width[0] = mPool->getPoolWidth(0,n);
-			width[1] = mPool->getPoolWidth(1,n);
-			cnt[0] = mPool->getPoolCnt(0,n);
-			cnt[1] = mPool->getPoolCnt(1,n);
-			fwrite ( &mLogDim[n], sizeof(int), 1, fp );
-			fwrite ( &res, sizeof(int), 1, fp );
-			fwrite ( &range.x, sizeof(int), 1, fp );
-			fwrite ( &range.y, sizeof(int), 1, fp );
-			fwrite ( &range.z, sizeof(int), 1, fp );
-			fwrite ( &cnt[0],   sizeof(int), 1, fp );			
-			fwrite ( &width[0], sizeof(int), 1, fp );		
-			fwrite ( &cnt[1],   sizeof(int), 1, fp );
-			fwrite ( &width[1], sizeof(int), 1, fp );			
-		}	
-		for (int n=0; n < levels; n++ )						// write pool 0 
-			mPool->PoolWrite ( fp, 0, n );			
-		for (int n=0; n < levels; n++ )						// write pool 1 
-			mPool->PoolWrite ( fp, 1, n );
+		if ( grid_topotype == 2 ) {
+			fwrite ( &levels, sizeof(int), 1, fp );				// num levels
+			fwrite ( &root, sizeof(uint64), 1, fp );			// root id	
+			for (int n=0; n < levels; n++ ) {				
+				res = getRes(n); range = getRange(n);			
+				width[0] = mPool->getPoolWidth(0,n);
+				width[1] = mPool->getPoolWidth(1,n);
+				cnt[0] = (width[0] > 0) ? int( nodes[n].size() / width[0] ) : 0;
+				cnt[1] = (width[1] > 0) ? int( lists[n].size() / width[1] ) : 0;
+				fwrite ( &mLogDim[n], sizeof(int), 1, fp );
+				fwrite ( &res, sizeof(int), 1, fp );
+				fwrite ( &range.x, sizeof(int), 1, fp );
+				fwrite ( &range.y, sizeof(int), 1, fp );
+				fwrite ( &range.z, sizeof(int), 1, fp );
+				fwrite ( &cnt[0],   sizeof(int), 1, fp );			
+				fwrite ( &width[0], sizeof(int), 1, fp );		
+				fwrite ( &cnt[1],   sizeof(int), 1, fp );
+				fwrite ( &width[1], sizeof(int), 1, fp );			
+			}	
+			for (int n=0; n < levels; n++ )						// write pool 0 
+				if ( nodes[n].size() > 0 ) fwrite ( &nodes[n][0], nodes[n].size(), 1, fp );
+			for (int n=0; n < levels; n++ )						// write pool 1 
+				if ( lists[n].size() > 0 ) fwrite ( &lists[n][0], lists[n].size(), 1, fp );
+		}
 
 		//---- atlas section
 		// readback slice-by-slice from gpu to conserve CPU and GPU mem	
 
-		for (int chan = 0 ; chan < num_chan; chan++ ) {
+		for (int chan = chan_first ; chan < chan_first + chan_cnt; chan++ ) {
 			DataPtr slice;
 			int chan_type = mPool->getAtlas(chan).type ;
 			int chan_stride = mPool->getSize ( chan_type ); 
@@ -639,10 +1296,26 @@ void VolumeGVDB::SaveVBX ( std::string fname )
 
 			fwrite ( &chan_type, sizeof(int), 1, fp );
 			fwrite ( &chan_stride, sizeof(int), 1, fp );
+			if ( bCompress ) {
+				WriteAtlasBricks ( fp, chan, brick_src );
+				continue;
+			}
 			mPool->CreateMemLinear ( slice, 0x0, chan_stride, axisres.x*axisres.y, true );
 
+			DataPtr atlas = mPool->getAtlas ( chan );
+			int bres = int(atlas.stride + atlas.apron*2);
+			std::vector<int> slot;
+			std::vector<char> moved;
 			for (int z = 0; z < axisres.z; z++ ) {
+				if ( z % bres == 0 ) ReadMovedBricks ( chan, z / bres, brick_src, slot, moved );
 				mPool->AtlasRetrieveSlice ( chan, z, slice.size, slice.gpu, (uchar*) slice.cpu );		// transfer from GPU, directly into CPU atlas		
+				for (int b=0; b < (int) slot.size(); b++ ) {			// bricks moved into this slice
+					if ( slot[b] < 0 ) continue;
+					uint64 bx = (b % axiscnt.x) * bres, by = (b / axiscnt.x) * bres;
+					char* src = &moved[ (uint64(slot[b])*bres + (z % bres)) * bres*bres*chan_stride ];
+					for (int j=0; j < bres; j++ )
+						memcpy ( slice.cpu + ((by+j)*axisres.x + bx)*chan_stride, src + uint64(j)*bres*chan_stride, bres*chan_stride );
+				}
 				fwrite ( slice.cpu, slice.size, 1, fp );
 			}
 			mPool->FreeMemLinear ( slice );
@@ -659,22 +1332,264 @@ void VolumeGVDB::SaveVBX ( std::string fname )
 	if ( mbProfile ) PERF_POP ();
 }
 
+// Compact topology for SaveVBX, without changing the grid
+// - Returns the root id in the file. 'nodes' and 'lists' receive pool 0 and pool 1 data of each level,
+//   with free nodes dropped and child lists in size-class runs as RepackChildLists lays them out.
+//   Node flags are cleared and prefix counts rebuilt, so ReadVBXGrid can use the pools as stored.
+// - Atlas holes are filled from the end (as AtlasCompact). 'brick_src' maps each brick in the file 
+//   to the brick of the atlas it is read from.
+uint64 VolumeGVDB::PackTopology ( std::vector< std::vector<char> >& nodes, std::vector< std::vector<char> >& lists, std::vector<uint64>& brick_src )
+{
+	int levels = mPool->getNumLevels();
+
+	// Node index in the file, ID_UNDEFL for free nodes
+	std::vector< std::vector<uint64> > remap ( levels );
+	std::vector<uint64> live ( levels, 0 );
+	for (int lev=0; lev < levels; lev++ ) {
+		uint64 cnt = mPool->getPoolCnt ( 0, lev );
+		remap[lev].resize ( cnt );
+		for (uint64 n=0; n < cnt; n++ )
+			remap[lev][n] = ( getNode(0, lev, n)->mFlags & NODE_FREE ) ? ID_UNDEFL : live[lev]++;
+	}
+	auto remapNode = [&] ( uint64 id ) -> uint64 {
+		if ( id == ID_UNDEFL ) return id;
+		return Elem ( 0, ElemLev(id), remap[ElemLev(id)][ElemNdx(id)] );
+	};
+
+	// Bricks in use move down into the holes below the live count
+	uint64 bricks = ( mPool->getNumAtlas() > 0 ) ? mPool->getAtlas(0).max : 0;
+	std::vector<uint64> brick_dst ( bricks );
+	std::vector<char> used ( bricks, 0 );
+	uint64 nused = 0;
+	for (uint64 n=0; n < remap[0].size(); n++ ) {
+		Node* node = getNode ( 0, 0, n );
+		if ( remap[0][n] == ID_UNDEFL || node->mValue.x == -1 ) continue;
+		uint64 id = mPool->getAtlasId ( 0, node->mValue );
+		if ( id < bricks && !used[id] ) { used[id] = 1; nused++; }
+	}
+	brick_src.resize ( bricks );
+	for (uint64 n=0; n < bricks; n++ ) brick_src[n] = brick_dst[n] = n;
+	for (uint64 i=0, j=bricks; ; i++, j-- ) {
+		while ( i < nused && used[i] ) i++;
+		while ( j > nused && !used[j-1] ) j--;
+		if ( i >= nused || j <= nused ) break;
+		brick_dst[j-1] = i;
+		brick_src[i] = j-1;
+	}
+
+	for (int lev=0; lev < levels; lev++ ) {
+		uint64 cnt = remap[lev].size();
+		uint64 wid = mPool->getPoolWidth ( 0, lev );
+		std::vector<uint64> first ( live[lev]+1, 0 );			// child list of each node in the file
+		for (uint64 n=0; n < cnt; n++ ) {
+			if ( remap[lev][n] == ID_UNDEFL ) continue;
+			Node* node = getNode ( 0, lev, n );
+			uint64 k = remap[lev][n];
+			first[k+1] = first[k] + ( node->mChildList != ID_UNDEFL ? getChildCap ( lev, node->getNumChild() ) : 0 );
+		}
+		nodes[lev].assign ( live[lev] * wid, 0 );
+		lists[lev].assign ( first[live[lev]] * mPool->getPoolWidth(1, lev), 0 );
+		uint64* list = (uint64*) lists[lev].data();
+		bool bPrefix = hasPrefix ( lev );
+
+		ParallelFor ( mWorkers, cnt, [&] ( slong s, slong e ) {
+			for (slong n = s; n < e; n++ ) {
+				uint64 k = remap[lev][n];
+				if ( k == ID_UNDEFL ) continue;
+				Node* node = (Node*) &nodes[lev][ k*wid ];
+				memcpy ( (void*) node, getNode(0, lev, n), wid );
+				node->mFlags = 0;
+				if ( bPrefix ) node->enablePrefix ( true );
+				node->mParent = remapNode ( node->mParent );
+				if ( lev == 0 && node->mValue.x != -1 ) {
+					uint64 id = mPool->getAtlasId ( 0, node->mValue );
+					if ( id < bricks ) node->mValue = mPool->getAtlasPos ( 0, brick_dst[id] );
+				}
+				if ( first[k+1] == first[k] ) continue;
+				uint64* child = mPool->PoolData64 ( node->mChildList );
+				for (int c=0; c < node->getNumChild(); c++ )
+					list[ first[k] + c ] = remapNode ( child[c] );
+				node->mChildList = Elem ( 1, lev, first[k] );
+			}
+		} );
+	}
+	return remapNode ( mRoot );
+}
+
+// Read the bricks of atlas layer z that are replaced in the file (see PackTopology)
+// - slot[b] is the index in 'buf' of brick b of the layer, or -1 if the brick is written in place.
+void VolumeGVDB::ReadMovedBricks ( uchar chan, int z, std::vector<uint64>& brick_src, std::vector<int>& slot, std::vector<char>& buf )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	int bres = int(atlas.stride + atlas.apron*2);
+	uint64 bsize = uint64(bres)*bres*bres*mPool->getSize ( atlas.type );
+	int layer = atlas.subdim.x * atlas.subdim.y;
+	int cnt = 0;
+
+	slot.assign ( layer, -1 );
+	for (int b=0; b < layer; b++ ) {
+		uint64 id = uint64(z)*layer + b;
+		if ( id < brick_src.size() && brick_src[id] != id ) slot[b] = cnt++;
+	}
+	buf.resize ( cnt * bsize );
+	for (int b=0; b < layer; b++ )
+		if ( slot[b] >= 0 ) mPool->AtlasReadBrick ( chan, mPool->getAtlasPos ( chan, brick_src[ uint64(z)*layer + b ] ), &buf[ slot[b]*bsize ] );
+}
+
+// Write atlas channel as compressed bricks
+// - Brick count, table of (count+1) offsets relative to the start of brick data, then brick data.
+// - Bricks include apron voxels, compressed in parallel one atlas layer at a time.
+// - Bricks moved by PackTopology are read from their place in the atlas.
+void VolumeGVDB::WriteAtlasBricks ( FILE* fp, uchar chan, std::vector<uint64>& brick_src )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	Vector3DI axiscnt = atlas.subdim;
+	Vector3DI axisres = mPool->getAtlasRes ( chan );
+	int bres = int(atlas.stride + atlas.apron*2);
+	int dsize = mPool->getSize ( atlas.type );
+	uint64 bsize = uint64(bres)*bres*bres*dsize;
+	uint64 slicesz = uint64(axisres.x)*axisres.y*dsize;
+	int layer = axiscnt.x * axiscnt.y;
+	int bricks = layer * axiscnt.z;
+
+	fwrite ( &bricks, sizeof(int), 1, fp );
+	uint64 table_pos = ftell ( fp );
+	std::vector<uint64> table ( bricks+1, 0 );
+	fwrite ( &table[0], sizeof(uint64), bricks+1, fp );		// written again when sizes are known
+
+	std::vector<char> lbuf ( slicesz * bres );
+	std::vector< std::vector<char> > cbuf ( layer );
+	std::vector<int> slot;
+	std::vector<char> moved;
+	for (int z=0; z < axiscnt.z; z++ ) {
+		for (int s=0; s < bres; s++ )
+			mPool->AtlasRetrieveSlice ( chan, z*bres + s, (int) slicesz, 0x0, (uchar*) &lbuf[s*slicesz] );
+		ReadMovedBricks ( chan, z, brick_src, slot, moved );
+
+		ParallelFor ( mWorkers, layer, [&] ( slong s, slong e ) {
+			std::vector<char> brick ( bsize );
+			for (slong b = s; b < e; b++ ) {
+				uint64 bx = (b % axiscnt.x) * bres, by = (b / axiscnt.x) * bres;
+				if ( slot[b] >= 0 )
+					memcpy ( &brick[0], &moved[ slot[b]*bsize ], bsize );
+				else
+					for (int k=0; k < bres; k++ )
+						for (int j=0; j < bres; j++ )
+							memcpy ( &brick[ (uint64(k)*bres + j)*bres*dsize ], &lbuf[ k*slicesz + ((by+j)*axisres.x + bx)*dsize ], bres*dsize );
+				cbuf[b].resize ( getCompressBound ( bsize ) );
+				cbuf[b].resize ( BrickCompress ( &brick[0], bsize, dsize, &cbuf[b][0] ) );
+			}
+		} );
+		for (int b=0; b < layer; b++ ) {
+			table[ z*layer + b + 1 ] = table[ z*layer + b ] + cbuf[b].size();
+			fwrite ( &cbuf[b][0], cbuf[b].size(), 1, fp );
+		}
+	}
+	uint64 end_pos = ftell ( fp );
+	fseek ( fp, table_pos, SEEK_SET );
+	fwrite ( &table[0], sizeof(uint64), bricks+1, fp );
+	fseek ( fp, end_pos, SEEK_SET );
+
+	if ( mbVerbose ) gprintf ( "  Atlas chan %d: %llu bytes compressed to %llu\n", chan, uint64(bricks)*bsize, table[bricks] );
+}
+
+// Read atlas channel from compressed bricks
+// - Bricks are decoded in parallel one atlas layer at a time, directly into the cpu atlas on host device.
+bool VolumeGVDB::ReadAtlasBricks ( VBXReader& vbx, uchar chan )
+{
+	DataPtr atlas = mPool->getAtlas ( chan );
+	Vector3DI axiscnt = atlas.subdim;
+	Vector3DI axisres = mPool->getAtlasRes ( chan );
+	int bres = int(atlas.stride + atlas.apron*2);
+	int dsize = mPool->getSize ( atlas.type );
+	uint64 bsize = uint64(bres)*bres*bres*dsize;
+	uint64 slicesz = uint64(axisres.x)*axisres.y*dsize;
+	int layer = axiscnt.x * axiscnt.y;
+	int bricks;
+
+	vbx.read ( &bricks, sizeof(int), 1 );
+	if ( bricks != layer * axiscnt.z ) return false;
+	std::vector<uint64> table ( bricks+1 );
+	vbx.read ( &table[0], sizeof(uint64), bricks+1 );
+
+	// Brick data, in place when mapped
+	const char* data;
+	std::vector<char> dbuf;
+	if ( vbx.map != 0x0 ) {
+		data = vbx.data ( table[bricks] );
+	} else {
+		dbuf.resize ( table[bricks] );
+		data = vbx.read ( dbuf.data(), 1, table[bricks] ) ? dbuf.data() : 0x0;
+	}
+	if ( data == 0x0 ) return false;
+
+	bool bHost = !mPool->hasGPU() && atlas.cpu != 0x0;
+	std::vector<char> lbuf ( bHost ? 0 : slicesz * bres );
+	std::atomic<bool> bValid ( true );
+	for (int z=0; z < axiscnt.z; z++ ) {
+		char* ldat = bHost ? atlas.cpu + z*bres*slicesz : lbuf.data();
+
+		ParallelFor ( mWorkers, layer, [&] ( slong s, slong e ) {
+			std::vector<char> brick ( bsize );
+			for (slong b = s; b < e; b++ ) {
+				uint64 id = z*layer + b;
+				if ( table[id+1] < table[id] || table[id+1] > table[bricks] ||
+					!BrickDecompress ( data + table[id], table[id+1] - table[id], dsize, &brick[0], bsize ) ) {
+					bValid = false; continue;
+				}
+				uint64 bx = (b % axiscnt.x) * bres, by = (b / axiscnt.x) * bres;
+				for (int k=0; k < bres; k++ )
+					for (int j=0; j < bres; j++ )
+						memcpy ( ldat + k*slicesz + ((by+j)*axisres.x + bx)*dsize, &brick[ (uint64(k)*bres + j)*bres*dsize ], bres*dsize );
+			}
+		} );
+		if ( !bHost ) {
+			for (int s=0; s < bres; s++ )
+				mPool->AtlasWriteSlice ( chan, z*bres + s, (int) slicesz, 0x0, (uchar*) ldat + s*slicesz );
+		}
+	}
+	return bValid;
+}
+
 // Compute bounding box of entire volume.
 // - This is done by finding the min/max of all bricks
 void VolumeGVDB::ComputeBounds ()
 {
 	Vector3DI range = getRange(0);
-	Node* curr = getNode ( 0, 0, 0 );	
-	mVoxMin = curr->mPos;
-	mVoxMax = mVoxMin;
-	for (int n=0; n < mPool->getPoolCnt(0,0); n++ ) {
+	Node* curr;
+	bool bEmpty = true;
+	auto extend = [&] ( Vector3DI pos ) {
+		if ( bEmpty ) { mVoxMin = pos; mVoxMax = pos; bEmpty = false; }
+		if ( pos.x < mVoxMin.x ) mVoxMin.x = pos.x;
+		if ( pos.y < mVoxMin.y ) mVoxMin.y = pos.y;
+		if ( pos.z < mVoxMin.z ) mVoxMin.z = pos.z;		
+		if ( pos.x + range.x > mVoxMax.x ) mVoxMax.x = pos.x + range.x;
+		if ( pos.y + range.y > mVoxMax.y ) mVoxMax.y = pos.y + range.y;
+		if ( pos.z + range.z > mVoxMax.z ) mVoxMax.z = pos.z + range.z;		
+	};
+	uint64 cnt = mPool->getPoolCnt(0,0);
+	for (uint64 n=0; n < cnt; n++ ) {
 		curr = getNode ( 0, 0, n );
-		if ( curr->mPos.x < mVoxMin.x ) mVoxMin.x = curr->mPos.x;
-		if ( curr->mPos.y < mVoxMin.y ) mVoxMin.y = curr->mPos.y;
-		if ( curr->mPos.z < mVoxMin.z ) mVoxMin.z = curr->mPos.z;		
-		if ( curr->mPos.x + range.x > mVoxMax.x ) mVoxMax.x = curr->mPos.x + range.x;
-		if ( curr->mPos.y + range.y > mVoxMax.y ) mVoxMax.y = curr->mPos.y + range.y;
-		if ( curr->mPos.z + range.z > mVoxMax.z ) mVoxMax.z = curr->mPos.z + range.z;		
+		if ( curr->mFlags & NODE_FREE ) continue;
+		extend ( curr->mPos );
+	}
+	if ( hasTiles(1) ) {						// tiles cover the extent of a leaf
+		uint64 cnt1 = mPool->getPoolCnt(0,1);
+		uint64 words = getMaskSize(1) / sizeof(uint64);
+		for (uint64 n=0; n < cnt1; n++ ) {
+			curr = getNode ( 0, 1, n );
+			if ( curr->mFlags & NODE_FREE ) continue;
+			uint64* tmask = getTileMask ( curr );
+			uint64* mask = curr->getMask ();
+			for (uint64 w=0; w < words; w++ )
+				for (uint64 bits = tmask[w] & ~mask[w]; bits != 0; bits &= bits-1 )
+					extend ( curr->mPos + getPosFromBit ( 1, uint32( w*64 + curr->firstBitOn ( bits ) ) ) * range );
+		}
+	}
+	if ( bEmpty ) {								// no live leaves
+		mVoxMin.Set ( 0, 0, 0 );	mVoxMax.Set ( 0, 0, 0 );	mVoxRes.Set ( 0, 0, 0 );
+		mObjMin.Set ( 0, 0, 0 );	mObjMax.Set ( 0, 0, 0 );
+		return;
 	}
 	mObjMin = mVoxMin;	mObjMin *= mVoxsize;
 	mObjMax = mVoxMax;  mObjMax *= mVoxsize;
@@ -777,7 +1692,11 @@ bool VolumeGVDB::LoadBRK ( std::string fname )
 	float* brick = 0x0;
 	bcurr.Set ( 0, 0, 0 );	
 
-	Volume3D vtemp ( mScene );
+	if ( fp == 0x0 ) {
+		gprintf ( "ERROR: Unable to open file %s\n", fn );
+		return false;
+	}
+	Volume3D* vtemp = mbCPU ? 0x0 : new Volume3D ( mScene );		// bricks staged in a gpu texture (host device copies directly)
 
 	sprintf ( buf, "Reading BRK %s", fname.c_str() );
 	gprintf ( "  %s\n", buf );
@@ -795,7 +1714,7 @@ bool VolumeGVDB::LoadBRK ( std::string fname )
 	bcurr = bres;
 	if ( brick != 0x0 ) free ( brick );
 	brick = (float*) malloc ( bres.x*bres.y*bres.z * sizeof(float) );	// allocate brick memory
-	vtemp.Resize ( T_FLOAT, bres, 0x0, false );
+	if ( vtemp ) vtemp->Resize ( T_FLOAT, bres, 0x0, false );
 	fseek ( fp, 0, SEEK_SET );
 	fread ( &brkcnt, sizeof(int), 1, fp );
 
@@ -822,9 +1741,26 @@ bool VolumeGVDB::LoadBRK ( std::string fname )
 	
 	float vmin = +1.0e20, vmax = -1.0e20;
 
-	// Read all bricks
+	// Read all brick positions and build topology
 	Vector3DF t;
+	std::vector<Vector3DI> brkpos;
+	std::vector<slong> leafs;
+	if ( mbProfile ) PERF_PUSH ( "Activate" );	
+	PERF_START ();
+	for (int n=0; n < brkcnt; n++ ) {
+		fread ( &bndx, sizeof(Vector3DI), 1, fp );
+		fread ( &bmin, sizeof(Vector3DF), 1, fp );
+		fread ( &bmax, sizeof(Vector3DF), 1, fp );
+		fread ( &bres, sizeof(Vector3DI), 1, fp );
+		fseek ( fp, bres.x*bres.y*bres.z*sizeof(float), SEEK_CUR );		// skip brick data
+		brkpos.push_back ( bndx );
+	}
+	BuildTopology ( brkpos, &leafs );
+	fseek ( fp, sizeof(int), SEEK_SET );
+	t.y += PERF_STOP ();
+	if ( mbProfile ) PERF_POP ();
 
+	// Read all bricks
 	if ( mbProfile ) PERF_PUSH ( "Load Bricks" );	
 	for (int n=0; n < brkcnt; n++ ) {
 		
@@ -842,18 +1778,15 @@ bool VolumeGVDB::LoadBRK ( std::string fname )
 		fread ( brick, sizeof(float), bres.x*bres.y*bres.z, fp );
 		t.x += PERF_STOP ();
 
-		// Activate space
-		PERF_START ();
-		bool bnew = false;
-		leaf = ActivateSpace ( mRoot, bndx, bnew );
-		t.y += PERF_STOP ();
-
+		leaf = leafs[n];
 		if ( leaf != ID_UNDEFL ) {
 
 			PERF_START ();
 			// Copy data from CPU into 3D Texture
-			vtemp.SetDomain ( bmin, bmax );
-			vtemp.CommitFromCPU ( brick );					
+			if ( vtemp ) {
+				vtemp->SetDomain ( bmin, bmax );
+				vtemp->CommitFromCPU ( brick );					
+			}
 
 			// Create VDB Atlas value and sub-copy 3D texture into it
 			Vector3DI brickpos;
@@ -862,7 +1795,8 @@ bool VolumeGVDB::LoadBRK ( std::string fname )
 				node = getNode ( leaf );
 				node->mValue = brickpos; 
 				// gprintf ( "%d %d %d: %d %d %d, %lld\n", node->mPos.x, node->mPos.y, node->mPos.z, brickpos.x, brickpos.y, brickpos.z, leaf );				
-				mPool->AtlasCopyTex ( 0, brickpos, vtemp.getPtr() );
+				if ( vtemp )	mPool->AtlasCopyTex ( 0, brickpos, vtemp->getPtr() );
+				else			mPool->AtlasCopyHost ( 0, brickpos, bres, (char*) brick, false );
 			}
 			leaf_cnt++;
 			t.z += PERF_STOP ();
@@ -884,7 +1818,12 @@ bool VolumeGVDB::LoadBRK ( std::string fname )
 
 	if ( mbProfile ) PERF_POP ();
 
+	fclose ( fp );
+	free ( brick );
+	if ( vtemp ) delete vtemp;
+
 	FinishTopology ();
+	UpdateAtlas ();				// bricks are already placed, this builds the atlas map
 	UpdateApron ();
 
 	return true;
@@ -1014,6 +1953,7 @@ bool VolumeGVDB::LoadVDB ( std::string fname )
 	n = 0;
 	gprintf ( "   Activating space.\n");
 
+	std::vector<Vector3DI> leafpos;
 	vdbSkip ( mOVDB, leaf_start, gridtype, isFloat );
 	for (leaf_max=0; vdbCheck ( mOVDB, gridtype, isFloat ) ; ) {
 			
@@ -1024,9 +1964,7 @@ bool VolumeGVDB::LoadVDB ( std::string fname )
 
 		if ( p0.x > vclipmin.x && p0.y > vclipmin.y && p0.z > vclipmin.z && p0.x < vclipmax.x && p0.y < vclipmax.y && p0.z < vclipmax.z ) {		// accept condition
 			// only accept those in clip volume
-			bool bnew = false;
-			leaf = ActivateSpace ( mRoot, p0, bnew );
-			leaf_ptr.push_back ( leaf );				
+			leafpos.push_back ( p0 );
 			leaf_pos.push_back ( p0 );
 			if ( leaf_max==0 ) { 
 				mVoxMin = p0; mVoxMax = p0; 
@@ -1037,6 +1975,9 @@ bool VolumeGVDB::LoadVDB ( std::string fname )
 		vdbNext ( mOVDB, gridtype, isFloat );
 		n++;
 	}	
+	std::vector<slong> leafs;
+	BuildTopology ( leafpos, &leafs );
+	leaf_ptr.insert ( leaf_ptr.end(), leafs.begin(), leafs.end() );
 
 	// Finish Topology
 	FinishTopology ();
@@ -1241,9 +2182,9 @@ void VolumeGVDB::Initialize ()
 	mScene->SetVolumeRange ( 0.1, 0, 1 );	// Default transfer range
 	mScene->LinearTransferFunc ( 0, 1, Vector4DF(0,0,0,0), Vector4DF(1,1,1,0.1) );		// Default transfer function
 	
-	CommitTransferFunc ();			// Commit transfer func to GPU
+	mPool = new Allocator ( !mbCPU );	// Allocator object (host-only on CPU device)
 
-	mPool = new Allocator;			// Allocator object
+	CommitTransferFunc ();			// Commit transfer func to GPU
 
 	SetChannelDefault ( 8, 8, 8 );
 }
@@ -1289,6 +2230,10 @@ void VolumeGVDB::Configure ( int levs, int* r, int* numcnt )
 	mClrDim[7] = Vector3DF(0,0.5,1);	// green-blue
 	mClrDim[8] = Vector3DF(0.7,0.7,0.7);  // grey
 
+	// Leaves of a paged atlas do not survive a new configuration
+	delete mCache;
+	mCache = 0x0;
+
 	// Initialize memory pools
 	int hdr = sizeof(Node);
 
@@ -1297,12 +2242,12 @@ void VolumeGVDB::Configure ( int levs, int* r, int* numcnt )
 	// node & mask list
 	mPool->PoolCreate ( 0, 0, hdr,					maxcnt[0], true );			
 	for (int n=1; n < levs; n++ ) 
-		mPool->PoolCreate ( 0, n, hdr+getMaskSize(n), maxcnt[n], true );
+		mPool->PoolCreate ( 0, n, hdr+getMaskSize(n)+(mbPrefix ? getPrefixSize(n) : 0)+(mbTiles ? getTileSize(n) : 0), maxcnt[n], true );
 
-	// child lists	
+	// child lists (runs of one size class per node, see InsertChild)
 	mPool->PoolCreate ( 1, 0, 0, 0, true );								
 	for (int n=1; n < levs; n++ ) 	
-		mPool->PoolCreate ( 1, n, sizeof(uint64)*getVoxCnt(n), maxcnt[n], true );
+		mPool->PoolCreate ( 1, n, sizeof(uint64), maxcnt[n]*CHILD_MIN, true );
 
 	mVoxResMax.Set ( 0, 0, 0 );
 
@@ -1337,6 +2282,7 @@ void VolumeGVDB::FillChannel ( uchar chan, Vector4DF val )
 void VolumeGVDB::DestroyChannels ()
 {
 	mPool->AtlasReleaseAll ();		
+	mRangeChan = -1;
 	SetColorChannel ( -1 );
 }
 
@@ -1346,6 +2292,8 @@ void VolumeGVDB::Clear ()
 	// Empty VDB data (keep pools)
 	mPool->PoolEmptyAll ();		// does not free pool mem
 	mRoot = ID_UNDEFL;
+	delete mCache;				// leaves of a paged atlas are gone
+	mCache = 0x0;
 
 	// Empty atlas & atlas map
 	mPool->AtlasEmptyAll ();	// does not free atlas
@@ -1364,11 +2312,17 @@ void VolumeGVDB::SetupNode ( slong nodeid, int lev, Vector3DF pos )
 {
 	Node* node = getNode ( nodeid );
 	node->mLev = lev;	
+	node->mFlags = 0;
+	node->mLogRes = (uchar) mLogDim[lev];
 	node->mPos = pos;	
 	node->mChildList = ID_UNDEFL;
 	node->mParent = ID_UNDEFL;
 	node->mValue = Vector3DI(-1,-1,-1);
-	if ( lev > 0 ) node->clearMask ();
+	if ( lev > 0 ) {
+		node->clearMask ();
+		node->enablePrefix ( hasPrefix(lev) );
+		if ( hasTiles(lev) ) memset ( getTileMask(node), 0, getMaskSize(lev) );
+	}
 }
 
 // Clear atlas mapping
@@ -1376,6 +2330,7 @@ void VolumeGVDB::ClearMapping ()
 { 
 	// This function ensures that the atlas mapping, for unused bricks in the atlas,
 	// maps to an undefined value which is checked by kernels.
+	mbDirtyBricks = true;
 
 	DataPtr a = mPool->getAtlas ( 0 );		// atlas
 	Vector3DI axiscnt = a.subdim;			// number of leaves along atlas axis
@@ -1443,21 +2398,28 @@ void VolumeGVDB::UpdateAtlas ()
 	Vector3DI brickpos;
 	Node* node;
 	int leafcnt = mPool->getPoolCnt(0,0);
+	int livecnt = leafcnt - (int) mPool->getPoolFree(0,0);		// excludes deactivated leaves
 
 	// Resize atlas
+	// - Freed bricks are reused by AtlasAlloc, so the atlas only grows when live leaves exceed it.
+	// - Before shrinking, live bricks are compacted out of the region being released.
+	// - A paged atlas keeps its size, bricks are assigned by UpdateBrickCache.
+	bool bPaged = ( mCache != 0x0 );
 	int amax = mPool->getAtlas(0).max;
-	if ( leafcnt > amax || (leafcnt < amax && ++mAtlasResize.x==mAtlasResize.y) ) {
+	if ( !bPaged && (livecnt > amax || (livecnt < amax && ++mAtlasResize.x==mAtlasResize.y)) ) {
 		mAtlasResize.x = 0;
+		if ( livecnt < amax ) AtlasCompact ();
 		if ( mbProfile ) PERF_PUSH ( "Resize Atlas" );
 		for (int n=0; n < mPool->getNumAtlas(); n++ )
-			mPool->AtlasResize ( n, leafcnt );
+			mPool->AtlasResize ( n, livecnt );
 		if ( mbProfile ) PERF_POP ();
 	}
 
 	// Assign new nodes to atlas
 	if ( mbProfile ) PERF_PUSH ( "Assign Atlas" );
-	for (int n=0; n < leafcnt; n++ ) {
+	for (int n=0; n < leafcnt && !bPaged; n++ ) {
 		node = getNode ( 0, 0, n );
+		if ( node->mFlags & NODE_FREE ) continue;		// deactivated node
 		if ( node->mValue.x == -1 ) {					// node not yet assigned to atlas			
 			if ( mPool->AtlasAlloc ( 0, brickpos ) )	// assign to atlas brick
 				node->mValue = brickpos;
@@ -1474,13 +2436,12 @@ void VolumeGVDB::UpdateAtlas ()
 
 	// Build Atlas Mapping	
 	if ( mbProfile ) PERF_PUSH ( "Atlas Mapping" );
-	int brickcnt = mPool->getAtlas(0).num;
 	int brickres = mPool->getAtlasBrickres(0);
 	Vector3DI atlasres = mPool->getAtlasRes(0);
 	Vector3DI atlasmax = atlasres - brickres + mPool->getAtlas(0).apron; 
-	for (int n=0; n < brickcnt; n++ ) {
+	for (int n=0; n < leafcnt; n++ ) {
 		Node* node = getNode ( 0, 0, n );
-		if ( node->mValue.x == -1 ) continue;
+		if ( node->mValue.x == -1 || (node->mFlags & NODE_FREE) ) continue;
 		if ( node->mValue.x > atlasmax.x || node->mValue.y > atlasmax.y || node->mValue.z > atlasmax.z ) {
 			gprintf ( "ERROR: Node value exceeds atlas res. node: %d, val: %d %d %d, atlas: %d %d %d\n", n, node->mValue.x, node->mValue.y, node->mValue.z, atlasres.x, atlasres.y, atlasres.z );
 			gerror ();
@@ -1566,6 +2527,7 @@ slong VolumeGVDB::Reparent(int lev, slong prevroot_id, Vector3DI pos, bool& bNew
 // Activate region of space at 3D position
 slong VolumeGVDB::ActivateSpace ( Vector3DF pos )
 {
+	if ( RejectPaged ( "ActivateSpace" ) ) return ID_UNDEFL;
 	pos /= mVoxsize;
 	
 	Vector3DI brickpos;
@@ -1579,6 +2541,7 @@ slong VolumeGVDB::ActivateSpace ( Vector3DF pos )
 // Activate region of space at 3D position down to a given level
 slong VolumeGVDB::ActivateSpaceAtLevel ( int lev, Vector3DF pos )
 {
+	if ( RejectPaged ( "ActivateSpaceAtLevel" ) ) return ID_UNDEFL;
 	pos /= mVoxsize;	
 	Vector3DI brickpos;
 	bool bnew = false;
@@ -1588,6 +2551,313 @@ slong VolumeGVDB::ActivateSpaceAtLevel ( int lev, Vector3DF pos )
 	return ID_UNDEFL;
 }
 
+// Concurrent activation state
+// Node pools are reserved ahead so nodes do not move while threads activate. New nodes
+// are taken from a per-level atomic count (free lists are not reused), and each node's
+// mask and child list are guarded by one of a set of striped locks. When a pool is full,
+// or a position lies outside the root, activation pauses all threads (ActivateExclusive).
+#define ACT_LOCKS		1024
+
+struct nvdb::ActivateState {
+	std::mutex			node_lock[ACT_LOCKS];	// node mask & child list, by node id
+	std::mutex			list_lock;				// child list pools (pool 1)
+	std::mutex			grow_lock;				// one exclusive section at a time
+	std::atomic<int>	users;					// threads inside ActivateSpaceConcurrent
+	std::atomic<bool>	growing;				// exclusive section waiting or running
+	std::atomic<uint64>	num[MAXLEV];			// next new node per level (pool 0)
+	uint64				max[2][MAXLEV];			// pool capacity at BeginActivate (gpu size)
+
+	std::mutex& getLock ( slong nodeid )	{ return node_lock[ (ElemNdx(nodeid)*MAXLEV + ElemLev(nodeid)) % ACT_LOCKS ]; }
+	void Enter ()
+	{
+		for (;;) {
+			while ( growing.load() ) std::this_thread::yield ();
+			users++;
+			if ( !growing.load() ) return;
+			users--;
+		}
+	}
+	void Leave ()	{ users--; }
+};
+
+// Start concurrent activation
+// - 'leaves'  Expected number of new leaves, reserved in the pools up front
+// Between BeginActivate and EndActivate, any number of threads may call ActivateSpaceConcurrent.
+// No other topology functions may be used until EndActivate.
+void VolumeGVDB::BeginActivate ( uint64 leaves )
+{
+	if ( RejectPaged ( "BeginActivate" ) ) return;
+	if ( mAct != 0x0 ) {
+		gprintf ( "ERROR: BeginActivate called twice, without EndActivate.\n" );
+		return;
+	}
+	ActivateState* st = new ActivateState;
+	st->users = 0;
+	st->growing = false;
+	for (int lev=0; lev < MAXLEV; lev++ ) {
+		bool bLev = lev < mPool->getNumLevels();
+		st->num[lev] = bLev ? mPool->getPoolCnt(0, lev) : 0;
+		st->max[0][lev] = bLev ? mPool->getPoolMax(0, lev) : 0;
+		st->max[1][lev] = bLev ? mPool->getPoolMax(1, lev) : 0;
+	}
+	mAct = st;
+
+	mPool->PoolReserve ( 0, 0, mPool->getPoolCnt(0, 0) + leaves, false );
+	ActivateReserve ();
+}
+
+// Finish concurrent activation
+// Sets the final node counts and resizes gpu pools which grew. Call FinishTopology after.
+void VolumeGVDB::EndActivate ()
+{
+	ActivateState* st = mAct;
+	if ( st == 0x0 ) return;
+	if ( st->users.load() > 0 ) {
+		gprintf ( "ERROR: EndActivate called while threads are activating.\n" );
+		gerror ();
+	}
+	for (int lev=0; lev < mPool->getNumLevels(); lev++ ) {
+		mPool->getPool(0, lev)->num = st->num[lev];
+		for (int grp=0; grp < 2; grp++ )
+			if ( mPool->getPoolMax(grp, lev) != st->max[grp][lev] ) mPool->PoolResizeGPU ( grp, lev );
+	}
+	delete st;
+	mAct = 0x0;
+}
+
+// Keep room in all pools for the next exclusive section (Reparent) and for concurrent inserts.
+// Caller must hold all activation threads (see ActivateExclusive), with node counts synced to the pools.
+void VolumeGVDB::ActivateReserve ()
+{
+	for (int lev=0; lev < mPool->getNumLevels(); lev++ ) {
+		uint64 cnt = mPool->getPoolCnt(0, lev);
+		if ( cnt + 4 > mPool->getPoolMax(0, lev) )
+			mPool->PoolReserve ( 0, lev, 2*(cnt + 4), false );
+
+		cnt = mPool->getPoolCnt(1, lev);
+		uint64 run = (lev > 0) ? 4*getChildCap ( lev, getVoxCnt(lev) ) : 0;		// largest size class
+		if ( cnt + run > mPool->getPoolMax(1, lev) )
+			mPool->PoolReserve ( 1, lev, 2*(cnt + run), false );
+	}
+}
+
+// Pause concurrent activation
+// Waits until all other threads are outside ActivateSpaceConcurrent, then grows pools
+// and, when 'pos' is given, activates it with the serial ActivateSpace (new root).
+// Returns the leaf at 'pos', or ID_UNDEFL if it could not be activated (level limit).
+// Caller must be inside ActivateSpaceConcurrent and hold no node locks.
+slong VolumeGVDB::ActivateExclusive ( Vector3DI* pos )
+{
+	ActivateState* st = mAct;
+	slong leaf = ID_UNDEFL;
+	st->Leave ();
+	{
+		std::lock_guard<std::mutex> guard ( st->grow_lock );
+		st->growing = true;
+		while ( st->users.load() > 0 ) std::this_thread::yield ();
+
+		for (int lev=0; lev < mPool->getNumLevels(); lev++ )
+			mPool->getPool(0, lev)->num = st->num[lev];
+		ActivateReserve ();
+		if ( pos != 0x0 ) {
+			bool bnew = false;
+			leaf = ActivateSpace ( mRoot, *pos, bnew, ID_UNDEFL, 0 );
+			ActivateReserve ();
+		}
+		for (int lev=0; lev < mPool->getNumLevels(); lev++ )
+			st->num[lev] = mPool->getPoolCnt(0, lev);
+		st->growing = false;
+	}
+	st->Enter ();
+	return leaf;
+}
+
+// Add a child to a node during concurrent activation
+// Same as AddChildNode, without moving pool memory. Caller holds the node lock.
+slong VolumeGVDB::ActivateChild ( slong nodeid, uint32 i )
+{
+	ActivateState* st = mAct;
+	Node* curr = getNode ( nodeid );
+	int lev = curr->mLev;
+
+	// room in child list
+	uint64 cnum = curr->getNumChild();
+	uint64 cap = getChildCap ( lev, cnum );
+	uint64 list = ID_UNDEFL;
+	if ( cnum + 1 > cap ) {
+		std::lock_guard<std::mutex> guard ( st->list_lock );
+		list = mPool->PoolAllocRun ( 1, lev, getChildCap ( lev, cnum+1 ), false );
+		if ( list == ID_UNDEFL ) return ID_UNDEFL;
+	}
+	// new node from the reserved pool
+	uint64 ndx = st->num[lev-1].load();
+	do {
+		if ( ndx >= mPool->getPoolMax(0, lev-1) ) {
+			if ( list != ID_UNDEFL ) {
+				std::lock_guard<std::mutex> guard ( st->list_lock );
+				mPool->PoolFreeRun ( list, getChildCap ( lev, cnum+1 ) );
+			}
+			return ID_UNDEFL;
+		}
+	} while ( !st->num[lev-1].compare_exchange_weak ( ndx, ndx+1 ) );
+
+	slong childid = Elem ( 0, lev-1, ndx );
+	Vector3DI p = getPosFromBit ( lev, i );
+	p *= getRange ( lev-1 );
+	p += curr->mPos;
+	SetupNode ( childid, lev-1, p );
+	getNode ( childid )->mParent = nodeid;
+
+	// insert into child list (see InsertChild)
+	if ( list != ID_UNDEFL ) {
+		if ( cnum > 0 ) {
+			memcpy ( mPool->PoolData64 ( list ), mPool->PoolData64 ( curr->mChildList ), cnum*sizeof(uint64) );
+			std::lock_guard<std::mutex> guard ( st->list_lock );
+			mPool->PoolFreeRun ( curr->mChildList, cap );
+		}
+		curr->mChildList = list;
+	}
+	uint64 pos = curr->countOn ( i );
+	uint64* clist = mPool->PoolData64 ( curr->mChildList );
+	if ( pos < cnum ) memmove ( clist + pos+1, clist + pos, (cnum-pos)*sizeof(uint64) );
+	*(clist + pos) = childid;
+	curr->setOn ( i );
+	if ( hasTiles(lev) ) getTileMask(curr)[i >> 6] &= ~(uint64(1) << (i & 63));		// child replaces tile
+
+	return childid;
+}
+
+// Activate region of space at 3D position, from multiple threads
+// Threads may activate the same or different regions at once. Returns the leaf at pos.
+slong VolumeGVDB::ActivateSpaceConcurrent ( Vector3DF pos )
+{
+	ActivateState* st = mAct;
+	if ( st == 0x0 ) {
+		gprintf ( "ERROR: ActivateSpaceConcurrent called outside of BeginActivate/EndActivate.\n" );
+		return ID_UNDEFL;
+	}
+	pos /= mVoxsize;
+	Vector3DI p = pos;
+	slong path[MAXLEV];
+	uint32 b;
+
+	st->Enter ();
+	for (;;) {
+		slong nodeid = mRoot;
+		if ( nodeid == ID_UNDEFL || !getPosInNode ( nodeid, p, b ) ) {
+			slong leaf = ActivateExclusive ( &p );	// new root covering pos
+			st->Leave ();
+			return leaf;							// ID_UNDEFL if level limit exceeded
+		}
+		// descend, locking one node at a time
+		int depth = 0;
+		bool bAdded = false;
+		while ( !isLeaf ( nodeid ) ) {
+			getPosInNode ( nodeid, p, b );
+			path[depth++] = nodeid;
+			std::mutex& lock = st->getLock ( nodeid );
+			lock.lock ();
+			Node* curr = getNode ( nodeid );
+			slong childid;
+			if ( curr->isOn ( b ) ) {
+				childid = getChildNode ( nodeid, curr->countOn ( b ) );
+			} else {
+				childid = ActivateChild ( nodeid, b );
+				bAdded = true;
+			}
+			lock.unlock ();
+			if ( childid == ID_UNDEFL ) break;		// pools are full
+			nodeid = childid;
+		}
+		if ( !isLeaf ( nodeid ) ) {
+			ActivateExclusive ( 0x0 );				// grow pools, then retry
+			continue;
+		}
+		// ancestor ranges no longer cover the sub-tree (see InsertChild)
+		if ( bAdded ) {
+			for (int n = depth-1; n >= 0; n-- ) {
+				std::lock_guard<std::mutex> guard ( st->getLock ( path[n] ) );
+				getNode ( path[n] )->mFlags &= ~NODE_RANGE;
+			}
+		}
+		st->Leave ();
+		return nodeid;
+	}
+}
+
+// Deactivate region of space at 3D position
+// - Removes the leaf containing pos, and any parents left empty
+bool VolumeGVDB::DeactivateSpace ( Vector3DF pos )
+{
+	if ( mRoot == ID_UNDEFL ) return false;
+	pos /= mVoxsize;
+
+	Vector3DI p = pos;
+	slong nodeid = mRoot;
+	uint32 b;
+	if ( !getPosInNode ( nodeid, p, b ) ) return false;			// outside of topology (root may be a leaf)
+	while ( !isLeaf ( nodeid ) ) {
+		getPosInNode ( nodeid, p, b );
+		Node* curr = getNode ( nodeid );
+		if ( isTile ( curr, b ) ) return ClearTile ( nodeid, b );
+		if ( !curr->isOn ( b ) ) return false;					// already inactive
+		nodeid = getChildNode ( nodeid, curr->countOn ( b ) );
+	}
+	return DeactivateNode ( nodeid );
+}
+
+// Deactivate node
+// - Detaches node from its parent and frees the sub-tree. 
+// - Parents which have no remaining children are also removed.
+bool VolumeGVDB::DeactivateNode ( slong nodeid )
+{
+	if ( nodeid == ID_UNDEFL || RejectPaged ( "DeactivateNode" ) ) return false;
+	Node* curr = getNode ( nodeid );
+	if ( curr->mFlags & NODE_FREE ) return false;
+
+	slong parent = curr->mParent;
+	if ( parent != ID_UNDEFL ) {
+		Vector3DI p;
+		RemoveChild ( parent, (uint32) getChildOffset ( parent, nodeid, p ) );
+	} else {
+		mRoot = ID_UNDEFL;					// removing the root
+	}
+	FreeNode ( nodeid );
+
+	if ( parent != ID_UNDEFL && getNode ( parent )->countOn() == 0 && !hasAnyTile ( getNode ( parent ) ) )
+		DeactivateNode ( parent );			// prune empty parent
+
+	mVDBInfo.update = true;
+	return true;
+}
+
+// Clear tile
+// - Removes the tile value of slot b of a level 1 node. The node is removed if it has no children or tiles left.
+bool VolumeGVDB::ClearTile ( slong nodeid, uint32 b )
+{
+	if ( nodeid == ID_UNDEFL || RejectPaged ( "ClearTile" ) ) return false;
+	Node* curr = getNode ( nodeid );
+	if ( !isTile ( curr, b ) ) return false;
+	getTileMask(curr)[b >> 6] &= ~(uint64(1) << (b & 63));
+	for (slong n = nodeid; n != ID_UNDEFL && (getNode(n)->mFlags & NODE_RANGE); n = getNode(n)->mParent )
+		getNode(n)->mFlags &= ~NODE_RANGE;		// ranges no longer match the sub-tree
+	if ( curr->countOn() == 0 && !hasAnyTile ( curr ) )
+		DeactivateNode ( nodeid );
+	mVDBInfo.update = true;
+	return true;
+}
+
+bool VolumeGVDB::hasAnyTile ( Node* node )
+{
+	if ( node->mLev != 1 || !hasTiles(1) ) return false;
+	uint64* tmask = getTileMask ( node );
+	uint64* mask = node->getMask ();
+	uint64 words = getMaskSize(1) / sizeof(uint64);
+	for (uint64 w=0; w < words; w++ )
+		if ( tmask[w] & ~mask[w] ) return true;
+	return false;
+}
+
 // Activate space
 // - 'nodeid'    Starting sub-tree for activation
 // - 'pos'       Index-space position to activate
@@ -1670,6 +2940,398 @@ bool VolumeGVDB::getPosInNode ( slong curr_id, Vector3DI pos, uint32& bit )
 	} 
 }
 
+// Morton code helpers. Interleave the low 21 bits of each axis into a 63-bit key.
+inline uint64 mortonSpread ( uint64 v )
+{
+	v &= 0x1FFFFF;
+	v = (v | (v << 32)) & UINT64_C(0x001F00000000FFFF);
+	v = (v | (v << 16)) & UINT64_C(0x001F0000FF0000FF);
+	v = (v | (v <<  8)) & UINT64_C(0x100F00F00F00F00F);
+	v = (v | (v <<  4)) & UINT64_C(0x10C30C30C30C30C3);
+	v = (v | (v <<  2)) & UINT64_C(0x1249249249249249);
+	return v;
+}
+inline uint64 mortonCompact ( uint64 v )
+{
+	v &= UINT64_C(0x1249249249249249);
+	v = (v ^ (v >>  2)) & UINT64_C(0x10C30C30C30C30C3);
+	v = (v ^ (v >>  4)) & UINT64_C(0x100F00F00F00F00F);
+	v = (v ^ (v >>  8)) & UINT64_C(0x001F0000FF0000FF);
+	v = (v ^ (v >> 16)) & UINT64_C(0x001F00000000FFFF);
+	v = (v ^ (v >> 32)) & 0x1FFFFF;
+	return v;
+}
+#define MORTON_BIAS		(1 << 20)		// offset of brick indices, keeps keys positive
+
+// Build topology from a list of bricks
+// - 'brickpos'  Index-space positions, one per brick (any voxel inside the brick)
+// - 'leafs'     Optional. Returns the leaf node for each entry of brickpos
+// Replaces the current topology. Bricks are sorted by Morton key and deduplicated, 
+// then each level is built bottom-up in parallel, writing nodes, masks and child lists
+// directly into the pools. The resulting tree matches repeated calls to ActivateSpace
+// (same nodes, masks and child order) except that nodes are stored in Morton order.
+// Returns the number of leaves.
+int VolumeGVDB::BuildTopology ( const std::vector<Vector3DI>& brickpos, std::vector<slong>* leafs )
+{
+	if ( RejectPaged ( "BuildTopology" ) ) return 0;
+	if ( mbProfile ) PERF_PUSH ( "Build Topology" );
+
+	int levs = mPool->getNumLevels ();
+	slong num = (slong) brickpos.size();
+
+	// Clear existing topology
+	mPool->PoolEmptyAll ();
+	mRoot = ID_UNDEFL;
+	if ( leafs != 0x0 ) leafs->assign ( num, ID_UNDEFL );
+	if ( num == 0 ) {
+		if ( mbProfile ) PERF_POP ();
+		return 0;
+	}
+
+	// Brick index bits covered by each level
+	int shift[MAXLEV];
+	shift[0] = 0;
+	for (int l=1; l < levs; l++ ) shift[l] = shift[l-1] + mLogDim[l];
+
+	// Morton key of each brick
+	if ( mbProfile ) PERF_PUSH ( "Keys" );
+	Vector3DI range0 = getRange ( 0 );
+	std::vector<uint64> keys ( num );
+	std::atomic<bool> bValid ( shift[levs-1] <= 20 );
+	ParallelFor ( mWorkers, num, [&] ( slong s, slong e ) {
+		Vector3DI b, r;
+		bool ok = true;
+		for (slong i = s; i < e; i++ ) {
+			b = GetCoveringNode ( 0, brickpos[i], r );
+			b.Set ( b.x / range0.x + MORTON_BIAS, b.y / range0.y + MORTON_BIAS, b.z / range0.z + MORTON_BIAS );
+			if ( b.x < 0 || b.y < 0 || b.z < 0 || b.x >= 2*MORTON_BIAS || b.y >= 2*MORTON_BIAS || b.z >= 2*MORTON_BIAS ) ok = false;
+			keys[i] = mortonSpread ( b.x ) | (mortonSpread ( b.y ) << 1) | (mortonSpread ( b.z ) << 2);
+		}
+		if ( !ok ) bValid = false;
+	} );
+	if ( mbProfile ) PERF_POP ();
+
+	// Sort and remove duplicates
+	if ( mbProfile ) PERF_PUSH ( "Sort" );
+	std::vector<uint64> lkeys[MAXLEV];			// node keys at each level
+	std::vector<uint64> lfirst[MAXLEV];			// first child of each node (+1 sentinel)
+	std::vector<uint64> llist[MAXLEV];			// child list of each node in pool 1
+	lkeys[0] = keys;
+	ParallelSort ( mWorkers, lkeys[0] );
+	lkeys[0].erase ( std::unique ( lkeys[0].begin(), lkeys[0].end() ), lkeys[0].end() );
+	if ( mbProfile ) PERF_POP ();
+
+	// Root level. Lowest level with a single node covering all bricks
+	int top = 0;
+	while ( bValid && top < levs && (lkeys[0].front() >> 3*shift[top]) != (lkeys[0].back() >> 3*shift[top]) ) top++;
+
+	if ( !bValid || top >= levs ) {
+		// Bricks exceed key range, use incremental path
+		gprintf ( "  BuildTopology: bricks out of key range, activating incrementally.\n" );
+		bool bnew;
+		for (slong i = 0; i < num; i++ ) {
+			bnew = false;
+			slong leaf = ActivateSpace ( mRoot, brickpos[i], bnew );
+			if ( leafs != 0x0 ) (*leafs)[i] = leaf;
+		}
+		if ( mbProfile ) PERF_POP ();
+		return getNumNodes ( 0 );
+	}
+
+	// Unique parent keys at each level. Children of a node are contiguous in Morton order.
+	if ( mbProfile ) PERF_PUSH ( "Levels" );
+	for (int l=1; l <= top; l++ ) {
+		std::vector<uint64>& ck = lkeys[l-1];
+		int sh = 3*mLogDim[l];
+		uint64 pk;
+		for (uint64 i = 0; i < ck.size(); i++ ) {
+			pk = ck[i] >> sh;
+			if ( i == 0 || pk != lkeys[l].back() ) {
+				lkeys[l].push_back ( pk );
+				lfirst[l].push_back ( i );
+			}
+		}
+		lfirst[l].push_back ( ck.size() );
+	}
+	for (int l=0; l <= top; l++ ) {
+		mPool->PoolAllocN ( 0, l, lkeys[l].size() );
+		if ( l == 0 ) continue;
+		uint64 first = 0;										// child lists sized by class, packed in node order
+		llist[l].resize ( lkeys[l].size() );
+		for (uint64 n = 0; n < lkeys[l].size(); n++ ) {
+			llist[l][n] = first;
+			first += getChildCap ( l, lfirst[l][n+1] - lfirst[l][n] );
+		}
+		first = ElemNdx ( mPool->PoolAllocN ( 1, l, first ) );
+		for (uint64 n = 0; n < lkeys[l].size(); n++ ) llist[l][n] += first;
+	}
+	if ( mbProfile ) PERF_POP ();
+
+	// Build nodes bottom-up
+	if ( mbProfile ) PERF_PUSH ( "Nodes" );
+	for (int l=0; l <= top; l++ ) {
+		Vector3DI range = getRange ( l );
+		int bias = MORTON_BIAS >> shift[l];
+		uint32 res = (uint32) getRes ( l );
+		bool bPrefix = hasPrefix ( l );
+		bool bTiles = hasTiles ( l );
+		ParallelFor ( mWorkers, (slong) lkeys[l].size(), [&] ( slong s, slong e ) {
+			std::vector< std::pair<uint32, uint64> > clist;
+			uint64 k, ck;
+			uint32 b;
+			for (slong n = s; n < e; n++ ) {
+				k = lkeys[l][n];
+				slong nodeid = Elem ( 0, l, n );
+				Node* node = getNode ( nodeid );
+				node->mLev = l;
+				node->mFlags = 0;
+				node->mLogRes = (uchar) mLogDim[l];
+				node->mPos.Set ( (int(mortonCompact(k)) - bias) * range.x, (int(mortonCompact(k >> 1)) - bias) * range.y, (int(mortonCompact(k >> 2)) - bias) * range.z );
+				node->mValue = Vector3DI(-1,-1,-1);
+				node->mParent = ID_UNDEFL;
+				node->mChildList = ID_UNDEFL;
+				if ( l == 0 ) continue;
+
+				// mask and child list, ordered by bit
+				node->clearMask ();
+				node->mChildList = Elem ( 1, l, llist[l][n] );
+				clist.clear ();
+				for (uint64 c = lfirst[l][n]; c < lfirst[l][n+1]; c++ ) {
+					ck = lkeys[l-1][c];
+					b = ((uint32(mortonCompact(ck >> 2)) & (res-1)) * res + (uint32(mortonCompact(ck >> 1)) & (res-1))) * res + (uint32(mortonCompact(ck)) & (res-1));
+					node->setOn ( b );
+					clist.push_back ( std::pair<uint32, uint64> ( b, Elem(0, l-1, c) ) );
+					getNode ( 0, l-1, c )->mParent = nodeid;
+				}
+				node->enablePrefix ( bPrefix );			// counts of the finished mask
+				if ( bTiles ) memset ( getTileMask(node), 0, getMaskSize(l) );
+				std::sort ( clist.begin(), clist.end() );
+				uint64* clist64 = mPool->PoolData64 ( node->mChildList );
+				for (size_t i=0; i < clist.size(); i++ )
+					clist64[i] = clist[i].second;
+			}
+		} );
+	}
+	mRoot = Elem ( 0, top, 0 );
+	if ( mbProfile ) PERF_POP ();
+
+	// Leaf of each brick
+	if ( leafs != 0x0 ) {
+		ParallelFor ( mWorkers, num, [&] ( slong s, slong e ) {
+			for (slong i = s; i < e; i++ ) 
+				(*leafs)[i] = Elem ( 0, 0, std::lower_bound ( lkeys[0].begin(), lkeys[0].end(), keys[i] ) - lkeys[0].begin() );
+		} );
+	}
+
+	if ( mbProfile ) PERF_POP ();
+
+	return (int) lkeys[0].size();
+}
+
+// Compact topology
+// - Defragments node and child list pools after nodes have been deactivated.
+// - Live elements are moved into free slots, then all references are patched.
+void VolumeGVDB::CompactTopology ()
+{
+	if ( RejectPaged ( "CompactTopology" ) ) return;
+	int levs = mPool->getNumLevels ();
+	std::vector< std::vector<uint64> > remap0 ( levs );
+	uint64 moved = 0;
+
+	if ( mbProfile ) PERF_PUSH ( "CompactTopology" );
+
+	for (int lev=0; lev < levs; lev++ )
+		moved += mPool->PoolCompact ( 0, lev, remap0[lev] );
+	
+	// Patch references to moved elements
+	auto remapNode = [&] ( uint64 id ) -> uint64 {
+		if ( id == ID_UNDEFL ) return id;
+		std::vector<uint64>& r = remap0[ ElemLev(id) ];
+		return ( ElemNdx(id) < r.size() ) ? Elem ( 0, ElemLev(id), r[ ElemNdx(id) ] ) : id;
+	};
+	for (int lev=0; lev < levs; lev++ ) {
+		ParallelFor ( mWorkers, mPool->getPoolCnt(0, lev), [&] ( slong s, slong e ) {
+			for (slong n = s; n < e; n++ ) {
+				Node* node = getNode ( 0, lev, n );
+				node->mParent = remapNode ( node->mParent );
+				if ( node->mChildList != ID_UNDEFL ) {
+					uint64* clist = mPool->PoolData64 ( node->mChildList );
+					int cnum = node->getNumChild ();
+					for (int i=0; i < cnum; i++ )
+						clist[i] = remapNode ( clist[i] );
+				}
+				if ( lev == 0 && node->mValue.x != -1 && mPool->getAtlasMapCPU ( 0 ) != 0x0 )
+					AssignMapping ( node->mValue, node->mPos, (int) n );
+			}
+		} );
+	}
+	mRoot = remapNode ( mRoot );
+
+	// Child lists are repacked rather than moved, as they hold runs of different sizes
+	for (int lev=1; lev < levs; lev++ ) {
+		uint64 runfree = mPool->getPoolRunFree(1, lev);
+		if ( runfree == 0 ) continue;
+		moved += mPool->getPoolCnt(1, lev) - runfree;
+		RepackChildLists ( lev );
+	}
+
+	if ( mPool->getAtlasMapCPU ( 0 ) != 0x0 ) mPool->PoolCommitAtlasMap ();
+	FinishTopology ();
+
+	if ( mbVerbose ) gprintf ( "CompactTopology: %llu elements moved.\n", moved );
+
+	if ( mbProfile ) PERF_POP ();
+}
+
+// Repack child lists
+// - Each list gets a run of its size class, in node order, so pool 1 holds no free runs.
+// - Also converts pools read from VBX files (exact-count or full-width lists) to size-class runs.
+void VolumeGVDB::RepackChildLists ( int lev )
+{
+	uint64 cnt = mPool->getPoolCnt ( 0, lev );
+	std::vector<uint64> first ( cnt+1, 0 );
+	for (uint64 n=0; n < cnt; n++ ) {
+		Node* node = getNode ( 0, lev, n );
+		bool bList = ( node->mChildList != ID_UNDEFL && !(node->mFlags & NODE_FREE) );
+		first[n+1] = first[n] + ( bList ? getChildCap ( lev, node->getNumChild() ) : 0 );
+	}
+	std::vector<uint64> lists ( first[cnt] );
+	ParallelFor ( mWorkers, cnt, [&] ( slong s, slong e ) {
+		for (slong n = s; n < e; n++ ) {
+			if ( first[n+1] == first[n] ) continue;
+			Node* node = getNode ( 0, lev, n );
+			memcpy ( &lists[ first[n] ], mPool->PoolData64 ( node->mChildList ), node->getNumChild()*sizeof(uint64) );
+			node->mChildList = Elem ( 1, lev, first[n] );
+		}
+	} );
+	mPool->PoolAssign ( 1, lev, (char*) lists.data(), first[cnt], sizeof(uint64) );
+}
+
+// Sort topology
+// - Nodes of each level are reordered by the Morton key of mPos, so nodes close in space 
+//   are close in the pools. Parent and child references are patched and child lists repacked.
+// - Atlas bricks of all channels are then permuted to follow leaf order, 
+//   so neighboring bricks are also neighbors in the atlas.
+// - Node ids and brick positions change, as with CompactTopology.
+void VolumeGVDB::SortTopology ()
+{
+	if ( RejectPaged ( "SortTopology" ) ) return;
+	if ( mRoot == ID_UNDEFL ) return;
+
+	if ( mbProfile ) PERF_PUSH ( "SortTopology" );
+
+	// Pools and atlas must be dense
+	int levs = mPool->getNumLevels ();
+	for (int lev=0; lev < levs; lev++ )
+		if ( mPool->getPoolFree(0, lev) > 0 || mPool->getPoolRunFree(1, lev) > 0 ) { CompactTopology (); break; }
+	AtlasCompact ();
+
+	// Sort each level by Morton key
+	Vector3DI range0 = getRange ( 0 );
+	std::vector< std::vector< std::pair<uint64, uint64> > > order ( levs );
+	std::atomic<bool> bValid ( true );
+	for (int lev=0; lev < levs; lev++ ) {
+		order[lev].resize ( mPool->getPoolCnt ( 0, lev ) );
+		ParallelFor ( mWorkers, order[lev].size(), [&] ( slong s, slong e ) {
+			Vector3DI b;
+			bool ok = true;
+			for (slong n = s; n < e; n++ ) {
+				b = getNode ( 0, lev, n )->mPos;
+				b.Set ( b.x / range0.x + MORTON_BIAS, b.y / range0.y + MORTON_BIAS, b.z / range0.z + MORTON_BIAS );
+				if ( b.x < 0 || b.y < 0 || b.z < 0 || b.x >= 2*MORTON_BIAS || b.y >= 2*MORTON_BIAS || b.z >= 2*MORTON_BIAS ) ok = false;
+				order[lev][n].first = mortonSpread ( b.x ) | (mortonSpread ( b.y ) << 1) | (mortonSpread ( b.z ) << 2);
+				order[lev][n].second = n;
+			}
+			if ( !ok ) bValid = false;
+		} );
+		ParallelSort ( mWorkers, order[lev] );
+	}
+	if ( !bValid ) {
+		gprintf ( "ERROR: SortTopology: node positions exceed Morton key range.\n" );
+		if ( mbProfile ) PERF_POP ();
+		return;
+	}
+
+	// Move nodes into sorted order
+	std::vector< std::vector<uint64> > remap0 ( levs );
+	for (int lev=0; lev < levs; lev++ ) {
+		uint64 cnt = order[lev].size();
+		uint64 wid = mPool->getPoolWidth ( 0, lev );
+		std::vector<char> buf ( cnt * wid );
+		remap0[lev].resize ( cnt );
+		ParallelFor ( mWorkers, cnt, [&] ( slong s, slong e ) {
+			for (slong n = s; n < e; n++ ) {
+				memcpy ( &buf[ n*wid ], getNode ( 0, lev, order[lev][n].second ), wid );
+				remap0[lev][ order[lev][n].second ] = n;
+			}
+		} );
+		mPool->PoolAssign ( 0, lev, buf.data(), cnt, wid );
+	}
+
+	// Patch references to moved nodes
+	auto remapNode = [&] ( uint64 id ) -> uint64 {
+		if ( id == ID_UNDEFL ) return id;
+		std::vector<uint64>& r = remap0[ ElemLev(id) ];
+		return ( ElemNdx(id) < r.size() ) ? Elem ( 0, ElemLev(id), r[ ElemNdx(id) ] ) : id;
+	};
+	for (int lev=0; lev < levs; lev++ ) {
+		ParallelFor ( mWorkers, mPool->getPoolCnt(0, lev), [&] ( slong s, slong e ) {
+			for (slong n = s; n < e; n++ ) {
+				Node* node = getNode ( 0, lev, n );
+				node->mParent = remapNode ( node->mParent );
+				if ( node->mChildList != ID_UNDEFL ) {
+					uint64* clist = mPool->PoolData64 ( node->mChildList );
+					int cnum = node->getNumChild ();
+					for (int i=0; i < cnum; i++ )
+						clist[i] = remapNode ( clist[i] );
+				}
+			}
+		} );
+	}
+	mRoot = remapNode ( mRoot );
+	for (int lev=1; lev < levs; lev++ )
+		RepackChildLists ( lev );		// lists follow node order
+
+	// Permute atlas bricks into leaf order
+	if ( mPool->getNumAtlas() > 0 ) {
+		uint64 bnum = mPool->getAtlas(0).num;
+		uint64 leafcnt = mPool->getPoolCnt ( 0, 0 );
+		std::vector<uint64> remap ( bnum, ID_UNDEFL );
+		std::vector<char> used ( bnum, 0 );
+		uint64 k = 0;
+		for (uint64 n=0; n < leafcnt; n++ ) {
+			Node* node = getNode ( 0, 0, n );
+			if ( node->mValue.x == -1 ) continue;
+			uint64 id = mPool->getAtlasId ( 0, node->mValue );
+			if ( id >= bnum ) continue;
+			remap[id] = k;
+			used[k] = 1;
+			node->mValue = mPool->getAtlasPos ( 0, k++ );
+		}
+		for (uint64 n=0, i=0; n < bnum; n++ ) {		// bricks without a leaf take the remaining ids
+			if ( remap[n] != ID_UNDEFL ) continue;
+			while ( used[i] ) i++;
+			remap[n] = i;
+			used[i] = 1;
+		}
+		for (int chan=0; chan < mPool->getNumAtlas(); chan++ )
+			mPool->AtlasPermute ( chan, remap );
+
+		if ( mPool->getAtlasMapCPU ( 0 ) != 0x0 ) {
+			ClearMapping ();
+			for (uint64 n=0; n < leafcnt; n++ ) {
+				Node* node = getNode ( 0, 0, n );
+				if ( node->mValue.x != -1 ) AssignMapping ( node->mValue, node->mPos, (int) n );
+			}
+			mPool->PoolCommitAtlasMap ();
+		}
+	}
+	mbDirtyBricks = true;
+	FinishTopology ();
+
+	if ( mbProfile ) PERF_POP ();
+}
+
 const char* binaryStr (uint64 x)
 {
 	static char b[65];
@@ -1734,21 +3396,32 @@ slong VolumeGVDB::InsertChild ( slong nodeid, slong childid, uint32 i )
 	Node* child = getNode ( childid );
 	child->mParent = nodeid;	// set parent of child
 
+	// ancestor ranges no longer cover the sub-tree (see UpdateRange)
+	for (slong n = nodeid; n != ID_UNDEFL && (getNode(n)->mFlags & NODE_RANGE); n = getNode(n)->mParent )
+		getNode(n)->mFlags &= ~NODE_RANGE;
+
 	// determine child bit position	
 	assert ( ! curr->isOn ( i ) );			// check if child already exists
 	uint64 p = curr->countOn ( i );
 	uint64 cnum = curr->getNumChild();		// existing children count
 	curr->setOn ( i );
+	if ( hasTiles(curr->mLev) ) getTileMask(curr)[i >> 6] &= ~(uint64(1) << (i & 63));		// child replaces tile
 
-	// add child list if doesn't exist
-	if ( curr->mChildList == ID_UNDEFL ) {
-		curr->mChildList = mPool->PoolAlloc ( 1, curr->mLev, true );		
-	}
-	uint64 max_child = mPool->getPoolWidth( 1, curr->mLev ) / sizeof(uint64);
+	uint64 max_child = getVoxCnt ( curr->mLev );
 	if ( cnum + 1 > max_child ) {
 		gprintf ( "ERROR: Number of children exceed max of %d (lev %d)\n", max_child, curr->mLev );
 		gerror ();
 	}
+	// add or grow child list to the next size class
+	uint64 cap = getChildCap ( curr->mLev, cnum );
+	if ( cnum + 1 > cap ) {
+		uint64 list = mPool->PoolAllocRun ( 1, curr->mLev, getChildCap ( curr->mLev, cnum+1 ) );
+		if ( cnum > 0 ) {
+			memcpy ( mPool->PoolData64 ( list ), mPool->PoolData64 ( curr->mChildList ), cnum*sizeof(uint64) );
+			mPool->PoolFreeRun ( curr->mChildList, cap );
+		}
+		curr->mChildList = list;
+	}
 	
 	// insert into child list
 	uint64* clist = mPool->PoolData64 ( curr->mChildList );
@@ -1765,6 +3438,75 @@ slong VolumeGVDB::InsertChild ( slong nodeid, slong childid, uint32 i )
 	return childid;
 }
 
+// Remove child from a child list
+slong VolumeGVDB::RemoveChild ( slong nodeid, uint32 i )
+{
+	Node* curr = getNode ( nodeid );
+	if ( ! curr->isOn ( i ) ) return ID_UNDEFL;	
+	uint64 p = curr->countOn ( i );
+	uint64 cnum = curr->getNumChild();		// existing children count
+	curr->setOff ( i );
+
+	// remove from child list
+	uint64* clist = mPool->PoolData64 ( curr->mChildList );
+	slong childid = *(clist + p);
+	if ( p + 1 < cnum )
+		memmove ( clist + p, clist + p+1, (cnum-p-1)*sizeof(uint64) );
+	*(clist + cnum-1) = ID_UNDEFL;
+
+	// release child list when empty, or move to a smaller size class
+	uint64 cap = getChildCap ( curr->mLev, cnum );
+	if ( cnum == 1 ) {
+		mPool->PoolFreeRun ( curr->mChildList, cap );
+		curr->mChildList = ID_UNDEFL;
+	} else if ( getChildCap ( curr->mLev, cnum-1 ) < cap ) {
+		uint64 list = mPool->PoolAllocRun ( 1, curr->mLev, getChildCap ( curr->mLev, cnum-1 ) );
+		memcpy ( mPool->PoolData64 ( list ), mPool->PoolData64 ( curr->mChildList ), (cnum-1)*sizeof(uint64) );
+		mPool->PoolFreeRun ( curr->mChildList, cap );
+		curr->mChildList = list;
+	}
+	getNode ( childid )->mParent = ID_UNDEFL;
+
+	return childid;
+}
+
+// Free node and its sub-tree
+// - Node must already be detached from its parent
+void VolumeGVDB::FreeNode ( slong nodeid )
+{
+	Node* curr = getNode ( nodeid );
+	if ( curr->mFlags & NODE_FREE ) return;
+
+	// free children
+	if ( curr->mChildList != ID_UNDEFL ) {
+		uint64* clist = mPool->PoolData64 ( curr->mChildList );
+		int cnum = curr->getNumChild();
+		for (int n=0; n < cnum; n++ )
+			FreeNode ( clist[n] );
+		mPool->PoolFreeRun ( curr->mChildList, getChildCap ( curr->mLev, cnum ) );
+		curr->mChildList = ID_UNDEFL;
+	}
+	if ( curr->mLev > 0 ) curr->clearMask ();
+	
+	// release atlas brick and mapping of leaf
+	if ( curr->mLev == 0 && curr->mValue.x != -1 ) {
+		if ( mPool->getAtlasMapCPU ( 0 ) != 0x0 ) {
+			AtlasNode* an = (AtlasNode*) mPool->getAtlasNode ( 0, curr->mValue );
+			if ( an->mLeafNode == int(ElemNdx(nodeid)) ) {
+				an->mLeafNode = ID_UNDEFL;
+				an->mPos.Set ( ID_UNDEFL, ID_UNDEFL, ID_UNDEFL );
+			}
+		}
+		if ( mPool->getNumAtlas() > 0 ) mPool->AtlasFree ( 0, curr->mValue );		// brick reused by AtlasAlloc
+		mbDirtyBricks = true;
+	}
+	curr->mFlags |= NODE_FREE;
+	curr->mValue.Set ( -1, -1, -1 );
+	curr->mParent = ID_UNDEFL;
+
+	mPool->PoolFree ( nodeid );
+}
+
 // Get child node at bit position
 slong VolumeGVDB::getChildNode ( slong nodeid, uint b )
 {
@@ -1791,167 +3533,6 @@ void VolumeGVDB::SetVoxelSize ( float vx, float vy, float vz )
 	mVoxsize.Set ( vx, vy, vz );
 }
 
-
-void VolumeGVDB::writeCube (  FILE* fp, unsigned char vpix[], slong& numfaces, int gv[], int*& vgToVert, slong vbase )
-{
-	// find absolute vert indices for this cube
-	// * map from local grid index to local vertex id, then add base index for this leaf	
-	long v[8];
-	vbase++;	// * .obj file indices are base 1;
-	v[0] = vbase + vgToVert[ gv[0] ];
-	v[1] = vbase + vgToVert[ gv[1] ];
-	v[2] = vbase + vgToVert[ gv[2] ];
-	v[3] = vbase + vgToVert[ gv[3] ];
-	v[4] = vbase + vgToVert[ gv[4] ];
-	v[5] = vbase + vgToVert[ gv[5] ];
-	v[6] = vbase + vgToVert[ gv[6] ];
-	v[7] = vbase + vgToVert[ gv[7] ];
-
-	if ( vpix[1] == 0 )	{fprintf(fp, "f %d//0 %d//0 %d//0 %d//0\n", v[1], v[2], v[6], v[5] );  numfaces++; }	// x+	
-	if ( vpix[2] == 0 ) {fprintf(fp, "f %d//1 %d//1 %d//1 %d//1\n", v[0], v[3], v[7], v[4] );  numfaces++; }	// x-
-	if ( vpix[3] == 0 ) {fprintf(fp, "f %d//2 %d//2 %d//2 %d//2\n", v[2], v[3], v[7], v[6] );  numfaces++; }	// y+
-	if ( vpix[4] == 0 ) {fprintf(fp, "f %d//3 %d//3 %d//3 %d//3\n", v[1], v[0], v[4], v[5] );  numfaces++; }	// y- 
-	if ( vpix[5] == 0 )	{fprintf(fp, "f %d//4 %d//4 %d//4 %d//4\n", v[4], v[5], v[6], v[7] );  numfaces++; }	// z+
-	if ( vpix[6] == 0 ) {fprintf(fp, "f %d//5 %d//5 %d//5 %d//5\n", v[0], v[1], v[2], v[3] );  numfaces++; }	// z-	
-}
-
-void VolumeGVDB::enableVerts ( int*& vgToVert, std::vector<Vector3DF>& verts, Vector3DF vm, int gv[] )
-{
-	if ( vgToVert[ gv[0] ] == -1) {	vgToVert[ gv[0] ] = (int) verts.size ();	verts.push_back ( vm );		}
-	if ( vgToVert[ gv[1] ] == -1) {	vgToVert[ gv[1] ] = (int) verts.size ();	verts.push_back ( vm+Vector3DF(1,0,0) ); 	}
-	if ( vgToVert[ gv[2] ] == -1) {	vgToVert[ gv[2] ] = (int) verts.size ();	verts.push_back ( vm+Vector3DF(1,1,0) ); 	}
-	if ( vgToVert[ gv[3] ] == -1) {	vgToVert[ gv[3] ] = (int) verts.size ();	verts.push_back ( vm+Vector3DF(0,1,0) ); 	}
-	if ( vgToVert[ gv[4] ] == -1) {	vgToVert[ gv[4] ] = (int) verts.size ();	verts.push_back ( vm+Vector3DF(0,0,1) ); 	}
-	if ( vgToVert[ gv[5] ] == -1) {	vgToVert[ gv[5] ] = (int) verts.size ();	verts.push_back ( vm+Vector3DF(1,0,1) ); 	}
-	if ( vgToVert[ gv[6] ] == -1) {	vgToVert[ gv[6] ] = (int) verts.size ();	verts.push_back ( vm+Vector3DF(1,1,1) ); 	}
-	if ( vgToVert[ gv[7] ] == -1) {	vgToVert[ gv[7] ] = (int) verts.size ();	verts.push_back ( vm+Vector3DF(0,1,1) ); 	}
-}
-void VolumeGVDB::setupVerts ( int gv[], Vector3DI g, int r1, int r2 )
-{
-	int g0 = (g.z*r1 + g.y)*r1 + g.x ;		// local index of first vertex
-	gv[0] = g0;
-	gv[1] = g0 + 1;
-	gv[2] = g0 + r1+1;
-	gv[3] = g0 + r1;
-	gv[4] = g0 + r2;
-	gv[5] = g0 + r2+1;
-	gv[6] = g0 + r2+r1+1;
-	gv[7] = g0 + r2+r1;
-}
-
-void VolumeGVDB::WriteObj ( char* fname )
-{
-	// Allocate CPU memory for leaf
-	/*int res0 = getRes ( 0 );	
-	Vector3DI vres0 ( res0, res0, res0 );	
-	Vector3DF vrange0 = getRange(0);
-	unsigned char* vdat = (unsigned char*) malloc ( res0*res0*res0 );
-	unsigned char vpix[8];
-	Vector3DF vmin;
-
-	FILE* fp = fopen( fname, "w");
-
-	fprintf(fp, "# Wavefront OBJ format\n\n");  
-			
-	// Output 6 normals (shared by all cubes)
-	fprintf(fp, "vn  1  0  0\n" );	// x+
-	fprintf(fp, "vn -1  0  0\n" );	// x-	
-	fprintf(fp, "vn  0  1  0\n" );	// y+
-	fprintf(fp, "vn  0 -1  0\n" );	// y-
-	fprintf(fp, "vn  0  0  1\n" );	// z+
-	fprintf(fp, "vn  0  0 -1\n" );	// z-
-
-	slong numverts = 0, numfaces = 0, numvox = 0;
-
-	// Create map from grid points to vertices
-	Vector3DI g;
-	int gv[8];
-	int r1 = (res0+1);
-	int r2 = (res0+1)*(res0+1);
-	int r3 = r2*r1;
-	int* vgToVert = (int*) malloc ( r3 * sizeof(int) );	
-	std::vector< Vector3DF >  verts;	
-
-	// Loop over every leaf in GVDB	
-	LeafNode* leaf = 0x0;
-	Vol3D* vox = 0x0;
-	gprintf ( "Write OBJ file: %s\n", fname );
-	for (int ln=0; ln < mLeaves.size(); ln++ ) {
-		gprintf ( "  Writing: %d of %d (%f%%)\n", ln, mLeaves.size(), float(ln*100.f)/mLeaves.size() );
-
-		// Get leaf
-		leaf = mLeaves[ ln ];	
-		vox = leaf->getVox( 0 );
-
-		// Transfer leaf data to CPU
-		vox->MemRetrieve ( vox->mData, vdat );
-
-		// Find all active vertices in leaf		
-		for (int n=0; n < r3; n++ ) vgToVert[n] = -1;
-		verts.clear ();
-		for (g.z=0; g.z < res0; g.z++)  {
-			for (g.y=0; g.y < res0; g.y++) {
-				for (g.x = 0; g.x < res0; g.x++) {
-					vpix[0] = *(vdat + (g.z*res0 + g.y)*res0 + g.x );
-					if ( vpix[0] > 0 ) {						
-						vmin = vox->mVolMin;				// world coordinates of leaf
-						vmin /= vrange0;					//  (reduce voxel to 1 unit size, for better rendering)
-						vmin *= vres0; 
-						vmin += g;						
-						setupVerts ( gv, g, r1, r2 );						
-						enableVerts ( vgToVert, verts, vmin, gv );
-					}
-				}
-			}
-		}
-
-		// Write vertices
-		long vbase = numverts;			// remember first vertex in this leaf 
-		fprintf ( fp, "#---- leaf: %d %lld\n", ln, vbase );
-		for (int v=0; v < verts.size(); v++ ) {			
-			fprintf(fp, "v %d %d %d\n", (int) verts[v].x, (int) verts[v].y, (int) verts[v].z );
-			numverts++;
-		}
-
-		// Write out faces from each voxel in leaf
-		int goff = 0;
-		for (g.z=0; g.z < res0; g.z++)  {
-			for (g.y=0; g.y < res0; g.y++) {
-				for (g.x = 0; g.x < res0; g.x++) {
-					goff = (g.z*res0 + g.y)*res0 + g.x;
-					vpix[0] = *(vdat + goff);					
-					if ( vpix[0] > 0 ) {
-						vpix[1] = (g.x==res0-1) ?	0 : *(vdat + goff + 1);			// x+;
-						vpix[2] = (g.x==0) ?		0 : *(vdat + goff - 1);			// x-;
-						vpix[3] = (g.y==res0-1) ?	0 : *(vdat + goff + res0);		// y+;
-						vpix[4] = (g.y==0) ?		0 : *(vdat + goff - res0);		// y-;
-						vpix[5] = (g.z==res0-1) ?	0 : *(vdat + goff + res0*res0);	// z+;
-						vpix[6] = (g.z==0) ?		0 : *(vdat + goff - res0*res0);	// z-;
-						setupVerts ( gv, g, r1, r2 );
-						writeCube ( fp, vpix, numfaces, gv, vgToVert, vbase );
-						numvox++;					
-					}
-				}
-			}
-		}
-	}
-	
-	fprintf(fp,     "# %ld voxels.\n", numvox ); 		
-	fprintf(fp,     "# %ld vertices.\n", numverts); 		
-	fprintf(fp,     "# %ld faces.\n", numfaces); 				
-	
-	gprintf ( "Write OBJ complete: %s\n", fname );
-	gprintf ( "  %lld voxels.\n", numvox ); 		
-	gprintf ( "  %lld vertices.\n", numverts); 	
-	gprintf ( "  %lld faces.\n", numfaces); 	
-
-	fclose(fp);	
-
-	// free temporary memory
-	free ( vdat );
-	free ( vgToVert );*/
-}
-
 // Validate OpenGL
 // - Set the current OpenGL context for GL operations
 void VolumeGVDB::ValidateOpenGL ()
@@ -2086,6 +3667,7 @@ void VolumeGVDB::AuxGeometryUnmap ( Model* model, int vertaux, int elemaux )
 // Activate a region of space
 int VolumeGVDB::ActivateRegion ( int lev, Extents& e )
 {
+	if ( RejectPaged ( "ActivateRegion" ) ) return 0;
 	Vector3DF pos;
 	uint64 leaf;		
 	int cnt = 0;
@@ -2104,6 +3686,7 @@ int VolumeGVDB::ActivateRegion ( int lev, Extents& e )
 // Activate a region of space from an auxiliary byte buffer
 int VolumeGVDB::ActivateRegionFromAux ( Extents& e, int auxid, uchar dt )
 {
+	if ( RejectPaged ( "ActivateRegionFromAux" ) ) return 0;
 	Vector3DF pos;
 	uint64 leaf;	
 	char* vdat = mAux[auxid].cpu;			// Get AUX data		
@@ -2207,6 +3790,7 @@ int VolumeGVDB::VoxelizeNode ( Node* node, uchar chan, Matrix4F* xform, float bd
 void VolumeGVDB::SolidVoxelize ( uchar chan, Model* model, Matrix4F* xform, uchar val_surf, uchar val_inside )
 {
 	TimerStart();
+	InvalidateRange ( chan );
 	
 	AuxGeometryMap ( model, AUX_VERTEX_BUF, AUX_ELEM_BUF );					// Setup VBO for CUDA (interop)
 	
@@ -2321,6 +3905,7 @@ void VolumeGVDB::SurfaceVoxelizeGL ( uchar chan, Model* model, Matrix4F* xform )
 	// VDB Hierarchical Rasterization
 	PERF_PUSH ( "clear" );
 	Clear ();									// creates a new root
+	InvalidateRange ( chan );
 	PERF_POP ();
 
 	// Configure model
@@ -2505,6 +4090,7 @@ void VolumeGVDB::Measure ( statVec& stats, slong nodeid )
 		stats[l].mem_node += (slong) sizeof(Node);
 		stats[l].mem_mask = 0;
 		stats[l].mem_compact = 0;
+		stats[l].mem_alloc = 0;
 		stats[l].mem_full = 0;
 		stats[l].num++;
 	} else {
@@ -2514,6 +4100,7 @@ void VolumeGVDB::Measure ( statVec& stats, slong nodeid )
 		stats[l].mem_node += (slong) sizeof(Node);
 		stats[l].mem_mask += (slong) node->getMaskBytes();
 		stats[l].mem_compact += (slong) node->getNumChild()*sizeof(uint64);
+		stats[l].mem_alloc += (slong) getChildCap(l, node->getNumChild())*sizeof(uint64);
 		stats[l].mem_full += (slong) node->getMaskBytes()*8 * sizeof(uint64);
 		stats[l].num++;				
 		for (int n=0; n < node->getNumChild(); n++ ) {			
@@ -2541,6 +4128,7 @@ void VolumeGVDB::Measure ( bool bPrint )
 {	
 	float tuse_nodes=0, tuse_masks=0, tuse_full=0, tuse_compact=0;
 	float tmax_nodes=0, tmax_masks=0, tmax_full=0, tmax_compact=0;
+	float tfree_full=0;
 	int	node_total = 0, node_max = 0, ave_child, max_child;
 	Vector3DI axisres, axiscnt;
 	int leafdim;
@@ -2576,13 +4164,14 @@ void VolumeGVDB::Measure ( bool bPrint )
 		tuse_nodes += stats[n].num * sizeof(Node);
 		tuse_masks += stats[n].num * (mPool->getPoolWidth(0, n) - sizeof(Node));
 		tuse_compact += stats[n].mem_compact;
-		tuse_full += stats[n].mem_full;
+		tuse_full += stats[n].mem_alloc;
 		
 		// nodes in memory		
 		node_max += mPool->getPoolMax(0, n);
 		tmax_nodes += mPool->getPoolMax(0, n) * sizeof(Node);
 		tmax_masks += mPool->getPoolMax(0, n) * (mPool->getPoolWidth(0, n) - sizeof(Node));
-		tmax_full  += mPool->getPoolMax(0, n) * mPool->getPoolWidth(1,n);
+		tmax_full  += mPool->getPoolSize(1, n);
+		tfree_full += float(mPool->getPoolRunFree(1, n)) * mPool->getPoolWidth(1, n);		// freed child list runs
 		
 		// child averages
 		ave_child = int(stats[n].mem_compact / (stats[n].num*sizeof(uint64)) );
@@ -2618,7 +4207,7 @@ void VolumeGVDB::Measure ( bool bPrint )
 		gprintf ( "  MEMORY USAGE:\n");
 		gprintf ( "   Topology Nodes:    %6.2f MB (%6.2f MB active)\n", tmax_nodes/MB, tuse_nodes/MB);
 		gprintf ( "   Topology Bitmasks: %6.2f MB (%6.2f MB active)\n", tmax_masks/MB, tuse_masks/MB);
-		gprintf ( "   Topology Pointers: %6.2f MB (%6.2f MB active)\n", tmax_full/MB,  tuse_full/MB);
+		gprintf ( "   Topology Pointers: %6.2f MB (%6.2f MB active, %6.2f MB used, %6.2f MB free)\n", tmax_full/MB,  tuse_full/MB, tuse_compact/MB, tfree_full/MB);
 		gprintf ( "   Topology Total:    %6.2f MB (%6.2f MB active)\n", (tmax_nodes+tmax_masks+tmax_full)/MB, (tuse_nodes+tuse_masks+tuse_full)/MB );
 		gprintf ( "   Atlas:\n" );		
 		int bpv;
@@ -2685,6 +4274,9 @@ void VolumeGVDB::PrepareVDB ()
 		mVDBInfo.bmax				= mObjMax;
 		mVDBInfo.thresh				= getScene()->mVThreshold;
 		mVDBInfo.transfer			= getTransferFuncGPU();
+		mVDBInfo.brick_req			= ( mCache != 0x0 ) ? mAux[AUX_BRICKREQ].gpu : 0;
+		mVDBInfo.tile_offs			= hasTiles(1) ? int( mPool->getPoolWidth(0, 1) - getTileSize(1) ) : 0;
+		if ( mbCPU ) return;			// host kernels read VDB info directly
 		if ( mVDBInfo.transfer == 0 ) {
 			gprintf ( "Error: Transfer function not on GPU. Must call CommitTransferFunc.\n" );
 			gerror ();
@@ -2694,6 +4286,19 @@ void VolumeGVDB::PrepareVDB ()
 	}		
 }
 
+// Node range skipping for the next render
+// - Needs current channel 0 ranges (UpdateRange) and a shading mode with a known visible span
+void VolumeGVDB::PrepareRangeSkip ( char shading )
+{
+	Vector3DF skip = getScene()->getSkipRange ( shading );
+	if ( mRangeChan != 0 ) skip.z = 0;
+	Vector3DF& curr = mVDBInfo.range_skip;
+	if ( skip.x != curr.x || skip.y != curr.y || skip.z != curr.z ) {
+		curr = skip;
+		mVDBInfo.update = true;
+	}
+}
+
 
 bool glCheck()
 {
@@ -2872,6 +4477,11 @@ void VolumeGVDB::ResizeRenderBuf ( int chan, int width, int height, int byteperp
 	if ( chan == 0 ) getScene()->SetRes ( width, height );
 	
 	size_t sz = mRenderBuf[chan].size;
+	if ( mbCPU ) {
+		// host device renders directly into cpu memory
+		mRenderBuf[chan].cpu = (char*) realloc ( mRenderBuf[chan].cpu, sz );
+		return;
+	}
 	if ( mRenderBuf[chan].gpu != 0x0 ) { 
 		cudaCheck ( cuMemFree ( mRenderBuf[chan].gpu ), "cuMemFree", "ResizeRenderBuf" ); 
 	}
@@ -2890,6 +4500,11 @@ void VolumeGVDB::ResizeRenderBuf ( int chan, int width, int height, int byteperp
 void VolumeGVDB::ReadRenderBuf ( int chan, unsigned char* outptr )
 {
 	if ( mbVerbose ) PERF_PUSH ( "ReadBuf" );
+	if ( mbCPU ) {
+		memcpy ( outptr, mRenderBuf[chan].cpu, mRenderBuf[chan].size );
+		if ( mbVerbose ) PERF_POP ();
+		return;
+	}
 	mRenderBuf[chan].cpu = (char*) outptr;
 	mPool->RetrieveMem ( mRenderBuf[chan] );		// transfer dev to host
 	if ( mbVerbose ) PERF_POP ();
@@ -2929,6 +4544,7 @@ void VolumeGVDB::PrepareRender ( int w, int h, char shading, char filtering, int
 	mScnInfo.outbuf		= -1;			// NOT USED  (was mRenderBuf[0].gpu;)
 	mScnInfo.dbuf 		= dbuf == 255 ? NULL : mRenderBuf[dbuf].gpu;
 
+	if ( mbCPU ) return;				// host raycaster reads mScnInfo directly
 	cudaCheck ( cuMemcpyHtoD ( cuScnInfo, &mScnInfo, sizeof(ScnInfo) ), "cuMemcpyHtoD(ScnInfo)", "PrepareRender" );
 }
 
@@ -2942,6 +4558,7 @@ void VolumeGVDB::RenderKernel ( uchar rbuf, CUfunction user_kernel, char shading
 
 	// Send Scene info (camera, lights)
 	PrepareRender ( width, height, shading, filtering, frame, max_samples, samt );
+	PrepareRangeSkip ( SHADE_OFF );								// user brick functions are unknown, no range skipping
 
 	// Send VDB Info & Atlas
 	PrepareVDB ();												
@@ -2961,6 +4578,7 @@ void VolumeGVDB::Render ( uchar rbuf, char shading, char filtering, int frame, i
 	int width = mRenderBuf[rbuf].stride;
 	int height = mRenderBuf[rbuf].max / width;	
 	if ( shading==SHADE_OFF ) {
+		if ( mbCPU ) { memset ( mRenderBuf[rbuf].cpu, 0, width*height*4 ); return; }
 		cudaCheck ( cuMemsetD8 ( mRenderBuf[rbuf].gpu, 0, width*height*4 ), "cuMemsetD8", "Render" );
 		return;
 	}
@@ -2969,10 +4587,17 @@ void VolumeGVDB::Render ( uchar rbuf, char shading, char filtering, int frame, i
 
 	// Send Scene info (camera, lights)
 	PrepareRender ( width, height, shading, filtering, frame, max_samples, samt, dbuf );
+	PrepareRangeSkip ( (mScnInfo.dbuf != 0) ? SHADE_TRILINEAR : shading );		// depth buffered surfaces always test thresh.x
 
 	// Send VDB Info & Atlas
 	PrepareVDB ();												
 
+	if ( mbCPU ) {
+		RenderCPU ( rbuf, shading );
+		if (mbProfile) PERF_POP ();
+		return;
+	}
+
 	// Prepare kernel
 	Vector3DI block ( 8, 8, 1);
 	Vector3DI grid ( int(width/block.x)+1, int(height/block.y)+1, 1);		
@@ -3005,10 +4630,17 @@ void VolumeGVDB::Raytrace ( DataPtr rays, char shading, int frame, float bias )
 
 	// Send scene data
 	PrepareRender ( 1, 1, shading, 0, frame, 1, 0 );
+	PrepareRangeSkip ( SHADE_TRICUBIC );						// rays are traced with tricubic bricks
 
 	// Send VDB Info & Atlas
 	PrepareVDB ();												
 
+	if ( mbCPU ) {
+		RaytraceCPU ( rays, bias );
+		if (mbProfile) PERF_POP ();
+		return;
+	}
+
 	// Run CUDA GVDB Raytracer
 	int cnt = rays.num;
 	Vector3DI block ( 64, 1, 1);
@@ -3036,6 +4668,13 @@ void VolumeGVDB::UpdateApron ( uchar chan )
 
 	// Send VDB Info	
 	PrepareVDB ();			
+	InvalidateRange ( chan );		// aprons are part of brick ranges
+
+	if ( mbCPU ) {
+		UpdateApronCPU ( chan );
+		if ( mbProfile ) PERF_POP ();
+		return;
+	}
 
 	// Determine grid and block dims
 	Vector3DI atlasres = mPool->getAtlasRes( chan );		// size of atlas
@@ -3068,6 +4707,10 @@ void VolumeGVDB::UpdateApron ( uchar chan )
 // Run a custom user compute kernel
 void VolumeGVDB::ComputeKernel ( CUmodule user_module, CUfunction user_kernel, uchar chan, bool bUpdateApron )
 {
+	if ( mbCPU ) {
+		gprintf ( "ERROR: ComputeKernel. User kernels require a CUDA device.\n" );
+		return;
+	}
 	if ( mbProfile ) PERF_PUSH ("ComputeKernel");
 
 	SetModule ( user_module );
@@ -3075,6 +4718,9 @@ void VolumeGVDB::ComputeKernel ( CUmodule user_module, CUfunction user_kernel, u
 	// Send VDB Info (*to user module*)
 	PrepareVDB ();
 
+	if ( mCache != 0x0 ) mCache->MarkResidentDirty ();		// kernel may write any resident brick
+	InvalidateRange ( chan );
+
 	// Determine grid and block dims (must match atlas bricks)	
 	Vector3DI block ( 8, 8, 8 );
 	Vector3DI res = mPool->getAtlasRes( chan );
@@ -3097,13 +4743,31 @@ void VolumeGVDB::Compute ( int effect, uchar chan, int iter, Vector3DF parm, boo
 { 
 	if ( mbProfile ) PERF_PUSH ("Compute");
 
+	// Active bricks (rebuilt after topology changes)
+	UpdateBrickList ();
+
 	// Send VDB Info	
 	PrepareVDB ();
 
-	// Determine grid and block dims (must match atlas bricks)	
+	if ( mCache != 0x0 ) mCache->MarkResidentDirty ();		// operators write resident bricks
+	InvalidateRange ( chan );
+
+	if ( mbCPU ) {
+		for (int n=0; n < iter; n++ ) {
+			ComputeCPU ( effect, chan, parm );
+			if ( bUpdateApron ) UpdateApron ( chan );		// update the apron
+		}
+		if ( mbProfile ) PERF_POP();
+		return;
+	}
+	if ( mVDBInfo.brick_cnt == 0 ) { if ( mbProfile ) PERF_POP(); return; }
+
+	// Determine grid and block dims
+	// - One grid.x entry per active brick, grid.y and grid.z tile larger bricks in 8^3 blocks
 	Vector3DI block ( 8, 8, 8 );
 	Vector3DI res = mPool->getAtlasRes( chan );
-	Vector3DI grid ( int(res.x/block.x)+1, int(res.y/block.y)+1, int(res.z/block.z)+1 );	
+	int sub = (mPool->getAtlasBrickres( chan ) + block.x-1) / block.x;
+	Vector3DI grid ( mVDBInfo.brick_cnt, sub*sub, sub );
 
 	void* args[5] = { &res, &chan, &parm.x, &parm.y, &parm.z };	
 	
@@ -3119,6 +4783,14 @@ void VolumeGVDB::Resample ( uchar chan, Matrix4F xform, Vector3DI in_res, char i
 {
 	PrepareVDB ();
 
+	if ( mCache != 0x0 ) mCache->MarkResidentDirty ();
+	InvalidateRange ( chan );
+
+	if ( mbCPU ) {
+		ResampleCPU ( chan, xform, in_res, in_aux, inr, outr );
+		return;
+	}
+
 	// Determine grid and block dims (must match atlas bricks)	
 	Vector3DI block ( 8, 8, 8 );
 	Vector3DI res = mPool->getAtlasRes( chan );
@@ -3134,6 +4806,216 @@ void VolumeGVDB::Resample ( uchar chan, Matrix4F xform, Vector3DI in_res, char i
 
 }
 
+// Value range pyramid
+// - Leaves without NODE_RANGE (all leaves with bAll or a new channel) get min, max over the 
+//   whole brick, apron included since filtered samples reach it, and the mean of the interior.
+// - Interior nodes above updated leaves take the union of their children, and keep NODE_RANGE
+//   only when every child has one, so a flagged node bounds its whole sub-tree.
+// - Paged leaves which are not resident keep the range of their last residency.
+void VolumeGVDB::UpdateRange ( uchar chan, bool bAll )
+{
+	if ( chan >= mPool->getNumAtlas() ) return;
+	DataPtr atlas = mPool->getAtlas ( chan );
+	if ( atlas.type != T_FLOAT && atlas.type != T_UCHAR ) {
+		gprintf ( "ERROR: UpdateRange requires a float or uchar channel.\n" );
+		return;
+	}
+	if ( mbProfile ) PERF_PUSH ( "UpdateRange" );
+	if ( chan != mRangeChan ) bAll = true;
+
+	// Leaves to update
+	int apron = atlas.apron;
+	std::vector<uint64> dirty;
+	std::vector<Vector3DI> bricks;
+	uint64 cnt = mPool->getPoolCnt ( 0, 0 );
+	for (uint64 n=0; n < cnt; n++ ) {
+		Node* node = getNode ( 0, 0, n );
+		if ( (node->mFlags & NODE_FREE) || (!bAll && (node->mFlags & NODE_RANGE)) ) continue;
+		if ( node->mValue.x == -1 ) { node->mFlags &= ~NODE_RANGE; continue; }		// no brick
+		dirty.push_back ( n );
+		bricks.push_back ( Vector3DI ( node->mValue.x - apron, node->mValue.y - apron, node->mValue.z - apron ) );
+	}
+
+	// Reduce bricks
+	int bcnt = (int) bricks.size();
+	std::vector<Vector3DF> vr ( bcnt );
+	if ( bcnt > 0 ) {
+		if ( mbCPU ) {
+			ComputeRangeCPU ( chan, bcnt, &bricks[0], &vr[0] );
+		} else {
+			PrepareVDB ();
+			PrepareAux ( AUX_RANGE, 2*bcnt, sizeof(Vector3DF), false, true );		// bricks, then ranges
+			memcpy ( mAux[AUX_RANGE].cpu, &bricks[0], bcnt*sizeof(Vector3DI) );
+			CommitData ( mAux[AUX_RANGE] );
+			int bres = mPool->getAtlasBrickres ( chan );
+			bool bFloat = ( atlas.type == T_FLOAT );
+			CUdeviceptr out = mAux[AUX_RANGE].gpu + bcnt*sizeof(Vector3DI);
+			void* args[7] = { &bcnt, &mAux[AUX_RANGE].gpu, &chan, &bres, &apron, &bFloat, &out };
+			cudaCheck ( cuLaunchKernel ( cuFunc[FUNC_RANGE], bcnt, 1, 1, 8, 8, 8, 0, NULL, args, NULL ), "cuLaunch(Range)", "UpdateRange" );
+			RetrieveData ( mAux[AUX_RANGE] );
+			float* rng = (float*) (mAux[AUX_RANGE].cpu + bcnt*sizeof(Vector3DI));
+			for (int n=0; n < bcnt; n++ )
+				vr[n].Set ( rng[n*3], rng[n*3+1], rng[n*3+2] );
+		}
+	}
+	for (int n=0; n < bcnt; n++ ) {
+		Node* node = getNode ( 0, 0, dirty[n] );
+		node->mVRange = vr[n];
+		node->mFlags |= NODE_RANGE;
+	}
+
+	// Propagate to parents, level by level
+	int levs = mPool->getNumLevels ();
+	for (int lev=1; lev < levs; lev++ ) {
+		std::vector<uint64> parents;
+		if ( bAll ) {
+			parents.resize ( mPool->getPoolCnt ( 0, lev ) );
+			for (uint64 n=0; n < parents.size(); n++ ) parents[n] = n;
+		} else {
+			for (uint64 n=0; n < dirty.size(); n++ ) {
+				slong p = getNode ( 0, lev-1, dirty[n] )->mParent;
+				if ( p != ID_UNDEFL ) parents.push_back ( ElemNdx ( p ) );
+			}
+			std::sort ( parents.begin(), parents.end() );
+			parents.erase ( std::unique ( parents.begin(), parents.end() ), parents.end() );
+		}
+		bool bTiles = hasTiles ( lev );
+		uint64 words = getMaskSize ( lev ) / sizeof(uint64);
+		for (uint64 n=0; n < parents.size(); n++ ) {
+			slong nodeid = Elem ( 0, lev, parents[n] );
+			Node* node = getNode ( nodeid );
+			if ( node->mFlags & NODE_FREE ) continue;
+			int nc = node->getNumChild ();
+			Vector3DF r ( 1.0e20f, -1.0e20f, 0 );
+			bool bValid = ( nc > 0 );
+			for (int c=0; c < nc && bValid; c++ ) {
+				Node* child = getNode ( getChildNode ( nodeid, c ) );
+				bValid = ( child->mFlags & NODE_RANGE ) != 0;
+				if ( child->mVRange.x < r.x ) r.x = child->mVRange.x;
+				if ( child->mVRange.y > r.y ) r.y = child->mVRange.y;
+				r.z += child->mVRange.z;
+			}
+			if ( bTiles && (bValid || nc == 0) ) {			// tiles count as children of their value
+				uint64* tmask = getTileMask ( node );
+				uint64* mask = node->getMask ();
+				float* tval = getTileValues ( node );
+				for (uint64 w=0; w < words; w++ ) {
+					for (uint64 bits = tmask[w] & ~mask[w]; bits != 0; bits &= bits-1 ) {
+						float v = tval[ w*64 + node->firstBitOn ( bits ) ];
+						if ( v < r.x ) r.x = v;
+						if ( v > r.y ) r.y = v;
+						r.z += v;
+						nc++;
+					}
+				}
+				bValid = ( nc > 0 );
+			}
+			if ( bValid ) {
+				r.z /= nc;
+				node->mVRange = r;
+				node->mFlags |= NODE_RANGE;
+			} else {
+				node->mFlags &= ~NODE_RANGE;
+			}
+		}
+		dirty.swap ( parents );
+	}
+	for (int lev=0; lev < levs; lev++ )
+		mPool->PoolCommit ( 0, lev );
+
+	mRangeChan = chan;
+	if ( mbProfile ) PERF_POP ();
+}
+
+// Prune background
+// - Leaves whose whole brick, apron included, lies within 'tolerance' of 'background' in 
+//   channel 'chan' are deactivated. This frees their atlas bricks in all channels and their
+//   pool nodes, and removes parents left empty. Ranges come from UpdateRange.
+// - The atlas is then compacted and shrunk to the live bricks, so SaveVBX writes fewer bricks.
+// - Leaves are classified in parallel, each range into its own list, merged in leaf order.
+// - Constant leaves of other values (range within 2*tolerance) become tiles of their parent, 
+//   holding the average value, when level 1 has room for tiles (SetTileValues) and the volume
+//   has a single float channel and no color channel. Otherwise they keep their bricks.
+// - Returns the number of leaves removed, including those collapsed to tiles.
+int VolumeGVDB::PruneBackground ( uchar chan, float tolerance, float background )
+{
+	if ( RejectPaged ( "PruneBackground" ) ) return 0;
+	if ( mRoot == ID_UNDEFL ) return 0;
+
+	UpdateRange ( chan );
+	if ( mRangeChan != chan ) return 0;			// channel has no ranges
+
+	if ( mbProfile ) PERF_PUSH ( "PruneBackground" );
+
+	// Find background leaves
+	slong cnt = mPool->getPoolCnt ( 0, 0 );
+	int ranges = mWorkers.getNumThreads ();
+	slong step = (cnt + ranges - 1) / ranges;
+	// Tiles hold one float, read by raycast, apron and mesher as channel 0. Other channels and 
+	// the color channel would lose their bricks, so collapse only a single float channel.
+	bool bTiles = hasTiles ( 1 ) && mPool->getNumAtlas() == 1 && mPool->getAtlas(0).type == T_FLOAT && mVDBInfo.clr_chan == CHAN_UNDEF;
+	if ( hasTiles ( 1 ) && !bTiles )
+		gprintf ( "WARNING: PruneBackground, tiles need a single float channel and no color channel. Constant leaves keep their bricks.\n" );
+	std::vector< std::vector<slong> > found ( ranges ), found_tiles ( ranges );
+	std::vector<int> found_uniform ( ranges, 0 );
+	ParallelFor ( mWorkers, ranges, [&] ( slong s, slong e ) {
+		for (slong r = s; r < e; r++ ) {
+			slong last = std::min ( (r+1)*step, cnt );
+			for (slong n = r*step; n < last; n++ ) {
+				Node* node = getNode ( 0, 0, n );
+				if ( (node->mFlags & NODE_FREE) || node->mValue.x == -1 || !(node->mFlags & NODE_RANGE) ) continue;
+				if ( node->mVRange.x >= background - tolerance && node->mVRange.y <= background + tolerance )
+					found[r].push_back ( Elem ( 0, 0, n ) );
+				else if ( node->mVRange.y - node->mVRange.x <= 2*tolerance ) {
+					found_uniform[r]++;
+					if ( bTiles && node->mParent != ID_UNDEFL ) found_tiles[r].push_back ( Elem ( 0, 0, n ) );
+				}
+			}
+		}
+	} );
+	std::vector<slong> prune;
+	int uniform = 0, tiles = 0;
+	for (int r=0; r < ranges; r++ ) {
+		prune.insert ( prune.end(), found[r].begin(), found[r].end() );
+		uniform += found_uniform[r];
+	}
+
+	// Collapse constant leaves into tiles of their parent. The tile is set first, so the parent is kept.
+	for (int r=0; r < ranges; r++ ) {
+		for (size_t n=0; n < found_tiles[r].size(); n++ ) {
+			slong leafid = found_tiles[r][n];
+			Node* leaf = getNode ( leafid );
+			slong parent = leaf->mParent;
+			uint32 b;
+			getPosInNode ( parent, leaf->mPos, b );
+			Node* pnode = getNode ( parent );
+			getTileMask(pnode)[b >> 6] |= uint64(1) << (b & 63);
+			getTileValues(pnode)[b] = leaf->mVRange.z;
+			DeactivateNode ( leafid );
+			tiles++;
+		}
+	}
+
+	// Remove leaves, then compact and shrink atlas
+	for (size_t n=0; n < prune.size(); n++ )
+		DeactivateNode ( prune[n] );
+	int removed = (int) prune.size() + tiles;
+
+	if ( removed > 0 ) {
+		AtlasCompact ();
+		uint64 bricks = mPool->getAtlas(0).num;
+		for (int n=0; n < mPool->getNumAtlas(); n++ )
+			mPool->AtlasResize ( n, (bricks > 0) ? bricks : 1 );
+		UpdateAtlas ();
+		FinishTopology ();
+	}
+	gprintf ( "PruneBackground: %d leaves removed, %d of %d constant leaves collapsed to tiles, %llu bricks in use.\n", (int) prune.size(), tiles, uniform, mPool->getAtlas(0).num );
+
+	if ( mbProfile ) PERF_POP ();
+
+	return removed;
+}
+
 float VolumeGVDB::getValue ( slong nodeid, Vector3DF pos, float* atlas )
 {
 	// Recurse to find value
@@ -3149,6 +5031,7 @@ float VolumeGVDB::getValue ( slong nodeid, Vector3DF pos, float* atlas )
 
 		if ( isLeaf ( nodeid ) ) {
 			
+			if ( mCache != 0x0 && !mCache->Touch ( ElemNdx(nodeid) ) ) return 0;		// brick not resident, requested
 			Vector3DF atlaspos = curr->mValue;
 			Vector3DI atlasres = mPool->getAtlasRes( 0 );
 			p += atlaspos;
@@ -3164,6 +5047,7 @@ float VolumeGVDB::getValue ( slong nodeid, Vector3DF pos, float* atlas )
 				childid = getChildNode ( nodeid, b );
 				return getValue ( childid, pos, atlas );
 			}			
+			if ( isTile ( curr, i ) ) return getTileValues(curr)[i];
 		}
 	} 
 	return 0.0;	
@@ -3269,16 +5153,57 @@ void VolumeGVDB::SetSupportPoints ( DataPtr pntpos, DataPtr dirpos )
 	mAux[AUX_PNTDIR] = dirpos;
 }
 
+// Aux buffers are scratch memory. Capacity is kept between calls and only grows,
+// so repeated kernels with similar counts do not reallocate. See BeginFrame/EndFrame.
 void VolumeGVDB::PrepareAux ( int id, int cnt, int stride, bool bZero, bool bCPU )
 {
-	if ( mAux[id].num < cnt || mAux[id].stride != stride ) {
-		mPool->CreateMemLinear ( mAux[id], 0x0, stride, cnt, bCPU );
+	if ( mPool->ReserveMemLinear ( mAux[id], stride, cnt, bCPU ) ) {
+		mAuxAllocs++;
+		mAuxAllocsTotal++;
 	}
-	if ( bZero ) {
+	if ( mAux[id].size > mAuxFramePeak[id] ) mAuxFramePeak[id] = mAux[id].size;
+
+	if ( bZero && mAux[id].size > 0 ) {
+		if ( mbCPU ) { memset ( mAux[id].cpu, 0, mAux[id].size ); return; }
 		cudaCheck ( cuMemsetD8 ( mAux[id].gpu, 0, mAux[id].size ), "cuMemsetD8", "PrepareAux" );
 	}
 }
 
+void VolumeGVDB::BeginFrame ()
+{
+	for (int n=0; n < MAX_AUX; n++ ) mAuxFramePeak[n] = 0;
+	mAuxAllocs = 0;
+}
+
+void VolumeGVDB::EndFrame ( bool bTrim )
+{
+	uint64 peak = getAuxFramePeak ();
+	if ( peak > mAuxPeakTotal ) mAuxPeakTotal = peak;
+
+	if ( bTrim ) {
+		for (int n=0; n < MAX_AUX; n++ ) {
+			if ( n == AUX_BRICKS || n == AUX_BRICKREQ ) continue;				// persistent, contents live across frames
+			if ( mAuxFramePeak[n] > 0 && mAuxFramePeak[n] < mAux[n].cap )		// only buffers used as scratch this frame
+				mPool->TrimMemLinear ( mAux[n], mAuxFramePeak[n] );
+		}
+	}
+	if ( mbVerbose ) gprintf ( "  Aux scratch: %llu bytes held, %llu frame peak, %d allocs\n", getAuxCapacity(), peak, mAuxAllocs );
+}
+
+uint64 VolumeGVDB::getAuxCapacity ()
+{
+	uint64 sz = 0;
+	for (int n=0; n < MAX_AUX; n++ ) sz += mAux[n].cap;
+	return sz;
+}
+
+uint64 VolumeGVDB::getAuxFramePeak ()
+{
+	uint64 sz = 0;
+	for (int n=0; n < MAX_AUX; n++ ) sz += mAuxFramePeak[n];
+	return sz;
+}
+
 void VolumeGVDB::InsertPoints ( int num_pnts, Vector3DF trans, bool bPrefix )
 {
 	if ( mbProfile ) PERF_PUSH ( "InsertPoints");
@@ -3291,7 +5216,17 @@ void VolumeGVDB::InsertPoints ( int num_pnts, Vector3DF trans, bool bPrefix )
 	PrepareAux ( AUX_PNODE, num_pnts, sizeof(int), false );			// node which each point falls into
 	PrepareAux ( AUX_PNDX,  num_pnts, sizeof(int), false );			// index of the point inside that node
 	PrepareAux ( AUX_GRIDCNT, bricks, sizeof(int), true );			// number of points in each brick cell
+	if ( bPrefix && mbCPU ) {
+		PrepareAux ( AUX_GRIDOFF, bricks, sizeof(int), false );
+		PrepareAux ( AUX_PNTSORT, num_pnts, sizeof(Vector3DF), false );
+	}
 	if ( mbProfile ) PERF_POP();
+
+	if ( mbCPU ) {
+		InsertPointsCPU ( num_pnts, trans, bPrefix );
+		if ( mbProfile ) PERF_POP();	// InsertParticles
+		return;
+	}
 	
 	// Insert particles
 	if ( mbProfile ) PERF_PUSH ( "Insert kernel");
@@ -3365,6 +5300,7 @@ void VolumeGVDB::GatherPointDensity ( int num_pnts, float radius, int chan )
 
 	// Send VDB Info	
 	PrepareVDB ();
+	InvalidateRange ( chan );
 
 	// Gather Point Density
 
@@ -3390,19 +5326,26 @@ void VolumeGVDB::ScatterPointDensity ( int num_pnts, float radius, float amp, Ve
 	uint num_voxels; 
 
 	PrepareVDB ();	
+	InvalidateRange ( 0 );
 
 	// Splat particles
 	if ( mbProfile ) PERF_PUSH ( "ScatterPointDensity");
 	int threads = 256;		
 	int pblks = int(num_pnts / threads)+1;	
 	
-    if (mAux[AUX_PNTCLR].gpu != NULL && avgColor) {
+    if ( (mAux[AUX_PNTCLR].gpu != NULL || (mbCPU && mAux[AUX_PNTCLR].cpu != 0x0)) && avgColor) {
 		Vector3DI brickResVec = getRes3DI(0);
 		num_voxels = brickResVec.x * brickResVec.y * brickResVec.z * getNumNodes(0);
 		if (mbProfile) PERF_PUSH("Prepare Aux");
 		PrepareAux(AUX_COLAVG, 4 * num_voxels, sizeof(uint), true);					// node which each point falls into
 		if (mbProfile) PERF_POP();
     }
+
+	if ( mbCPU ) {
+		ScatterPointDensityCPU ( num_pnts, radius, amp, trans, expand, avgColor );
+		if ( mbProfile ) PERF_POP ();
+		return;
+	}
 	
 	void* args[13] = { &num_pnts, &radius, &amp, &mAux[AUX_PNTPOS].gpu, &mAux[AUX_PNTPOS].subdim.x, &mAux[AUX_PNTPOS].stride, &mAux[AUX_PNTCLR].gpu, &mAux[AUX_PNTCLR].subdim.x, &mAux[AUX_PNTCLR].stride, &mAux[AUX_PNODE].gpu, &trans.x, &expand, &mAux[AUX_COLAVG].gpu };
 	cudaCheck ( cuLaunchKernel ( cuFunc[FUNC_SCATTER_DENSITY], pblks, 1, 1, threads, 1, 1, 0, NULL, args, NULL ), "cuLaunch(SPLAT)", "SplatPoints" );
@@ -3420,6 +5363,7 @@ void VolumeGVDB::ScatterPointDensity ( int num_pnts, float radius, float amp, Ve
 void VolumeGVDB::AddSupportVoxel ( int num_pnts, float radius, float offset, float amp, Vector3DF trans, bool expand, bool avgColor )
 {
 	PrepareVDB ();	
+	InvalidateRange ( 0 );
 
 	// Splat particles
 	if ( mbProfile ) PERF_PUSH ( "AddSupportVoxel");
@@ -26,6 +26,7 @@
 	#include "gvdb_node.h"	
 	#include "gvdb_volume_base.h"
 	#include "gvdb_allocator.h"		
+	#include "gvdb_parallel.h"
 	using namespace nvdb;
 
 	#ifdef BUILD_OPENVDB
@@ -51,25 +52,32 @@
 	#endif
 
 	#define MAXLEV			10
+	#define CHILD_MIN		4			// smallest child list size class (pool 1 elements)
 
 	class OVDBGrid;
 	class Volume3D;
+	struct VBXReader;
 
 	namespace nvdb {
 
+	class BrickCache;
+	class ValueAccessor;
+	struct ActivateState;
+
 	struct AtlasNode {
 		Vector3DI	mPos;	
 		int			mLeafNode;
 	};
 
 	struct Stat {
-		Stat ()	{ num=0; cover=0; occupy=0; mem_node=0; mem_mask=0; mem_compact=0; mem_full=0;}
+		Stat ()	{ num=0; cover=0; occupy=0; mem_node=0; mem_mask=0; mem_compact=0; mem_alloc=0; mem_full=0;}
 		slong	num;			// number of nodes at this level
 		slong	cover;			// total coverage of all nodes (addressable bits)
 		slong	occupy;			// number of set bits (occupied bits)
 		slong	mem_node;		// memory used 
 		slong	mem_mask;
-		slong	mem_compact;
+		slong	mem_compact;	// child entries in use
+		slong	mem_alloc;		// child list runs allocated (size class, see getChildCap)
 		slong	mem_full;
 	};
 	typedef std::vector<Stat>	statVec;
@@ -98,6 +106,11 @@
 		Vector3DF	bmax;
 		Vector3DF	thresh;
 		CUdeviceptr transfer;		
+		CUdeviceptr	brick_list;				// active bricks (Vector3DI brick origin in atlas)
+		int			brick_cnt;
+		CUdeviceptr	brick_req;				// paged atlas: per-leaf flags, 1 = requested, 2 = used (0 if not paged)
+		Vector3DF	range_skip;				// skip nodes with value range outside x..y, when z != 0 (see UpdateRange)
+		int			tile_offs;				// offset of the tile mask in level 1 nodes, 0 if no tiles (see hasTiles)
 	};
 
 	struct ALIGN(16) ScnInfo {
@@ -176,6 +189,7 @@
 	#define FUNC_GROW				155
 	#define FUNC_CLR_EXPAND			156
 	#define FUNC_EXPANDC			157
+	#define FUNC_RANGE				158		// value range of bricks
 
 	#define MAX_FUNC				255
 
@@ -205,6 +219,9 @@
 	#define AUX_PNTDIR				16
 	#define AUX_DATA3D				17
 	#define AUX_MATRIX4F			18
+	#define AUX_BRICKS				19
+	#define AUX_BRICKREQ			20
+	#define AUX_RANGE				21
 
 	#define MAX_AUX					64
 		
@@ -229,11 +246,15 @@
 
 	
 	class GVDB_API VolumeGVDB : public VolumeBase {
+	friend class ValueAccessor;
 	public:
 			VolumeGVDB ();			
+			~VolumeGVDB ();
 			
 			// Setup
 			void SetCudaDevice ( int devid );
+			void SetCPUDevice ( int threads = 0 );			// host reference backend (no CUDA). threads=0, all cores
+			bool isCPUDevice ()		{ return mbCPU; }
 			void Initialize ();			
 			void Clear ();	
 			void SetVoxelSize ( float vx, float vy, float vz );
@@ -255,14 +276,30 @@
 			void ComputeKernel ( CUmodule user_module, CUfunction user_kernel, uchar chan, bool bUpdateApron );
 			void Resample ( uchar chan, Matrix4F xform, Vector3DI in_res, char in_aux, Vector3DF inr, Vector3DF outr );			
 			
+			// Value range pyramid (Node::mVRange = min, max, mean)
+			void UpdateRange ( uchar chan = 0, bool bAll = false );	// leaves without NODE_RANGE, then their parents
+			void InvalidateRange ( uchar chan )		{ if ( chan == mRangeChan ) mRangeChan = -1; }
+			int  getRangeChannel ()					{ return mRangeChan; }	// -1 if ranges are stale
+
 			// File I/O
 			bool LoadBRK ( std::string fname );
 			bool LoadVDB ( std::string fname );
-			bool LoadVBX ( std::string fname );
-			void SaveVBX ( std::string fname );
+			bool LoadVBX ( std::string fname, bool bMap = false, bool bLazy = false );	// bMap: use file pages in place (copy-on-write), bLazy: page in on first access
+			bool LoadVBXGrid ( std::string fname, std::string name, bool bMap = false, bool bLazy = false );	// load one named grid as channel 0
+			void SaveVBX ( std::string fname, bool bCompress = false );				// bCompress: store atlas as compressed bricks
+			void SaveVBX ( std::string fname, std::vector<std::string>& grids, bool bCompress = false );	// one named grid per channel, sharing topology
+			bool SwapFrame ( VolumeGVDB& src );					// take frame loaded into a host-only staging volume
+			bool LoadVBXPaged ( std::string fname, uint64 budget, std::string spill = "" );	// out-of-core: topology resident, atlas bricks paged within budget bytes
+			void ReleaseMapped ();								// drop a grid mapped from a previous file, before loading
+			int  UpdateBrickCache ();							// page in requested bricks, call between frames
+			void RequestBricks ( Vector3DF wmin, Vector3DF wmax );	// request bricks of leaves overlapping a world box
+			BrickCache* getBrickCache ()				{ return mCache; }	// 0x0 unless paged
 			void SaveVDB ( std::string fname );
 			bool ImportVTK ( std::string fname, std::string field, Vector3DI& res );
-			void WriteObj ( char* fname );
+			bool WriteObj ( char* fname, uchar chan = 0, float thresh = 0.5f );	// write isosurface of channel as .obj
+			bool WritePly ( char* fname, uchar chan = 0, float thresh = 0.5f );	// write isosurface of channel as binary .ply
+			bool ExtractSurface ( Model* model, uchar chan, float thresh );		// isosurface of channel into a polygonal model
+			bool ExtractSurface ( uchar chan, float thresh, std::vector<Vector3DF>& verts, std::vector<Vector3DF>& norms, std::vector<Vector3DI>& faces );	// host surface nets over active bricks
 			void AddPath ( std::string path );
 			bool FindFile ( std::string fname, char* path );		
 
@@ -278,6 +315,17 @@
 			slong ActivateSpace ( Vector3DF pos );
 			slong ActivateSpace ( slong nodeid, Vector3DI pos, bool& bNew, slong stopnode = ID_UNDEFL, int stoplev = 0 );	// Active leaf at given location
 			slong ActivateSpaceAtLevel ( int lev, Vector3DF pos );
+			void  BeginActivate ( uint64 leaves = 0 );			// Start concurrent activation, reserve room for new leaves
+			slong ActivateSpaceConcurrent ( Vector3DF pos );	// Thread-safe between BeginActivate and EndActivate, returns leaf
+			void  EndActivate ();								// Finish concurrent activation (FinishTopology after)
+			int BuildTopology ( const std::vector<Vector3DI>& brickpos, std::vector<slong>* leafs = 0x0 );		// Bulk build of tree from brick positions
+			bool DeactivateSpace ( Vector3DF pos );				// Deactivate leaf at given location
+			bool DeactivateNode ( slong nodeid );				// Remove node and its sub-tree, prune empty parents
+			int  PruneBackground ( uchar chan, float tolerance, float background = 0 );	// Deactivate leaves within tolerance of background, collapse constant leaves to tiles, shrink atlas
+			bool ClearTile ( slong nodeid, uint32 b );			// Remove tile value of a level 1 slot, prune the node if left empty
+			void CompactTopology ();							// Defragment node pools after deactivation
+			void RepackChildLists ( int lev );					// Pack child lists of a level into size-class runs, in node order
+			void SortTopology ();								// Reorder nodes and atlas bricks in Morton order of node position
 			Vector3DI GetCoveringNode ( int lev, Vector3DI pos, Vector3DI& range );
 			void ComputeBounds ();
 			void ClearAtlasAccess ();
@@ -285,6 +333,8 @@
 			void FinishTopology ();						
 			void UpdateAtlas ();
 			void ClearAtlas ();			
+			void AtlasCompact ();						// Defragment atlas after deactivation
+			void UpdateBrickList ();					// Active brick list for native operators
 			void UpdateApron ();
 			void UpdateApron ( uchar chan );
 			void SetColorChannel ( uchar chan );
@@ -294,6 +344,11 @@
 			void  SetupNode ( slong nodeid, int lev, Vector3DF pos);
 			slong AddChildNode ( slong nodeid, Vector3DF ppos, int plev, uint32 i, Vector3DI pos );
 			slong InsertChild ( slong nodeid, slong child, uint32 i );			
+			slong RemoveChild ( slong nodeid, uint32 i );
+			slong ActivateChild ( slong nodeid, uint32 i );					// concurrent AddChildNode, ID_UNDEFL if pools are full
+			slong ActivateExclusive ( Vector3DI* pos );						// pause concurrent activation to grow pools or reparent
+			void  ActivateReserve ();
+			void  FreeNode ( slong nodeid );
 			void DebugNode ( slong nodeid );
 			void ClearMapping ();
 			void AssignMapping ( Vector3DI brickpos, Vector3DI pos, int leafid );
@@ -302,6 +357,8 @@
 			nvdb::Node* getNode ( slong nodeid )		{ return (Node*) mPool->PoolData ( nodeid ); }			
 			bool  isLeaf ( slong nodeid )		{ return ElemLev ( nodeid )==0; }
 			slong getChildNode ( slong nodeid, uint b );
+			nvdb::Node* getNodeAtPoint ( Vector3DF pos, Vector3DF& vmin, slong& nodeid );		// leaf at world pos (host, after PrepareVDB)
+			bool getTileAtPoint ( Vector3DF pos, float& v );		// tile value at world pos, false in a leaf or empty space (host, after PrepareVDB)
 			slong getChildOffset ( slong  nodeid, slong childid, Vector3DI& pos );
 			bool getPosInNode ( slong curr_id, Vector3DI pos, uint32& bit );
 
@@ -314,6 +371,7 @@
 
 			// Prepare
 			void PrepareVDB ();
+			void PrepareRangeSkip ( char shading );
 			void PrepareRender ( int w, int h, char shading, char filtering, int frame, int samples, float samt, uchar dbuf = 255 );
 			void SetVoxels ( VolumeGVDB* vdb, std::vector<Vector3DI> poslist, float val );			
 			void Measure ( bool bPrint );
@@ -346,6 +404,13 @@
 
 			// Data Operations
 			void PrepareAux ( int id, int cnt, int stride, bool bZero, bool bCPU=false );
+			void BeginFrame ();								// reset scratch high-water for aux buffers
+			void EndFrame ( bool bTrim=false );				// bTrim: shrink scratch aux buffers used this frame to their high-water (contents not kept)
+			uint64 getAuxCapacity ();						// bytes held by aux scratch buffers
+			uint64 getAuxFramePeak ();						// sum of per-buffer high-water, current frame
+			uint64 getAuxPeak ()			{ return mAuxPeakTotal; }		// largest frame peak seen
+			int	 getAuxAllocs ()			{ return mAuxAllocs; }			// reallocations, current frame
+			int	 getAuxAllocsTotal ()		{ return mAuxAllocsTotal; }
 			void PrepareV3D ( Vector3DI ires, uchar dtype );
 			void AllocData ( DataPtr& ptr, int cnt, int stride, bool bCPU=true );
 			void RetrieveData ( DataPtr ptr );			
@@ -366,11 +431,6 @@
 			void InsertSupportPoints ( int num_pnts, float offset, Vector3DF trans, bool bPrefix=false );
 			void AddSupportVoxel ( int num_pnts, float radius, float offset, float amp, Vector3DF trans, bool expand = true, bool avgColor = false );
 
-			// Write .OBJ 
-			void setupVerts ( int gv[], Vector3DI g, int r1, int r2 );
-			void enableVerts ( int*& vgToVert, std::vector<Vector3DF>& verts, Vector3DF vm, int gv[] );
-			void writeCube ( FILE* fp, unsigned char vpix[], slong& numfaces, int gv[], int*& vgToVert, slong vbase );
-
 			// Helpers
 			void CommitTransferFunc ();
 			void TimerStart ();
@@ -379,11 +439,27 @@
 
 			// VDB Configuration			
 			void SetVDBConfig ( int lev, int i )		{ mVCFG[lev] = i; }
+			void SetPrefixCache ( bool on )				{ mbPrefix = on; }		// cache mask prefix counts in pool 0, call before Configure
+			void SetTileValues ( bool on )				{ mbTiles = on; }		// room for tile values in level 1 nodes (PruneBackground), call before Configure
 			Vector3DI getNearestAbsVox ( int lev, Vector3DF pnt );
 			int getLD(int lev)			{ return mLogDim[lev]; }							// Logres
 			int getRes(int lev)			{ return (1 << mLogDim[lev]); }						// Resolution of level
 			uint64 getVoxCnt(int lev)	{ uint64 r = uint64(1) << mLogDim[lev]; return r*r*r; }		// # of Voxels of level
 			uint64 getMaskSize(int lev)	{ uint64 sz = getVoxCnt(lev) / 8; return (sz < 8 ) ? 8 : sz; }		// Mask Size of level						
+			uint64 getPrefixSize(int lev)	{ uint64 w = getMaskSize(lev) / 8; return (w > 1) ? w*sizeof(uint32) : 0; }	// Prefix count size of level
+			uint64 getChildCap(int lev, uint64 cnum)	{ if ( cnum == 0 ) return 0; uint64 c = CHILD_MIN; while ( c < cnum ) c <<= 1; return (c < getVoxCnt(lev)) ? c : getVoxCnt(lev); }	// Child list size class
+			bool hasPrefix(int lev)		{ return lev > 0 && getPrefixSize(lev) > 0 && mPool->getPoolWidth(0, lev) >= sizeof(Node) + getMaskSize(lev) + getPrefixSize(lev) + (hasTiles(lev) ? getTileSize(lev) : 0); }
+
+			// Tiles
+			// A level 1 node may hold a constant value per child slot in place of a leaf. The tile mask
+			// and one float per slot fill the end of the node. A slot is a tile when its tile bit is on 
+			// and its child bit is off, so code which only follows children sees tiles as empty space.
+			uint64 getTileSize(int lev)	{ return (lev == 1) ? getMaskSize(lev) + getVoxCnt(lev)*sizeof(float) : 0; }	// Tile mask and values of level
+			bool hasTiles(int lev)		{ return lev == 1 && mPool->getPoolWidth(0, lev) >= sizeof(Node) + getMaskSize(lev) + getTileSize(lev); }
+			uint64* getTileMask(Node* node)	{ return (uint64*) ((char*) node + mPool->getPoolWidth(0, 1) - getTileSize(1)); }
+			float* getTileValues(Node* node)	{ return (float*) ((char*) getTileMask(node) + getMaskSize(1)); }
+			bool isTile(Node* node, uint32 b)	{ return node->mLev == 1 && hasTiles(1) && !node->isOn(b) && (getTileMask(node)[b >> 6] & (uint64(1) << (b & 63))) != 0; }
+			bool hasAnyTile(Node* node);
 			int getBitPos ( int lv, Vector3DI pos )			{ int res=getRes(lv);	return (pos.z*res + pos.y)*res+ pos.x; }
 			Vector3DI getPosFromBit ( int lv, uint32 b )	{ 
 					int logr = mLogDim[lv]; 					
@@ -416,6 +492,34 @@
 			Vector3DF getVoxelSize() { return mVoxsize; }
 			
 	protected:
+			// Host (CPU) kernels, see gvdb_volume_cpu.cpp
+			void ComputeCPU ( int effect, uchar chan, Vector3DF parm );
+			void UpdateApronCPU ( uchar chan );
+			void ResampleCPU ( uchar chan, Matrix4F& xform, Vector3DI in_res, char in_aux, Vector3DF inr, Vector3DF outr );
+			void InsertPointsCPU ( int num_pnts, Vector3DF trans, bool bPrefix );
+			void ScatterPointDensityCPU ( int num_pnts, float radius, float amp, Vector3DF trans, bool expand, bool avgColor );
+			void ComputeRangeCPU ( uchar chan, int cnt, Vector3DI* bricks, Vector3DF* out );
+
+			// Host (CPU) raycasting, see gvdb_raycast_cpu.cpp
+			bool PrepareRenderCPU ( void* info );
+			void RenderCPU ( uchar rbuf, char shading );
+			void RaytraceCPU ( DataPtr rays, float bias );
+
+			bool RejectPaged ( const char* func );			// error and true if the atlas is paged
+			
+			// VBX grids and compressed atlas
+			bool ReadVBXGrid ( VBXReader& vbx, int& chan, bool bAtlas );
+			uint64 PackTopology ( std::vector< std::vector<char> >& nodes, std::vector< std::vector<char> >& lists, std::vector<uint64>& brick_src );
+			void ReadMovedBricks ( uchar chan, int z, std::vector<uint64>& brick_src, std::vector<int>& slot, std::vector<char>& buf );
+			void WriteAtlasBricks ( FILE* fp, uchar chan, std::vector<uint64>& brick_src );
+			bool ReadAtlasBricks ( VBXReader& vbx, uchar chan );
+
+			// Host device
+			bool			mbCPU;
+			int				mNumThreads;
+			WorkerPool		mWorkers;			// host loops, sized by mNumThreads
+
+
 			// VDB Settings
 			int				mLogDim[MAXLEV];	// internal res config
 			Vector3DF		mClrDim[MAXLEV];
@@ -425,6 +529,12 @@
 			bool			mbGlew;
 			bool			mbUseGLAtlas;
 			Vector3DI		mAtlasResize;
+			bool			mbDirtyBricks;		// active brick list needs rebuild
+			bool			mbPrefix;			// node masks have prefix counts
+			bool			mbTiles;			// level 1 nodes have tile values
+			BrickCache*		mCache;				// paged atlas (out-of-core)
+			ActivateState*	mAct;				// concurrent activation (between BeginActivate and EndActivate)
+			int				mRangeChan;			// channel of node value ranges, -1 if stale
 			Vector3DI		mDefaultAxiscnt;
 						
 			// Root node
@@ -462,6 +572,10 @@
 
 			// Auxiliary buffers
 			DataPtr			mAux[MAX_AUX];		// Auxiliary
+			uint64			mAuxFramePeak[MAX_AUX];	// scratch high-water in bytes, current frame
+			uint64			mAuxPeakTotal;		// largest frame peak
+			int				mAuxAllocs;			// scratch reallocations, current frame
+			int				mAuxAllocsTotal;
 			
 			OVDBGrid*		mOVDB;			// OpenVDB grid	
 			Volume3D*		mV3D;			// Volume 3D
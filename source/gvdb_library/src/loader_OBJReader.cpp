@@ -21,36 +21,192 @@
 // Chris Wyman (9/2/2014)                                    
 //
 
-#include "loader_OBJReader.h"
 
+#include "loader_OBJReader.h"
+#include "gvdb_parallel.h"
+#include "string_helper.h"
+
+#if defined(_WIN32)
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <GL/glew.h>
 #include <float.h>
 #include <string.h>
 
-struct OBJTri
+#define OBJ_REL			0x80000000		// corner index is relative to vertex count of chunk
+#define OBJ_BIAS		0x40000000
+#define OBJ_NONE		0xFFFFFFFF		// corner has no normal
+
+// Geometry parsed from one chunk of the file.
+// Each chunk owns its arrays, they are released together once merged.
+struct OBJChunk
 {
-	OBJTri() {}
-	int vIdx[3], nIdx[3];
+	OBJChunk() : start(0), end(0), unknown(0), corrupt(0), hasNormals(false) {}
+	const char*			start;
+	const char*			end;
+	std::vector<float>	vx, vy, vz;
+	std::vector<float>	nx, ny, nz;
+	std::vector<uint>	triV, triN;
+	int					unknown, corrupt;
+	bool				hasNormals;
 };
 
 namespace {
-	inline int Max( int x, int y )         { return (x>y)?x:y; }
-	inline int Min( int x, int y )         { return (x<y)?x:y; }
-	inline float Max( float x, float y )   { return (x>y)?x:y; }
-	inline float Min( float x, float y )   { return (x<y)?x:y; }
-}
+	inline bool isSpace ( char c )		{ return c==' ' || c=='\t' || c=='\r'; }
+	inline bool isDigit ( char c )		{ return c >= '0' && c <= '9'; }
+	inline const char* skipSpace ( const char* p, const char* e )	{ while ( p < e && isSpace(*p) ) p++; return p; }
+
+	const double pow10tab[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+								  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	// Parse a float. Common decimal forms are handled directly,
+	// long mantissas, large exponents, inf and nan fall back to strtod.
+	const char* parseFloat ( const char* p, const char* e, float& f )
+	{
+		const char* s = p;
+		bool neg = false;
+		if ( p < e && (*p=='-' || *p=='+') ) neg = (*p++ == '-');
+		uint64 m = 0;
+		int digits = 0, ex = 0;
+		for (; p < e && isDigit(*p); p++, digits++ ) m = m*10 + (*p - '0');
+		if ( p < e && *p=='.' ) 
+			for (p++; p < e && isDigit(*p); p++, digits++, ex-- ) m = m*10 + (*p - '0');
+		if ( p < e && (*p=='e' || *p=='E') && digits > 0 ) {
+			const char* q = p+1;
+			bool eneg = false;
+			int en = 0;
+			if ( q < e && (*q=='-' || *q=='+') ) eneg = (*q++ == '-');
+			if ( q < e && isDigit(*q) ) {
+				for (; q < e && isDigit(*q); q++ ) if ( en < 10000 ) en = en*10 + (*q - '0');
+				ex += eneg ? -en : en;
+				p = q;
+			}
+		}
+		if ( digits > 0 && digits <= 15 && ex >= -22 && ex <= 22 ) {
+			double v = (ex < 0) ? double(m) / pow10tab[-ex] : double(m) * pow10tab[ex];
+			f = float( neg ? -v : v );
+			return p;
+		}
+		// fallback
+		char buf[64];
+		int n = 0;
+		for (p = s; p < e && n < 63 && !isSpace(*p) && *p != '\n' && *p != '/'; ) buf[n++] = *p++;
+		buf[n] = '\0';
+		char* end;
+		f = (float) strtod ( buf, &end );
+		return s + (end - buf);
+	}
+	const char* parseInt ( const char* p, const char* e, int& i )
+	{
+		bool neg = false;
+		const char* s = p;
+		if ( p < e && (*p=='-' || *p=='+') ) neg = (*p++ == '-');
+		if ( p >= e || !isDigit(*p) ) return s;
+		for (i = 0; p < e && isDigit(*p); p++ ) i = i*10 + (*p - '0');
+		if ( neg ) i = -i;
+		return p;
+	}
+
+	// OBJ indices start from 1, negative indices are relative to the last vertex read.
+	// Relative indices are resolved during merge, when the vertex count of earlier chunks is known.
+	inline uint getIndex ( int idx, size_t cnt )
+	{
+		if ( idx > 0 ) return uint(idx - 1);
+		if ( idx == 0 ) return 0;					// undefined in OBJ, use first
+		return OBJ_REL | uint( int(cnt) + idx + OBJ_BIAS );
+	}
+	inline int resolveIndex ( uint i, uint off )
+	{
+		if ( i == OBJ_NONE ) return -1;
+		if ( i & OBJ_REL ) return int( (i & ~OBJ_REL) - OBJ_BIAS ) + int(off);
+		return int(i);
+	}
 
-// prototype from simpleParser.cpp
-char *StripLeadingTokenToBuffer( char *string, char *buf );
+	void ParseChunk ( OBJChunk& c )
+	{
+		const char* p = c.start;
+		const char* e = c.end;
+		size_t len = e - p;
+		c.vx.reserve ( len / 48 ); c.vy.reserve ( len / 48 ); c.vz.reserve ( len / 48 );
+		c.triV.reserve ( len / 16 ); c.triN.reserve ( len / 16 );
+
+		float x, y, z;
+		int vi, ti, ni;
+		uint cv[3], cn[3];
+
+		while ( p < e ) {
+			p = skipSpace ( p, e );
+			const char* kw = p;
+			while ( p < e && !isSpace(*p) && *p != '\n' ) p++;
+			int klen = int(p - kw);
+
+			if ( klen == 0 || *kw == '#' ) {
+				// blank line or comment
+			} else if ( kw[0] == 'v' && klen <= 2 && (klen == 1 || kw[1] == 'n') ) {
+				// vertex or normal
+				x = y = z = 0;
+				p = parseFloat ( skipSpace ( p, e ), e, x );
+				p = parseFloat ( skipSpace ( p, e ), e, y );
+				p = parseFloat ( skipSpace ( p, e ), e, z );
+				if ( klen == 1 )	{ c.vx.push_back ( x ); c.vy.push_back ( y ); c.vz.push_back ( z ); }
+				else				{ c.nx.push_back ( x ); c.ny.push_back ( y ); c.nz.push_back ( z ); }
+			} else if ( kw[0] == 'f' && klen == 1 ) {
+				// facet, formats v, v/t, v//n, v/t/n. Polygons are triangulated as a fan.
+				int cnt = 0;
+				for (;;) {
+					p = skipSpace ( p, e );
+					if ( p >= e || *p == '\n' || *p == '#' ) break;
+					const char* q = parseInt ( p, e, vi );
+					if ( q == p ) { cnt = -1; break; }
+					p = q;
+					bool hasN = false;
+					if ( p < e && *p == '/' ) {
+						p++;
+						if ( p < e && *p != '/' ) p = parseInt ( p, e, ti );
+						if ( p < e && *p == '/' ) {
+							q = parseInt ( ++p, e, ni );
+							hasN = (q != p);
+							p = q;
+						}
+					}
+					while ( p < e && !isSpace(*p) && *p != '\n' ) p++;
+
+					uint v = getIndex ( vi, c.vx.size() );
+					uint n = ( hasN && ni != 0 ) ? getIndex ( ni, c.nx.size() ) : OBJ_NONE;
+					c.hasNormals |= hasN;
+					if ( cnt >= 3 ) {
+						cv[1] = cv[2];	cn[1] = cn[2];
+						cnt = 2;
+					}
+					cv[cnt] = v;	cn[cnt] = n;
+					if ( ++cnt == 3 ) {
+						c.triV.push_back ( cv[0] );	c.triV.push_back ( cv[1] );	c.triV.push_back ( cv[2] );
+						c.triN.push_back ( cn[0] );	c.triN.push_back ( cn[1] );	c.triN.push_back ( cn[2] );
+					}
+				}
+				if ( cnt < 3 ) c.corrupt++;
+			} else if ( strchr ( "vfmogusl", kw[0] ) == 0x0 ) {
+				// texture coords, materials, objects, groups and smoothing are ignored
+				c.unknown++;
+			}
+			while ( p < e && *p != '\n' ) p++;		// next line
+			if ( p < e ) p++;
+		}
+	}
+}
 
 OBJReader::OBJReader() :
-	m_hasNormals(false), m_hasVertices(false),                // These flags are set to true when we encounter a facet line in the OBJ that uses normals or verts
-	m_resize( false ), m_center( false ), m_guessNorms( true ), // These are usually parameters, but for this demo we have good defaults to hardcode.
-	m_numVertices(0), m_numNormals(0), m_numTris(0),          // We start having read in 0 normals, vertices, and triangles
-	m_triangles(0), m_normals(0), m_vertices(0),              // Set our arrays to NULL
-	m_allocVert(0), m_allocNorm(0), m_allocTri(0)	
+	m_data(0), m_size(0), m_mapped(false), m_mapHandle(0),
+	m_numVertices(0), m_numNormals(0), m_numTris(0), m_threads(0),
+	m_hasNormals(false), m_guessNorms(true),
+	m_vertStride(0), m_vertOff(0), m_normOff(0)
 {
 }
 
@@ -61,9 +217,11 @@ OBJReader::~OBJReader()
 
 bool OBJReader::Cleanup ()
 {
-	if ( m_normals != 0 ) 	delete[] m_normals;
-	if ( m_vertices != 0 )	delete[] m_vertices;
-	if ( m_triangles != 0 )	free( m_triangles );
+	UnmapFile ();
+	m_vx.clear(); m_vy.clear(); m_vz.clear();
+	m_nx.clear(); m_ny.clear(); m_nz.clear();
+	m_triV.clear(); m_triN.clear();
+	m_numVertices = m_numNormals = m_numTris = 0;
 	return true;
 }
 
@@ -72,449 +230,280 @@ bool OBJReader::isMyFile( const char* filename )
 	return getExtension( filename ) == "obj";
 }
 
-bool OBJReader::LoadFile ( Model* model, char *filename, char** searchPaths, int numPaths )
+Model* OBJReader::LoadModel ( char *filename, char** searchPaths, int numPaths, int threads )
 {
-	gprintf ("Loading and parsing model '%s'...\n", filename);
+	char fileName[1024];
+	if ( !getFileLocation ( filename, fileName, searchPaths, numPaths ) ) return 0x0;
 
-	ParseFile ( filename, searchPaths, numPaths );
+	Model* model = new Model;
+	model->modelType = 0;	// polygonal model
 
-	// For clarity (later), we have a pointer to the Read_???_Token() method we will
-	//    use when reading a facet.  This will be set when we first see a 'f' line.
-	FnParserPtr fnFacetParsePtr = NULL;
-
-	// OK, we have a parser.  Now parse through the file
-	int lineCount = 0;
-	OBJTri *curTri = 0;
-	char *linePtr = 0, *mtlFilePtr = 0;
-	char keyword[64], vertToken[128];
+	OBJReader obj;
+	obj.SetThreads ( threads );
+	if ( !obj.LoadFile ( model, filename, searchPaths, numPaths ) ) {
+		delete model;
+		return 0x0;
+	}
+	return model;
+}
 
-	while ( (linePtr = this->ReadNextLine()) != NULL )
-	{
-		// Each OBJ line starts with a keyword/keyletter
-		this->GetLowerCaseToken( keyword );
-		
-		switch( keyword[0] )
-		{
-		case 'v': 
-			if (keyword[1] == 'n')        // We found a normal!
-				AddNormal( this->GetVec3() ); // m_objNorms.Add( this->GetVec3() );
-			else if (keyword[1] == 't')   // Ignore texture coordinates in this demo
-				; 
-			else if (keyword[1] == 0 )    // We found a vertex!
-			{
-				AddVertex( this->GetVec3() ); // m_objVerts.Add( this->GetVec3() );  
-			}
-			break;
-		case 'm':  // For this simple demo... We're ignoring materials, so do nothing.
-		case 'o':  // For this simple demo... We're ignoring object designations, so do nothing.
-		case 'g':  // For this simple demo... We're ignoring group designations, so do nothing.
-		case 'u':  // For this simple demo... We're ignoring materials, so do nothing.
-		case 's':  // There's a smoothing command.  We're ignoring these.
-			break;
-		case 'f': // We found a facet!
-			if (keyword[1] != 0)  // There's some odd models out there with 'fo' or other
-				continue;         //    additional facet types.  Mostly these are junk!
-			
-			//Ensure the 'f' line has at least three entries. 
-			if(!IsValidFLine(&fnFacetParsePtr))
-				continue;
-
-			curTri = new OBJTri();
-
-			// There are multiple different formats for 'f' lines.  Decide which it is,
-			//    and select the appropriate class member we'll use to read this line.
-			SelectReadMethod( &fnFacetParsePtr );
-
-			// Read first three set of indices on this line
-			((*this).*(fnFacetParsePtr))( curTri, 0, NULL );
-			((*this).*(fnFacetParsePtr))( curTri, 1, NULL );
-			((*this).*(fnFacetParsePtr))( curTri, 2, NULL );
-			AddTriangle( curTri );  // m_objTris.Add( curTri );
-
-			// Do we have more vertices in this facet?  Check to see if the 
-			//    next token is non-empty (if empty the [0]'th char == 0)
-			//    If we do, we'll have to triangulate the facet, so make a new tri
-			this->GetToken( vertToken );
-			while ( vertToken[0] ) 
-			{
-				curTri = new OBJTri();
-				CopyForTriangleFan( curTri );
-				((*this).*(fnFacetParsePtr))( curTri, 2, vertToken );
-				AddTriangle( curTri ); // m_objTris.Add( curTri );
-				this->GetToken( vertToken );
-			}
-			break;
+bool OBJReader::LoadFile ( Model* model, char *filename, char** searchPaths, int numPaths )
+{
+	gprintf ("Loading and parsing model '%s'...\n", filename);
 
-		default:  // We have no clue what to do with this line....
-			this->WarningMessage("Found corrupt line in OBJ.  Unknown keyword '%s'", keyword);
-		}
+	// Locate the file
+	char fileName[1024];
+	if ( !getFileLocation ( filename, fileName, searchPaths, numPaths ) ) {
+		gprintf ("Error: OBJReader unable to find '%s'\n", filename );
+		gerror ();
+		return false;
 	}
+	Cleanup ();
+	if ( !MapFile ( fileName ) ) {
+		gprintf ("Error: Unable to open file '%s'\n", fileName );
+		gerror ();
+		return false;
+	}
+
+	ParseChunks ();
 
 	// No need to keep the file hanging around open.
-	CloseFile();
-	
-	//AddVertex(Vector4DF( 47.2224* 0.01, 0.0117588* 0.01, 46.8401* 0.01,  0.0f ) );
-	//AddVertex(Vector4DF(47.2224* 0.01, 10.0784* 0.01, 46.8401* 0.01,   0.0f ));
-	//AddVertex(Vector4DF( 47.2224* 0.01, 10.0784* 0.01, 47.8401* 0.01, 0.0f ));
-	//AddVertex(Vector4DF( 47.2224* 0.01, 0.0117588* 0.01, 47.8401* 0.01, 0.0f ));
-
-	//curTri = new OBJTri();
-	//curTri->vIdx[0] = m_numVertices - 1; 
-	//curTri->vIdx[1] = m_numVertices - 2;
-	//curTri->vIdx[2] = m_numVertices - 3;
-	//AddTriangle( curTri );
-
-	//curTri = new OBJTri();
-	//curTri->vIdx[0] = m_numVertices - 4; 
-	//curTri->vIdx[1] = m_numVertices - 2;
-	//curTri->vIdx[2] = m_numVertices - 3;
-	//AddTriangle( curTri );
+	UnmapFile ();
 
 	// If we already have surface normals, there's no need to use facet normals
 	if (m_hasNormals) m_guessNorms = false;
 
-	// Create the GPU buffers for this object, so we have them laying around later.
+	// Create the buffers for this object
 	GetCompactArrayBuffer( model );
 
-
-	// OK.  Now we've created our vertex array.  Enable the attributes so that we're sending the correct
-	//    data to all our shaders.
-
-	//m_vertArr->EnableAttribute( IGLU_ATTRIB_VERTEX, 3, GL_FLOAT, m_vertStride, BUFFER_OFFSET(m_vertOff));
-	//if (HasNormals())  {
-	//	m_vertArr->EnableAttribute( IGLU_ATTRIB_NORMAL, 3, GL_FLOAT, m_vertStride, BUFFER_OFFSET(m_normOff));
-	//}
-
 	gprintf ( " Model reading completed successfully! (%d verts, %d tris)\n", m_numVertices, m_numTris );
 
 	return true;
 }
 
-unsigned int OBJReader::GetVertexIndex( int relativeIdx )
-{
-	if (relativeIdx == 0)
-	{
-		this->WarningMessage("Unexpected OBJ vertex index of 0!");
-		relativeIdx = 1;  // 0 is undefined, and will crash.  Give at least a non-segfaultable value;
-	}
-	return relativeIdx > 0 ? relativeIdx-1 : m_numVertices+relativeIdx;
-}
-
-unsigned int OBJReader::GetNormalIndex( int relativeIdx )
-{
-	if (relativeIdx == 0)
-		this->WarningMessage("Unexpected OBJ normal index of 0!");
-	// Note the >=, which is different than the > in the vertex index.  An index
-	//    of 0 is invalid.  Our code treats a -1 return value as "no normal".  That' fine
-	//    for nomrals and texture coords
-	return relativeIdx >= 0 ? relativeIdx-1 : m_numNormals+relativeIdx;
-}
-
-void OBJReader::Read_V_Token( OBJTri *tri, int idx, char *token )
-{
-	char vertToken[128], *tPtr = vertToken;
-	int vIdx;
-
-	// If the user didn't pass in a token, read one
-	if (!token)
-		this->GetToken( vertToken );
-	else 
-		tPtr = token;
-
-	// Parse a vertex & normal from the token
-	sscanf( tPtr, "%d", &vIdx );
-
-	// Resolve these into indicies in our data structure (not the OBJ file)
-	tri->vIdx[idx] = GetVertexIndex( vIdx );
-	tri->nIdx[idx] = -1;
-	//tri->tIdx[idx] = -1;
-}
-
-void OBJReader::Read_VN_Token( OBJTri *tri, int idx, char *token )
-{
-	char vertToken[128], *tPtr = vertToken;
-	int vIdx, nIdx;
-
-	// If the user didn't pass in a token, read one
-	if (!token)
-		this->GetToken( vertToken );
-	else 
-		tPtr = token;
-
-	// Parse a vertex & normal from the token
-	sscanf( tPtr, "%d//%d", &vIdx, &nIdx );
-
-	// Resolve these into indicies in our data structure (not the OBJ file)
-	tri->vIdx[idx] = GetVertexIndex( vIdx );
-	tri->nIdx[idx] = GetNormalIndex( nIdx );
-	//tri->tIdx[idx] = -1;
-}
-
-void OBJReader::Read_VT_Token( OBJTri *tri, int idx, char *token )
+// Map file read-only. Falls back to reading it into memory if mapping is unavailable.
+bool OBJReader::MapFile ( const char* fname )
 {
-	char vertToken[128], *tPtr = vertToken;
-	int vIdx, tIdx;
-
-	// If the user didn't pass in a token, read one
-	if (!token)
-		this->GetToken( vertToken );
-	else 
-		tPtr = token;
-
-	// Parse a vertex & normal from the token
-	sscanf( tPtr, "%d/%d", &vIdx, &tIdx );
-
-	// Resolve these into indicies in our data structure (not the OBJ file)
-	tri->vIdx[idx] = GetVertexIndex( vIdx );
-	tri->nIdx[idx] = -1;
-	// tri->tIdx[idx] = GetTextureIndex( tIdx ); // Ignore texture coordinates
-}
-
-void OBJReader::Read_VTN_Token( OBJTri *tri, int idx, char *token )
-{
-	char vertToken[128], *tPtr = vertToken;
-	int vIdx, tIdx, nIdx;
-
-	// If the user didn't pass in a token, read one
-	if (!token)
-		this->GetToken( vertToken );
-	else 
-		tPtr = token;
-
-	// Parse a vertex & normal from the token
-	sscanf( tPtr, "%d/%d/%d", &vIdx, &tIdx, &nIdx );
-
-	// Resolve these into indicies in our data structure (not the OBJ file)
-	tri->vIdx[idx] = GetVertexIndex( vIdx );
-	tri->nIdx[idx] = GetNormalIndex( nIdx );
-	// tri->tIdx[idx] = GetTextureIndex( tIdx ); // Ignore texture coordinates
-}
-
-void OBJReader::CopyForTriangleFan( OBJTri *newTri )
-{
-	newTri->vIdx[0] = m_triangles[m_numTris-1]->vIdx[0]; 
-	newTri->nIdx[0] = m_triangles[m_numTris-1]->nIdx[0];
-	//newTri->tIdx[0] = m_triangles[m_numTris-1]->tIdx[0];
-	newTri->vIdx[1] = m_triangles[m_numTris-1]->vIdx[2];
-	newTri->nIdx[1] = m_triangles[m_numTris-1]->nIdx[2];
-	//newTri->tIdx[1] = m_triangles[m_numTris-1]->tIdx[2];
+	#if defined(_WIN32)
+		HANDLE file = CreateFileA ( fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+		if ( file != INVALID_HANDLE_VALUE ) {
+			LARGE_INTEGER sz;
+			GetFileSizeEx ( file, &sz );
+			HANDLE hmap = ( sz.QuadPart > 0 ) ? CreateFileMappingA ( file, NULL, PAGE_READONLY, 0, 0, NULL ) : NULL;
+			CloseHandle ( file );									// mapping keeps file referenced
+			if ( hmap != NULL ) {
+				m_data = (char*) MapViewOfFile ( hmap, FILE_MAP_READ, 0, 0, 0 );
+				if ( m_data != 0x0 ) {
+					m_size = sz.QuadPart;
+					m_mapHandle = hmap;
+					m_mapped = true;
+					return true;
+				}
+				CloseHandle ( hmap );
+			}
+		}
+	#else
+		int fd = open ( fname, O_RDONLY );
+		if ( fd != -1 ) {
+			struct stat st;
+			if ( fstat ( fd, &st ) == 0 && st.st_size > 0 ) {
+				void* data = mmap ( 0x0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+				if ( data != MAP_FAILED ) {
+					close ( fd );
+					m_data = (char*) data;
+					m_size = st.st_size;
+					m_mapped = true;
+					return true;
+				}
+			}
+			close ( fd );
+		}
+	#endif
+
+	FILE* fp = fopen ( fname, "rb" );
+	if ( fp == 0x0 ) return false;
+	fseek ( fp, 0, SEEK_END );
+	m_size = ftell ( fp );
+	fseek ( fp, 0, SEEK_SET );
+	m_data = (char*) malloc ( m_size + 1 );
+	m_size = fread ( m_data, 1, m_size, fp );
+	fclose ( fp );
+	m_mapped = false;
+	return true;
 }
 
-void OBJReader::SelectReadMethod( FnParserPtr *pPtr )
+void OBJReader::UnmapFile ()
 {
-	int v, t, n; // garbage vars
-	char vertToken[128];
-	char *lPtr = this->GetCurrentLinePointer();
-
-	// Non-destructively parse the next token
-	StripLeadingTokenToBuffer( lPtr, vertToken );
-
-	if (strstr(vertToken, "//"))                               // Then it has the v//n format
-	{
-		*pPtr = &OBJReader::Read_VN_Token;
-		m_hasVertices = m_hasNormals = true;
-	}
-
-	else if ( sscanf(vertToken, "%d/%d/%d", &v, &t, &n) == 3 ) // Then it has the v/t/n format
-	{
-		*pPtr = &OBJReader::Read_VTN_Token;
-		m_hasVertices = m_hasNormals = m_hasTexCoords = true;
+	if ( m_data == 0x0 ) return;
+	if ( m_mapped ) {
+		#if defined(_WIN32)
+			UnmapViewOfFile ( m_data );
+			CloseHandle ( (HANDLE) m_mapHandle );
+		#else
+			munmap ( m_data, m_size );
+		#endif
+	} else {
+		free ( m_data );
 	}
+	m_data = 0x0;
+	m_size = 0;
+	m_mapped = false;
+	m_mapHandle = 0x0;
+}
 
-	else if ( sscanf(vertToken, "%d/%d", &v, &t) == 2 )        // Then it has the v/t format
-	{
-		*pPtr = &OBJReader::Read_VT_Token;
-		m_hasVertices = m_hasTexCoords = true;
-	}else                                                     // Then it has the v format
-		*pPtr = &OBJReader::Read_V_Token;
-		m_hasVertices = true;
-	}
-	
-bool OBJReader::IsValidFLine(FnParserPtr *pPtr)
+void OBJReader::ParseChunks ()
 {
-
-	//Garbage variables. This will break if it comes accross an entry on a line
-	//longer than 128 characters. 
-	char c0[128];
-	char c1[128];
-	char c2[128];
-	char vertToken[128]; 
-
-	// Non-destructively parse the next token
-	char *lPtr = this->GetCurrentLinePointer();
-	StripLeadingTokenToBuffer( lPtr, vertToken );
-
-	//Make sure we have at least three entries in this vertex
-	if(sscanf(lPtr, "%s %s %s", c0, c1, c2) >= 3){
-		return true;
-	}else{
-		this->WarningMessage("Corrupt 'f': %s", lPtr);
-		return false; 
+	// Split file into chunks at line boundaries
+	int threads = getHostThreads ( m_threads );
+	uint64 cnt = m_size / 65536 + 1;
+	if ( cnt > uint64(threads)*4 ) cnt = uint64(threads)*4;
+	std::vector<OBJChunk> chunks ( (size_t) cnt );
+
+	const char* e = m_data + m_size;
+	const char* p = m_data;
+	for (uint64 n=0; n < cnt; n++ ) {
+		const char* q = m_data + (m_size * (n+1)) / cnt;
+		if ( q < p ) q = p;
+		while ( q < e && q > m_data && *(q-1) != '\n' ) q++;
+		chunks[n].start = p;
+		chunks[n].end = q;
+		p = q;
 	}
-}
-
-void OBJReader::AddDataToArray( float *arr, int startIdx, Vector4DF *vert, Vector4DF *norm )
-{	
-	int i = startIdx;
 
-	// Add the vertex
-	arr[i++] = vert->X();
-	arr[i++] = vert->Y();
-	arr[i++] = vert->Z();
+	// Parse in parallel
+	ParallelFor ( threads, cnt, [&] ( slong start, slong end ) {
+		for (slong n = start; n < end; n++ )
+			ParseChunk ( chunks[n] );
+	} );
 
-	// If this vertex has a normal, add it.
-	if (norm)
-	{
-		arr[i++] = norm->X();
-		arr[i++] = norm->Y();
-		arr[i++] = norm->Z();
-	}
+	MergeChunks ( chunks );
 }
 
-void OBJReader::CenterAndResize( float *arr, int numVerts )
+void OBJReader::MergeChunks ( std::vector<OBJChunk>& chunks )
 {
-#ifdef min
-#undef min
-#endif
-#ifdef max
-#undef max
-#endif
-
-	int startIdx   = m_vertOff / sizeof(float);
-	int vertStride = m_vertStride / sizeof(float);
-	float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
-	float maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
-
-	// Walk through vertex array, find max & min (x, y, z)
-	for (int i=0; i<numVerts; i++)
-	{
-		int idx = startIdx + i*vertStride;
-		minX = Min( minX, arr[idx+0] );
-		maxX = Max( maxX, arr[idx+0] );
-		minY = Min( minY, arr[idx+1] );
-		maxY = Max( maxY, arr[idx+1] );
-		minZ = Min( minZ, arr[idx+2] );
-		maxZ = Max( maxZ, arr[idx+2] );
-	}
-
-	// Find the center of the object & the width of the object
-	float ctrX = (m_resize || m_center ? 0.5f*(minX+maxX) : 0.0f );
-	float ctrY = (m_resize || m_center ? 0.5f*(minY+maxY) : 0.0f ); 
-	float ctrZ = (m_resize || m_center ? 0.5f*(minZ+maxZ) : 0.0f );
-	float deltaX = 0.5f*(maxX-minX), deltaY = 0.5f*(maxY-minY), deltaZ = 0.5f*(maxZ-minZ);
-	float delta = ( m_resize ? 
-		            Max( deltaX, Max( deltaY, deltaZ ) ) :
-	                1.0f );
-
-	// Walk through the vertex array and update the positions
-	for (int i=0; i<numVerts; i++)
-	{
-		int idx = startIdx + i*vertStride;
-		arr[idx+0] = (arr[idx+0] - ctrX ) / delta;
-		arr[idx+1] = (arr[idx+1] - ctrY ) / delta;
-		arr[idx+2] = (arr[idx+2] - ctrZ ) / delta;
+	// Offsets of each chunk in the merged arrays
+	int cnt = (int) chunks.size();
+	std::vector<uint> voff ( cnt ), noff ( cnt ), toff ( cnt );
+	uint vsum = 0, nsum = 0, tsum = 0;
+	int unknown = 0, corrupt = 0;
+	for (int n=0; n < cnt; n++ ) {
+		voff[n] = vsum;		vsum += (uint) chunks[n].vx.size();
+		noff[n] = nsum;		nsum += (uint) chunks[n].nx.size();
+		toff[n] = tsum;		tsum += (uint) chunks[n].triV.size();
+		unknown += chunks[n].unknown;
+		corrupt += chunks[n].corrupt;
+		m_hasNormals |= chunks[n].hasNormals;
 	}
+	if ( unknown > 0 ) gprintf ( "Warning: Found %d lines with unknown keywords in OBJ.\n", unknown );
+	if ( corrupt > 0 ) gprintf ( "Warning: Found %d corrupt 'f' lines in OBJ.\n", corrupt );
+
+	m_numVertices = vsum;
+	m_numNormals = nsum;
+	m_numTris = tsum / 3;
+	m_vx.resize ( vsum );	m_vy.resize ( vsum );	m_vz.resize ( vsum );
+	m_nx.resize ( nsum );	m_ny.resize ( nsum );	m_nz.resize ( nsum );
+	m_triV.resize ( tsum );	m_triN.resize ( tsum );
+
+	// Copy chunks and resolve relative indices
+	ParallelFor ( m_threads, cnt, [&] ( slong start, slong end ) {
+		for (slong n = start; n < end; n++ ) {
+			OBJChunk& c = chunks[n];
+			if ( !c.vx.empty() ) {
+				memcpy ( &m_vx[ voff[n] ], &c.vx[0], c.vx.size()*sizeof(float) );
+				memcpy ( &m_vy[ voff[n] ], &c.vy[0], c.vy.size()*sizeof(float) );
+				memcpy ( &m_vz[ voff[n] ], &c.vz[0], c.vz.size()*sizeof(float) );
+			}
+			if ( !c.nx.empty() ) {
+				memcpy ( &m_nx[ noff[n] ], &c.nx[0], c.nx.size()*sizeof(float) );
+				memcpy ( &m_ny[ noff[n] ], &c.ny[0], c.ny.size()*sizeof(float) );
+				memcpy ( &m_nz[ noff[n] ], &c.nz[0], c.nz.size()*sizeof(float) );
+			}
+			int* tv = m_triV.empty() ? 0x0 : &m_triV[ toff[n] ];
+			int* tn = m_triN.empty() ? 0x0 : &m_triN[ toff[n] ];
+			for (size_t i=0; i < c.triV.size(); i++ ) {
+				tv[i] = resolveIndex ( c.triV[i], voff[n] );
+				tn[i] = resolveIndex ( c.triN[i], noff[n] );
+			}
+			std::vector<float>().swap ( c.vx );	std::vector<float>().swap ( c.vy );	std::vector<float>().swap ( c.vz );
+			std::vector<float>().swap ( c.nx );	std::vector<float>().swap ( c.ny );	std::vector<float>().swap ( c.nz );
+			std::vector<uint>().swap ( c.triV );	std::vector<uint>().swap ( c.triN );
+		}
+	} );
 }
 
 void OBJReader::GetCompactArrayBuffer( Model* model )
 {
-
 	// Create an OBJ vert ID -> element array vert ID map.  Init all entries to 0xFFFFFFFF.
 	//    Also, create mapping vertID -> last normal ID used for this vertex
-	//          create mapping vertID -> last tex coord used for this vertex
-	unsigned int *vertMapping = (unsigned int *)malloc( m_numVertices * sizeof( unsigned int ) );
-	unsigned int *normMapping = (unsigned int *)malloc( m_numVertices * sizeof( unsigned int ) );
-	memset( vertMapping, 0xFF, m_numVertices * sizeof( unsigned int ) );
-	memset( normMapping, 0xFF, m_numVertices * sizeof( unsigned int ) );
+	std::vector<uint> vertMapping ( m_numVertices, 0xFFFFFFFF );
+	std::vector<int>  normMapping ( m_numVertices, -1 );
 
-	//   We'll have 1 float for a material ID
 	//   We'll have 3 floats (x,y,z) for each of the 3 verts of each triangle 
 	//   We'll have 3 floats (x,y,z) for each of the 3 normals of each triangle
-	//   We'll have 2 floats (u,v) for each of the 3 texture coordinates of each triangle
 	unsigned int  numComponents = 3 + (m_hasNormals||m_guessNorms ? 3 : 0);
 
-	int bufSz  = numComponents * sizeof( float ) * (3 * m_numTris);
 	m_vertStride = numComponents * sizeof( float );
 	m_vertOff    = 0 * sizeof( float );
 	m_normOff    = (m_hasNormals||m_guessNorms? 3 : 0) * sizeof( float );
 	gprintf ("    (*) Stride: %d, Offsets: v %d, m %d, o %d, n %d t %d\n", m_vertStride, m_vertOff, 0, 0, m_normOff, 0);
 
-	// Add a vertex buffer to the model
+	// Add a vertex buffer to the model (worst case size, trimmed below)
 	if ( model->vertBuffer != 0x0 )		free ( model->vertBuffer );
-	model->vertBuffer = (float*)		malloc ( bufSz );
-	if (!model->vertBuffer) this->ErrorMessage("Memory allocation error during .obj read!");
-	float* tmpBuf = (float*) model->vertBuffer;							// cast to float* to populate it	
+	model->vertBuffer = (float*) malloc ( numComponents * sizeof( float ) * (3 * uint64(m_numTris) + 1) );
+	float* tmpBuf = model->vertBuffer;
 	
 	// Add an element buffer to the model
-	unsigned int elembufSz = 3 * sizeof( unsigned int ) * m_numTris;
 	if ( model->elemBuffer != 0x0 )		free ( model->elemBuffer );
-	model->elemBuffer = (unsigned int*)	malloc( elembufSz );
-	unsigned int *tmpElemBuf = (unsigned int *) model->elemBuffer;		// cast to unsigned int* to populate it
-
-	// We'll need to know the size of our two arrays
-	int numArrayElements = 3 * m_numTris;         // Known in advance
-	int numArrayVerts    = 0;                     // Depends on how many verts are reused.  We'll compute
-
-	// A location to store normal guesses
-	Vector4DF tmpNorm;
-	Vector4DF *normGuess = (m_guessNorms ? &tmpNorm : 0);
-
+	model->elemBuffer = (unsigned int*)	malloc( 3 * sizeof( unsigned int ) * (uint64(m_numTris) + 1) );
+	unsigned int *tmpElemBuf = model->elemBuffer;
+	if ( model->vertBuffer == 0x0 || model->elemBuffer == 0x0 ) {
+		gprintf ( "Error: Memory allocation error during .obj read!\n" );
+		gerror ();
+		return;
+	}
 
-	for (unsigned int i=0, triNum=0; triNum < m_numTris; i+=3,triNum++ )
-	{
-		int i0 = m_triangles[triNum]->vIdx[0];
-		int i1 = m_triangles[triNum]->vIdx[1];
-		int i2 = m_triangles[triNum]->vIdx[2];
-
-		int *nIdx = m_triangles[triNum]->nIdx;
-		//int *tIdx = m_triangles[triNum]->tIdx;
-
-		if ( i0 < 0 || i0 > int(m_numVertices) ) continue;
-		if ( i1 < 0 || i1 > int(m_numVertices) ) continue;
-		if ( i2 < 0 || i2 > int(m_numVertices) ) continue;
-
-		tmpNorm = ((m_vertices[i1]-m_vertices[i0]).Cross(m_vertices[i2]-m_vertices[i0])).Normalize();
-
-		if (    (vertMapping[i0] == 0xFFFFFFFF) // We haven't seen this vertex yet.  Add to list
-		     || (m_hasNormals && normMapping[i0] != m_triangles[triNum]->nIdx[0]) )    // We saw this vertex...  but w/different normal
-		{
-			AddDataToArray( tmpBuf, numArrayVerts*numComponents, &m_vertices[m_triangles[triNum]->vIdx[0]], (m_hasNormals && (nIdx[0]>=0)) ? &m_normals[nIdx[0]] : normGuess );
-			tmpElemBuf[i]   = numArrayVerts;
-			vertMapping[i0] = numArrayVerts++;
-			normMapping[i0] = nIdx[0];
-		}
-		else                               // We've already seen vertex; reuse it.
-			tmpElemBuf[i] = vertMapping[i0];
-
-		if (    (vertMapping[i1] == 0xFFFFFFFF) // We haven't seen this vertex yet.  Add to list
-		     || (m_hasNormals && normMapping[i1] != m_triangles[triNum]->nIdx[1]) )    // We saw this vertex...  but w/different normal
-		{
-			AddDataToArray( tmpBuf, numArrayVerts*numComponents, &m_vertices[m_triangles[triNum]->vIdx[1]], (m_hasNormals && (nIdx[1]>=0)) ? &m_normals[nIdx[1]] : normGuess );
-			tmpElemBuf[i+1]   = numArrayVerts;
-			vertMapping[i1] = numArrayVerts++;
-			normMapping[i1] = nIdx[1];
-		}
-		else                               // We've already seen vertex; reuse it.
-			tmpElemBuf[i+1] = vertMapping[i1];
-
-		if (    (vertMapping[i2] == 0xFFFFFFFF) // We haven't seen this vertex yet.  Add to list
-		     || (m_hasNormals && normMapping[i2] != m_triangles[triNum]->nIdx[2]) )    // We saw this vertex...  but w/different normal
-		{
-			AddDataToArray( tmpBuf, numArrayVerts*numComponents, &m_vertices[m_triangles[triNum]->vIdx[2]], (m_hasNormals && (nIdx[2]>=0)) ? &m_normals[nIdx[2]] : normGuess );
-			tmpElemBuf[i+2]   = numArrayVerts;
-			vertMapping[i2] = numArrayVerts++;
-			normMapping[i2] = nIdx[2];
+	int numArrayVerts = 0;						// Depends on how many verts are reused.  We'll compute
+	uint numArrayTris = 0;
+	int numVert = int(m_numVertices), numNorm = int(m_numNormals);
+	Vector3DF v0, v1, v2, guess;
+	int vi, ni;
+
+	for (uint t=0; t < m_numTris; t++ ) {
+		int* tv = &m_triV[ t*3 ];
+		int* tn = &m_triN[ t*3 ];
+		if ( tv[0] < 0 || tv[0] >= numVert || tv[1] < 0 || tv[1] >= numVert || tv[2] < 0 || tv[2] >= numVert ) continue;
+
+		v0.Set ( m_vx[tv[0]], m_vy[tv[0]], m_vz[tv[0]] );
+		v1.Set ( m_vx[tv[1]], m_vy[tv[1]], m_vz[tv[1]] );
+		v2.Set ( m_vx[tv[2]], m_vy[tv[2]], m_vz[tv[2]] );
+		v1 -= v0;	v2 -= v0;
+		guess = v1.Cross ( v2 );
+		guess.Normalize ();
+
+		for (int k=0; k < 3; k++ ) {
+			vi = tv[k];
+			ni = ( m_hasNormals && tn[k] < numNorm ) ? tn[k] : -1;
+			if ( vertMapping[vi] == 0xFFFFFFFF			// We haven't seen this vertex yet.  Add to list
+				|| (m_hasNormals && normMapping[vi] != ni) ) {		// We saw this vertex...  but w/different normal
+				float* dat = tmpBuf + numArrayVerts * numComponents;
+				dat[0] = m_vx[vi];	dat[1] = m_vy[vi];	dat[2] = m_vz[vi];
+				if ( ni >= 0 )	{ dat[3] = m_nx[ni];	dat[4] = m_ny[ni];	dat[5] = m_nz[ni]; }
+				else			{ dat[3] = guess.x;		dat[4] = guess.y;	dat[5] = guess.z; }
+				vertMapping[vi] = numArrayVerts++;
+				normMapping[vi] = ni;
+			}
+			tmpElemBuf[ numArrayTris*3 + k ] = vertMapping[vi];
 		}
-		else                               // We've already seen vertex; reuse it.
-			tmpElemBuf[i+2] = vertMapping[i2];
+		numArrayTris++;
 	}
+	if ( numArrayTris < m_numTris ) gprintf ( "Warning: Skipped %d triangles with invalid vertex indices.\n", m_numTris - numArrayTris );
+	m_numTris = numArrayTris;
 
-	// If the user asked us to resize & center the object, do that.
-	
-	// NOTE: Should be moved out of OBJReader, as it is really
-	// a post-process applied to mesh and load. Also, messes up animations.
-	/* if (m_resize || m_center)
-		CenterAndResize( tmpBuf, numArrayVerts ); */
+	// Trim buffers to final size
+	float* vbuf = (float*) realloc ( model->vertBuffer, numComponents * sizeof( float ) * (uint64(numArrayVerts) + 1) );
+	if ( vbuf != 0x0 ) model->vertBuffer = vbuf;
+	unsigned int* ebuf = (unsigned int*) realloc ( model->elemBuffer, 3 * sizeof( unsigned int ) * (uint64(m_numTris) + 1) );
+	if ( ebuf != 0x0 ) model->elemBuffer = ebuf;
 
 	// Copy our arrays into model GPU buffers
 	model->elemDataType      = GL_TRIANGLES;           // What type of GL-renderable primitive does this model contain (e.g., GL_TRIANGLES)
@@ -532,84 +521,6 @@ void OBJReader::GetCompactArrayBuffer( Model* model )
 	model->normComponents	 = 3;                      // How many components are in each vertex normal attribute?
 	model->normOffset        = m_normOff;              // What's the byte offset to the start of the first vertex normal in the vertex buffer?
 
-	// Free our temporary copy of the data
-	free( vertMapping );
-	free( normMapping );
-
 	// If we asked to guess normals, we've done it.  Treat everything hereon as if we had norms:
 	if (m_guessNorms) m_hasNormals = true;
 }
-
-
-
-void OBJReader::AddVertex( const Vector4DF &vert )
-{
-	if ( m_numVertices >= m_allocVert )
-	{
-		unsigned int oldAlloc = m_allocVert;
-		if (oldAlloc <= 0)
-		{
-			m_allocVert = 1000000;
-			m_vertices = new Vector4DF[ m_allocVert ];
-		}
-		else
-		{
-			m_allocVert = oldAlloc + 1000000;
-			Vector4DF *ptr = m_vertices;
-			m_vertices = new Vector4DF[ m_allocVert ];
-			for (unsigned int i=0; i<oldAlloc; i++)
-				m_vertices[i] = ptr[i];
-			delete[] ptr;
-		}
-	}
-	m_vertices[ m_numVertices ] = vert;
-	m_numVertices++;
-}
-
-void OBJReader::AddNormal( const Vector4DF &norm )
-{
-	if ( m_numNormals >= m_allocNorm )
-	{
-		unsigned int oldAlloc = m_allocNorm;
-		if (oldAlloc <= 0)
-		{
-			m_allocNorm = 1000000;
-			m_normals = new Vector4DF[ m_allocNorm ];
-		}
-		else
-		{
-			m_allocNorm = oldAlloc + 1000000;
-			Vector4DF *ptr = m_normals;
-			m_normals = new Vector4DF[ m_allocNorm ];
-			for (unsigned int i=0; i<oldAlloc; i++)
-				m_normals[i] = ptr[i];
-			delete[] ptr;
-		}
-	}
-	m_normals[ m_numNormals ] = norm;
-	m_numNormals++;
-}
-
-void OBJReader::AddTriangle( OBJTri *tri )
-{
-	if ( m_numTris >= m_allocTri )
-	{
-		unsigned int oldAlloc = m_allocTri;
-		if (oldAlloc <= 0)
-		{
-			m_allocTri = 1000000;
-			m_triangles = (OBJTri **)malloc( m_allocTri * sizeof (OBJTri *) );
-		}
-		else
-		{
-			m_allocTri = oldAlloc + 1000000;
-			OBJTri **ptr = m_triangles;
-			m_triangles = (OBJTri **)malloc( m_allocTri * sizeof (OBJTri *) );
-			for (unsigned int i=0; i<oldAlloc; i++)
-				m_triangles[i] = ptr[i];
-			free( ptr );
-		}
-	}
-	m_triangles[ m_numTris ] = tri;
-	m_numTris++;
-}
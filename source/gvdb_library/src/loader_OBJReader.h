@@ -27,17 +27,17 @@
 
 #include "gvdb_model.h"
 #include "loader_Parser.h"
+#include <vector>
 
 using namespace nvdb;
 
 #pragma warning( disable: 4996 )
 
-struct OBJTri;
+struct OBJChunk;
 
-class OBJReader : public Parser
+class OBJReader
 {
 public:
-	// Constructor reads from the file.
 	OBJReader();
 	virtual ~OBJReader();
 	
@@ -45,65 +45,42 @@ public:
 	bool Cleanup ();	
 	static bool isMyFile ( const char* filename );
 
-	friend Model;
-
-private:
-	// Indicies in OBJ files may be relative (i.e., negative).  OBJ files also
-	//    use a Pascal array indexing scheme (i.e., start from 1).  These methods
-	//    fixes these issues to give an array index we can actually use.
-	unsigned int GetVertexIndex( int relativeIdx );
-	unsigned int GetNormalIndex( int relativeIdx );
-	// unsigned int GetTextureIndex( int relativeIdx );
-
-	// These methods make sure the vertex array and element array buffers are set up correctly
-	void GetCompactArrayBuffer( Model* model );
-
-	// Read appropriate facet tokens
-	void Read_V_Token( OBJTri *tri, int idx, char *token=0 );
-	void Read_VT_Token( OBJTri *tri, int idx, char *token=0 );
-	void Read_VN_Token( OBJTri *tri, int idx, char *token=0 );
-	void Read_VTN_Token( OBJTri *tri, int idx, char *token=0 );
-
-	// Helper function for adding data to a float array for our GPU-packed array
-	void AddDataToArray( float *arr, int startIdx, Vector4DF *vert, Vector4DF *norm );
+	// Load a new model. Returns 0x0 if the file could not be read.
+	static Model* LoadModel ( char *filename, char** searchPaths = 0x0, int numPaths = 0, int threads = 0 );
 
-	// Helper for centering & resizing the geometry in the array before sending it to OpenGL
-	void CenterAndResize( float *arr, int numVerts );
+	void SetThreads ( int n )		{ m_threads = n; }
 
-	// This declares an ugly type FnParserPtr that points to one of the Read_???_Token methods
-	typedef void (OBJReader::*FnParserPtr)(OBJTri *, int, char *); 
-
-	// Copy from prior triangle facets when triangulating
-	void CopyForTriangleFan( OBJTri *newTri );
+	friend Model;
 
-	// A method that is called after finding an 'f' line that identifies
-	//    the appropriate Read_???_Token() method to call when parsing
-	void SelectReadMethod( FnParserPtr *pPtr );
+private:
+	// File is mapped (or read) whole, then split into chunks at line boundaries.
+	bool MapFile ( const char* filename );
+	void UnmapFile ();
 
-	//Checks that an f line has enough vertices to be parsed as a triangle.
-	//For example, it returns false if the f line has only two entries on it
-	bool IsValidFLine( FnParserPtr *pPtr);
+	// Parse chunks in parallel, then merge into one set of arrays
+	void ParseChunks ();
+	void MergeChunks ( std::vector<OBJChunk>& chunks );
 
-	// Simple drop in for expandable arrays.  Sort of dumb.
-	void AddVertex( const Vector4DF &vert );
-	void AddNormal( const Vector4DF &norm );
-	void AddTriangle( OBJTri *tri );
+	// Build the interleaved vertex and element buffers of the model
+	void GetCompactArrayBuffer( Model* model );
 	
 protected:
-	// Basic geometric definitions read from the file
+	// Mapped file
+	char*		m_data;
+	uint64		m_size;
+	bool		m_mapped;
+	void*		m_mapHandle;
+
+	// Geometry read from the file (structure of arrays)
+	// Corners hold zero-based vertex and normal indices, normal is -1 when none given.
+	std::vector<float>	m_vx, m_vy, m_vz;
+	std::vector<float>	m_nx, m_ny, m_nz;
+	std::vector<int>	m_triV, m_triN;
 	unsigned int m_numVertices, m_numNormals, m_numTris;
-	unsigned int m_allocVert, m_allocNorm, m_allocTri;
-	OBJTri **m_triangles;
-	Vector4DF *m_normals;
-	Vector4DF *m_vertices;
-
-	// Does the user want us to resize and center the object around the origin?
-	//    Some/many models use completely arbitrary coordinates, so it's difficult
-	//    to know how big and where they'll be relative to each other
-	bool m_resize, m_center;
+	int			m_threads;
 
 	// Information about the OBJ file we read
-	bool m_hasVertices, m_hasNormals, m_hasTexCoords, m_guessNorms;
+	bool m_hasNormals, m_guessNorms;
 
 	// What is the stride of the data?
 	int m_vertStride, m_vertOff, m_normOff;
@@ -114,4 +91,3 @@ protected:
 
 
 #endif
-